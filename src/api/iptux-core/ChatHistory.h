@@ -0,0 +1,94 @@
+#ifndef IPTUX_CHAT_HISTORY_H
+#define IPTUX_CHAT_HISTORY_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "iptux-core/Models.h"
+
+namespace iptux {
+
+/**
+ * 一条聊天记录.
+ */
+struct ChatRecord {
+  std::string peer;        ///< 好友(PalKey::ToString()), 广播时为空
+  int64_t timestamp = 0;   ///< 秒
+  uint32_t packetNo = 0;   ///< 包编号, 未知时为0
+  bool outgoing = false;   ///< 自己发出的消息
+  MessageContentType type = MessageContentType::STRING;
+  std::string text;        ///< 文本, 或图片路径
+};
+
+/**
+ * @brief append-only chat history store.
+ *
+ * Records are appended to segment files under dir, which are mmap'ed for
+ * reading. Opening the store scans the segments once, on a background
+ * thread started by the constructor, to build a per-peer index for paging
+ * and a token index for search: lowercase ASCII words, and every non-ASCII
+ * character on its own, so CJK text is searchable without word
+ * segmentation. Records appended before the scan finishes are held and
+ * written after it; the other calls wait for it, check IsOpen() first on
+ * the UI thread.
+ *
+ * ErasePeer() appends a tombstone; the dead records are dropped from the
+ * sealed segments by a background compaction. All methods are thread safe.
+ */
+class ChatHistory {
+ public:
+  explicit ChatHistory(const std::string& dir,
+                       size_t segmentSize = 16 * 1024 * 1024);
+  ~ChatHistory();
+
+  ChatHistory(const ChatHistory&) = delete;
+  ChatHistory& operator=(const ChatHistory&) = delete;
+
+  /**
+   * @return false if the record could not be written
+   */
+  bool Append(const ChatRecord& record);
+  /**
+   * @brief whether the segments have been scanned, so reading does not
+   * block
+   */
+  bool IsOpen() const;
+
+  size_t Count(const std::string& peer) const;
+  /**
+   * @brief records with peer, oldest first.
+   *
+   * skip the newest skip records, then return at most limit older ones, so
+   * Page(peer, 0, 100) is the last 100 messages.
+   */
+  std::vector<ChatRecord> Page(const std::string& peer,
+                               size_t skip,
+                               size_t limit) const;
+  /**
+   * @brief text records containing every word of query, newest first.
+   * @param peer only search this peer if not empty
+   */
+  std::vector<ChatRecord> Search(const std::string& query,
+                                 size_t limit,
+                                 const std::string& peer = "") const;
+
+  /**
+   * @return the number of records erased
+   */
+  size_t ErasePeer(const std::string& peer);
+  /**
+   * @brief drop erased records from the sealed segments now, instead of
+   * waiting for the background compaction
+   */
+  void Compact();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> pImpl;
+};
+
+}  // namespace iptux
+
+#endif
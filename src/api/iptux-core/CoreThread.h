@@ -6,6 +6,8 @@
 #include "iptux-core/Models.h"
 #include <atomic>
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <memory>
 #include <netinet/in.h>
 #include <vector>
@@ -13,12 +15,16 @@
 #include <sigc++/signal.h>
 
 #include "iptux-core/Event.h"
+#include "iptux-core/Metrics.h"
 #include "iptux-core/ProgramData.h"
 #include "iptux-core/TransFileModel.h"
 
 namespace iptux {
 
+class CharsetConverter;
+class PacketBuilder;
 class TransAbstract;
+class TransScheduler;
 
 enum CoreThreadErr {
   CORE_THREAD_ERR_NONE = 0,
@@ -32,6 +38,30 @@ enum CoreThreadErr {
 
 const char* coreThreadErrToStr(enum CoreThreadErr err);
 
+/* events delivered to the UI per main loop iteration */
+const size_t DEFAULT_EVENT_BATCH = 64;
+
+/**
+ * @brief time spent by events between emitEvent and being popped
+ */
+struct EventQueueLatency {
+  uint64_t count{0};
+  int64_t totalUs{0};
+  int64_t maxUs{0};
+};
+
+/**
+ * @brief counters of the UDP receive loop
+ */
+struct UdpRecvStats {
+  uint64_t received{0};       // datagrams received
+  uint64_t batches{0};        // non-empty receive batches
+  uint64_t truncated{0};      // datagrams larger than the buffer
+  uint64_t failed{0};         // datagrams failed to process
+  uint64_t kernelDropped{0};  // dropped by the kernel (socket queue full)
+  uint32_t maxBatch{0};       // largest batch seen, a queue depth hint
+};
+
 class CoreThread {
  public:
   explicit CoreThread(std::shared_ptr<ProgramData> data);
@@ -42,8 +72,21 @@ class CoreThread {
 
   // For testing only: ignore TCP bind failures
   void setIgnoreTcpBindFailed(bool ignore);
-  // For testing only: get the count of active TCP handler threads
+  // get the count of TCP connections being handled by the worker pool
   size_t getTcpHandlerThreadCount() const;
+  // get the count of accepted TCP connections waiting for a free worker
+  size_t getTcpQueuedConnectionCount() const;
+  // get the count of TCP connections rejected (queue full / per-peer cap)
+  uint64_t getTcpRejectedConnectionCount() const;
+  UdpRecvStats getUdpRecvStats() const;
+  // get the count of sent messages still waiting for the pal's ack
+  size_t getPendingAckCount() const;
+  // counters, gauges and latency histograms updated by the core
+  MetricsRegistry& getMetrics();
+  /**
+   * @brief all runtime metrics, including the stats above, as a JSON text
+   */
+  std::string DumpMetrics() const;
 
   CPPalInfo getMe() const;
   PPalInfo getMe();
@@ -57,11 +100,28 @@ class CoreThread {
   bool BlacklistContainItem(in_addr ipv4) const;
 
   /**
-   * @brief add ipaddress to block list
+   * @brief add ipaddress to block list until the program exits, it is not
+   * saved to the config
    *
    * @param ipv4 the ip address
    */
   void AddBlockIp(in_addr ipv4);
+  /**
+   * @brief add an ip ("1.2.3.4") or a CIDR range ("10.0.0.0/8") to the
+   * block list, which is saved to the config
+   *
+   * @return false if entry is invalid or already in the list
+   */
+  bool AddBlockEntry(const std::string& entry);
+  /**
+   * @brief remove the entry, from the saved list and from the AddBlockIp()
+   * ones
+   */
+  bool DelBlockEntry(const std::string& entry);
+  /**
+   * @brief the saved entries, without the AddBlockIp() ones
+   */
+  std::vector<std::string> GetBlockEntries() const;
 
   /**
    * @brief whether the ipv4 address is blocked?
@@ -75,7 +135,7 @@ class CoreThread {
   void Lock() const;
   void Unlock() const;
 
-  const std::vector<std::shared_ptr<PalInfo>>& GetPalList();
+  std::vector<std::shared_ptr<PalInfo>> GetPalList();
   virtual void ClearAllPalFromList();
 
   CPPalInfo GetPal(PalKey palKey) const;
@@ -111,6 +171,21 @@ class CoreThread {
   PFileInfo GetPrivateFileById(uint32_t id);
   PFileInfo GetPrivateFileByPacketN(uint32_t packageNum, uint32_t filectime);
 
+  /**
+   * @brief keep the encoded file infos that did not fit into the UDP packet
+   * packetno sent to pal, until pal fetches them over TCP.
+   *
+   * Manifests expire after a while, the oldest are dropped when too many
+   * are pending.
+   */
+  void RegisterFileManifest(const PalKey& pal,
+                            uint32_t packetno,
+                            std::string manifest);
+  /**
+   * @brief the manifest of packetno if it was sent to ipv4, "" otherwise
+   */
+  std::string GetFileManifest(in_addr ipv4, uint32_t packetno);
+
   bool sendFeatureData(PPalInfo pal) noexcept;
   void emitSomeoneExit(const PalKey& palKey);
   void emitNewPalOnline(PPalInfo palInfo);
@@ -134,6 +209,28 @@ class CoreThread {
   std::shared_ptr<const Event> getLastEvent() const;
   bool HasEvent() const;
   std::shared_ptr<const Event> PopEvent();
+  /**
+   * @brief pop at most maxCount pending events
+   */
+  std::vector<std::shared_ptr<const Event>> PopEvents(size_t maxCount);
+
+  /**
+   * @brief deliver events on a main context instead of polling PopEvent
+   *
+   * ctx (nullptr for the default one) is woken up whenever an event is
+   * queued; handler then runs on ctx's thread, at most maxBatch events per
+   * main loop iteration until the queue is empty.
+   */
+  void connectEventDispatcher(
+      GMainContext* ctx,
+      std::function<void(std::shared_ptr<const Event>)> handler,
+      size_t maxBatch = DEFAULT_EVENT_BATCH);
+  void disconnectEventDispatcher();
+
+  /**
+   * @brief time events spent in the queue, by event type
+   */
+  std::map<EventType, EventQueueLatency> getEventQueueLatency() const;
 
   const std::string& GetAccessPublicLimit() const;
   void SetAccessPublicLimit(const std::string& val);
@@ -141,6 +238,10 @@ class CoreThread {
   /**
    * @brief send message to pal
    *
+   * The call does not wait for the pal's ack: the message is resent in the
+   * background until acked, then a MessageAckEvent (MESSAGE_DELIVERED or
+   * MESSAGE_FAILED) is emitted.
+   *
    * @param pal
    * @param message string message
    * @return true if send success
@@ -154,6 +255,12 @@ class CoreThread {
                        uint32_t opttype,
                        const std::string& message);
   void SendGroupMessage(const PalKey& palKey, const std::string& message);
+  /* 群发, 编码相同的好友共用一个数据包 */
+  void SendUnitMessage(const std::vector<PalKey>& palKeys,
+                       uint32_t opttype,
+                       const std::string& message);
+  void SendGroupMessage(const std::vector<PalKey>& palKeys,
+                        const std::string& message);
 
   bool SendAskShared(PPalInfo pal);
   bool SendAskSharedWithPassword(const PalKey& palKey,
@@ -161,6 +268,16 @@ class CoreThread {
 
   void SendDetectPacket(const std::string& ipv4);
   void SendDetectPacket(in_addr ipv4);
+  /**
+   * @brief send a detect packet to every address of the net segments
+   *
+   * The scan runs in the background at no more than discovery_pps packets
+   * per second, emitting DiscoveryProgressEvent and finally
+   * DiscoveryFinishedEvent. A scan already running is cancelled first.
+   */
+  void StartDiscoveryScan();
+  void CancelDiscoveryScan();
+  bool IsDiscoveryScanning() const;
   void SendExit(PPalInfo pal);
   void SendMyIcon(PPalInfo pal, std::istream& iss);
   void SendSharedFiles(PPalInfo pal);
@@ -190,7 +307,32 @@ class CoreThread {
   void clearFinishedTransTasks();
 
   void RecvFile(FileInfo* file);
+  /**
+   * @brief queue the file for download, it starts when the transfer
+   * limits allow
+   */
   void RecvFileAsync(FileInfo* file);
+  /**
+   * @brief pause a queued or running transfer, it keeps its slot
+   *
+   * @return false if the task is unknown or already finished
+   */
+  bool PauseTransTask(int taskId);
+  /**
+   * @brief continue a paused task, or resume a failed receive task from
+   * where it stopped
+   *
+   * @param taskId the task id
+   * @return true if the task was paused or is resumable and has been
+   * restarted
+   */
+  bool ResumeTransTask(int taskId);
+  /**
+   * @brief queued tasks with a higher priority start first, default 0
+   *
+   * @return false if the task is not queued
+   */
+  bool SetTransTaskPriority(int taskId, int priority);
   enum CoreThreadErr getLastErr() const;
 
  public:
@@ -199,6 +341,20 @@ class CoreThread {
   // these functions should be move to CoreThreadImpl
  public:
   void RegisterTransTask(std::shared_ptr<TransAbstract> task);
+  // drop a task that never started, it is not shown as failed
+  void UnregisterTransTask(int taskId);
+  // limits how many transfers run at once and their bandwidth
+  TransScheduler& getTransScheduler();
+  // send a packet carrying IPMSG_SENDCHECKOPT, resent until the pal acks it
+  void SendCheckedPacket(const PalKey& palKey,
+                         uint32_t packetno,
+                         const std::string& packet);
+  // the pal acked packetno, return false if it was not waiting for an ack
+  bool AckPacket(const PalKey& palKey, uint32_t packetno);
+  // builds outgoing packets, caching my encoded info
+  PacketBuilder& getPacketBuilder();
+  // converts incoming packets to utf-8
+  CharsetConverter& getCharsetConverter();
 
  public:
   static void SendNotifyToAll(CoreThread* pcthrd);
@@ -216,6 +372,9 @@ class CoreThread {
 
  private:
   bool bind_iptux_port() noexcept;
+  void SaveBlacklist();
+  void onPacketAcked(const PalKey& palKey, uint32_t packetno, bool delivered);
+  static gboolean DispatchEvents(gpointer data);
 
  public:
   struct Impl;
@@ -20,6 +20,10 @@ enum class EventType {
   RECV_FILE_FINISHED,
   TRANS_TASKS_CHANGED,
   CONFIG_CHANGED,
+  MESSAGE_DELIVERED,
+  MESSAGE_FAILED,
+  DISCOVERY_PROGRESS,
+  DISCOVERY_FINISHED,
 };
 
 const char* EventTypeToStr(EventType type);
@@ -107,6 +111,23 @@ class NewShareFileFromFriendEvent : public PalEvent {
   FileInfo fileInfo;
 };
 
+/**
+ * @brief the pal acked (or never acked) a message sent to it
+ */
+class MessageAckEvent : public PalEvent {
+ public:
+  MessageAckEvent(PalKey palKey, uint32_t packetno, bool delivered)
+      : PalEvent(palKey,
+                 delivered ? EventType::MESSAGE_DELIVERED
+                           : EventType::MESSAGE_FAILED),
+        packetno(packetno) {}
+  uint32_t GetPacketNo() const { return packetno; }
+  bool IsDelivered() const { return getType() == EventType::MESSAGE_DELIVERED; }
+
+ private:
+  uint32_t packetno;
+};
+
 class AbstractTaskIdEvent : public Event {
  protected:
   AbstractTaskIdEvent(EventType et, int taskId) : Event(et), taskId(taskId) {}
@@ -152,6 +173,39 @@ class ConfigChangedEvent : public Event {
   ConfigChangedEvent() : Event(EventType::CONFIG_CHANGED) {}
 };
 
+/**
+ * @brief result of a scan of the net segments
+ */
+struct DiscoveryStats {
+  uint64_t total{0};   // addresses in the net segments
+  uint64_t sent{0};    // detect packets sent
+  uint64_t failed{0};  // detect packets failed to send
+  int64_t elapsedUs{0};
+  bool cancelled{false};
+};
+
+class DiscoveryProgressEvent : public Event {
+ public:
+  DiscoveryProgressEvent(uint64_t done, uint64_t total)
+      : Event(EventType::DISCOVERY_PROGRESS), done(done), total(total) {}
+  uint64_t GetDone() const { return done; }
+  uint64_t GetTotal() const { return total; }
+
+ private:
+  uint64_t done;
+  uint64_t total;
+};
+
+class DiscoveryFinishedEvent : public Event {
+ public:
+  explicit DiscoveryFinishedEvent(const DiscoveryStats& stats)
+      : Event(EventType::DISCOVERY_FINISHED), stats(stats) {}
+  const DiscoveryStats& GetStats() const { return stats; }
+
+ private:
+  DiscoveryStats stats;
+};
+
 }  // namespace iptux
 
 #endif  // IPTUX_EVENT_H
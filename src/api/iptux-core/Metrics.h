@@ -0,0 +1,100 @@
+#ifndef IPTUX_METRICS_H
+#define IPTUX_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <json/json.h>
+
+namespace iptux {
+
+/**
+ * @brief monotonically increasing count, lock free
+ */
+class Counter {
+ public:
+  void Inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t Get() const { return value.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value{0};
+};
+
+/**
+ * @brief current value of something that goes up and down, lock free
+ */
+class Gauge {
+ public:
+  void Set(int64_t v) { value.store(v, std::memory_order_relaxed); }
+  void Add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+  int64_t Get() const { return value.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value{0};
+};
+
+/**
+ * @brief distribution of values (usually microseconds) in power-of-two
+ * buckets, lock free
+ *
+ * Bucket 0 counts the value 0, bucket i counts [2^(i-1), 2^i).
+ */
+class Histogram {
+ public:
+  static const int kBuckets = 40;
+
+  struct Snapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    uint64_t buckets[kBuckets] = {};
+
+    /**
+     * @brief upper bound of the bucket holding the p-th (0..1) value
+     */
+    uint64_t Percentile(double p) const;
+  };
+
+  void Observe(uint64_t value);
+  Snapshot Get() const;
+
+ private:
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> sum{0};
+  std::atomic<uint64_t> max{0};
+  std::atomic<uint64_t> buckets[kBuckets] = {};
+};
+
+/**
+ * @brief named metrics.
+ *
+ * Get*() creates the metric on first use and takes a lock, so hot paths
+ * should look a metric up once and keep the reference, which stays valid
+ * as long as the registry.
+ */
+class MetricsRegistry {
+ public:
+  Counter& GetCounter(const std::string& name);
+  Gauge& GetGauge(const std::string& name);
+  Histogram& GetHistogram(const std::string& name);
+
+  /**
+   * @brief {"counters": {name: n}, "gauges": {name: n},
+   * "histograms": {name: {"count", "sum", "max", "p50", "p90", "p99"}}}
+   */
+  Json::Value ToJson() const;
+
+ private:
+  mutable std::mutex mutex;
+  std::map<std::string, std::unique_ptr<Counter>> counters;
+  std::map<std::string, std::unique_ptr<Gauge>> gauges;
+  std::map<std::string, std::unique_ptr<Histogram>> histograms;
+};
+
+}  // namespace iptux
+
+#endif
@@ -103,6 +103,15 @@ class PalInfo {
   PalInfo& setGroup(const std::string& group);
   const std::string& getGroup() const { return group; }
 
+  /**
+   * @brief iptux extensions announced by the pal, IPTUX_FEATURE_* bits
+   */
+  PalInfo& setFeatures(uint32_t features);
+  uint32_t getFeatures() const { return features; }
+  bool hasFeature(uint32_t feature) const {
+    return (features & feature) == feature;
+  }
+
   const std::string& icon_file() const { return icon_file_; }
   PalInfo& set_icon_file(const std::string& icon_file) {
     icon_file_ = icon_file;
@@ -146,6 +155,7 @@ class PalInfo {
   std::string version;  ///< 版本串 *
   std::string encode;   ///< 好友编码 *
   std::string group;    ///< 所在群组
+  uint32_t features;    ///< 好友支持的iptux扩展功能
   uint8_t compatible : 1;
   uint8_t online : 1;
   uint8_t changed : 1;
@@ -229,6 +239,7 @@ class MsgPara {
 
 /**
  * 网段数据.
+ * 起止地址在设置时即解析为数值, 查找时无需再解析.
  */
 class NetSegment {
  public:
@@ -244,12 +255,30 @@ class NetSegment {
   uint64_t Count() const;
   std::string NthIp(uint64_t i) const;
 
-  std::string startip;      ///< IP起始地址 *
-  std::string endip;        ///< IP终止地址 *
+  const std::string& getStartIp() const { return startip; }
+  const std::string& getEndIp() const { return endip; }
+  void setStartIp(const std::string& ip);
+  void setEndIp(const std::string& ip);
+  /**
+   * @brief both ends are ipv4 addresses, and start <= end
+   */
+  bool IsValid() const;
+  /* 主机字节序的起止地址, 仅在IsValid()时有意义 */
+  uint32_t getStart() const { return start; }
+  uint32_t getEnd() const { return end; }
+
   std::string description;  ///< 此IP段描述
 
   Json::Value ToJsonValue() const;
   static NetSegment fromJsonValue(Json::Value& value);
+
+ private:
+  std::string startip;  ///< IP起始地址 *
+  std::string endip;    ///< IP终止地址 *
+  uint32_t start{0};
+  uint32_t end{0};
+  bool startValid{false};
+  bool endValid{false};
 };
 
 }  // namespace iptux
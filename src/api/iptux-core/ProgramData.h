@@ -11,6 +11,8 @@
 
 namespace iptux {
 
+class ShareCatalog;
+
 class ProgramData {
  public:
   explicit ProgramData(std::shared_ptr<IptuxConfig> config);
@@ -35,6 +37,11 @@ class ProgramData {
   void ClearShareFileInfos();
   FileInfo* GetShareFileInfo(uint32_t fileId);
   FileInfo* GetShareFileInfo(uint32_t packetn, uint32_t filenum);
+  /**
+   * @brief indexed copy of the shared files with cached metadata, kept in
+   * sync by AddShareFileInfo() and ClearShareFileInfos()
+   */
+  ShareCatalog& GetShareCatalog() { return *shareCatalog; }
 
   std::string FindNetSegDescription(in_addr ipv4) const;
   void Lock();
@@ -97,10 +104,18 @@ class ProgramData {
  private:
   uint16_t port_ = 2425;
   std::vector<NetSegment> netseg;  // 需要通知登录的IP段
+  /* netseg中各地址所属的网段, 区间互不相交且按地址排序 */
+  struct NetSegmentRange {
+    uint32_t first;
+    uint32_t last;
+    size_t segment;  // 覆盖此区间的第一个网段在netseg中的下标
+  };
+  std::vector<NetSegmentRange> netsegIndex;
   std::shared_ptr<IptuxConfig> config;
   std::mutex mutex;  // 锁
   std::string passwd;
   std::vector<FileInfo> sharedFileInfos;
+  std::unique_ptr<ShareCatalog> shareCatalog;
   uint8_t open_chat : 1;
   uint8_t hide_startup : 1;
   uint8_t open_transmission : 1;
@@ -119,6 +134,7 @@ class ProgramData {
 
   void WriteNetSegment();
   void ReadNetSegment();
+  void IndexNetSegments();
 };
 }  // namespace iptux
 
@@ -21,6 +21,8 @@ class TransFileModel {
   TransFileModel& setRate(const std::string& value);
   TransFileModel& setFilePath(const std::string& value);
   TransFileModel& setTaskId(int taskId);
+  TransFileModel& setQueued(bool value);  ///< 排队等待中, 尚未开始
+  TransFileModel& setPaused(bool value);
   void finish();
 
   const std::string& getStatus() const;
@@ -38,6 +40,8 @@ class TransFileModel {
   const std::string& getRate() const;
   const std::string& getFilePath() const;
   bool isFinished() const;
+  bool isQueued() const;
+  bool isPaused() const;
   int getTaskId() const;
 
  private:
@@ -53,6 +57,8 @@ class TransFileModel {
   std::string rate;
   std::string filePath;
   bool finished;
+  bool queued;
+  bool paused;
   int taskId;
 };
 
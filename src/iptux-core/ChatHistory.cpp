@@ -0,0 +1,728 @@
+#include "config.h"
+#include "iptux-core/ChatHistory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <glib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "iptux-utils/output.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+
+const uint32_t kRecordMagic = 0x48435049;  // "IPCH"
+const uint8_t kFlagOutgoing = 1 << 0;
+const uint8_t kFlagPicture = 1 << 1;
+const uint8_t kFlagErase = 1 << 7;
+const size_t kMaxTokenLen = 32;
+/* 已封存分段中失效数据超过此比例时后台压缩 */
+const double kCompactRatio = 0.25;
+const size_t kCopyBufferSize = 1 << 20;
+
+struct RecordHeader {
+  uint32_t magic;
+  uint32_t length;  // peer + text
+  int64_t timestamp;
+  uint32_t packetNo;
+  uint8_t flags;
+  uint8_t reserved;
+  uint16_t peerLen;
+};
+static_assert(sizeof(RecordHeader) == 24, "on-disk layout");
+
+string segmentName(uint32_t id) {
+  return stringFormat("%08u.seg", id);
+}
+
+bool isWordChar(unsigned char c) {
+  return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+/**
+ * 分词: ASCII字母数字串转小写为一个词, 每个非ASCII字符单独成词.
+ */
+template <typename F>
+void tokenize(const string& text, F emit) {
+  size_t i = 0, n = text.size();
+  while (i < n) {
+    unsigned char c = text[i];
+    if (c < 0x80) {
+      if (!isWordChar(c)) {
+        ++i;
+        continue;
+      }
+      string token;
+      for (; i < n && isWordChar(text[i]); ++i) {
+        if (token.size() < kMaxTokenLen) {
+          token += char(text[i] | (text[i] >= 'A' ? 0x20 : 0));
+        }
+      }
+      emit(token);
+    } else {
+      size_t len = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+      len = min(len, n - i);
+      emit(text.substr(i, len));
+      i += len;
+    }
+  }
+}
+
+vector<string> uniqueTokens(const string& text) {
+  vector<string> tokens;
+  tokenize(text, [&](string token) { tokens.push_back(std::move(token)); });
+  sort(tokens.begin(), tokens.end());
+  tokens.erase(unique(tokens.begin(), tokens.end()), tokens.end());
+  return tokens;
+}
+
+/* 查询中连续的非ASCII串, 命中后需确认其在原文中连续出现 */
+vector<string> nonAsciiRuns(const string& text) {
+  vector<string> runs;
+  size_t i = 0;
+  while (i < text.size()) {
+    if ((unsigned char)text[i] < 0x80) {
+      ++i;
+      continue;
+    }
+    size_t j = i;
+    while (j < text.size() && (unsigned char)text[j] >= 0x80) {
+      ++j;
+    }
+    runs.push_back(text.substr(i, j - i));
+    i = j;
+  }
+  return runs;
+}
+
+bool writeAll(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t ret = write(fd, data, len);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+}  // namespace
+
+class ChatHistory::Impl {
+ public:
+  struct Segment {
+    int fd = -1;
+    uint64_t size = 0;
+    uint64_t deadBytes = 0;  // 已删除记录和删除标记
+    char* map = nullptr;
+    size_t mapSize = 0;
+  };
+
+  struct Slot {
+    uint32_t segment;
+    uint32_t offset;
+    uint32_t length;  // 含记录头
+    uint32_t peer;
+    bool dead;
+  };
+
+  Impl(const string& dir, size_t segmentSize)
+      : dir(dir), segmentSize(segmentSize) {}
+
+  void Open();
+  void Close();
+  unique_lock<std::mutex> LockOpened() const;
+
+  bool AppendLocked(const string& peer,
+                    const string& text,
+                    int64_t timestamp,
+                    uint32_t packetNo,
+                    uint8_t flags);
+  bool AppendRecordLocked(const ChatRecord& record);
+  ChatRecord ReadLocked(uint32_t slot) const;
+  size_t ErasePeerLocked(const string& peer);
+  void MaybeCompactLocked();
+  void CompactAll();
+
+  const string dir;
+  const size_t segmentSize;
+
+  mutable std::mutex mutex;
+  mutable std::condition_variable openDone;
+  std::condition_variable compactDone;
+  bool opened = false;
+  vector<ChatRecord> pending;  // 打开完成前追加的记录
+  std::thread opener;
+  map<uint32_t, Segment> segments;  // 最后一个为活动分段
+  vector<Slot> slots;
+  vector<string> peerNames;
+  unordered_map<string, uint32_t> peerIds;
+  vector<vector<uint32_t>> peerSlots;  // 每个好友未删除的记录, 按追加顺序
+  unordered_map<string, vector<uint32_t>> postings;
+  std::thread compactor;
+  bool compacting = false;
+  bool stopping = false;
+
+ private:
+  void scanAll();
+  bool openSegment(uint32_t id);
+  bool mapSegment(Segment& segment, size_t size);
+  void scanSegment(uint32_t id, Segment& segment);
+  void indexLocked(uint32_t segment,
+                   uint32_t offset,
+                   const RecordHeader& header,
+                   const char* body);
+  uint32_t peerIdLocked(const string& peer);
+  string segmentPath(uint32_t id) const {
+    return dir + "/" + segmentName(id);
+  }
+};
+
+/**
+ * 在后台线程中打开所有分段并建立索引. 完成前追加的记录先暂存,
+ * 其他方法则会等待.
+ */
+void ChatHistory::Impl::Open() {
+  /* opened置位前其他线程不访问分段和索引, 扫描时不必加锁 */
+  scanAll();
+  lock_guard<std::mutex> l(mutex);
+  for (const ChatRecord& record : pending) {
+    AppendRecordLocked(record);
+  }
+  pending.clear();
+  opened = true;
+  MaybeCompactLocked();
+  openDone.notify_all();
+}
+
+unique_lock<std::mutex> ChatHistory::Impl::LockOpened() const {
+  unique_lock<std::mutex> l(mutex);
+  openDone.wait(l, [this] { return opened; });
+  return l;
+}
+
+void ChatHistory::Impl::scanAll() {
+  if (g_mkdir_with_parents(dir.c_str(), 0755) != 0) {
+    LOG_WARN("create chat history dir %s failed: %s", dir.c_str(),
+             strerror(errno));
+    return;
+  }
+  vector<uint32_t> ids;
+  GDir* gdir = g_dir_open(dir.c_str(), 0, nullptr);
+  if (gdir) {
+    const gchar* name;
+    while ((name = g_dir_read_name(gdir))) {
+      unsigned id;
+      char suffix[8];
+      if (strlen(name) == 12 && sscanf(name, "%8u.%3s", &id, suffix) == 2 &&
+          strcmp(suffix, "seg") == 0) {
+        ids.push_back(id);
+      }
+    }
+    g_dir_close(gdir);
+  }
+  sort(ids.begin(), ids.end());
+  for (uint32_t id : ids) {
+    if (openSegment(id)) {
+      scanSegment(id, segments[id]);
+    }
+  }
+  if (segments.empty()) {
+    openSegment(1);
+  }
+}
+
+void ChatHistory::Impl::Close() {
+  if (opener.joinable()) {
+    opener.join();
+  }
+  {
+    lock_guard<std::mutex> l(mutex);
+    stopping = true;
+  }
+  if (compactor.joinable()) {
+    compactor.join();
+  }
+  for (auto& it : segments) {
+    if (it.second.map) {
+      munmap(it.second.map, it.second.mapSize);
+    }
+    close(it.second.fd);
+  }
+  segments.clear();
+}
+
+bool ChatHistory::Impl::openSegment(uint32_t id) {
+  string path = segmentPath(id);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    LOG_WARN("open %s failed: %s", path.c_str(), strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  Segment segment;
+  segment.fd = fd;
+  segment.size = st.st_size;
+  if (!mapSegment(segment, max<size_t>(segment.size, segmentSize))) {
+    close(fd);
+    return false;
+  }
+  segments[id] = segment;
+  return true;
+}
+
+/**
+ * 映射整个分段容量而不只是当前大小, 追加时不必重新映射.
+ */
+bool ChatHistory::Impl::mapSegment(Segment& segment, size_t size) {
+  void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, segment.fd, 0);
+  if (map == MAP_FAILED) {
+    LOG_WARN("mmap chat history failed: %s", strerror(errno));
+    return false;
+  }
+  if (segment.map) {
+    munmap(segment.map, segment.mapSize);
+  }
+  segment.map = (char*)map;
+  segment.mapSize = size;
+  return true;
+}
+
+void ChatHistory::Impl::scanSegment(uint32_t id, Segment& segment) {
+  uint64_t offset = 0;
+  while (offset < segment.size) {
+    RecordHeader header;
+    if (segment.size - offset < sizeof(header)) {
+      break;
+    }
+    memcpy(&header, segment.map + offset, sizeof(header));
+    if (header.magic != kRecordMagic || header.peerLen > header.length ||
+        segment.size - offset - sizeof(header) < header.length) {
+      break;
+    }
+    indexLocked(id, offset, header, segment.map + offset + sizeof(header));
+    offset += sizeof(header) + header.length;
+  }
+  if (offset < segment.size) {
+    /* 写入中途退出留下的残缺记录 */
+    LOG_WARN("truncate chat history segment %u at %" PRIu64, id, offset);
+    if (ftruncate(segment.fd, offset) != 0) {
+      LOG_WARN("ftruncate failed: %s", strerror(errno));
+    }
+    segment.size = offset;
+  }
+}
+
+uint32_t ChatHistory::Impl::peerIdLocked(const string& peer) {
+  auto it = peerIds.find(peer);
+  if (it != peerIds.end()) {
+    return it->second;
+  }
+  uint32_t id = peerNames.size();
+  peerNames.push_back(peer);
+  peerSlots.emplace_back();
+  peerIds[peer] = id;
+  return id;
+}
+
+void ChatHistory::Impl::indexLocked(uint32_t segment,
+                                    uint32_t offset,
+                                    const RecordHeader& header,
+                                    const char* body) {
+  string peer(body, header.peerLen);
+  uint32_t length = sizeof(header) + header.length;
+  if (header.flags & kFlagErase) {
+    ErasePeerLocked(peer);
+    segments[segment].deadBytes += length;
+    return;
+  }
+
+  uint32_t peerId = peerIdLocked(peer);
+  uint32_t slot = slots.size();
+  slots.push_back(Slot{segment, offset, length, peerId, false});
+  peerSlots[peerId].push_back(slot);
+  if (!(header.flags & kFlagPicture)) {
+    string text(body + header.peerLen, header.length - header.peerLen);
+    for (const string& token : uniqueTokens(text)) {
+      postings[token].push_back(slot);
+    }
+  }
+}
+
+bool ChatHistory::Impl::AppendLocked(const string& peer,
+                                     const string& text,
+                                     int64_t timestamp,
+                                     uint32_t packetNo,
+                                     uint8_t flags) {
+  if (segments.empty() || peer.size() > UINT16_MAX) {
+    return false;
+  }
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kRecordMagic;
+  header.length = peer.size() + text.size();
+  header.timestamp = timestamp;
+  header.packetNo = packetNo;
+  header.flags = flags;
+  header.peerLen = peer.size();
+  string buf((const char*)&header, sizeof(header));
+  buf += peer;
+  buf += text;
+
+  auto active = prev(segments.end());
+  if (active->second.size > 0 &&
+      active->second.size + buf.size() > segmentSize) {
+    uint32_t id = active->first + 1;
+    if (!openSegment(id)) {
+      return false;
+    }
+    active = segments.find(id);
+    MaybeCompactLocked();
+  }
+  Segment& segment = active->second;
+  if (segment.size + buf.size() > segment.mapSize &&
+      !mapSegment(segment, segment.size + buf.size())) {
+    return false;
+  }
+  if (!writeAll(segment.fd, buf.data(), buf.size())) {
+    LOG_WARN("write chat history failed: %s", strerror(errno));
+    if (ftruncate(segment.fd, segment.size) != 0) {
+      LOG_WARN("ftruncate failed: %s", strerror(errno));
+    }
+    return false;
+  }
+  uint32_t offset = segment.size;
+  segment.size += buf.size();
+  indexLocked(active->first, offset, header, buf.data() + sizeof(header));
+  return true;
+}
+
+bool ChatHistory::Impl::AppendRecordLocked(const ChatRecord& record) {
+  uint8_t flags = 0;
+  if (record.outgoing) {
+    flags |= kFlagOutgoing;
+  }
+  if (record.type == MessageContentType::PICTURE) {
+    flags |= kFlagPicture;
+  }
+  return AppendLocked(record.peer, record.text, record.timestamp,
+                      record.packetNo, flags);
+}
+
+ChatRecord ChatHistory::Impl::ReadLocked(uint32_t slot) const {
+  const Slot& s = slots[slot];
+  const char* data = segments.at(s.segment).map + s.offset;
+  RecordHeader header;
+  memcpy(&header, data, sizeof(header));
+  data += sizeof(header);
+
+  ChatRecord record;
+  record.peer.assign(data, header.peerLen);
+  record.text.assign(data + header.peerLen, header.length - header.peerLen);
+  record.timestamp = header.timestamp;
+  record.packetNo = header.packetNo;
+  record.outgoing = header.flags & kFlagOutgoing;
+  record.type = (header.flags & kFlagPicture) ? MessageContentType::PICTURE
+                                              : MessageContentType::STRING;
+  return record;
+}
+
+size_t ChatHistory::Impl::ErasePeerLocked(const string& peer) {
+  auto it = peerIds.find(peer);
+  if (it == peerIds.end()) {
+    return 0;
+  }
+  auto& list = peerSlots[it->second];
+  size_t count = list.size();
+  for (uint32_t slot : list) {
+    slots[slot].dead = true;
+    segments[slots[slot].segment].deadBytes += slots[slot].length;
+  }
+  list.clear();
+  list.shrink_to_fit();
+  return count;
+}
+
+void ChatHistory::Impl::MaybeCompactLocked() {
+  if (compacting || stopping || segments.size() < 2) {
+    return;
+  }
+  uint64_t total = 0, dead = 0;
+  for (auto it = segments.begin(); it != prev(segments.end()); ++it) {
+    total += it->second.size;
+    dead += it->second.deadBytes;
+  }
+  if (dead == 0 || dead < total * kCompactRatio) {
+    return;
+  }
+  if (compactor.joinable()) {
+    compactor.join();  // 上一次已结束, 只差线程退出
+  }
+  compacting = true;
+  compactor = thread([this] { CompactAll(); });
+}
+
+/**
+ * 按顺序重写所有含失效数据的封存分段, 只保留有效记录.
+ *
+ * 删除标记只会使它之前的记录失效, 而之前含失效记录的分段都在本轮中重写,
+ * 所以封存分段中的删除标记可以一并丢弃. 中途失败则停止本轮, 以免后面分段的
+ * 删除标记先于前面的失效记录被丢弃.
+ * 调用前compacting须已置位.
+ */
+void ChatHistory::Impl::CompactAll() {
+  struct Job {
+    uint32_t id;
+    const char* map;
+    vector<uint32_t> live;
+    vector<pair<uint32_t, uint32_t>> ranges;  // offset, length
+  };
+  vector<Job> jobs;
+  {
+    lock_guard<std::mutex> l(mutex);
+    map<uint32_t, size_t> index;
+    for (auto it = segments.begin(); it != prev(segments.end()); ++it) {
+      if (it->second.deadBytes > 0) {
+        index[it->first] = jobs.size();
+        jobs.push_back(Job{it->first, it->second.map, {}, {}});
+      }
+    }
+    for (uint32_t i = 0; i < slots.size(); ++i) {
+      auto it = index.find(slots[i].segment);
+      if (it != index.end() && !slots[i].dead) {
+        Job& job = jobs[it->second];
+        job.live.push_back(i);
+        job.ranges.emplace_back(slots[i].offset, slots[i].length);
+      }
+    }
+  }
+
+  for (Job& job : jobs) {
+    {
+      lock_guard<std::mutex> l(mutex);
+      if (stopping) {
+        break;
+      }
+    }
+    /* 封存分段只有压缩会修改, 不加锁读取 */
+    string tmpPath = segmentPath(job.id) + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    bool ok = fd >= 0;
+    string buf;
+    vector<uint32_t> offsets;
+    uint64_t size = 0;
+    for (size_t i = 0; ok && i < job.ranges.size(); ++i) {
+      offsets.push_back(size);
+      buf.append(job.map + job.ranges[i].first, job.ranges[i].second);
+      size += job.ranges[i].second;
+      if (buf.size() >= kCopyBufferSize) {
+        ok = writeAll(fd, buf.data(), buf.size());
+        buf.clear();
+      }
+    }
+    ok = ok && writeAll(fd, buf.data(), buf.size()) && fsync(fd) == 0;
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (!ok) {
+      LOG_WARN("compact chat history segment %u failed: %s", job.id,
+               strerror(errno));
+      unlink(tmpPath.c_str());
+      break;
+    }
+
+    lock_guard<std::mutex> l(mutex);
+    string path = segmentPath(job.id);
+    Segment& old = segments[job.id];
+    int newFd = -1;
+    if (rename(tmpPath.c_str(), path.c_str()) != 0 ||
+        (newFd = open(path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC)) < 0) {
+      LOG_WARN("replace %s failed: %s", path.c_str(), strerror(errno));
+      unlink(tmpPath.c_str());
+      break;
+    }
+    Segment segment;
+    segment.fd = newFd;
+    segment.size = size;
+    if (!mapSegment(segment, max<size_t>(size, 1))) {
+      /* 文件已替换, 旧映射仍指向原数据, 只能放弃后续压缩 */
+      close(newFd);
+      break;
+    }
+    munmap(old.map, old.mapSize);
+    close(old.fd);
+    for (size_t i = 0; i < job.live.size(); ++i) {
+      Slot& slot = slots[job.live[i]];
+      slot.offset = offsets[i];
+      if (slot.dead) {
+        segment.deadBytes += slot.length;  // 压缩期间删除的
+      }
+    }
+    old = segment;
+  }
+
+  lock_guard<std::mutex> l(mutex);
+  compacting = false;
+  compactDone.notify_all();
+}
+
+ChatHistory::ChatHistory(const string& dir, size_t segmentSize)
+    : pImpl(make_unique<Impl>(dir, segmentSize)) {
+  Impl* impl = pImpl.get();
+  impl->opener = thread([impl] { impl->Open(); });
+}
+
+ChatHistory::~ChatHistory() {
+  pImpl->Close();
+}
+
+bool ChatHistory::Append(const ChatRecord& record) {
+  lock_guard<std::mutex> l(pImpl->mutex);
+  if (!pImpl->opened) {
+    pImpl->pending.push_back(record);
+    return true;
+  }
+  return pImpl->AppendRecordLocked(record);
+}
+
+bool ChatHistory::IsOpen() const {
+  lock_guard<std::mutex> l(pImpl->mutex);
+  return pImpl->opened;
+}
+
+size_t ChatHistory::Count(const string& peer) const {
+  auto l = pImpl->LockOpened();
+  auto it = pImpl->peerIds.find(peer);
+  return it == pImpl->peerIds.end() ? 0 : pImpl->peerSlots[it->second].size();
+}
+
+vector<ChatRecord> ChatHistory::Page(const string& peer,
+                                     size_t skip,
+                                     size_t limit) const {
+  vector<ChatRecord> res;
+  auto l = pImpl->LockOpened();
+  auto it = pImpl->peerIds.find(peer);
+  if (it == pImpl->peerIds.end()) {
+    return res;
+  }
+  const auto& list = pImpl->peerSlots[it->second];
+  if (skip >= list.size()) {
+    return res;
+  }
+  size_t end = list.size() - skip;
+  size_t begin = end > limit ? end - limit : 0;
+  for (size_t i = begin; i < end; ++i) {
+    res.push_back(pImpl->ReadLocked(list[i]));
+  }
+  return res;
+}
+
+vector<ChatRecord> ChatHistory::Search(const string& query,
+                                       size_t limit,
+                                       const string& peer) const {
+  vector<ChatRecord> res;
+  auto tokens = uniqueTokens(query);
+  auto runs = nonAsciiRuns(query);
+  if (tokens.empty() || limit == 0) {
+    return res;
+  }
+
+  auto l = pImpl->LockOpened();
+  uint32_t peerId = UINT32_MAX;
+  if (!peer.empty()) {
+    auto it = pImpl->peerIds.find(peer);
+    if (it == pImpl->peerIds.end()) {
+      return res;
+    }
+    peerId = it->second;
+  }
+  vector<const vector<uint32_t>*> lists;
+  for (const string& token : tokens) {
+    auto it = pImpl->postings.find(token);
+    if (it == pImpl->postings.end()) {
+      return res;
+    }
+    lists.push_back(&it->second);
+  }
+  sort(lists.begin(), lists.end(),
+       [](const vector<uint32_t>* a, const vector<uint32_t>* b) {
+         return a->size() < b->size();
+       });
+
+  const auto& shortest = *lists[0];
+  for (auto it = shortest.rbegin(); it != shortest.rend(); ++it) {
+    const auto& slot = pImpl->slots[*it];
+    if (slot.dead || (peerId != UINT32_MAX && slot.peer != peerId)) {
+      continue;
+    }
+    bool all = true;
+    for (size_t i = 1; all && i < lists.size(); ++i) {
+      all = binary_search(lists[i]->begin(), lists[i]->end(), *it);
+    }
+    if (!all) {
+      continue;
+    }
+    ChatRecord record = pImpl->ReadLocked(*it);
+    for (const string& run : runs) {
+      all = all && record.text.find(run) != string::npos;
+    }
+    if (all) {
+      res.push_back(std::move(record));
+      if (res.size() == limit) {
+        break;
+      }
+    }
+  }
+  return res;
+}
+
+size_t ChatHistory::ErasePeer(const string& peer) {
+  auto l = pImpl->LockOpened();
+  auto it = pImpl->peerIds.find(peer);
+  if (it == pImpl->peerIds.end() || pImpl->peerSlots[it->second].empty()) {
+    return 0;
+  }
+  size_t count = pImpl->peerSlots[it->second].size();
+  if (!pImpl->AppendLocked(peer, "", g_get_real_time() / G_USEC_PER_SEC, 0,
+                           kFlagErase)) {
+    return 0;
+  }
+  pImpl->MaybeCompactLocked();
+  return count;
+}
+
+void ChatHistory::Compact() {
+  unique_lock<std::mutex> l = pImpl->LockOpened();
+  pImpl->compactDone.wait(l, [this] { return !pImpl->compacting; });
+  if (pImpl->segments.size() < 2) {
+    return;
+  }
+  pImpl->compacting = true;
+  l.unlock();
+  pImpl->CompactAll();
+}
+
+}  // namespace iptux
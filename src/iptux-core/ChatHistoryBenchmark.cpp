@@ -0,0 +1,99 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "iptux-core/ChatHistory.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+
+const int kMessages = 1000000;
+const int kPeers = 200;
+const int kPages = 10000;
+const int kSearches = 1000;
+
+const char* kWords[] = {"hello", "file",  "meeting", "lunch", "build",
+                        "test",  "share", "folder",  "sorry", "thanks",
+                        "你好",  "文件",  "下班",    "开会",  "谢谢"};
+
+double msSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+int main() {
+  gchar* tmp = g_dir_make_tmp("iptux-history-bench-XXXXXX", nullptr);
+  string dir(tmp);
+  g_free(tmp);
+
+  auto start = chrono::steady_clock::now();
+  {
+    ChatHistory history(dir);
+    ChatRecord record;
+    for (int i = 0; i < kMessages; ++i) {
+      record.peer = "10.0." + to_string(i % kPeers) + ".1:2425";
+      record.timestamp = 1700000000 + i;
+      record.packetNo = i;
+      record.outgoing = i % 3 == 0;
+      record.text = string(kWords[i % 15]) + " " + kWords[(i / 15) % 15] +
+                    " message number " + to_string(i);
+      history.Append(record);
+    }
+  }
+  double append = msSince(start);
+
+  /* 打开在后台进行, 计到第一次读取返回为止 */
+  start = chrono::steady_clock::now();
+  ChatHistory history(dir);
+  size_t count = history.Count("10.0.0.1:2425");
+  double open = msSince(start);
+
+  start = chrono::steady_clock::now();
+  size_t loaded = 0;
+  for (int i = 0; i < kPages; ++i) {
+    string peer = "10.0." + to_string(i % kPeers) + ".1:2425";
+    loaded += history.Page(peer, (i % 50) * 100, 100).size();
+  }
+  double page = msSince(start) * 1000 / kPages;
+
+  start = chrono::steady_clock::now();
+  size_t found = 0;
+  for (int i = 0; i < kSearches; ++i) {
+    found += history.Search(string("meeting ") + kWords[i % 15], 50).size();
+  }
+  double search = msSince(start) * 1000 / kSearches;
+
+  start = chrono::steady_clock::now();
+  size_t rare = history.Search("number 123456", 50).size();
+  double rareSearch = msSince(start) * 1000;
+
+  printf("append   %d messages  %10.1f ms (%.0f msg/s)\n", kMessages, append,
+         kMessages / append * 1000);
+  printf("reopen   %d messages  %10.1f ms (%zu for one peer)\n", kMessages,
+         open, count);
+  printf("page     100 messages  %10.1f us/page (%zu loaded)\n", page, loaded);
+  printf("search   2 words       %10.1f us/query (%zu found)\n", search, found);
+  printf("search   rare word     %10.1f us/query (%zu found)\n", rareSearch,
+         rare);
+
+  GDir* gdir = g_dir_open(dir.c_str(), 0, nullptr);
+  const gchar* name;
+  while (gdir && (name = g_dir_read_name(gdir))) {
+    g_remove((dir + "/" + name).c_str());
+  }
+  if (gdir) {
+    g_dir_close(gdir);
+  }
+  g_rmdir(dir.c_str());
+  return 0;
+}
@@ -0,0 +1,216 @@
+#include "gtest/gtest.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "iptux-core/ChatHistory.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+string makeDir() {
+  gchar* tmp = g_dir_make_tmp("iptux-history-XXXXXX", nullptr);
+  string dir(tmp);
+  g_free(tmp);
+  return dir;
+}
+
+void removeDir(const string& dir) {
+  GDir* gdir = g_dir_open(dir.c_str(), 0, nullptr);
+  const gchar* name;
+  while (gdir && (name = g_dir_read_name(gdir))) {
+    g_remove((dir + "/" + name).c_str());
+  }
+  if (gdir) {
+    g_dir_close(gdir);
+  }
+  g_rmdir(dir.c_str());
+}
+
+int64_t dirSize(const string& dir) {
+  int64_t size = 0;
+  GDir* gdir = g_dir_open(dir.c_str(), 0, nullptr);
+  const gchar* name;
+  while (gdir && (name = g_dir_read_name(gdir))) {
+    GStatBuf st;
+    if (g_stat((dir + "/" + name).c_str(), &st) == 0) {
+      size += st.st_size;
+    }
+  }
+  if (gdir) {
+    g_dir_close(gdir);
+  }
+  return size;
+}
+
+ChatRecord makeRecord(const string& peer, const string& text, int64_t ts) {
+  ChatRecord record;
+  record.peer = peer;
+  record.text = text;
+  record.timestamp = ts;
+  record.packetNo = ts + 1000;
+  return record;
+}
+
+vector<string> texts(const vector<ChatRecord>& records) {
+  vector<string> res;
+  for (auto& record : records) {
+    res.push_back(record.text);
+  }
+  return res;
+}
+}  // namespace
+
+TEST(ChatHistory, AppendAndPage) {
+  string dir = makeDir();
+  {
+    ChatHistory history(dir);
+    for (int i = 0; i < 10; ++i) {
+      ASSERT_TRUE(history.Append(makeRecord("a", "msg" + to_string(i), i)));
+    }
+    auto picture = makeRecord("b", "/tmp/1.png", 100);
+    picture.type = MessageContentType::PICTURE;
+    picture.outgoing = true;
+    ASSERT_TRUE(history.Append(picture));
+
+    EXPECT_EQ(history.Count("a"), 10u);
+    EXPECT_EQ(history.Count("b"), 1u);
+    EXPECT_EQ(history.Count("c"), 0u);
+    EXPECT_EQ(texts(history.Page("a", 0, 3)),
+              vector<string>({"msg7", "msg8", "msg9"}));
+    EXPECT_EQ(texts(history.Page("a", 8, 3)), vector<string>({"msg0", "msg1"}));
+    EXPECT_TRUE(history.Page("a", 10, 3).empty());
+
+    auto page = history.Page("b", 0, 10);
+    ASSERT_EQ(page.size(), 1u);
+    EXPECT_EQ(page[0].peer, "b");
+    EXPECT_EQ(page[0].timestamp, 100);
+    EXPECT_EQ(page[0].packetNo, 1100u);
+    EXPECT_TRUE(page[0].outgoing);
+    EXPECT_EQ(page[0].type, MessageContentType::PICTURE);
+  }
+
+  // 重新打开后索引重建
+  ChatHistory history(dir);
+  EXPECT_EQ(history.Count("a"), 10u);
+  EXPECT_EQ(texts(history.Page("a", 0, 1)), vector<string>({"msg9"}));
+  ASSERT_TRUE(history.Append(makeRecord("a", "msg10", 10)));
+  EXPECT_EQ(texts(history.Page("a", 0, 1)), vector<string>({"msg10"}));
+  removeDir(dir);
+}
+
+TEST(ChatHistory, Search) {
+  string dir = makeDir();
+  ChatHistory history(dir);
+  history.Append(makeRecord("a", "Hello World", 1));
+  history.Append(makeRecord("b", "hello there", 2));
+  history.Append(makeRecord("a", "say HELLO to the world!", 3));
+  history.Append(makeRecord("b", "你好世界", 4));
+  history.Append(makeRecord("a", "世界你好", 5));
+  auto picture = makeRecord("a", "hello.png", 6);
+  picture.type = MessageContentType::PICTURE;
+  history.Append(picture);
+
+  EXPECT_EQ(texts(history.Search("hello", 10)),
+            vector<string>({"say HELLO to the world!", "hello there",
+                            "Hello World"}));
+  EXPECT_EQ(texts(history.Search("world hello", 10)),
+            vector<string>({"say HELLO to the world!", "Hello World"}));
+  EXPECT_EQ(texts(history.Search("hello", 1)),
+            vector<string>({"say HELLO to the world!"}));
+  EXPECT_EQ(texts(history.Search("hello", 10, "b")),
+            vector<string>({"hello there"}));
+  EXPECT_TRUE(history.Search("hell", 10).empty());
+  EXPECT_TRUE(history.Search("", 10).empty());
+  EXPECT_TRUE(history.Search("hello", 10, "nobody").empty());
+
+  EXPECT_EQ(texts(history.Search("你好", 10)),
+            vector<string>({"世界你好", "你好世界"}));
+  EXPECT_EQ(texts(history.Search("好世", 10)), vector<string>({"你好世界"}));
+  removeDir(dir);
+}
+
+TEST(ChatHistory, EraseAndCompact) {
+  string dir = makeDir();
+  {
+    // 小分段, 让记录分布在多个分段中
+    ChatHistory history(dir, 256);
+    for (int i = 0; i < 20; ++i) {
+      history.Append(makeRecord(i % 2 ? "a" : "b", "word" + to_string(i), i));
+    }
+    EXPECT_EQ(history.ErasePeer("a"), 10u);
+    EXPECT_EQ(history.ErasePeer("a"), 0u);
+    EXPECT_EQ(history.Count("a"), 0u);
+    EXPECT_TRUE(history.Search("word1", 10).empty());
+    history.Append(makeRecord("a", "again", 20));
+
+    int64_t before = dirSize(dir);
+    history.Compact();
+    EXPECT_LT(dirSize(dir), before);
+    EXPECT_EQ(history.Count("a"), 1u);
+    EXPECT_EQ(history.Count("b"), 10u);
+    EXPECT_EQ(texts(history.Page("b", 0, 2)),
+              vector<string>({"word16", "word18"}));
+    EXPECT_EQ(texts(history.Search("word0", 10)), vector<string>({"word0"}));
+  }
+
+  ChatHistory history(dir, 256);
+  EXPECT_EQ(texts(history.Page("a", 0, 10)), vector<string>({"again"}));
+  EXPECT_EQ(history.Count("b"), 10u);
+  EXPECT_EQ(texts(history.Page("b", 9, 1)), vector<string>({"word0"}));
+  removeDir(dir);
+}
+
+TEST(ChatHistory, TruncatedTail) {
+  string dir = makeDir();
+  {
+    ChatHistory history(dir);
+    history.Append(makeRecord("a", "first", 1));
+    history.Append(makeRecord("a", "second", 2));
+  }
+  // 模拟写入中途退出
+  string path = dir + "/00000001.seg";
+  GStatBuf st;
+  ASSERT_EQ(g_stat(path.c_str(), &st), 0);
+  ASSERT_EQ(truncate(path.c_str(), st.st_size - 3), 0);
+
+  {
+    ChatHistory history(dir);
+    EXPECT_EQ(texts(history.Page("a", 0, 10)), vector<string>({"first"}));
+    history.Append(makeRecord("a", "third", 3));
+  }
+  ChatHistory history(dir);
+  EXPECT_EQ(texts(history.Page("a", 0, 10)),
+            vector<string>({"first", "third"}));
+  removeDir(dir);
+}
+
+TEST(ChatHistory, OpenInBackground) {
+  string dir = makeDir();
+  {
+    ChatHistory history(dir, 4096);
+    for (int i = 0; i < 2000; ++i) {
+      history.Append(makeRecord("a", "word" + to_string(i), i));
+    }
+  }
+  // 打开期间的调用等待索引建好, 而不是看到空的记录
+  {
+    ChatHistory history(dir, 4096);
+    EXPECT_EQ(history.Count("a"), 2000u);
+  }
+  // 打开期间追加的记录暂存, 排在已有的记录之后
+  {
+    ChatHistory history(dir, 4096);
+    EXPECT_TRUE(history.Append(makeRecord("a", "last", 2000)));
+    EXPECT_EQ(texts(history.Page("a", 0, 2)),
+              vector<string>({"word1999", "last"}));
+    EXPECT_TRUE(history.IsOpen());
+  }
+  // 打开未完成就销毁
+  { ChatHistory history(dir, 4096); }
+  ChatHistory history(dir, 4096);
+  EXPECT_EQ(history.Count("a"), 2001u);
+  removeDir(dir);
+}
@@ -13,6 +13,18 @@ const int MAX_PHOTOSIZE = 300;
 const int MAX_UDPLEN = 8192;
 const int MAX_SHAREDFILE = 10000;
 
+const int DEFAULT_TCP_WORKER_COUNT = 8;
+const int DEFAULT_TCP_ACCEPT_QUEUE = 64;
+const int DEFAULT_TCP_MAX_CONN_PER_PEER = 4;
+const int DEFAULT_UDP_RECV_BUFFER = 1024 * 1024;
+const int DEFAULT_DISCOVERY_PPS = 5000;
+const int DEFAULT_SHARE_RESCAN_INTERVAL = 60 * 1000;  // ms
+const int DEFAULT_DOWNLOAD_SEGMENTS = 4;
+const int MAX_DOWNLOAD_SEGMENTS = 16;
+const int DEFAULT_TRANS_MAX_DOWNLOADS = 4;
+const int DEFAULT_TRANS_MAX_UPLOADS = 6;  // 给其他TCP请求留出处理线程
+const int DEFAULT_TRANS_MAX_PER_PEER = 4;  // 分段下载每段占一个名额
+
 const uint32_t IPTUX_REGULAROPT = 0x00000100UL;
 const uint32_t IPTUX_SEGMENTOPT = 0x00000200UL;
 const uint32_t IPTUX_GROUPOPT = 0x00000300UL;
@@ -3,25 +3,39 @@
 
 #include "Const.h"
 #include "gio/gio.h"
+#include <algorithm>
 #include <cassert>
+#include <cinttypes>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <deque>
 #include <fstream>
 #include <functional>
 #include <future>
-#include <list>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
+#include <arpa/inet.h>
 #include <sys/socket.h>
 
+#include "iptux-core/internal/AckTracker.h"
+#include "iptux-core/internal/Blacklist.h"
+#include "iptux-core/internal/CharsetConverter.h"
 #include "iptux-core/internal/Command.h"
+#include "iptux-core/internal/DiscoveryScanner.h"
+#include "iptux-core/internal/PacketBuilder.h"
+#include "iptux-core/internal/PalRegistry.h"
 #include "iptux-core/internal/RecvFileData.h"
 #include "iptux-core/internal/SendFile.h"
+#include "iptux-core/internal/ShareCatalog.h"
 #include "iptux-core/internal/TcpData.h"
+#include "iptux-core/internal/TcpWorkerPool.h"
+#include "iptux-core/internal/TransScheduler.h"
 #include "iptux-core/internal/UdpDataService.h"
 #include "iptux-core/internal/ipmsg.h"
 #include "iptux-core/internal/support.h"
@@ -34,6 +48,11 @@ using namespace std::placeholders;
 
 namespace iptux {
 
+static const char* CONFIG_BLACKLIST = "blacklist";
+/* 等待好友取走的文件清单 */
+static const size_t MAX_FILE_MANIFESTS = 32;
+static const gint64 FILE_MANIFEST_TTL_US = 10 * 60 * G_USEC_PER_SEC;
+
 // MARK: enum CoreThreadErr
 
 const char* coreThreadErrToStr(enum CoreThreadErr err) {
@@ -62,7 +81,8 @@ const char* coreThreadErrToStr(enum CoreThreadErr err) {
 struct UdpThread;
 struct UdpThreadOps {
   bool (*on_new_msg)(UdpThread* udpThread,
-                     GSocketAddress* peer,
+                     in_addr ipv4,
+                     uint16_t port,
                      const char* msg,
                      size_t size);
   void (*on_init_failed)(UdpThread* udpThread);
@@ -75,6 +95,22 @@ enum UdpThreadState {
   UDP_THREAD_STATE_CLOSED
 };
 
+/* 每次recvmmsg最多接收的数据报数 */
+const int UDP_RECV_BATCH = 32;
+/* 每次唤醒最多处理的批次，避免长期占用事件循环 */
+const int UDP_RECV_MAX_BATCHES = 8;
+
+struct UdpRecvBatch {
+  char bufs[UDP_RECV_BATCH][MAX_UDPLEN];
+  size_t lens[UDP_RECV_BATCH];
+  struct sockaddr_in addrs[UDP_RECV_BATCH];
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[UDP_RECV_BATCH];
+  struct iovec iovs[UDP_RECV_BATCH];
+  char ctrls[UDP_RECV_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+#endif
+};
+
 struct UdpThread {
   // config
   GSocket* socket = nullptr;
@@ -86,6 +122,14 @@ struct UdpThread {
   GThread* thread = nullptr;
   GMainContext* ctx = nullptr;
   guint id = 0;
+  unique_ptr<UdpRecvBatch> batch;
+  // stats
+  atomic<uint64_t> received{0};
+  atomic<uint64_t> batches{0};
+  atomic<uint64_t> truncated{0};
+  atomic<uint64_t> failed{0};
+  atomic<uint64_t> kernelDropped{0};
+  atomic<uint32_t> maxBatch{0};
 
   UdpThread() = default;
   ~UdpThread();
@@ -108,6 +152,70 @@ UdpThread::~UdpThread() {
   }
 }
 
+/**
+ * 非阻塞地接收一批数据报.
+ * @return 接收到的数据报数，-1 表示出错
+ */
+static int udpThreadRecvBatch(UdpThread* udpThread) {
+  UdpRecvBatch* b = udpThread->batch.get();
+  int fd = g_socket_get_fd(udpThread->socket);
+
+#if HAVE_RECVMMSG
+  for (int i = 0; i < UDP_RECV_BATCH; ++i) {
+    b->iovs[i].iov_base = b->bufs[i];
+    b->iovs[i].iov_len = MAX_UDPLEN - 1;
+    memset(&b->msgs[i], 0, sizeof(b->msgs[i]));
+    b->msgs[i].msg_hdr.msg_name = &b->addrs[i];
+    b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addrs[i]);
+    b->msgs[i].msg_hdr.msg_iov = &b->iovs[i];
+    b->msgs[i].msg_hdr.msg_iovlen = 1;
+    b->msgs[i].msg_hdr.msg_control = b->ctrls[i];
+    b->msgs[i].msg_hdr.msg_controllen = sizeof(b->ctrls[i]);
+  }
+  int n;
+  do {
+    n = recvmmsg(fd, b->msgs, UDP_RECV_BATCH, MSG_DONTWAIT, nullptr);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  }
+  for (int i = 0; i < n; ++i) {
+    struct msghdr* hdr = &b->msgs[i].msg_hdr;
+    b->lens[i] = b->msgs[i].msg_len;
+    if (hdr->msg_flags & MSG_TRUNC) {
+      udpThread->truncated++;
+    }
+#ifdef SO_RXQ_OVFL
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg;
+         cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+        uint32_t dropped;
+        memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+        udpThread->kernelDropped = dropped;
+      }
+    }
+#endif
+  }
+  return n;
+#else
+  int n = 0;
+  while (n < UDP_RECV_BATCH) {
+    socklen_t len = sizeof(b->addrs[n]);
+    ssize_t size = recvfrom(fd, b->bufs[n], MAX_UDPLEN - 1, MSG_DONTWAIT,
+                            (struct sockaddr*)&b->addrs[n], &len);
+    if (size < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return n > 0 ? n : -1;
+    }
+    b->lens[n++] = size;
+  }
+  return n;
+#endif
+}
+
 gboolean udpThreadCb(GIOChannel*, GIOCondition condition, gpointer data) {
   UdpThread* udpThread = static_cast<UdpThread*>(data);
 
@@ -116,31 +224,42 @@ gboolean udpThreadCb(GIOChannel*, GIOCondition condition, gpointer data) {
     return FALSE;  // remove source
   }
 
-  if (condition & G_IO_IN) {
-    char buf[MAX_UDPLEN];
-    GSocketAddress* peer;
-    GError* error = nullptr;
+  if (!(condition & G_IO_IN)) {
+    return TRUE;  // keep watching
+  }
 
-    gssize n = g_socket_receive_from(udpThread->socket, &peer, buf,
-                                     sizeof(buf) - 1, NULL, /* GCancellable */
-                                     &error);
+  /* 排空套接口接收队列(每次唤醒有上限) */
+  UdpRecvBatch* b = udpThread->batch.get();
+  for (int round = 0; round < UDP_RECV_MAX_BATCHES; ++round) {
+    int n = udpThreadRecvBatch(udpThread);
     if (n < 0) {
-      LOG_ERROR("g_socket_receive_from failed: %s", error->message);
-      g_error_free(error);
-      return TRUE;  // keep watching
+      LOG_ERROR("receive udp datagrams failed: %s", strerror(errno));
+      break;
     }
-
     if (n == 0) {
-      g_object_unref(peer);
-      return TRUE;  // keep watching
+      break;
+    }
+    udpThread->batches++;
+    udpThread->received += n;
+    if (uint32_t(n) > udpThread->maxBatch) {
+      udpThread->maxBatch = n;
     }
 
-    buf[n] = '\0';
-    LOG_INFO("Received %zd bytes: %s\n", n, buf);
-    if (!udpThread->ops->on_new_msg(udpThread, peer, buf, n)) {
-      LOG_WARN("udpThreadCb on_new_msg failed");
+    for (int i = 0; i < n; ++i) {
+      if (b->lens[i] == 0) {
+        continue;
+      }
+      b->bufs[i][b->lens[i]] = '\0';
+      if (!udpThread->ops->on_new_msg(udpThread, b->addrs[i].sin_addr,
+                                      ntohs(b->addrs[i].sin_port), b->bufs[i],
+                                      b->lens[i])) {
+        udpThread->failed++;
+        LOG_WARN("udpThreadCb on_new_msg failed");
+      }
+    }
+    if (n < UDP_RECV_BATCH) {
+      break;
     }
-    g_object_unref(peer);
   }
 
   return TRUE;  // keep watching
@@ -232,6 +351,7 @@ gboolean udpThreadStart(UdpThread* udpThread) {
   }
 
   udpThread->ctx = g_main_context_new();
+  udpThread->batch = make_unique<UdpRecvBatch>();
   udpThread->thread = g_thread_new("udpThread", udpThreadRun, udpThread);
   udpThread->state = UDP_THREAD_STATE_RUNNING;
   if (!udpThread->thread) {
@@ -471,6 +591,60 @@ void init_iptux_environment() {
     g_mkdir(path, 0777);
 }
 
+/**
+ * 从配置读取传输调度的限制, 速率以KiB/s配置.
+ */
+TransScheduler::Options transSchedulerOptions(const IptuxConfig& config) {
+  TransScheduler::Options options;
+  options.maxDownloads = max(
+      config.GetInt("trans_max_downloads", DEFAULT_TRANS_MAX_DOWNLOADS), 0);
+  /* 上传占用TCP处理线程, 至少留下四分之一处理其他请求 */
+  int workers =
+      max(config.GetInt("tcp_worker_count", DEFAULT_TCP_WORKER_COUNT), 1);
+  size_t uploadLimit = max(workers - max(workers / 4, 1), 1);
+  options.maxUploads =
+      max(config.GetInt("trans_max_uploads", DEFAULT_TRANS_MAX_UPLOADS), 0);
+  if (options.maxUploads == 0 || options.maxUploads > uploadLimit) {
+    options.maxUploads = uploadLimit;
+  }
+  options.maxPerPeer =
+      max(config.GetInt("trans_max_per_peer", DEFAULT_TRANS_MAX_PER_PEER), 0);
+  options.downloadRate =
+      int64_t(max(config.GetInt("trans_download_rate_kb", 0), 0)) * 1024;
+  options.uploadRate =
+      int64_t(max(config.GetInt("trans_upload_rate_kb", 0), 0)) * 1024;
+  options.peerRate =
+      int64_t(max(config.GetInt("trans_peer_rate_kb", 0), 0)) * 1024;
+  return options;
+}
+
+/**
+ * 消息未收到回复时的首次重发间隔.
+ */
+chrono::milliseconds ackRetryInterval(const ProgramData& programData) {
+  return chrono::duration_cast<chrono::milliseconds>(
+      chrono::microseconds(programData.getSendMessageRetryInUs()));
+}
+
+/**
+ * 任务列表中的一项, 标出排队与暂停的状态.
+ */
+unique_ptr<TransFileModel> transTaskStat(TransAbstract& task,
+                                         TransScheduler& scheduler) {
+  auto res = make_unique<TransFileModel>(task.getTransFileModel());
+  switch (scheduler.GetState(task.GetTaskId())) {
+    case TransScheduler::State::QUEUED:
+      res->setQueued(true).setRemain(_("Queued"));
+      break;
+    case TransScheduler::State::PAUSED:
+      res->setPaused(true).setRemain(_("Paused")).setRate("");
+      break;
+    default:
+      break;
+  }
+  return res;
+}
+
 }  // namespace
 
 // MARK: CoreThread
@@ -482,17 +656,41 @@ struct CoreThread::Impl {
 
   UdpDataService_U udp_data_service;
 
-  GSList* blacklist{nullptr};  // 黑名单链表
+  Blacklist blacklist;
+  Blacklist sessionBlocks;  // AddBlockIp(), not saved to the config
   bool debugDontBroadcast{false};
-  vector<shared_ptr<PalInfo>> pallist;  // 好友链表(成员不能被删除)
+  PalRegistry pallist;  // 好友链表(成员不能被删除)
 
+  std::mutex privateFilesMutex;
   map<uint32_t, shared_ptr<FileInfo>> privateFiles;
+  // (packetn, filenum) -> fileid of privateFiles, packetn is only assigned
+  // when the file is announced, so the index is rebuilt on a miss
+  unordered_map<uint64_t, uint32_t> privateFilesByPacket;
+  struct FileManifest {
+    in_addr ipv4;
+    gint64 deadline;  // g_get_monotonic_time()
+    string data;
+  };
+  std::mutex fileManifestsMutex;
+  map<uint32_t, FileManifest> fileManifests;  // packetno -> 清单
   int lastTransTaskId{0};
   int eventCount{0};
   shared_ptr<const Event> lastEvent{nullptr};
   map<int, shared_ptr<TransAbstract>> transTasks;
-  deque<shared_ptr<const Event>> waitingEvents;
+  deque<pair<shared_ptr<const Event>, gint64>> waitingEvents;  // 事件及入队时间
   std::mutex waitingEventsMutex;
+  map<EventType, EventQueueLatency> eventLatency;
+  MetricsRegistry metrics;
+  Counter* tcpAccepted{nullptr};
+
+  // wakes up the UI main context when an event is queued
+  GMainContext* dispatchCtx{nullptr};
+  GSource* dispatchSource{nullptr};
+  function<void(shared_ptr<const Event>)> dispatchHandler;
+  size_t dispatchBatch{0};
+
+  shared_ptr<const Event> popEventLocked();
+  void scheduleDispatchLocked(CoreThread* owner);
 
   future<void> notifyToAllFuture;
 
@@ -503,21 +701,36 @@ struct CoreThread::Impl {
   GSocket* tcpSocket{nullptr};
   bool ignoreTcpBindFailed{false};
 
-  // TCP handler threads for incoming connections
-  std::list<GThread*> tcpHandlerThreads;
-  std::mutex tcpHandlerThreadsMutex;
-
-  Impl() = default;
+  // workers serving incoming TCP connections
+  unique_ptr<TcpWorkerPool> tcpWorkerPool;
+  // queues file transfers and shapes their bandwidth
+  shared_ptr<TransScheduler> transScheduler;
+  // messages waiting for the pal's ack
+  unique_ptr<AckTracker> ackTracker;
+  unique_ptr<PacketBuilder> packetBuilder;
+  CharsetConverter charsetConverter;
+
+  // scans the net segments in the background
+  std::mutex discoveryMutex;
+  unique_ptr<DiscoveryScanner> discoveryScanner;
+  thread discoveryThread;
+  atomic_bool discoveryScanning{false};
+
+  void stopDiscoveryLocked();
+  bool submitRecvTask(shared_ptr<RecvFileData> rfdt);
+
+  Impl() { tcpAccepted = &metrics.GetCounter("tcp.connections.accepted"); }
   ~Impl();
-
-  std::list<GThread*>::iterator addTcpHandlerThread(GThread* thread);
-  void removeTcpHandlerThread(std::list<GThread*>::iterator it);
-  void joinAllTcpHandlerThreads();
 };
 
 CoreThread::Impl::~Impl() {
-  // Join any remaining TCP handler threads
-  joinAllTcpHandlerThreads();
+  // throttled uploads hold the TCP workers
+  if (transScheduler) {
+    transScheduler->Stop();
+  }
+  if (tcpWorkerPool) {
+    tcpWorkerPool->stop();
+  }
 
   if (udpThread) {
     delete udpThread;
@@ -537,27 +750,21 @@ CoreThread::Impl::~Impl() {
   }
 }
 
-std::list<GThread*>::iterator CoreThread::Impl::addTcpHandlerThread(GThread* thread) {
-  std::lock_guard<std::mutex> lock(tcpHandlerThreadsMutex);
-  tcpHandlerThreads.push_back(thread);
-  return std::prev(tcpHandlerThreads.end());
+bool CoreThread::Impl::submitRecvTask(shared_ptr<RecvFileData> rfdt) {
+  return transScheduler->Submit(
+      rfdt->GetTaskId(), TransScheduler::Direction::DOWNLOAD,
+      rfdt->GetPeerIpv4(), [rfdt] { rfdt->RecvFileDataEntry(); }, 0,
+      rfdt->SegmentCount());
 }
 
-void CoreThread::Impl::removeTcpHandlerThread(std::list<GThread*>::iterator it) {
-  std::lock_guard<std::mutex> lock(tcpHandlerThreadsMutex);
-  GThread* thread = *it;
-  tcpHandlerThreads.erase(it);
-  g_thread_join(thread);
-}
-
-void CoreThread::Impl::joinAllTcpHandlerThreads() {
-  std::lock_guard<std::mutex> lock(tcpHandlerThreadsMutex);
-  for (GThread* thread : tcpHandlerThreads) {
-    if (thread) {
-      g_thread_join(thread);
-    }
+void CoreThread::Impl::stopDiscoveryLocked() {
+  if (discoveryScanner) {
+    discoveryScanner->Cancel();
   }
-  tcpHandlerThreads.clear();
+  if (discoveryThread.joinable()) {
+    discoveryThread.join();
+  }
+  discoveryScanner.reset();
 }
 
 CoreThread::CoreThread(shared_ptr<ProgramData> data)
@@ -570,7 +777,9 @@ CoreThread::CoreThread(shared_ptr<ProgramData> data)
     pImpl->debugDontBroadcast = true;
   }
   pImpl->port = programData->port();
+  pImpl->blacklist.Assign(config->GetStringList(CONFIG_BLACKLIST));
   pImpl->udp_data_service = make_unique<UdpDataService>(*this);
+  pImpl->packetBuilder = make_unique<PacketBuilder>(programData);
   pImpl->me = make_shared<PalInfo>("127.0.0.1", port());
   (*pImpl->me)
       .setUser(g_get_user_name())
@@ -578,24 +787,38 @@ CoreThread::CoreThread(shared_ptr<ProgramData> data)
       .setName(programData->nickname)
       .setGroup(programData->mygroup)
       .setEncode("utf-8")
+      .setFeatures(IPTUX_FEATURES)
       .setCompatible(true);
+  pImpl->transScheduler =
+      make_shared<TransScheduler>(transSchedulerOptions(*config));
+  pImpl->ackTracker = make_unique<AckTracker>(
+      ackRetryInterval(*programData), MAX_RETRYTIMES,
+      [this](const PalKey& palKey, const string& packet) {
+        Command(*this).SendPacket(getUdpSock(), palKey, packet);
+      },
+      [this](const PalKey& palKey, uint32_t packetno, bool delivered) {
+        onPacketAcked(palKey, packetno, delivered);
+      });
 }
 
 CoreThread::~CoreThread() {
+  pImpl->ackTracker->Stop();
   if (started) {
     stop();
   }
-  g_slist_free(pImpl->blacklist);
+  CancelDiscoveryScan();
+  disconnectEventDispatcher();
 }
 
 bool udpThreadOpsOnNewMsg(UdpThread* udpThread,
-                          GSocketAddress* peer,
+                          in_addr ipv4,
+                          uint16_t port,
                           const char* msg,
                           size_t size) {
   CoreThread::Impl* self = static_cast<CoreThread::Impl*>(udpThread->data);
 
   try {
-    self->udp_data_service->process(peer, msg, size);
+    self->udp_data_service->process(ipv4, port, msg, size);
   } catch (const std::exception& e) {
     LOG_ERROR("Exception in UDP message processing: %s", e.what());
     return false;
@@ -617,67 +840,25 @@ static const UdpThreadOps udpThreadOps = {
     .on_init_failed = udpThreadOpsOnInitFailed,
 };
 
-// Data passed to TCP handler thread
-struct TcpHandlerData {
-  CoreThread* coreThread;
-  CoreThread::Impl* impl;
-  GSocket* clientSocket;
-  std::list<GThread*>::iterator threadIt;  // Set after thread creation
-  bool threadItValid{false};
-};
-
-// Cleanup callback invoked on TCP thread's main context
-static gboolean tcpHandlerCleanupCb(gpointer data) {
-  TcpHandlerData* handlerData = static_cast<TcpHandlerData*>(data);
-  if (handlerData->threadItValid) {
-    handlerData->impl->removeTcpHandlerThread(handlerData->threadIt);
-  }
-  delete handlerData;
-  return FALSE;
-}
-
-static gpointer tcpHandlerThreadFunc(gpointer data) {
-  TcpHandlerData* handlerData = static_cast<TcpHandlerData*>(data);
-  try {
-    TcpData::TcpDataEntry(handlerData->coreThread, handlerData->clientSocket);
-  } catch (const std::exception& e) {
-    LOG_ERROR("Exception in TCP handler: %s", e.what());
-  } catch (...) {
-    LOG_ERROR("Unknown exception in TCP handler");
-  }
-
-  // Schedule cleanup on TCP thread's main context
-  if (handlerData->impl->tcpThread &&
-      handlerData->impl->tcpThread->ctx) {
-    g_main_context_invoke(handlerData->impl->tcpThread->ctx,
-                          tcpHandlerCleanupCb, handlerData);
-  } else {
-    // TCP thread already stopped, just delete
-    delete handlerData;
-  }
-  return nullptr;
-}
-
 void tcpThreadOpsOnNewConnection(TcpThread* tcpThread, GSocket* clientSocket) {
   CoreThread::Impl* impl = static_cast<CoreThread::Impl*>(tcpThread->data);
+  impl->tcpAccepted->Inc();
 
-  // Create handler data (will be freed by cleanup callback)
-  TcpHandlerData* handlerData = new TcpHandlerData();
-  handlerData->coreThread = impl->owner;
-  handlerData->impl = impl;
-  handlerData->clientSocket = clientSocket;
-
-  // Create a GThread to handle the connection
-  GThread* thread =
-      g_thread_new("tcp-handler", tcpHandlerThreadFunc, handlerData);
-  if (thread) {
-    handlerData->threadIt = impl->addTcpHandlerThread(thread);
-    handlerData->threadItValid = true;
-  } else {
-    LOG_ERROR("Failed to create TCP handler thread");
-    delete handlerData;
+  uint32_t peer = 0;
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (getpeername(g_socket_get_fd(clientSocket), (struct sockaddr*)&addr,
+                  &len) == 0 &&
+      addr.sin_family == AF_INET) {
+    peer = addr.sin_addr.s_addr;
+  }
+
+  if (!impl->tcpWorkerPool) {
+    LOG_ERROR("TCP worker pool not running, drop connection");
     g_object_unref(clientSocket);
+    return;
   }
+  impl->tcpWorkerPool->submit(clientSocket, peer);
 }
 
 static const TcpThreadOps tcpThreadOps = {
@@ -708,6 +889,16 @@ bool CoreThread::start() noexcept {
   }
 
   if (pImpl->tcpSocket) {
+    int workers = config->GetInt("tcp_worker_count", DEFAULT_TCP_WORKER_COUNT);
+    int backlog = config->GetInt("tcp_accept_queue", DEFAULT_TCP_ACCEPT_QUEUE);
+    int perPeer = config->GetInt("tcp_max_conn_per_peer",
+                                 DEFAULT_TCP_MAX_CONN_PER_PEER);
+    pImpl->tcpWorkerPool = make_unique<TcpWorkerPool>(
+        max(workers, 1), max(backlog, 1), max(perPeer, 0),
+        [this](GSocket* clientSocket) {
+          TcpData::TcpDataEntry(this, clientSocket);
+        });
+    g_socket_set_listen_backlog(pImpl->tcpSocket, max(backlog, 1));
     pImpl->tcpThread = new TcpThread();
     pImpl->tcpThread->socket = pImpl->tcpSocket;
     pImpl->tcpThread->ops = &tcpThreadOps;
@@ -719,12 +910,13 @@ bool CoreThread::start() noexcept {
     }
   }
 
+  programData->GetShareCatalog().Start();
   pImpl->notifyToAllFuture =
       async([](CoreThread* ct) { SendNotifyToAll(ct); }, this);
   return true;
 }
 
-static GSocket* bind_udp_port(const char* ip, uint16_t port) {
+static GSocket* bind_udp_port(const char* ip, uint16_t port, int rcvbuf) {
   GError* error = nullptr;
   GSocket* udpSock = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
                                   G_SOCKET_PROTOCOL_UDP, &error);
@@ -735,6 +927,22 @@ static GSocket* bind_udp_port(const char* ip, uint16_t port) {
   }
   g_socket_set_broadcast(udpSock, TRUE);
 
+  // Enlarge the receive buffer to survive broadcast storms
+  if (rcvbuf > 0 &&
+      !g_socket_set_option(udpSock, SOL_SOCKET, SO_RCVBUF, rcvbuf, &error)) {
+    LOG_WARN("g_socket_set_option for SO_RCVBUF failed: %s", error->message);
+    g_error_free(error);
+    error = nullptr;
+  }
+#ifdef SO_RXQ_OVFL
+  // Report datagrams dropped by the kernel
+  if (!g_socket_set_option(udpSock, SOL_SOCKET, SO_RXQ_OVFL, 1, &error)) {
+    LOG_WARN("g_socket_set_option for SO_RXQ_OVFL failed: %s", error->message);
+    g_error_free(error);
+    error = nullptr;
+  }
+#endif
+
   GSocketAddress* bind_addr = g_inet_socket_address_new_from_string(ip, port);
   if (!bind_addr) {
     g_object_unref(udpSock);
@@ -801,15 +1009,38 @@ void CoreThread::setIgnoreTcpBindFailed(bool ignore) {
 }
 
 size_t CoreThread::getTcpHandlerThreadCount() const {
-  std::lock_guard<std::mutex> lock(pImpl->tcpHandlerThreadsMutex);
-  return pImpl->tcpHandlerThreads.size();
+  return pImpl->tcpWorkerPool ? pImpl->tcpWorkerPool->activeCount() : 0;
+}
+
+size_t CoreThread::getTcpQueuedConnectionCount() const {
+  return pImpl->tcpWorkerPool ? pImpl->tcpWorkerPool->queuedCount() : 0;
+}
+
+uint64_t CoreThread::getTcpRejectedConnectionCount() const {
+  return pImpl->tcpWorkerPool ? pImpl->tcpWorkerPool->rejectedCount() : 0;
+}
+
+UdpRecvStats CoreThread::getUdpRecvStats() const {
+  UdpRecvStats stats;
+  UdpThread* udpThread = pImpl->udpThread;
+  if (udpThread) {
+    stats.received = udpThread->received;
+    stats.batches = udpThread->batches;
+    stats.truncated = udpThread->truncated;
+    stats.failed = udpThread->failed;
+    stats.kernelDropped = udpThread->kernelDropped;
+    stats.maxBatch = udpThread->maxBatch;
+  }
+  return stats;
 }
 
 bool CoreThread::bind_iptux_port() noexcept {
   auto bind_ip = config->GetString("bind_ip", "0.0.0.0");
   uint16_t port = programData->port();
 
-  pImpl->udpSocket = bind_udp_port(bind_ip.c_str(), port);
+  pImpl->udpSocket =
+      bind_udp_port(bind_ip.c_str(), port,
+                    config->GetInt("udp_recv_buffer", DEFAULT_UDP_RECV_BUFFER));
   if (!pImpl->udpSocket) {
     pImpl->lastErr = CORE_THREAD_ERR_UDP_BIND_FAILED;
     return false;
@@ -835,6 +1066,7 @@ void CoreThread::stop() {
     throw "CoreThread not started, or already stopped";
   }
   started = false;
+  CancelDiscoveryScan();
   ClearSublayer();
   if (pImpl->tcpThread) {
     tcpThreadStop(pImpl->tcpThread);
@@ -842,8 +1074,13 @@ void CoreThread::stop() {
   if (pImpl->udpThread) {
     udpThreadStop(pImpl->udpThread);
   }
-  // Join all TCP handler threads after stopping the accept thread
-  pImpl->joinAllTcpHandlerThreads();
+  // Uploads waiting for a slot hold TCP workers, release them first
+  pImpl->transScheduler->Stop();
+  // Drain the worker pool after stopping the accept thread
+  if (pImpl->tcpWorkerPool) {
+    pImpl->tcpWorkerPool->stop();
+  }
+  programData->GetShareCatalog().Stop();
   pImpl->notifyToAllFuture.wait();
 }
 
@@ -856,7 +1093,7 @@ void CoreThread::ClearSublayer() {
    * @note 必须在发送下线信息之后才能关闭套接口.
    * Socket closing is handled by the thread destructors and Impl destructor.
    */
-  for (auto palInfo : pImpl->pallist) {
+  for (auto palInfo : pImpl->pallist.Snapshot()) {
     SendBroadcastExit(palInfo);
   }
 }
@@ -894,16 +1131,17 @@ void CoreThread::SendNotifyToAll(CoreThread* pcthrd) {
   if (!pcthrd->pImpl->debugDontBroadcast) {
     cmd.BroadCast(pcthrd->getUdpSocket(), pcthrd->port());
   }
-  cmd.DialUp(pcthrd->getUdpSock(), pcthrd->port());
+  pcthrd->StartDiscoveryScan();
 }
 
 /**
- * 黑名单链表中是否包含此项.
+ * 黑名单中是否包含此地址(单个地址或所在网段).
  * @param ipv4 ipv4
  * @return 是否包含
  */
 bool CoreThread::BlacklistContainItem(in_addr ipv4) const {
-  return g_slist_find(pImpl->blacklist, GUINT_TO_POINTER(ipv4.s_addr));
+  return pImpl->blacklist.Contains(ipv4) or
+         pImpl->sessionBlocks.Contains(ipv4);
 }
 
 bool CoreThread::IsBlocked(in_addr ipv4) const {
@@ -920,10 +1158,10 @@ void CoreThread::Unlock() const {
 
 /**
  * 获取好友链表.
- * @return 好友链表
+ * @return 好友链表的副本, UDP线程可能同时加入好友
  */
-const vector<shared_ptr<PalInfo>>& CoreThread::GetPalList() {
-  return pImpl->pallist;
+vector<shared_ptr<PalInfo>> CoreThread::GetPalList() {
+  return pImpl->pallist.Snapshot();
 }
 
 /**
@@ -932,24 +1170,27 @@ const vector<shared_ptr<PalInfo>>& CoreThread::GetPalList() {
  */
 void CoreThread::ClearAllPalFromList() {
   /* 清除所有好友的在线标志 */
-  for (auto palInfo : pImpl->pallist) {
+  for (auto palInfo : pImpl->pallist.Snapshot()) {
     palInfo->setOnline(false);
   }
 }
 
 shared_ptr<PalInfo> CoreThread::GetPal(PalKey palKey) {
-  for (auto palInfo : pImpl->pallist) {
-    if (ipv4Equal(palInfo->ipv4(), palKey.GetIpv4())) {
-      return palInfo;
-    }
-  }
-  return {};
+  return pImpl->pallist.Find(palKey);
+}
+
+CPPalInfo CoreThread::GetPal(PalKey palKey) const {
+  return pImpl->pallist.Find(palKey);
 }
 
 shared_ptr<PalInfo> CoreThread::GetPal(const string& ipv4) {
   return GetPal(PalKey(inAddrFromString(ipv4), port()));
 }
 
+CPPalInfo CoreThread::GetPal(const string& ipv4) const {
+  return GetPal(PalKey(inAddrFromString(ipv4), port()));
+}
+
 /**
  * 从好友链表中删除指定的好友信息数据(非UI线程安全).
  * @param ipv4 ipv4
@@ -991,7 +1232,7 @@ void CoreThread::UpdatePalToList(PalKey palKey) {
  * 也应该分配好友到相应的群组
  */
 void CoreThread::AttachPalToList(shared_ptr<PalInfo> pal) {
-  pImpl->pallist.push_back(pal);
+  pImpl->pallist.Attach(pal);
   pal->setOnline(true);
   emitNewPalOnline(pal);
 }
@@ -1013,9 +1254,10 @@ void CoreThread::emitNewPalOnline(const PalKey& palKey) {
 
 void CoreThread::emitEvent(shared_ptr<const Event> event) {
   lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
-  pImpl->waitingEvents.push_back(event);
+  pImpl->waitingEvents.emplace_back(event, g_get_monotonic_time());
   this->pImpl->eventCount++;
   this->pImpl->lastEvent = event;
+  pImpl->scheduleDispatchLocked(this);
   signalEvent.emit(event);
 }
 
@@ -1063,16 +1305,131 @@ void CoreThread::SendMyIcon(PPalInfo pal, istream& iss) {
 }
 
 void CoreThread::AddBlockIp(in_addr ipv4) {
-  pImpl->blacklist =
-      g_slist_append(pImpl->blacklist, GUINT_TO_POINTER(ipv4.s_addr));
+  pImpl->sessionBlocks.Add(inAddrToString(ipv4));
+}
+
+bool CoreThread::AddBlockEntry(const string& entry) {
+  if (!pImpl->blacklist.Add(entry)) {
+    return false;
+  }
+  SaveBlacklist();
+  return true;
+}
+
+bool CoreThread::DelBlockEntry(const string& entry) {
+  bool inSession = pImpl->sessionBlocks.Remove(entry);
+  if (!pImpl->blacklist.Remove(entry)) {
+    return inSession;
+  }
+  SaveBlacklist();
+  return true;
+}
+
+vector<string> CoreThread::GetBlockEntries() const {
+  return pImpl->blacklist.List();
+}
+
+void CoreThread::SaveBlacklist() {
+  config->SetStringList(CONFIG_BLACKLIST, pImpl->blacklist.List());
+  if (!config->getFileName().empty()) {
+    config->Save();
+  }
 }
 
 bool CoreThread::SendMessage(CPPalInfo palInfo, const string& message) {
-  Command cmd(*this);
-  cmd.SendMessage(getUdpSock(), palInfo, message.c_str());
+  Command(*this).SendMessage(palInfo, message.c_str());
   return true;
 }
 
+void CoreThread::SendCheckedPacket(const PalKey& palKey,
+                                   uint32_t packetno,
+                                   const string& packet) {
+  pImpl->ackTracker->Track(palKey, packetno, packet);
+}
+
+bool CoreThread::AckPacket(const PalKey& palKey, uint32_t packetno) {
+  return pImpl->ackTracker->Ack(palKey, packetno);
+}
+
+size_t CoreThread::getPendingAckCount() const {
+  return pImpl->ackTracker->PendingCount();
+}
+
+MetricsRegistry& CoreThread::getMetrics() {
+  return pImpl->metrics;
+}
+
+/**
+ * 注册表中的指标加上各处已有的统计, 后者在此时采样.
+ */
+string CoreThread::DumpMetrics() const {
+  Json::Value root = pImpl->metrics.ToJson();
+  auto& gauges = root["gauges"];
+  auto& counters = root["counters"];
+
+  gauges["tcp.connections.active"] = Json::UInt64(getTcpHandlerThreadCount());
+  gauges["tcp.connections.queued"] =
+      Json::UInt64(getTcpQueuedConnectionCount());
+  counters["tcp.connections.rejected"] =
+      Json::UInt64(getTcpRejectedConnectionCount());
+
+  auto udp = getUdpRecvStats();
+  counters["udp.recv.received"] = Json::UInt64(udp.received);
+  counters["udp.recv.batches"] = Json::UInt64(udp.batches);
+  counters["udp.recv.truncated"] = Json::UInt64(udp.truncated);
+  counters["udp.recv.failed"] = Json::UInt64(udp.failed);
+  counters["udp.recv.kernel_dropped"] = Json::UInt64(udp.kernelDropped);
+  gauges["udp.recv.max_batch"] = Json::UInt64(udp.maxBatch);
+  gauges["udp.pending_acks"] = Json::UInt64(getPendingAckCount());
+
+  size_t activeTasks = 0;
+  Lock();
+  for (auto& it : pImpl->transTasks) {
+    if (!it.second->getTransFileModel().isFinished()) {
+      activeTasks++;
+    }
+  }
+  gauges["trans.tasks"] = Json::UInt64(pImpl->transTasks.size());
+  Unlock();
+  gauges["trans.tasks.active"] = Json::UInt64(activeTasks);
+
+  {
+    lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
+    gauges["events.queue_depth"] = Json::UInt64(pImpl->waitingEvents.size());
+    counters["events.emitted"] = pImpl->eventCount;
+    auto& latency = root["events.queue_latency_us"];
+    latency = Json::Value(Json::objectValue);
+    for (auto& it : pImpl->eventLatency) {
+      Json::Value value(Json::objectValue);
+      value["count"] = Json::UInt64(it.second.count);
+      value["avg"] = Json::Int64(
+          it.second.count ? it.second.totalUs / int64_t(it.second.count) : 0);
+      value["max"] = Json::Int64(it.second.maxUs);
+      latency[EventTypeToStr(it.first)] = value;
+    }
+  }
+
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "  ";
+  return Json::writeString(builder, root);
+}
+
+void CoreThread::onPacketAcked(const PalKey& palKey,
+                               uint32_t packetno,
+                               bool delivered) {
+  auto pal = GetPal(palKey);
+  if (!delivered && pal) {
+    MsgPara para(pal);
+    para.stype = MessageSourceType::ERROR;
+    para.btype = GROUP_BELONG_TYPE_REGULAR;
+    para.dtlist.emplace_back(
+        MESSAGE_CONTENT_TYPE_STRING,
+        _("Your pal didn't receive the packet. He or she is offline maybe."));
+    InsertMessage(std::move(para));
+  }
+  emitEvent(make_shared<MessageAckEvent>(palKey, packetno, delivered));
+}
+
 bool CoreThread::SendMessage(CPPalInfo pal, const ChipData& chipData) {
   auto ptr = chipData.data.c_str();
   bool ret = true;
@@ -1111,6 +1468,15 @@ bool CoreThread::SendMsgPara(shared_ptr<MsgPara> para) {
 }
 
 void CoreThread::AsyncSendMsgPara(std::shared_ptr<MsgPara> msgPara) {
+  // text messages return at once (acks are tracked in the background),
+  // only pictures need a thread for their TCP transfer
+  bool textOnly = all_of(
+      msgPara->dtlist.begin(), msgPara->dtlist.end(),
+      [](const ChipData& chip) { return chip.type == MessageContentType::STRING; });
+  if (textOnly) {
+    SendMsgPara(msgPara);
+    return;
+  }
   thread t(&CoreThread::SendMsgPara, this, msgPara);
   t.detach();
 }
@@ -1136,17 +1502,22 @@ void CoreThread::SendSharedFiles(PPalInfo pal) {
 void CoreThread::UpdateMyInfo() {
   Command cmd(*this);
 
+  pImpl->packetBuilder->Invalidate();
   Lock();
-  for (auto pal : pImpl->pallist) {
+  vector<CPPalInfo> onlinePals;
+  for (auto pal : pImpl->pallist.Snapshot()) {
     if (pal->isOnline()) {
-      cmd.SendAbsence(getUdpSock(), pal);
+      onlinePals.push_back(pal);
     }
     if (pal->isOnline() and pal->isCompatible()) {
       thread t1(bind(&CoreThread::sendFeatureData, this, _1), pal);
       t1.detach();
     }
   }
+  cmd.SendAbsence(getUdpSock(), onlinePals);
   Unlock();
+  pImpl->transScheduler->SetOptions(transSchedulerOptions(*config));
+  pImpl->ackTracker->SetRetryInterval(ackRetryInterval(*programData));
   emitEvent(make_shared<const ConfigChangedEvent>());
 }
 
@@ -1165,7 +1536,7 @@ int CoreThread::GetOnlineCount() const {
   }
 
   int res = 0;
-  for (auto pal : pImpl->pallist) {
+  for (auto pal : pImpl->pallist.Snapshot()) {
     if (pal->isOnline()) {
       res++;
     }
@@ -1181,6 +1552,47 @@ void CoreThread::SendDetectPacket(in_addr ipv4) {
   Command(*this).SendDetectPacket(getUdpSock(), ipv4, port());
 }
 
+void CoreThread::StartDiscoveryScan() {
+  lock_guard<std::mutex> l(pImpl->discoveryMutex);
+  pImpl->stopDiscoveryLocked();
+  if (!started) {
+    LOG_WARN("discovery scan skipped, core thread not started");
+    return;
+  }
+
+  programData->Lock();
+  auto ranges = DiscoveryScanner::MakeRanges(programData->getNetSegments());
+  programData->Unlock();
+  string packet = Command(*this).CreateDetectPacket();
+  int pps = config->GetInt("discovery_pps", DEFAULT_DISCOVERY_PPS);
+
+  pImpl->discoveryScanner =
+      make_unique<DiscoveryScanner>(getUdpSock(), port(), max(pps, 0));
+  DiscoveryScanner* scanner = pImpl->discoveryScanner.get();
+  pImpl->discoveryScanning = true;
+  pImpl->discoveryThread = thread([this, scanner, ranges, packet] {
+    auto stats = scanner->Scan(ranges, packet, [this](uint64_t done,
+                                                      uint64_t total) {
+      emitEvent(make_shared<DiscoveryProgressEvent>(done, total));
+    });
+    LOG_INFO("discovery scan %s: %" PRIu64 "/%" PRIu64
+             " sent, %" PRIu64 " failed, %.1fs",
+             stats.cancelled ? "cancelled" : "finished", stats.sent,
+             stats.total, stats.failed, stats.elapsedUs / 1e6);
+    pImpl->discoveryScanning = false;
+    emitEvent(make_shared<DiscoveryFinishedEvent>(stats));
+  });
+}
+
+void CoreThread::CancelDiscoveryScan() {
+  lock_guard<std::mutex> l(pImpl->discoveryMutex);
+  pImpl->stopDiscoveryLocked();
+}
+
+bool CoreThread::IsDiscoveryScanning() const {
+  return pImpl->discoveryScanning;
+}
+
 void CoreThread::emitSomeoneExit(const PalKey& palKey) {
   if (!GetPal(palKey)) {
     return;
@@ -1209,22 +1621,26 @@ void CoreThread::SetAccessPublicLimit(const string& val) {
 void CoreThread::AddPrivateFile(PFileInfo file) {
   g_assert(file);
   g_assert(file->fileid >= MAX_SHAREDFILE);
+  lock_guard<std::mutex> l(pImpl->privateFilesMutex);
   g_assert(pImpl->privateFiles.count(file->fileid) == 0);
   pImpl->privateFiles[file->fileid] = file;
 }
 
 bool CoreThread::DelPrivateFile(uint32_t id) {
+  lock_guard<std::mutex> l(pImpl->privateFilesMutex);
   return pImpl->privateFiles.erase(id) >= 1;
 }
 
+/**
+ * 共享文件取自共享目录的快照, 返回副本, 传输过程中会修改其进度.
+ */
 PFileInfo CoreThread::GetPrivateFileById(uint32_t id) {
   if (id < MAX_SHAREDFILE) {
-    FileInfo* f = programData->GetShareFileInfo(id);
-    if (!f)
-      return PFileInfo();
-    return make_shared<FileInfo>(*f);
+    auto file = programData->GetShareCatalog().Get()->FindById(id);
+    return file ? make_shared<FileInfo>(*file) : PFileInfo();
   }
 
+  lock_guard<std::mutex> l(pImpl->privateFilesMutex);
   auto res = pImpl->privateFiles.find(id);
   if (res == pImpl->privateFiles.end()) {
     return PFileInfo();
@@ -1234,14 +1650,67 @@ PFileInfo CoreThread::GetPrivateFileById(uint32_t id) {
 
 PFileInfo CoreThread::GetPrivateFileByPacketN(uint32_t packageNum,
                                               uint32_t filectime) {
-  for (auto& i : pImpl->privateFiles) {
-    if (i.second->packetn == packageNum && i.second->filenum == filectime) {
-      return i.second;
+  auto shared =
+      programData->GetShareCatalog().Get()->FindByPacket(packageNum, filectime);
+  if (shared) {
+    return make_shared<FileInfo>(*shared);
+  }
+
+  uint64_t key = uint64_t(packageNum) << 32 | filectime;
+  lock_guard<std::mutex> l(pImpl->privateFilesMutex);
+  auto& index = pImpl->privateFilesByPacket;
+  for (int pass = 0; pass < 2; ++pass) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+      auto file = pImpl->privateFiles.find(it->second);
+      if (file != pImpl->privateFiles.end() &&
+          file->second->packetn == packageNum &&
+          file->second->filenum == filectime) {
+        return file->second;
+      }
+    }
+    if (pass == 0) {
+      index.clear();
+      for (auto& i : pImpl->privateFiles) {
+        index[uint64_t(i.second->packetn) << 32 | i.second->filenum] =
+            i.first;
+      }
     }
   }
   return PFileInfo();
 }
 
+void CoreThread::RegisterFileManifest(const PalKey& pal,
+                                      uint32_t packetno,
+                                      string manifest) {
+  lock_guard<std::mutex> l(pImpl->fileManifestsMutex);
+  auto& manifests = pImpl->fileManifests;
+  gint64 now = g_get_monotonic_time();
+  for (auto it = manifests.begin(); it != manifests.end();) {
+    it = it->second.deadline < now ? manifests.erase(it) : next(it);
+  }
+  while (manifests.size() >= MAX_FILE_MANIFESTS) {
+    auto oldest = min_element(
+        manifests.begin(), manifests.end(), [](auto& a, auto& b) {
+          return a.second.deadline < b.second.deadline;
+        });
+    manifests.erase(oldest);
+  }
+  manifests[packetno] = {pal.GetIpv4(), now + FILE_MANIFEST_TTL_US,
+                         std::move(manifest)};
+}
+
+string CoreThread::GetFileManifest(in_addr ipv4, uint32_t packetno) {
+  lock_guard<std::mutex> l(pImpl->fileManifestsMutex);
+  auto it = pImpl->fileManifests.find(packetno);
+  if (it == pImpl->fileManifests.end() ||
+      it->second.ipv4.s_addr != ipv4.s_addr ||
+      it->second.deadline < g_get_monotonic_time()) {
+    return "";
+  }
+  return it->second.data;
+}
+
 void CoreThread::RegisterTransTask(std::shared_ptr<TransAbstract> task) {
   int taskId = ++(pImpl->lastTransTaskId);
   task->SetTaskId(taskId);
@@ -1249,24 +1718,94 @@ void CoreThread::RegisterTransTask(std::shared_ptr<TransAbstract> task) {
   LOG_INFO("add trans task %d", taskId);
 }
 
+void CoreThread::UnregisterTransTask(int taskId) {
+  Lock();
+  pImpl->transTasks.erase(taskId);
+  Unlock();
+  LOG_INFO("remove trans task %d", taskId);
+}
+
 bool CoreThread::TerminateTransTask(int taskId) {
   auto task = pImpl->transTasks.find(taskId);
   if (task == pImpl->transTasks.end()) {
     return false;
   }
   task->second->TerminateTrans();
+  pImpl->transScheduler->Cancel(taskId);
   return true;
 }
 
+TransScheduler& CoreThread::getTransScheduler() {
+  return *pImpl->transScheduler;
+}
+
 void CoreThread::RecvFile(FileInfo* file) {
   auto rfdt = make_shared<RecvFileData>(this, file);
   RegisterTransTask(rfdt);
-  rfdt->RecvFileDataEntry();
+  rfdt->CreateUIPara();
+  if (!pImpl->transScheduler->Run(
+          rfdt->GetTaskId(), TransScheduler::Direction::DOWNLOAD,
+          rfdt->GetPeerIpv4(), [rfdt] { rfdt->RecvFileDataEntry(); }, 0,
+          rfdt->SegmentCount())) {
+    LOG_WARN("trans scheduler stopped, drop recv task %d", rfdt->GetTaskId());
+    /* 不接收数据, 只把任务标为失败 */
+    rfdt->TerminateTrans();
+    rfdt->RecvFileDataEntry();
+  }
 }
 
 void CoreThread::RecvFileAsync(FileInfo* file) {
-  thread t(&CoreThread::RecvFile, this, file);
-  t.detach();
+  auto rfdt = make_shared<RecvFileData>(this, file);
+  RegisterTransTask(rfdt);
+  rfdt->CreateUIPara();
+  if (!pImpl->submitRecvTask(rfdt)) {
+    LOG_WARN("trans scheduler stopped, drop recv task %d", rfdt->GetTaskId());
+    rfdt->TerminateTrans();
+    rfdt->RecvFileDataEntry();
+    return;
+  }
+  if (pImpl->transScheduler->GetState(rfdt->GetTaskId()) ==
+      TransScheduler::State::QUEUED) {
+    emitEvent(make_shared<TransTasksChangedEvent>());
+  }
+}
+
+bool CoreThread::PauseTransTask(int taskId) {
+  if (!pImpl->transScheduler->Pause(taskId)) {
+    return false;
+  }
+  emitEvent(make_shared<TransTasksChangedEvent>());
+  return true;
+}
+
+bool CoreThread::SetTransTaskPriority(int taskId, int priority) {
+  return pImpl->transScheduler->SetPriority(taskId, priority);
+}
+
+bool CoreThread::ResumeTransTask(int taskId) {
+  if (pImpl->transScheduler->Resume(taskId)) {
+    emitEvent(make_shared<TransTasksChangedEvent>());
+    return true;
+  }
+
+  shared_ptr<RecvFileData> rfdt;
+  Lock();
+  auto task = pImpl->transTasks.find(taskId);
+  if (task != pImpl->transTasks.end()) {
+    rfdt = dynamic_pointer_cast<RecvFileData>(task->second);
+  }
+  if (rfdt && rfdt->IsResumable()) {
+    rfdt->PrepareResume();
+  } else {
+    rfdt.reset();
+  }
+  Unlock();
+
+  if (!rfdt) {
+    return false;
+  }
+  LOG_INFO("resume trans task %d", taskId);
+  return pImpl->submitRecvTask(rfdt);
 }
 
 std::unique_ptr<TransFileModel> CoreThread::GetTransTaskStat(int taskId) const {
@@ -1274,7 +1813,7 @@ std::unique_ptr<TransFileModel> CoreThread::GetTransTaskStat(int taskId) const {
   if (task == pImpl->transTasks.end()) {
     return {};
   }
-  return make_unique<TransFileModel>(task->second->getTransFileModel());
+  return transTaskStat(*task->second, *pImpl->transScheduler);
 }
 
 void CoreThread::clearFinishedTransTasks() {
@@ -1316,6 +1855,33 @@ void CoreThread::SendGroupMessage(const PalKey& palKey,
   Command(*this).SendGroupMsg(getUdpSock(), GetPal(palKey), message.c_str());
 }
 
+void CoreThread::SendUnitMessage(const vector<PalKey>& palKeys,
+                                 uint32_t opttype,
+                                 const string& message) {
+  vector<CPPalInfo> pals;
+  for (auto& palKey : palKeys) {
+    pals.push_back(GetPal(palKey));
+  }
+  Command(*this).SendUnitMsg(getUdpSock(), pals, opttype, message.c_str());
+}
+
+void CoreThread::SendGroupMessage(const vector<PalKey>& palKeys,
+                                  const string& message) {
+  vector<CPPalInfo> pals;
+  for (auto& palKey : palKeys) {
+    pals.push_back(GetPal(palKey));
+  }
+  Command(*this).SendGroupMsg(getUdpSock(), pals, message.c_str());
+}
+
+PacketBuilder& CoreThread::getPacketBuilder() {
+  return *pImpl->packetBuilder;
+}
+
+CharsetConverter& CoreThread::getCharsetConverter() {
+  return pImpl->charsetConverter;
+}
+
 void CoreThread::BcstFileInfoEntry(const vector<const PalInfo*>& pals,
                                    const vector<FileInfo*>& files) {
   SendFile::BcstFileInfoEntry(this, pals, files);
@@ -1326,7 +1892,7 @@ vector<unique_ptr<TransFileModel>> CoreThread::listTransTasks() const {
   Lock();
   for (auto it = pImpl->transTasks.begin(); it != pImpl->transTasks.end();
        it++) {
-    res.push_back(make_unique<TransFileModel>(it->second->getTransFileModel()));
+    res.push_back(transTaskStat(*it->second, *pImpl->transScheduler));
   }
   Unlock();
   return res;
@@ -1355,9 +1921,102 @@ bool CoreThread::HasEvent() const {
 
 shared_ptr<const Event> CoreThread::PopEvent() {
   lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
-  auto event = pImpl->waitingEvents.front();
-  pImpl->waitingEvents.pop_front();
-  return event;
+  return pImpl->popEventLocked();
+}
+
+vector<shared_ptr<const Event>> CoreThread::PopEvents(size_t maxCount) {
+  vector<shared_ptr<const Event>> res;
+  lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
+  while (res.size() < maxCount && !pImpl->waitingEvents.empty()) {
+    res.push_back(pImpl->popEventLocked());
+  }
+  return res;
+}
+
+shared_ptr<const Event> CoreThread::Impl::popEventLocked() {
+  auto item = waitingEvents.front();
+  waitingEvents.pop_front();
+
+  gint64 latency = g_get_monotonic_time() - item.second;
+  auto& stat = eventLatency[item.first->getType()];
+  stat.count++;
+  stat.totalUs += latency;
+  stat.maxUs = max(stat.maxUs, latency);
+  return item.first;
+}
+
+map<EventType, EventQueueLatency> CoreThread::getEventQueueLatency() const {
+  lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
+  return pImpl->eventLatency;
+}
+
+/**
+ * 在UI主循环中分派一批事件，每次主循环迭代至多分派dispatchBatch个.
+ */
+gboolean CoreThread::DispatchEvents(gpointer data) {
+  CoreThread* self = static_cast<CoreThread*>(data);
+  auto& pImpl = self->pImpl;
+  function<void(shared_ptr<const Event>)> handler;
+  vector<shared_ptr<const Event>> events;
+  {
+    lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
+    handler = pImpl->dispatchHandler;
+    while (events.size() < pImpl->dispatchBatch &&
+           !pImpl->waitingEvents.empty()) {
+      events.push_back(pImpl->popEventLocked());
+    }
+  }
+  for (auto& event : events) {
+    handler(event);
+  }
+
+  lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
+  if (pImpl->dispatchSource != g_main_current_source()) {
+    // disconnected by the handler
+    return G_SOURCE_REMOVE;
+  }
+  if (!pImpl->waitingEvents.empty()) {
+    return G_SOURCE_CONTINUE;
+  }
+  g_source_unref(pImpl->dispatchSource);
+  pImpl->dispatchSource = nullptr;
+  return G_SOURCE_REMOVE;
+}
+
+void CoreThread::Impl::scheduleDispatchLocked(CoreThread* owner) {
+  if (!dispatchHandler || dispatchSource) {
+    return;
+  }
+  dispatchSource = g_idle_source_new();
+  g_source_set_priority(dispatchSource, G_PRIORITY_DEFAULT);
+  g_source_set_callback(dispatchSource, CoreThread::DispatchEvents, owner,
+                        nullptr);
+  g_source_attach(dispatchSource, dispatchCtx);
+}
+
+void CoreThread::connectEventDispatcher(
+    GMainContext* ctx,
+    function<void(shared_ptr<const Event>)> handler,
+    size_t maxBatch) {
+  disconnectEventDispatcher();
+  lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
+  pImpl->dispatchCtx = ctx;
+  pImpl->dispatchHandler = std::move(handler);
+  pImpl->dispatchBatch = max<size_t>(maxBatch, 1);
+  if (!pImpl->waitingEvents.empty()) {
+    pImpl->scheduleDispatchLocked(this);
+  }
+}
+
+void CoreThread::disconnectEventDispatcher() {
+  lock_guard<std::mutex> l(pImpl->waitingEventsMutex);
+  if (pImpl->dispatchSource) {
+    g_source_destroy(pImpl->dispatchSource);
+    g_source_unref(pImpl->dispatchSource);
+    pImpl->dispatchSource = nullptr;
+  }
+  pImpl->dispatchHandler = nullptr;
+  pImpl->dispatchCtx = nullptr;
 }
 
 enum CoreThreadErr CoreThread::getLastErr() const {
@@ -1,13 +1,20 @@
 #include "gtest/gtest.h"
 
 #include "iptux-core/Models.h"
+#include <cinttypes>
 #include <fstream>
 #include <mutex>
+#include <sstream>
 #include <thread>
 
+#include <glib/gstdio.h>
+#include <json/json.h>
+
 #include "iptux-core/CoreThread.h"
 #include "iptux-core/Exception.h"
 #include "iptux-core/TestHelper.h"
+#include "iptux-core/internal/RecvFileData.h"
+#include "iptux-core/internal/TransScheduler.h"
 #include "iptux-core/internal/ipmsg.h"
 #include "iptux-core/internal/support.h"
 #include "iptux-utils/output.h"
@@ -42,6 +49,31 @@ TEST(CoreThread, IsBlocked) {
   delete thread;
 }
 
+TEST(CoreThread, BlockEntries) {
+  auto config = newTestIptuxConfig();
+  auto core = make_shared<ProgramData>(config);
+  core->SetUsingBlacklist(true);
+  auto thread = make_unique<CoreThread>(core);
+  EXPECT_TRUE(thread->AddBlockEntry("10.1.0.0/16"));
+  EXPECT_FALSE(thread->AddBlockEntry("10.1.0.0/33"));
+  EXPECT_TRUE(thread->AddBlockEntry("1.2.3.4"));
+  thread->AddBlockIp(inAddrFromString("5.6.7.8"));
+  EXPECT_TRUE(thread->IsBlocked(inAddrFromString("5.6.7.8")));
+  EXPECT_TRUE(thread->IsBlocked(inAddrFromString("10.1.2.3")));
+  EXPECT_FALSE(thread->IsBlocked(inAddrFromString("10.2.0.0")));
+  EXPECT_EQ(thread->GetBlockEntries(),
+            vector<string>({"10.1.0.0/16", "1.2.3.4"}));
+
+  // saved to the config, and loaded by the next CoreThread
+  EXPECT_EQ(config->GetStringList("blacklist"), thread->GetBlockEntries());
+  EXPECT_TRUE(thread->DelBlockEntry("1.2.3.4"));
+  thread = make_unique<CoreThread>(core);
+  EXPECT_TRUE(thread->IsBlocked(inAddrFromString("10.1.2.3")));
+  EXPECT_FALSE(thread->IsBlocked(inAddrFromString("1.2.3.4")));
+  // AddBlockIp() only lasts for the session
+  EXPECT_FALSE(thread->IsBlocked(inAddrFromString("5.6.7.8")));
+}
+
 TEST(CoreThread, GetPalList) {
   auto config = newTestIptuxConfig();
   auto core = make_shared<ProgramData>(config);
@@ -59,6 +91,36 @@ TEST(CoreThread, GetPalList) {
   delete thread;
 }
 
+TEST(CoreThread, EventDispatcher) {
+  auto thread = newCoreThread();
+  auto ctx = g_main_context_new();
+  vector<EventType> handled;
+  thread->connectEventDispatcher(
+      ctx, [&](shared_ptr<const Event> e) { handled.push_back(e->getType()); },
+      2);
+
+  for (int i = 0; i < 5; ++i) {
+    thread->emitEvent(make_shared<ConfigChangedEvent>());
+  }
+  // one bounded batch per main loop iteration
+  g_main_context_iteration(ctx, FALSE);
+  EXPECT_EQ(handled.size(), 2u);
+  while (g_main_context_iteration(ctx, FALSE)) {
+  }
+  EXPECT_EQ(handled.size(), 5u);
+  EXPECT_FALSE(thread->HasEvent());
+
+  auto latency = thread->getEventQueueLatency();
+  EXPECT_EQ(latency[EventType::CONFIG_CHANGED].count, 5u);
+
+  thread->disconnectEventDispatcher();
+  thread->emitEvent(make_shared<ConfigChangedEvent>());
+  EXPECT_FALSE(g_main_context_iteration(ctx, FALSE));
+  EXPECT_EQ(handled.size(), 5u);
+  EXPECT_EQ(thread->PopEvents(10).size(), 1u);
+  g_main_context_unref(ctx);
+}
+
 TEST(CoreThread, SendMessage) {
   auto config = newTestIptuxConfig();
   auto core = make_shared<ProgramData>(config);
@@ -77,6 +139,92 @@ TEST(CoreThread, SendMessage) {
   delete thread;
 }
 
+TEST(CoreThread, SendMessage_NotAcked) {
+  using namespace std::chrono_literals;
+  auto config = newTestIptuxConfig();
+  auto core = make_shared<ProgramData>(config);
+  CoreThread* thread = new CoreThread(core);
+  auto pal = make_shared<PalInfo>("127.0.0.1", 2425);
+  thread->AttachPalToList(pal);
+
+  EXPECT_TRUE(thread->SendMessage(pal, "hello world"));
+  EXPECT_EQ(thread->getPendingAckCount(), 1u);
+  for (int i = 0; i < 200 && thread->getPendingAckCount() > 0; ++i) {
+    this_thread::sleep_for(10ms);
+  }
+  EXPECT_EQ(thread->getPendingAckCount(), 0u);
+
+  bool failed = false;
+  while (thread->HasEvent()) {
+    auto event = thread->PopEvent();
+    if (event->getType() == EventType::MESSAGE_FAILED) {
+      failed = true;
+    }
+  }
+  EXPECT_TRUE(failed);
+  delete thread;
+}
+
+TEST(CoreThread, DiscoveryScan) {
+  using namespace std::chrono_literals;
+  auto thread1 = newCoreThreadOnIp("127.0.0.1");
+  auto thread2 = newCoreThreadOnIp("127.0.0.2");
+  thread2->getProgramData()->setNetSegments(
+      {NetSegment("127.0.0.1", "127.0.0.1", "")});
+  ASSERT_TRUE(thread1->start());
+  ASSERT_TRUE(thread2->start());
+
+  thread2->StartDiscoveryScan();
+  for (int i = 0; i < 200 && thread1->GetOnlineCount() == 0; ++i) {
+    this_thread::sleep_for(10ms);
+  }
+  EXPECT_EQ(thread1->GetOnlineCount(), 1);
+
+  for (int i = 0; i < 200 && thread2->IsDiscoveryScanning(); ++i) {
+    this_thread::sleep_for(10ms);
+  }
+  shared_ptr<const DiscoveryFinishedEvent> finished;
+  while (thread2->HasEvent()) {
+    auto event = thread2->PopEvent();
+    if (event->getType() == EventType::DISCOVERY_FINISHED) {
+      finished = dynamic_pointer_cast<const DiscoveryFinishedEvent>(event);
+    }
+  }
+  ASSERT_TRUE(finished);
+  EXPECT_EQ(finished->GetStats().total, 1u);
+  EXPECT_EQ(finished->GetStats().sent, 1u);
+  thread2->stop();
+  thread1->stop();
+}
+
+TEST(CoreThread, DumpMetrics) {
+  using namespace std::chrono_literals;
+  auto thread1 = newCoreThreadOnIp("127.0.0.1");
+  auto thread2 = newCoreThreadOnIp("127.0.0.2");
+  ASSERT_TRUE(thread1->start());
+  ASSERT_TRUE(thread2->start());
+
+  thread2->SendDetectPacket("127.0.0.1");
+  for (int i = 0; i < 200 && thread1->GetOnlineCount() == 0; ++i) {
+    this_thread::sleep_for(10ms);
+  }
+  ASSERT_EQ(thread1->GetOnlineCount(), 1);
+
+  Json::Value root;
+  istringstream iss(thread1->DumpMetrics());
+  Json::CharReaderBuilder builder;
+  string errs;
+  ASSERT_TRUE(Json::parseFromStream(builder, iss, &root, &errs)) << errs;
+  EXPECT_GE(root["counters"]["udp.packets.BR_ENTRY"].asUInt64(), 1u);
+  EXPECT_GE(root["counters"]["udp.recv.received"].asUInt64(), 1u);
+  EXPECT_GE(root["counters"]["events.emitted"].asUInt64(), 1u);
+  EXPECT_GE(root["histograms"]["udp.process_us"]["count"].asUInt64(), 1u);
+  EXPECT_TRUE(root["gauges"].isMember("events.queue_depth"));
+  EXPECT_EQ(root["gauges"]["trans.tasks.active"].asUInt64(), 0u);
+  thread2->stop();
+  thread1->stop();
+}
+
 TEST(CoreThread, SendMessage_ChipData) {
   auto config = newTestIptuxConfig();
   auto core = make_shared<ProgramData>(config);
@@ -148,6 +296,16 @@ TEST(CoreThread, FullCase) {
   EXPECT_TRUE(thread2->GetPal("127.0.0.1"));
   EXPECT_EQ(thread1->GetOnlineCount(), 1);
   EXPECT_TRUE(thread1->GetPal("127.0.0.2"));
+  // 上线通告中带有所支持的扩展
+  EXPECT_TRUE(
+      thread2->GetPal("127.0.0.1")->hasFeature(IPTUX_FEATURE_SEGMENT));
+  EXPECT_TRUE(
+      thread2->GetPal("127.0.0.1")->hasFeature(IPTUX_FEATURE_COMPRESS));
+
+  auto udpStats = thread2->getUdpRecvStats();
+  EXPECT_GT(udpStats.received, 0u);
+  EXPECT_GT(udpStats.batches, 0u);
+  EXPECT_GE(udpStats.maxBatch, 1u);
 
   vector<shared_ptr<const Event>> thread2Events;
   mutex thread2EventsMutex;
@@ -270,6 +428,128 @@ TEST(CoreThread, PrivateFiles) {
   EXPECT_STREQ(file4->filepath, file3->filepath);
 }
 
+TEST(CoreThread, FileManifest) {
+  auto thread = newCoreThreadOnIp("127.0.0.1");
+  PalKey pal(inAddrFromString("127.0.0.2"), 2425);
+  thread->RegisterFileManifest(pal, 100, "manifest");
+  EXPECT_EQ(thread->GetFileManifest(pal.GetIpv4(), 100), "manifest");
+  // 只给收到那个包的好友
+  EXPECT_EQ(thread->GetFileManifest(inAddrFromString("127.0.0.3"), 100), "");
+  EXPECT_EQ(thread->GetFileManifest(pal.GetIpv4(), 101), "");
+
+  // 太多时丢掉最早的
+  for (uint32_t i = 0; i < 100; ++i) {
+    thread->RegisterFileManifest(pal, 200 + i, "manifest");
+  }
+  EXPECT_EQ(thread->GetFileManifest(pal.GetIpv4(), 100), "");
+  EXPECT_EQ(thread->GetFileManifest(pal.GetIpv4(), 299), "manifest");
+}
+
+TEST(CoreThread, ResumeTransTask) {
+  auto thread = newCoreThreadOnIp("127.0.0.1");
+  EXPECT_FALSE(thread->ResumeTransTask(1));
+}
+
+namespace {
+string readFile(const string& path) {
+  gchar* content = nullptr;
+  gsize len = 0;
+  if (!g_file_get_contents(path.c_str(), &content, &len, nullptr)) {
+    return "";
+  }
+  string res(content, len);
+  g_free(content);
+  return res;
+}
+}  // namespace
+
+TEST(CoreThread, ResumeDownload) {
+  auto config1 = IptuxConfig::newFromString("{}");
+  config1->SetString("bind_ip", "127.0.0.5");
+  auto config2 = IptuxConfig::newFromString("{}");
+  config2->SetString("bind_ip", "127.0.0.6");
+  auto threads = initAndConnnectThreadsFromConfig(config1, config2);
+  auto sender = get<0>(threads);
+  auto receiver = get<1>(threads);
+
+  gchar* tmp = g_dir_make_tmp("iptux-resume-XXXXXX", nullptr);
+  string dir(tmp);
+  g_free(tmp);
+  string content;
+  for (int i = 0; content.size() < 300000; ++i) {
+    content += to_string(i) + ",";
+  }
+  string src = dir + "/src.bin";
+  ASSERT_TRUE(g_file_set_contents(src.c_str(), content.data(), content.size(),
+                                  nullptr));
+  auto shared = make_shared<FileInfo>();
+  shared->fileid = MAX_SHAREDFILE + 10;
+  shared->fileattr = FileAttr::REGULAR;
+  shared->filepath = g_strdup(src.c_str());
+  shared->ensureFilesizeFilled();
+  sender->AddPrivateFile(shared);
+
+  // 上次接收了前面一部分, 填充为'x'以区分续传的数据和从头接收的数据
+  auto download = [&](CPPalInfo owner) {
+    string dst = dir + "/dst.bin";
+    string partial(100000, 'x');
+    g_file_set_contents(dst.c_str(), partial.data(), partial.size(), nullptr);
+    string marker = stringFormat("%s:%" PRIx32 ":%" PRIx32 ":%" PRIx64 "\n",
+                                 owner->GetKey().ToString().c_str(), 0,
+                                 shared->fileid, shared->filesize);
+    g_file_set_contents((dst + RESUME_MARKER_SUFFIX).c_str(), marker.c_str(),
+                        -1, nullptr);
+
+    FileInfo file;
+    file.fileid = shared->fileid;
+    file.fileattr = FileAttr::REGULAR;
+    file.filesize = shared->filesize;
+    file.fileown = owner;
+    file.filepath = g_strdup(dst.c_str());
+    receiver->RecvFile(&file);
+    EXPECT_FALSE(g_file_test((dst + RESUME_MARKER_SUFFIX).c_str(),
+                             G_FILE_TEST_EXISTS));
+    string res = readFile(dst);
+    g_unlink(dst.c_str());
+    return res;
+  };
+
+  auto owner = receiver->GetPal("127.0.0.5");
+  ASSERT_TRUE(owner->hasFeature(IPTUX_FEATURE_SEGMENT));
+  EXPECT_EQ(download(owner), string(100000, 'x') + content.substr(100000));
+
+  // 不支持偏移量的好友总是从头发送, 不能续传
+  auto legacy = make_shared<PalInfo>(*owner);
+  legacy->setFeatures(0);
+  EXPECT_EQ(download(legacy), content);
+
+  sender->DelPrivateFile(shared->fileid);
+  g_unlink(src.c_str());
+  g_rmdir(dir.c_str());
+  sender->stop();
+  receiver->stop();
+}
+
+TEST(CoreThread, PauseTransTask) {
+  auto thread = newCoreThreadOnIp("127.0.0.1");
+  EXPECT_FALSE(thread->PauseTransTask(1));
+  EXPECT_FALSE(thread->SetTransTaskPriority(1, 1));
+  EXPECT_EQ(thread->getTransScheduler().QueuedCount(), 0u);
+}
+
+TEST(CoreThread, UploadLimit) {
+  auto config = newTestIptuxConfig();
+  config->SetInt("tcp_worker_count", 4);
+  config->SetInt("trans_max_uploads", 0);
+  CoreThread thread(make_shared<ProgramData>(config));
+  // 上传占用TCP处理线程, 不能全部占满
+  EXPECT_EQ(thread.getTransScheduler().GetOptions().maxUploads, 3u);
+
+  config->SetInt("trans_max_uploads", 2);
+  CoreThread thread2(make_shared<ProgramData>(config));
+  EXPECT_EQ(thread2.getTransScheduler().GetOptions().maxUploads, 2u);
+}
+
 TEST(CoreThread, clearFinishedTransTasks) {
   auto thread = newCoreThreadOnIp("127.0.0.1");
   thread->clearFinishedTransTasks();
@@ -278,6 +558,8 @@ TEST(CoreThread, clearFinishedTransTasks) {
 TEST(CoreThread, TcpHandlerThreadCount) {
   auto thread = newCoreThreadOnIp("127.0.0.1");
   EXPECT_EQ(thread->getTcpHandlerThreadCount(), 0u);
+  EXPECT_EQ(thread->getTcpQueuedConnectionCount(), 0u);
+  EXPECT_EQ(thread->getTcpRejectedConnectionCount(), 0u);
 }
 
 TEST(CoreThread, TcpHandlerThreadCleanup) {
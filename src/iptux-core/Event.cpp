@@ -22,10 +22,14 @@ static const char* event_type_strs[] = {
     [(int)EventType::RECV_FILE_FINISHED] = "RECV_FILE_FINISHED",
     [(int)EventType::TRANS_TASKS_CHANGED] = "TRANS_TASKS_CHANGED",
     [(int)EventType::CONFIG_CHANGED] = "CONFIG_CHANGED",
+    [(int)EventType::MESSAGE_DELIVERED] = "MESSAGE_DELIVERED",
+    [(int)EventType::MESSAGE_FAILED] = "MESSAGE_FAILED",
+    [(int)EventType::DISCOVERY_PROGRESS] = "DISCOVERY_PROGRESS",
+    [(int)EventType::DISCOVERY_FINISHED] = "DISCOVERY_FINISHED",
 };
 
 const char* EventTypeToStr(EventType type) {
-  if (type < EventType::NEW_PAL_ONLINE || type > EventType::CONFIG_CHANGED) {
+  if (type < EventType::NEW_PAL_ONLINE || type > EventType::DISCOVERY_FINISHED) {
     return "UNKNOWN";
   }
   return event_type_strs[(int)type];
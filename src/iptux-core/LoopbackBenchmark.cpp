@@ -0,0 +1,349 @@
+// End-to-end benchmarks between two CoreThreads over loopback.
+//
+// Usage: loopback_benchmark [--json FILE]
+//
+// The results are printed as JSON on stdout (and written to FILE), so
+// they can be compared between releases.
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json/json.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "iptux-core/TestHelper.h"
+#include "iptux-core/internal/ipmsg.h"
+#include "iptux-utils/output.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace iptux;
+
+namespace {
+
+const int kRttSamples = 200;
+const int kThroughputMessages = 2000;
+const int64_t kLargeFileSize = 128 * 1024 * 1024;
+const int kSmallFileDirs = 20;
+const int kSmallFilesPerDir = 100;
+const int kSmallFileSize = 4096;
+const int kDiscoveryPeers = 200;
+const auto kTimeout = seconds(60);
+
+double secondsSince(steady_clock::time_point start) {
+  return duration<double>(steady_clock::now() - start).count();
+}
+
+// wait until cond() is true, false on timeout
+template <typename F>
+bool waitFor(F cond) {
+  auto deadline = steady_clock::now() + kTimeout;
+  while (!cond()) {
+    if (steady_clock::now() > deadline) {
+      return false;
+    }
+    this_thread::sleep_for(microseconds(200));
+  }
+  return true;
+}
+
+string makeTempDir() {
+  gchar* dir = g_dir_make_tmp("iptux-bench-XXXXXX", nullptr);
+  string res(dir);
+  g_free(dir);
+  return res;
+}
+
+void removeTree(const string& path) {
+  if (g_file_test(path.c_str(), G_FILE_TEST_IS_DIR)) {
+    GDir* dir = g_dir_open(path.c_str(), 0, nullptr);
+    const gchar* name;
+    while (dir && (name = g_dir_read_name(dir))) {
+      removeTree(path + "/" + name);
+    }
+    if (dir) {
+      g_dir_close(dir);
+    }
+  }
+  g_remove(path.c_str());
+}
+
+int64_t treeSize(const string& path) {
+  GStatBuf st;
+  if (g_stat(path.c_str(), &st) != 0) {
+    return -1;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return st.st_size;
+  }
+  int64_t size = 0;
+  GDir* dir = g_dir_open(path.c_str(), 0, nullptr);
+  const gchar* name;
+  while (dir && (name = g_dir_read_name(dir))) {
+    size += treeSize(path + "/" + name);
+  }
+  if (dir) {
+    g_dir_close(dir);
+  }
+  return size;
+}
+
+Json::Value summarize(vector<double> samples) {
+  Json::Value res;
+  sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (double s : samples) {
+    sum += s;
+  }
+  res["count"] = Json::UInt64(samples.size());
+  if (!samples.empty()) {
+    res["mean"] = sum / samples.size();
+    res["p50"] = samples[samples.size() / 2];
+    res["p99"] = samples[samples.size() * 99 / 100];
+    res["max"] = samples.back();
+  }
+  return res;
+}
+
+/**
+ * counts the MESSAGE_DELIVERED events of a CoreThread
+ */
+struct AckCounter {
+  atomic<int> delivered{0};
+  atomic<int> failed{0};
+  sigc::connection connection;
+
+  explicit AckCounter(CoreThread& thread) {
+    connection =
+        thread.signalEvent.connect([this](shared_ptr<const Event> event) {
+          if (event->getType() == EventType::MESSAGE_DELIVERED) {
+            delivered++;
+          } else if (event->getType() == EventType::MESSAGE_FAILED) {
+            failed++;
+          }
+        });
+  }
+  // later events must not reach a destroyed counter
+  ~AckCounter() { connection.disconnect(); }
+};
+
+Json::Value benchMessageRtt(CoreThread& sender, PPalInfo pal) {
+  AckCounter acks(sender);
+  vector<double> samples;
+  for (int i = 0; i < kRttSamples; ++i) {
+    auto start = steady_clock::now();
+    sender.SendMessage(pal, "ping");
+    if (!waitFor([&] { return acks.delivered + acks.failed > i; })) {
+      break;
+    }
+    samples.push_back(secondsSince(start) * 1e6);
+  }
+  Json::Value res = summarize(samples);
+  res["unit"] = "us";
+  res["failed"] = acks.failed.load();
+  return res;
+}
+
+Json::Value benchMessageThroughput(CoreThread& sender, PPalInfo pal) {
+  AckCounter acks(sender);
+  auto start = steady_clock::now();
+  for (int i = 0; i < kThroughputMessages; ++i) {
+    sender.SendMessage(pal, "hello world");
+  }
+  waitFor([&] { return acks.delivered + acks.failed >= kThroughputMessages; });
+  double elapsed = secondsSince(start);
+
+  Json::Value res;
+  res["messages"] = kThroughputMessages;
+  res["delivered"] = acks.delivered.load();
+  res["seconds"] = elapsed;
+  res["messages_per_sec"] = acks.delivered / elapsed;
+  return res;
+}
+
+/**
+ * shares path on sender, then receiver downloads it to destDir
+ */
+Json::Value benchTransfer(CoreThread& sender,
+                          CoreThread& receiver,
+                          const string& path,
+                          FileAttr attr,
+                          const string& destDir,
+                          int files) {
+  static uint32_t nextFileId = MAX_SHAREDFILE + 1;
+
+  auto shared = make_shared<FileInfo>();
+  shared->fileid = nextFileId++;
+  shared->fileattr = attr;
+  shared->filepath = g_strdup(path.c_str());
+  shared->ensureFilesizeFilled();
+  sender.AddPrivateFile(shared);
+
+  FileInfo file;
+  file.fileid = shared->fileid;
+  file.fileattr = attr;
+  file.filesize = shared->filesize;
+  file.fileown = receiver.GetPal(inAddrToString(sender.getMe()->ipv4()));
+  gchar* name = g_path_get_basename(path.c_str());
+  file.filepath = g_strdup_printf("%s/%s", destDir.c_str(), name);
+  g_free(name);
+
+  auto start = steady_clock::now();
+  receiver.RecvFile(&file);
+  double elapsed = secondsSince(start);
+  int64_t bytes = treeSize(file.filepath);
+  sender.DelPrivateFile(shared->fileid);
+
+  Json::Value res;
+  res["files"] = files;
+  res["bytes"] = Json::Int64(bytes);
+  res["expected_bytes"] = Json::Int64(treeSize(path));
+  res["seconds"] = elapsed;
+  res["mb_per_sec"] = bytes / 1048576.0 / elapsed;
+  res["files_per_sec"] = files / elapsed;
+  return res;
+}
+
+Json::Value benchLargeFile(CoreThread& sender, CoreThread& receiver) {
+  string src = makeTempDir(), dst = makeTempDir();
+  string path = src + "/large.bin";
+  {
+    ofstream ofs(path, ios::binary);
+    vector<char> chunk(1024 * 1024);
+    for (size_t i = 0; i < chunk.size(); ++i) {
+      chunk[i] = char(i * 31);
+    }
+    for (int64_t n = 0; n < kLargeFileSize; n += chunk.size()) {
+      ofs.write(chunk.data(), chunk.size());
+    }
+  }
+  auto res = benchTransfer(sender, receiver, path, FileAttr::REGULAR, dst, 1);
+  removeTree(src);
+  removeTree(dst);
+  return res;
+}
+
+Json::Value benchSmallFiles(CoreThread& sender, CoreThread& receiver) {
+  string src = makeTempDir(), dst = makeTempDir();
+  string root = src + "/tree";
+  string content(kSmallFileSize, 'x');
+  g_mkdir(root.c_str(), 0755);
+  for (int d = 0; d < kSmallFileDirs; ++d) {
+    string dir = root + "/dir" + to_string(d);
+    g_mkdir(dir.c_str(), 0755);
+    for (int f = 0; f < kSmallFilesPerDir; ++f) {
+      string file = dir + "/file" + to_string(f);
+      g_file_set_contents(file.c_str(), content.data(), content.size(),
+                          nullptr);
+    }
+  }
+  auto res = benchTransfer(sender, receiver, root, FileAttr::DIRECTORY, dst,
+                           kSmallFileDirs * kSmallFilesPerDir);
+  removeTree(src);
+  removeTree(dst);
+  return res;
+}
+
+/**
+ * N peers on 127.0.1.x announce themselves (IPMSG_BR_ENTRY) at once
+ */
+Json::Value benchDiscovery(CoreThread& thread) {
+  vector<int> socks;
+  int base = thread.GetOnlineCount();
+  auto start = steady_clock::now();
+  for (int i = 0; i < kDiscoveryPeers; ++i) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(thread.port());
+    addr.sin_addr.s_addr = htonl(0x7f000100u + 1 + i / 250 * 256 + i % 250);
+    if (sock == -1 ||
+        bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+      perror("bind simulated peer");
+      if (sock != -1) {
+        close(sock);
+      }
+      break;
+    }
+    socks.push_back(sock);
+
+    char packet[MAX_UDPLEN];
+    int size = snprintf(packet, sizeof(packet),
+                        "1_iptux 0.10.0:%d:bench:peer%d:%lu:peer%d", i + 1, i,
+                        IPMSG_BR_ENTRY, i) +
+               1;
+    addr.sin_addr = thread.getMe()->ipv4();
+    sendto(sock, packet, size, 0, (struct sockaddr*)&addr, sizeof(addr));
+  }
+  int peers = socks.size();
+  bool ok = waitFor([&] { return thread.GetOnlineCount() >= base + peers; });
+  double elapsed = secondsSince(start);
+  for (int sock : socks) {
+    close(sock);
+  }
+
+  Json::Value res;
+  res["peers"] = peers;
+  res["discovered"] = thread.GetOnlineCount() - base;
+  res["completed"] = ok;
+  res["seconds"] = elapsed;
+  return res;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  string jsonPath;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      jsonPath = argv[++i];
+    }
+  }
+  Log::setLogLevel(LogLevel::WARN);
+
+  auto config1 = IptuxConfig::newFromString("{}");
+  config1->SetString("bind_ip", "127.0.0.1");
+  auto config2 = IptuxConfig::newFromString("{}");
+  config2->SetString("bind_ip", "127.0.0.2");
+  auto threads = initAndConnnectThreadsFromConfig(config1, config2);
+  auto thread1 = get<0>(threads);
+  auto thread2 = get<1>(threads);
+  auto pal2InThread1 = thread1->GetPal("127.0.0.2");
+
+  Json::Value root;
+  root["version"] = VERSION;
+  root["timestamp"] = Json::Int64(g_get_real_time() / G_USEC_PER_SEC);
+  Json::Value& results = root["results"];
+  results["message_rtt"] = benchMessageRtt(*thread1, pal2InThread1);
+  results["message_throughput"] =
+      benchMessageThroughput(*thread1, pal2InThread1);
+  // loopback connections come from 127.0.0.1, so 127.0.0.2 serves the files
+  results["transfer_large_file"] = benchLargeFile(*thread2, *thread1);
+  results["transfer_small_files"] = benchSmallFiles(*thread2, *thread1);
+  results["discovery"] = benchDiscovery(*thread1);
+
+  thread1->stop();
+  thread2->stop();
+
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "  ";
+  string json = Json::writeString(builder, root);
+  cout << json << endl;
+  if (!jsonPath.empty()) {
+    ofstream(jsonPath) << json << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include "config.h"
+#include "iptux-core/Metrics.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+int bucketOf(uint64_t value) {
+  int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+  return bucket < Histogram::kBuckets ? bucket : Histogram::kBuckets - 1;
+}
+
+template <typename T>
+T& getOrCreate(map<string, unique_ptr<T>>& metrics, const string& name) {
+  auto& metric = metrics[name];
+  if (!metric) {
+    metric = make_unique<T>();
+  }
+  return *metric;
+}
+}  // namespace
+
+void Histogram::Observe(uint64_t value) {
+  count.fetch_add(1, memory_order_relaxed);
+  sum.fetch_add(value, memory_order_relaxed);
+  buckets[bucketOf(value)].fetch_add(1, memory_order_relaxed);
+  uint64_t old = max.load(memory_order_relaxed);
+  while (value > old &&
+         !max.compare_exchange_weak(old, value, memory_order_relaxed)) {
+  }
+}
+
+Histogram::Snapshot Histogram::Get() const {
+  Snapshot snapshot;
+  snapshot.count = count.load(memory_order_relaxed);
+  snapshot.sum = sum.load(memory_order_relaxed);
+  snapshot.max = max.load(memory_order_relaxed);
+  for (int i = 0; i < kBuckets; ++i) {
+    snapshot.buckets[i] = buckets[i].load(memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+uint64_t Histogram::Snapshot::Percentile(double p) const {
+  /* 各字段分别读取, 以桶内计数为准 */
+  uint64_t total = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    total += buckets[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = uint64_t(p * (total - 1)) + 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      uint64_t upper = i == 0 ? 0 : (uint64_t(1) << i) - 1;
+      return upper < max ? upper : max;
+    }
+  }
+  return max;
+}
+
+Counter& MetricsRegistry::GetCounter(const string& name) {
+  lock_guard<std::mutex> l(mutex);
+  return getOrCreate(counters, name);
+}
+
+Gauge& MetricsRegistry::GetGauge(const string& name) {
+  lock_guard<std::mutex> l(mutex);
+  return getOrCreate(gauges, name);
+}
+
+Histogram& MetricsRegistry::GetHistogram(const string& name) {
+  lock_guard<std::mutex> l(mutex);
+  return getOrCreate(histograms, name);
+}
+
+Json::Value MetricsRegistry::ToJson() const {
+  Json::Value res(Json::objectValue);
+  res["counters"] = Json::Value(Json::objectValue);
+  res["gauges"] = Json::Value(Json::objectValue);
+  res["histograms"] = Json::Value(Json::objectValue);
+
+  lock_guard<std::mutex> l(mutex);
+  for (auto& it : counters) {
+    res["counters"][it.first] = Json::UInt64(it.second->Get());
+  }
+  for (auto& it : gauges) {
+    res["gauges"][it.first] = Json::Int64(it.second->Get());
+  }
+  for (auto& it : histograms) {
+    auto snapshot = it.second->Get();
+    Json::Value value(Json::objectValue);
+    value["count"] = Json::UInt64(snapshot.count);
+    value["sum"] = Json::UInt64(snapshot.sum);
+    value["max"] = Json::UInt64(snapshot.max);
+    value["p50"] = Json::UInt64(snapshot.Percentile(0.5));
+    value["p90"] = Json::UInt64(snapshot.Percentile(0.9));
+    value["p99"] = Json::UInt64(snapshot.Percentile(0.99));
+    res["histograms"][it.first] = value;
+  }
+  return res;
+}
+
+}  // namespace iptux
@@ -0,0 +1,81 @@
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+#include "iptux-core/Metrics.h"
+
+using namespace std;
+using namespace iptux;
+
+TEST(Metrics, CounterAndGauge) {
+  MetricsRegistry registry;
+  auto& counter = registry.GetCounter("a");
+  counter.Inc();
+  counter.Inc(4);
+  EXPECT_EQ(&registry.GetCounter("a"), &counter);
+  EXPECT_EQ(registry.GetCounter("a").Get(), 5u);
+
+  auto& gauge = registry.GetGauge("b");
+  gauge.Set(10);
+  gauge.Add(-3);
+  EXPECT_EQ(gauge.Get(), 7);
+}
+
+TEST(Metrics, HistogramPercentile) {
+  Histogram histogram;
+  EXPECT_EQ(histogram.Get().Percentile(0.5), 0u);
+
+  for (uint64_t i = 1; i <= 100; ++i) {
+    histogram.Observe(i);
+  }
+  auto snapshot = histogram.Get();
+  EXPECT_EQ(snapshot.count, 100u);
+  EXPECT_EQ(snapshot.sum, 5050u);
+  EXPECT_EQ(snapshot.max, 100u);
+  // 50 falls in [32, 64), 99 in [64, 128) capped by max
+  EXPECT_EQ(snapshot.Percentile(0.5), 63u);
+  EXPECT_EQ(snapshot.Percentile(0.99), 100u);
+  EXPECT_EQ(snapshot.Percentile(0), 1u);
+
+  Histogram zero;
+  zero.Observe(0);
+  EXPECT_EQ(zero.Get().Percentile(1), 0u);
+}
+
+TEST(Metrics, ToJson) {
+  MetricsRegistry registry;
+  registry.GetCounter("udp.packets.SENDMSG").Inc(3);
+  registry.GetGauge("trans.tasks.active").Set(2);
+  registry.GetHistogram("udp.process_us").Observe(8);
+
+  auto json = registry.ToJson();
+  EXPECT_EQ(json["counters"]["udp.packets.SENDMSG"].asUInt64(), 3u);
+  EXPECT_EQ(json["gauges"]["trans.tasks.active"].asInt64(), 2);
+  auto& histogram = json["histograms"]["udp.process_us"];
+  EXPECT_EQ(histogram["count"].asUInt64(), 1u);
+  EXPECT_EQ(histogram["max"].asUInt64(), 8u);
+  EXPECT_EQ(histogram["p99"].asUInt64(), 8u);
+}
+
+TEST(Metrics, Concurrent) {
+  MetricsRegistry registry;
+  vector<thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&registry] {
+      auto& counter = registry.GetCounter("c");
+      auto& histogram = registry.GetHistogram("h");
+      for (int j = 0; j < 10000; ++j) {
+        counter.Inc();
+        histogram.Observe(j);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(registry.GetCounter("c").Get(), 40000u);
+  auto snapshot = registry.GetHistogram("h").Get();
+  EXPECT_EQ(snapshot.count, 40000u);
+  EXPECT_EQ(snapshot.max, 9999u);
+}
@@ -14,6 +14,7 @@
 
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
+#include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sstream>
 #include <unistd.h>
@@ -27,7 +28,12 @@ using namespace std;
 namespace iptux {
 
 PalInfo::PalInfo(in_addr ipv4, uint16_t port)
-    : segdes(NULL), photo(NULL), sign(NULL), packetn(0), rpacketn(0) {
+    : segdes(NULL),
+      photo(NULL),
+      sign(NULL),
+      packetn(0),
+      rpacketn(0),
+      features(0) {
   this->ipv4_ = ipv4;
   this->port_ = port;
   compatible = 0;
@@ -37,7 +43,12 @@ PalInfo::PalInfo(in_addr ipv4, uint16_t port)
 }
 
 PalInfo::PalInfo(const string& ipv4, uint16_t port)
-    : segdes(NULL), photo(NULL), sign(NULL), packetn(0), rpacketn(0) {
+    : segdes(NULL),
+      photo(NULL),
+      sign(NULL),
+      packetn(0),
+      rpacketn(0),
+      features(0) {
   this->ipv4_ = inAddrFromString(ipv4);
   this->port_ = port;
   compatible = 0;
@@ -94,6 +105,11 @@ PalInfo& PalInfo::setHost(const std::string& host) {
   return *this;
 }
 
+PalInfo& PalInfo::setFeatures(uint32_t features) {
+  this->features = features;
+  return *this;
+}
+
 PalInfo& PalInfo::setVersion(const std::string& version) {
   this->version = utf8MakeValid(version);
   return *this;
@@ -183,28 +199,53 @@ ChipData::~ChipData() {}
 NetSegment::NetSegment() {}
 
 NetSegment::NetSegment(string startip, string endip, string description)
-    : startip(startip), endip(endip), description(description) {}
+    : description(description) {
+  setStartIp(startip);
+  setEndIp(endip);
+}
 
 NetSegment::~NetSegment() {}
 
+namespace {
+bool parseIpv4(const string& ip, uint32_t& value) {
+  in_addr ipv4;
+  if (inet_pton(AF_INET, ip.c_str(), &ipv4) != 1) {
+    return false;
+  }
+  value = inAddrToUint32(ipv4);
+  return true;
+}
+}  // namespace
+
+void NetSegment::setStartIp(const string& ip) {
+  startip = ip;
+  startValid = parseIpv4(ip, start);
+}
+
+void NetSegment::setEndIp(const string& ip) {
+  endip = ip;
+  endValid = parseIpv4(ip, end);
+}
+
+bool NetSegment::IsValid() const {
+  return startValid && endValid && start <= end;
+}
+
 uint64_t NetSegment::Count() const {
-  uint32_t start = inAddrToUint32(inAddrFromString(startip));
-  uint32_t end = inAddrToUint32(inAddrFromString(endip));
-  if (start > end) {
+  if (!IsValid()) {
     return 0;
   }
   return uint64_t(end) - uint64_t(start) + 1;
 }
 
 std::string NetSegment::NthIp(uint64_t i) const {
-  uint32_t start = inAddrToUint32(inAddrFromString(startip));
   uint64_t res = start + i;
   return inAddrToString(inAddrFromUint32(res));
 }
 
 bool NetSegment::ContainIP(in_addr ipv4) const {
-  return ipv4Compare(inAddrFromString(startip), ipv4) <= 0 &&
-         ipv4Compare(ipv4, inAddrFromString(endip)) <= 0;
+  uint32_t ip = inAddrToUint32(ipv4);
+  return IsValid() && start <= ip && ip <= end;
 }
 
 Json::Value NetSegment::ToJsonValue() const {
@@ -216,11 +257,8 @@ Json::Value NetSegment::ToJsonValue() const {
 }
 
 NetSegment NetSegment::fromJsonValue(Json::Value& value) {
-  NetSegment res;
-  res.startip = value["startip"].asString();
-  res.endip = value["endip"].asString();
-  res.description = value["description"].asString();
-  return res;
+  return NetSegment(value["startip"].asString(), value["endip"].asString(),
+                    value["description"].asString());
 }
 
 string ChipData::ToString() const {
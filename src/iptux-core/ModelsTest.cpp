@@ -12,6 +12,16 @@ TEST(PalInfo, GetKey) {
   ASSERT_EQ(info.GetKey().ToString(), "127.0.0.1:2425");
 }
 
+TEST(PalInfo, Features) {
+  PalInfo info("127.0.0.1", 2425);
+  EXPECT_FALSE(info.hasFeature(1));
+  info.setFeatures(0x5);
+  EXPECT_EQ(info.getFeatures(), 0x5u);
+  EXPECT_TRUE(info.hasFeature(1));
+  EXPECT_FALSE(info.hasFeature(2));
+  EXPECT_TRUE(info.hasFeature(4));
+}
+
 TEST(PalKey, CopyConstructor) {
   PalKey key1(inAddrFromString("1.2.3.4"), 1234);
   PalKey key2 = key1;
@@ -49,6 +59,29 @@ TEST(NetSegment, ContainIP) {
   }
 }
 
+TEST(NetSegment, Bounds) {
+  NetSegment netSegment("1.2.3.4", "1.2.4.5", "");
+  EXPECT_TRUE(netSegment.IsValid());
+  EXPECT_EQ(netSegment.getStart(), inAddrToUint32(inAddrFromString("1.2.3.4")));
+  EXPECT_EQ(netSegment.Count(), 258u);
+  EXPECT_EQ(netSegment.NthIp(257), "1.2.4.5");
+
+  netSegment.setEndIp("1.2.3.4");
+  EXPECT_EQ(netSegment.Count(), 1u);
+  EXPECT_TRUE(netSegment.ContainIP(inAddrFromString("1.2.3.4")));
+  EXPECT_FALSE(netSegment.ContainIP(inAddrFromString("1.2.3.5")));
+
+  netSegment.setEndIp("1.2.3.3");
+  EXPECT_FALSE(netSegment.IsValid());
+  EXPECT_EQ(netSegment.Count(), 0u);
+
+  netSegment.setEndIp("not an ip");
+  EXPECT_EQ(netSegment.getEndIp(), "not an ip");
+  EXPECT_FALSE(netSegment.IsValid());
+  EXPECT_EQ(netSegment.Count(), 0u);
+  EXPECT_FALSE(netSegment.ContainIP(inAddrFromString("1.2.3.4")));
+}
+
 TEST(ChipData, ToString) {
   EXPECT_EQ(ChipData("").ToString(), "ChipData(MessageContentType::STRING, )");
 }
@@ -1,9 +1,14 @@
 #include "config.h"
 #include "iptux-core/ProgramData.h"
 
+#include <algorithm>
+#include <set>
+
 #include <sys/stat.h>
 #include <sys/time.h>
 
+#include "Const.h"
+#include "iptux-core/internal/ShareCatalog.h"
 #include "iptux-core/internal/ipmsg.h"
 #include "iptux-utils/output.h"
 #include "iptux-utils/utils.h"
@@ -18,7 +23,12 @@ static const char* CONFIG_SHARED_FILE_LIST = "shared_file_list";
  * 类构造函数.
  */
 ProgramData::ProgramData(shared_ptr<IptuxConfig> config)
-    : palicon(NULL), font(NULL), config(config), need_restart_(0) {
+    : palicon(NULL),
+      font(NULL),
+      config(config),
+      shareCatalog(make_unique<ShareCatalog>(config->GetInt(
+          "share_rescan_interval", DEFAULT_SHARE_RESCAN_INTERVAL))),
+      need_restart_(0) {
   gettimeofday(&timestamp, NULL);
   InitSublayer();
 }
@@ -87,7 +97,8 @@ const std::vector<NetSegment>& ProgramData::getNetSegments() const {
 }
 
 void ProgramData::setNetSegments(std::vector<NetSegment>&& netSegments) {
-  netseg = netSegments;
+  netseg = std::move(netSegments);
+  IndexNetSegments();
 }
 
 void ProgramData::set_port(uint16_t port, bool is_init) {
@@ -111,12 +122,64 @@ void ProgramData::set_port(uint16_t port, bool is_init) {
  * @return 描述串
  */
 string ProgramData::FindNetSegDescription(in_addr ipv4) const {
+  uint32_t ip = inAddrToUint32(ipv4);
+  auto it = upper_bound(
+      netsegIndex.begin(), netsegIndex.end(), ip,
+      [](uint32_t value, const NetSegmentRange& range) {
+        return value < range.first;
+      });
+  if (it == netsegIndex.begin() || ip > (--it)->last) {
+    return "";
+  }
+  return netseg[it->segment].description;
+}
+
+/**
+ * 重建网段索引.
+ * 将各网段切分为互不相交的区间, 重叠部分归属配置中靠前的网段.
+ */
+void ProgramData::IndexNetSegments() {
+  /* (位置, 网段下标), 网段在start处开始, 在end+1处结束 */
+  vector<pair<uint64_t, size_t>> starts, ends;
   for (size_t i = 0; i < netseg.size(); ++i) {
-    if (netseg[i].ContainIP(ipv4)) {
-      return netseg[i].description;
+    if (netseg[i].IsValid()) {
+      starts.emplace_back(netseg[i].getStart(), i);
+      ends.emplace_back(uint64_t(netseg[i].getEnd()) + 1, i);
+    }
+  }
+  sort(starts.begin(), starts.end());
+  sort(ends.begin(), ends.end());
+
+  netsegIndex.clear();
+  set<size_t> active;
+  size_t si = 0, ei = 0;
+  while (si < starts.size() || ei < ends.size()) {
+    uint64_t pos = si < starts.size() ? starts[si].first : UINT64_MAX;
+    if (ei < ends.size()) {
+      pos = min(pos, ends[ei].first);
+    }
+    for (; ei < ends.size() && ends[ei].first == pos; ++ei) {
+      active.erase(ends[ei].second);
+    }
+    for (; si < starts.size() && starts[si].first == pos; ++si) {
+      active.insert(starts[si].second);
+    }
+    if (active.empty()) {
+      continue;
+    }
+    /* 区间延续到下一个端点之前 */
+    uint64_t next = si < starts.size() ? starts[si].first : UINT64_MAX;
+    if (ei < ends.size()) {
+      next = min(next, ends[ei].first);
+    }
+    size_t segment = *active.begin();
+    if (!netsegIndex.empty() && netsegIndex.back().segment == segment &&
+        uint64_t(netsegIndex.back().last) + 1 == pos) {
+      netsegIndex.back().last = next - 1;
+    } else {
+      netsegIndex.push_back({uint32_t(pos), uint32_t(next - 1), segment});
     }
   }
-  return "";
 }
 
 /**
@@ -177,6 +240,7 @@ void ProgramData::ReadProgData() {
     fileInfo.filepath = strdup(sharedFileList[i].c_str());
     sharedFileInfos.emplace_back(fileInfo);
   }
+  shareCatalog->Reset(sharedFileInfos);
 }
 
 /**
@@ -202,6 +266,7 @@ void ProgramData::ReadNetSegment() {
   for (size_t i = 0; i < values.size(); ++i) {
     netseg.push_back(NetSegment::fromJsonValue(values[i]));
   }
+  IndexNetSegments();
 }
 
 void ProgramData::Lock() {
@@ -261,28 +326,22 @@ ProgramData& ProgramData::SetUsingBlacklist(bool value) {
 }
 
 FileInfo* ProgramData::GetShareFileInfo(uint32_t fileId) {
-  for (const FileInfo& fileInfo : sharedFileInfos) {
-    if (fileInfo.fileid == fileId) {
-      return new FileInfo(fileInfo);
-    }
-  }
-  return nullptr;
+  auto file = shareCatalog->Get()->FindById(fileId);
+  return file ? new FileInfo(*file) : nullptr;
 }
 
 FileInfo* ProgramData::GetShareFileInfo(uint32_t packetn, uint32_t filenum) {
-  for (const FileInfo& fileInfo : sharedFileInfos) {
-    if (fileInfo.packetn == packetn && fileInfo.filenum == filenum) {
-      return new FileInfo(fileInfo);
-    }
-  }
-  return nullptr;
+  auto file = shareCatalog->Get()->FindByPacket(packetn, filenum);
+  return file ? new FileInfo(*file) : nullptr;
 }
 
 void ProgramData::ClearShareFileInfos() {
   sharedFileInfos.clear();
+  shareCatalog->Clear();
 }
 
 void ProgramData::AddShareFileInfo(FileInfo fileInfo) {
+  shareCatalog->Add(fileInfo);
   sharedFileInfos.emplace_back(std::move(fileInfo));
 }
 
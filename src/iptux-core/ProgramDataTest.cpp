@@ -4,6 +4,7 @@
 
 #include "iptux-core/ProgramData.h"
 #include "iptux-core/TestHelper.h"
+#include "iptux-utils/utils.h"
 
 using namespace std;
 using namespace iptux;
@@ -22,8 +23,8 @@ TEST(ProgramData, WriteAndRead) {
   auto config = newTestIptuxConfigWithFile();
   ProgramData* core = new ProgramData(config);
   NetSegment netSegment;
-  netSegment.startip = "1.2.3.4";
-  netSegment.endip = "1.2.3.5";
+  netSegment.setStartIp("1.2.3.4");
+  netSegment.setEndIp("1.2.3.5");
   netSegment.description = "foobar";
   core->setNetSegments(vector<NetSegment>(1, netSegment));
   core->WriteProgData();
@@ -32,8 +33,10 @@ TEST(ProgramData, WriteAndRead) {
   auto config2 = make_shared<IptuxConfig>(config->getFileName());
   ProgramData* core2 = new ProgramData(config2);
   ASSERT_EQ(int(core2->getNetSegments().size()), 1);
-  ASSERT_EQ(core2->getNetSegments()[0].startip, "1.2.3.4");
-  ASSERT_EQ(core2->getNetSegments()[0].endip, "1.2.3.5");
+  ASSERT_EQ(core2->getNetSegments()[0].getStartIp(), "1.2.3.4");
+  ASSERT_EQ(core2->getNetSegments()[0].getEndIp(), "1.2.3.5");
+  ASSERT_EQ(core2->FindNetSegDescription(inAddrFromString("1.2.3.5")),
+            "foobar");
   ASSERT_EQ(core2->getNetSegments()[0].description, "foobar");
   ASSERT_TRUE(core2->IsSaveChatHistory());
   ASSERT_FALSE(core2->IsUsingBlacklist());
@@ -42,3 +45,37 @@ TEST(ProgramData, WriteAndRead) {
 
   g_unlink(config->getFileName().c_str());
 }
+
+TEST(ProgramData, FindNetSegDescription) {
+  ProgramData core(newTestIptuxConfig());
+  auto find = [&](const char* ip) {
+    return core.FindNetSegDescription(inAddrFromString(ip));
+  };
+  EXPECT_EQ(find("10.0.0.1"), "");
+
+  core.setNetSegments({
+      NetSegment("10.0.1.0", "10.0.1.255", "b"),
+      NetSegment("10.0.0.0", "10.0.3.255", "a"),
+      NetSegment("10.0.2.0", "10.0.2.255", "c"),
+      NetSegment("10.0.9.9", "10.0.9.1", "reversed"),
+      NetSegment("bad", "10.0.9.9", "invalid"),
+      NetSegment("255.255.255.0", "255.255.255.255", "last"),
+      NetSegment("0.0.0.0", "0.0.0.0", "first"),
+  });
+  // overlapping segments: the first configured one wins
+  EXPECT_EQ(find("10.0.0.0"), "a");
+  EXPECT_EQ(find("10.0.0.255"), "a");
+  EXPECT_EQ(find("10.0.1.0"), "b");
+  EXPECT_EQ(find("10.0.1.255"), "b");
+  EXPECT_EQ(find("10.0.2.0"), "a");
+  EXPECT_EQ(find("10.0.3.255"), "a");
+  EXPECT_EQ(find("10.0.4.0"), "");
+  EXPECT_EQ(find("9.255.255.255"), "");
+  EXPECT_EQ(find("10.0.9.5"), "");
+  EXPECT_EQ(find("255.255.255.255"), "last");
+  EXPECT_EQ(find("0.0.0.0"), "first");
+  EXPECT_EQ(find("0.0.0.1"), "");
+
+  core.setNetSegments({});
+  EXPECT_EQ(find("10.0.0.0"), "");
+}
@@ -7,7 +7,11 @@
 namespace iptux {
 
 TransFileModel::TransFileModel()
-    : fileLength(0), finishedLength(0), finished(false) {}
+    : fileLength(0),
+      finishedLength(0),
+      finished(false),
+      queued(false),
+      paused(false) {}
 
 TransFileModel& TransFileModel::setStatus(const std::string& value) {
   status = value;
@@ -69,6 +73,16 @@ TransFileModel& TransFileModel::setTaskId(int taskId) {
   return *this;
 }
 
+TransFileModel& TransFileModel::setQueued(bool value) {
+  queued = value;
+  return *this;
+}
+
+TransFileModel& TransFileModel::setPaused(bool value) {
+  paused = value;
+  return *this;
+}
+
 void TransFileModel::finish() {
   finished = true;
 }
@@ -145,6 +159,14 @@ bool TransFileModel::isFinished() const {
   return finished;
 }
 
+bool TransFileModel::isQueued() const {
+  return queued;
+}
+
+bool TransFileModel::isPaused() const {
+  return paused;
+}
+
 int TransFileModel::getTaskId() const {
   return taskId;
 }
@@ -0,0 +1,174 @@
+#include "config.h"
+#include "AckTracker.h"
+
+#include <algorithm>
+
+#include "iptux-utils/output.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace iptux {
+
+namespace {
+const size_t WHEEL_SLOTS = 64;
+// the retry interval grows up to this multiple of the initial one
+const int MAX_BACKOFF = 4;
+}  // namespace
+
+AckTracker::AckTracker(milliseconds retryInterval,
+                       int maxAttempts,
+                       Sender sender,
+                       Completion completion)
+    : maxAttempts(max(maxAttempts, 1)),
+      sender(std::move(sender)),
+      completion(std::move(completion)),
+      wheel(WHEEL_SLOTS) {
+  SetRetryInterval(retryInterval);
+  timer = thread(&AckTracker::timerLoop, this);
+}
+
+AckTracker::~AckTracker() {
+  Stop();
+}
+
+bool AckTracker::Track(const PalKey& pal, uint32_t packetno, string packet) {
+  {
+    lock_guard<std::mutex> l(mutex);
+    if (stopping) {
+      return false;
+    }
+    bool wasIdle = pending.empty();
+    Key key = keyOf(pal, packetno);
+    pending.erase(key);
+    auto it =
+        pending
+            .emplace(key, Pending{pal, packet, nextSeq++, 1, retryInterval, 0})
+            .first;
+    scheduleLocked(key, it->second);
+    if (wasIdle) {
+      cond.notify_all();
+    }
+  }
+  sender(pal, packet);
+  return true;
+}
+
+bool AckTracker::Ack(const PalKey& pal, uint32_t packetno) {
+  {
+    lock_guard<std::mutex> l(mutex);
+    auto it = pending.find(keyOf(pal, packetno));
+    if (it == pending.end()) {
+      return false;
+    }
+    LOG_DEBUG("packet %u acked by %s after %d send(s)", packetno,
+              pal.ToString().c_str(), it->second.attempts);
+    pending.erase(it);
+  }
+  completion(pal, packetno, true);
+  return true;
+}
+
+/**
+ * 重试间隔来自设置, 设置修改后由此更新, 已在等待的包不重新排期.
+ */
+void AckTracker::SetRetryInterval(milliseconds interval) {
+  lock_guard<std::mutex> l(mutex);
+  retryInterval = max(interval, milliseconds(1));
+  maxInterval = retryInterval * MAX_BACKOFF;
+  tick = clamp(retryInterval / 4, milliseconds(1), milliseconds(100));
+}
+
+void AckTracker::Stop() {
+  {
+    lock_guard<std::mutex> l(mutex);
+    stopping = true;
+    pending.clear();
+    for (auto& slot : wheel) {
+      slot.clear();
+    }
+  }
+  cond.notify_all();
+  if (timer.joinable()) {
+    timer.join();
+  }
+}
+
+size_t AckTracker::PendingCount() const {
+  lock_guard<std::mutex> l(mutex);
+  return pending.size();
+}
+
+milliseconds AckTracker::Tick() const {
+  lock_guard<std::mutex> l(mutex);
+  return tick;
+}
+
+AckTracker::Key AckTracker::keyOf(const PalKey& pal, uint32_t packetno) {
+  uint64_t peer = uint64_t(pal.GetIpv4().s_addr) << 16;
+  return Key(peer | uint16_t(pal.GetPort()), packetno);
+}
+
+void AckTracker::scheduleLocked(const Key& key, Pending& entry) {
+  size_t ticks = max<size_t>(1, (entry.interval + tick - milliseconds(1)) / tick);
+  entry.rounds = (ticks - 1) / wheel.size();
+  wheel[(cursor + ticks) % wheel.size()].push_back(Slot{key, entry.seq});
+}
+
+void AckTracker::timerLoop() {
+  unique_lock<std::mutex> l(mutex);
+  auto next = steady_clock::now();
+  while (true) {
+    if (pending.empty()) {
+      cond.wait(l, [this] { return stopping || !pending.empty(); });
+      next = steady_clock::now();
+    }
+    next += tick;
+    if (cond.wait_until(l, next, [this] { return stopping; })) {
+      return;
+    }
+
+    cursor = (cursor + 1) % wheel.size();
+    vector<Slot> due;
+    due.swap(wheel[cursor]);
+    vector<pair<PalKey, string>> resend;
+    vector<pair<PalKey, uint32_t>> failed;
+    for (auto& slot : due) {
+      auto it = pending.find(slot.key);
+      if (it == pending.end() || it->second.seq != slot.seq) {
+        continue;
+      }
+      auto& entry = it->second;
+      if (entry.rounds > 0) {
+        entry.rounds--;
+        wheel[cursor].push_back(slot);
+        continue;
+      }
+      if (entry.attempts >= maxAttempts) {
+        failed.emplace_back(entry.pal, slot.key.second);
+        pending.erase(it);
+        continue;
+      }
+      entry.attempts++;
+      entry.interval = min(entry.interval * 2, maxInterval);
+      scheduleLocked(slot.key, entry);
+      resend.emplace_back(entry.pal, entry.packet);
+    }
+    if (resend.empty() && failed.empty()) {
+      continue;
+    }
+
+    l.unlock();
+    for (auto& item : resend) {
+      sender(item.first, item.second);
+    }
+    for (auto& item : failed) {
+      LOG_INFO("packet %u to %s not acked after %d send(s)", item.second,
+               item.first.ToString().c_str(), maxAttempts);
+      completion(item.first, item.second, false);
+    }
+    l.lock();
+  }
+}
+
+}  // namespace iptux
@@ -0,0 +1,117 @@
+#ifndef IPTUX_ACK_TRACKER_H
+#define IPTUX_ACK_TRACKER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "iptux-core/Models.h"
+
+namespace iptux {
+
+/**
+ * @brief tracks messages sent with IPMSG_SENDCHECKOPT until they are acked.
+ *
+ * Pending packets are keyed by peer and packet number, since every peer
+ * numbers its packets on its own, and scheduled on a hashed
+ * timer wheel driven by a single thread, which resends a packet when its
+ * retry interval expires (doubling the interval up to maxInterval) and
+ * reports it as failed after maxAttempts sends. The thread only wakes up
+ * while packets are pending.
+ */
+class AckTracker {
+ public:
+  using Sender =
+      std::function<void(const PalKey& pal, const std::string& packet)>;
+  using Completion =
+      std::function<void(const PalKey& pal, uint32_t packetno, bool delivered)>;
+
+  AckTracker(std::chrono::milliseconds retryInterval,
+             int maxAttempts,
+             Sender sender,
+             Completion completion);
+  ~AckTracker();
+
+  AckTracker(const AckTracker&) = delete;
+  AckTracker& operator=(const AckTracker&) = delete;
+
+  /**
+   * @brief send the packet and wait for its ack in the background.
+   *
+   * @return false if the tracker is stopped (nothing is sent)
+   */
+  bool Track(const PalKey& pal, uint32_t packetno, std::string packet);
+
+  /**
+   * @brief mark the packet as delivered.
+   *
+   * @return false if the packet is unknown (already acked or failed)
+   */
+  bool Ack(const PalKey& pal, uint32_t packetno);
+
+  /**
+   * @brief change the retry interval of the packets tracked from now on.
+   */
+  void SetRetryInterval(std::chrono::milliseconds interval);
+
+  /**
+   * @brief drop pending packets without reporting them, and join the timer.
+   */
+  void Stop();
+
+  size_t PendingCount() const;
+  std::chrono::milliseconds Tick() const;
+
+ private:
+  using Key = std::pair<uint64_t, uint32_t>;  // (ipv4 << 16 | port, packetno)
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<uint64_t>()(key.first * 0x9e3779b97f4a7c15ULL ^
+                                   key.second);
+    }
+  };
+
+  struct Pending {
+    PalKey pal;
+    std::string packet;
+    uint64_t seq;
+    int attempts;
+    std::chrono::milliseconds interval;
+    size_t rounds;  // full wheel turns left before it expires
+  };
+  struct Slot {
+    Key key;
+    uint64_t seq;  // skips entries acked and reused since scheduled
+  };
+
+  static Key keyOf(const PalKey& pal, uint32_t packetno);
+  void scheduleLocked(const Key& key, Pending& pending);
+  void timerLoop();
+
+  std::chrono::milliseconds retryInterval;
+  std::chrono::milliseconds maxInterval;
+  std::chrono::milliseconds tick;
+  const int maxAttempts;
+  Sender sender;
+  Completion completion;
+
+  mutable std::mutex mutex;
+  std::condition_variable cond;
+  std::unordered_map<Key, Pending, KeyHash> pending;
+  std::vector<std::vector<Slot>> wheel;
+  size_t cursor{0};
+  uint64_t nextSeq{1};
+  bool stopping{false};
+  std::thread timer;
+};
+
+}  // namespace iptux
+
+#endif
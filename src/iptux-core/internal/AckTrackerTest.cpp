@@ -0,0 +1,126 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+
+#include "iptux-core/internal/AckTracker.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace iptux;
+
+namespace {
+struct Recorder {
+  mutex m;
+  vector<string> sent;
+  vector<pair<uint32_t, bool>> completed;
+
+  AckTracker::Sender sender() {
+    return [this](const PalKey&, const string& packet) {
+      lock_guard<mutex> l(m);
+      sent.push_back(packet);
+    };
+  }
+  AckTracker::Completion completion() {
+    return [this](const PalKey&, uint32_t packetno, bool delivered) {
+      lock_guard<mutex> l(m);
+      completed.emplace_back(packetno, delivered);
+    };
+  }
+  size_t sentCount() {
+    lock_guard<mutex> l(m);
+    return sent.size();
+  }
+  size_t completedCount() {
+    lock_guard<mutex> l(m);
+    return completed.size();
+  }
+};
+
+const PalKey pal1(inAddrFromString("127.0.0.1"), 2425);
+const PalKey pal2(inAddrFromString("127.0.0.2"), 2425);
+
+void waitUntil(function<bool()> cond) {
+  for (int i = 0; i < 400 && !cond(); ++i) {
+    this_thread::sleep_for(milliseconds(5));
+  }
+}
+}  // namespace
+
+TEST(AckTracker, AckBeforeRetry) {
+  Recorder rec;
+  AckTracker tracker(seconds(10), 4, rec.sender(), rec.completion());
+  EXPECT_TRUE(tracker.Track(pal1, 1, "hello"));
+  EXPECT_EQ(rec.sentCount(), 1u);
+  EXPECT_EQ(tracker.PendingCount(), 1u);
+
+  // ack from another pal is ignored
+  EXPECT_FALSE(tracker.Ack(pal2, 1));
+  EXPECT_TRUE(tracker.Ack(pal1, 1));
+  EXPECT_FALSE(tracker.Ack(pal1, 1));
+  EXPECT_EQ(tracker.PendingCount(), 0u);
+  ASSERT_EQ(rec.completedCount(), 1u);
+  EXPECT_EQ(rec.completed[0], make_pair(1u, true));
+  EXPECT_EQ(rec.sentCount(), 1u);
+}
+
+TEST(AckTracker, RetryThenFail) {
+  Recorder rec;
+  AckTracker tracker(milliseconds(10), 3, rec.sender(), rec.completion());
+  EXPECT_TRUE(tracker.Track(pal1, 7, "hello"));
+  waitUntil([&] { return rec.completedCount() == 1; });
+  ASSERT_EQ(rec.completedCount(), 1u);
+  EXPECT_EQ(rec.completed[0], make_pair(7u, false));
+  EXPECT_EQ(rec.sentCount(), 3u);
+  EXPECT_EQ(tracker.PendingCount(), 0u);
+}
+
+TEST(AckTracker, ManyPending) {
+  Recorder rec;
+  AckTracker tracker(milliseconds(20), 100, rec.sender(), rec.completion());
+  for (uint32_t i = 1; i <= 100; ++i) {
+    EXPECT_TRUE(tracker.Track(i % 2 ? pal1 : pal2, i, "msg"));
+  }
+  EXPECT_EQ(tracker.PendingCount(), 100u);
+  waitUntil([&] { return rec.sentCount() >= 200; });
+  for (uint32_t i = 1; i <= 100; ++i) {
+    EXPECT_TRUE(tracker.Ack(i % 2 ? pal1 : pal2, i));
+  }
+  EXPECT_EQ(tracker.PendingCount(), 0u);
+  EXPECT_EQ(rec.completedCount(), 100u);
+}
+
+TEST(AckTracker, SamePacketnoFromTwoPals) {
+  Recorder rec;
+  AckTracker tracker(seconds(10), 4, rec.sender(), rec.completion());
+  EXPECT_TRUE(tracker.Track(pal1, 5, "to pal1"));
+  EXPECT_TRUE(tracker.Track(pal2, 5, "to pal2"));
+  EXPECT_EQ(tracker.PendingCount(), 2u);
+  EXPECT_TRUE(tracker.Ack(pal2, 5));
+  EXPECT_EQ(tracker.PendingCount(), 1u);
+  EXPECT_TRUE(tracker.Ack(pal1, 5));
+  EXPECT_EQ(rec.completedCount(), 2u);
+}
+
+TEST(AckTracker, SetRetryInterval) {
+  Recorder rec;
+  AckTracker tracker(seconds(10), 2, rec.sender(), rec.completion());
+  tracker.SetRetryInterval(milliseconds(10));
+  EXPECT_EQ(tracker.Tick(), milliseconds(2));
+  EXPECT_TRUE(tracker.Track(pal1, 1, "hello"));
+  waitUntil([&] { return rec.completedCount() == 1; });
+  ASSERT_EQ(rec.completedCount(), 1u);
+  EXPECT_EQ(rec.completed[0], make_pair(1u, false));
+  EXPECT_EQ(rec.sentCount(), 2u);
+}
+
+TEST(AckTracker, StopDropsPending) {
+  Recorder rec;
+  AckTracker tracker(milliseconds(10), 4, rec.sender(), rec.completion());
+  EXPECT_TRUE(tracker.Track(pal1, 1, "hello"));
+  tracker.Stop();
+  EXPECT_EQ(tracker.PendingCount(), 0u);
+  EXPECT_FALSE(tracker.Track(pal1, 2, "hello"));
+  EXPECT_EQ(rec.completedCount(), 0u);
+}
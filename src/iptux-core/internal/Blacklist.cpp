@@ -0,0 +1,169 @@
+#include "config.h"
+#include "Blacklist.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#include <arpa/inet.h>
+
+#include "iptux-utils/output.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+uint32_t prefixMask(int prefixLen) {
+  return prefixLen == 0 ? 0 : ~uint32_t(0) << (32 - prefixLen);
+}
+
+string entryToString(uint32_t network, int prefixLen) {
+  string res = inAddrToString(inAddrFromUint32(network));
+  if (prefixLen < 32) {
+    res += "/" + to_string(prefixLen);
+  }
+  return res;
+}
+}  // namespace
+
+Blacklist::Table::Table(vector<Entry> entries) : entries(std::move(entries)) {
+  trie.emplace_back();
+  for (const Entry& entry : this->entries) {
+    if (entry.second == 32) {
+      hosts.insert(entry.first);
+    } else {
+      Insert(entry.first, entry.second);
+    }
+  }
+}
+
+void Blacklist::Table::Insert(uint32_t network, int prefixLen) {
+  uint32_t node = 0;
+  for (int i = 0; i < prefixLen; ++i) {
+    if (trie[node].terminal) {
+      return;  // 已被更短的前缀覆盖
+    }
+    int bit = (network >> (31 - i)) & 1;
+    if (trie[node].child[bit] == 0) {
+      trie[node].child[bit] = trie.size();
+      trie.emplace_back();
+    }
+    node = trie[node].child[bit];
+  }
+  trie[node].terminal = true;
+}
+
+bool Blacklist::Table::Match(uint32_t ip) const {
+  if (hosts.count(ip)) {
+    return true;
+  }
+  uint32_t node = 0;
+  for (int i = 0; !trie[node].terminal; ++i) {
+    if (i == 32) {
+      return false;
+    }
+    node = trie[node].child[(ip >> (31 - i)) & 1];
+    if (node == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Blacklist::Blacklist() : table(make_shared<Table>(vector<Entry>())) {}
+
+bool Blacklist::ParseEntry(const string& entry,
+                           uint32_t& network,
+                           int& prefixLen) {
+  size_t slash = entry.find('/');
+  in_addr ipv4;
+  if (inet_pton(AF_INET, entry.substr(0, slash).c_str(), &ipv4) != 1) {
+    return false;
+  }
+  prefixLen = 32;
+  if (slash != string::npos) {
+    string len = entry.substr(slash + 1);
+    if (len.empty() || len.size() > 2 ||
+        len.find_first_not_of("0123456789") != string::npos) {
+      return false;
+    }
+    prefixLen = atoi(len.c_str());
+    if (prefixLen > 32) {
+      return false;
+    }
+  }
+  network = inAddrToUint32(ipv4) & prefixMask(prefixLen);
+  return true;
+}
+
+bool Blacklist::Add(const string& entry) {
+  Entry parsed;
+  if (!ParseEntry(entry, parsed.first, parsed.second)) {
+    return false;
+  }
+  lock_guard<std::mutex> l(writeMutex);
+  auto entries = load()->entries;
+  if (find(entries.begin(), entries.end(), parsed) != entries.end()) {
+    return false;
+  }
+  entries.push_back(parsed);
+  publishLocked(std::move(entries));
+  return true;
+}
+
+bool Blacklist::Remove(const string& entry) {
+  Entry parsed;
+  if (!ParseEntry(entry, parsed.first, parsed.second)) {
+    return false;
+  }
+  lock_guard<std::mutex> l(writeMutex);
+  auto entries = load()->entries;
+  auto it = find(entries.begin(), entries.end(), parsed);
+  if (it == entries.end()) {
+    return false;
+  }
+  entries.erase(it);
+  publishLocked(std::move(entries));
+  return true;
+}
+
+void Blacklist::Assign(const vector<string>& list) {
+  vector<Entry> entries;
+  for (const string& entry : list) {
+    Entry parsed;
+    if (!ParseEntry(entry, parsed.first, parsed.second)) {
+      LOG_WARN("invalid blacklist entry: %s", entry.c_str());
+      continue;
+    }
+    if (find(entries.begin(), entries.end(), parsed) == entries.end()) {
+      entries.push_back(parsed);
+    }
+  }
+  lock_guard<std::mutex> l(writeMutex);
+  publishLocked(std::move(entries));
+}
+
+bool Blacklist::Contains(in_addr ipv4) const {
+  return load()->Match(inAddrToUint32(ipv4));
+}
+
+vector<string> Blacklist::List() const {
+  vector<string> res;
+  for (const Entry& entry : load()->entries) {
+    res.push_back(entryToString(entry.first, entry.second));
+  }
+  return res;
+}
+
+shared_ptr<const Blacklist::Table> Blacklist::load() const {
+  return atomic_load(&table);
+}
+
+void Blacklist::publishLocked(vector<Entry> entries) {
+  atomic_store(&table, shared_ptr<const Table>(
+                           make_shared<Table>(std::move(entries))));
+}
+
+}  // namespace iptux
@@ -0,0 +1,85 @@
+#ifndef IPTUX_BLACKLIST_H
+#define IPTUX_BLACKLIST_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+
+namespace iptux {
+
+/**
+ * @brief blocked ips ("1.2.3.4") and CIDR ranges ("10.0.0.0/8").
+ *
+ * Single ips are kept in a hash set and ranges in a binary prefix trie.
+ * Both live in an immutable table: writers build a new table and publish
+ * it with an atomic pointer swap, so Contains() (called for every incoming
+ * datagram) never waits for a writer.
+ */
+class Blacklist {
+ public:
+  Blacklist();
+
+  Blacklist(const Blacklist&) = delete;
+  Blacklist& operator=(const Blacklist&) = delete;
+
+  /**
+   * @brief parse "a.b.c.d" or "a.b.c.d/n", the host bits of a range are
+   * cleared
+   */
+  static bool ParseEntry(const std::string& entry,
+                         uint32_t& network,
+                         int& prefixLen);
+
+  /**
+   * @return false if entry is invalid or already in the list
+   */
+  bool Add(const std::string& entry);
+  /**
+   * @return false if entry is not in the list
+   */
+  bool Remove(const std::string& entry);
+  /**
+   * @brief replace the whole list, invalid entries are skipped
+   */
+  void Assign(const std::vector<std::string>& entries);
+
+  bool Contains(in_addr ipv4) const;
+  /**
+   * @brief the entries in the order added, in normalized form
+   */
+  std::vector<std::string> List() const;
+
+ private:
+  using Entry = std::pair<uint32_t, int>;  // network (host order), prefixLen
+
+  struct Table {
+    struct Node {
+      uint32_t child[2] = {0, 0};  // 0: none, the root is never a child
+      bool terminal = false;
+    };
+
+    std::vector<Entry> entries;
+    std::unordered_set<uint32_t> hosts;  // /32 entries
+    std::vector<Node> trie;              // shorter prefixes, trie[0] is root
+
+    explicit Table(std::vector<Entry> entries);
+    bool Match(uint32_t ip) const;
+    void Insert(uint32_t network, int prefixLen);
+  };
+
+  std::shared_ptr<const Table> load() const;
+  void publishLocked(std::vector<Entry> entries);
+
+  std::mutex writeMutex;  // serializes writers only
+  std::shared_ptr<const Table> table;
+};
+
+}  // namespace iptux
+
+#endif
@@ -0,0 +1,58 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include <glib.h>
+
+#include "iptux-core/internal/Blacklist.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+
+const int kEntries = 1000;
+const int kLookups = 1000000;
+
+template <typename F>
+double nsPerLookup(F contains) {
+  auto start = chrono::steady_clock::now();
+  uint64_t hits = 0;
+  for (int i = 0; i < kLookups; ++i) {
+    // mostly misses, like the datagrams of a normal LAN
+    hits += contains(inAddrFromUint32(0xc0a80000 + i % 65536));
+  }
+  auto elapsed = chrono::steady_clock::now() - start;
+  if (hits == 0) {
+    fprintf(stderr, "nothing found\n");
+  }
+  return chrono::duration<double, nano>(elapsed).count() / kLookups;
+}
+
+}  // namespace
+
+int main() {
+  Blacklist blacklist;
+  GSList* list = nullptr;
+  for (int i = 0; i < kEntries; ++i) {
+    in_addr ipv4 = inAddrFromUint32(0xc0a80000 + i * 61);
+    blacklist.Add(inAddrToString(ipv4));
+    list = g_slist_append(list, GUINT_TO_POINTER(ipv4.s_addr));
+  }
+  blacklist.Add("172.16.0.0/12");
+
+  double engine =
+      nsPerLookup([&](in_addr ipv4) { return blacklist.Contains(ipv4); });
+  // what CoreThread::BlacklistContainItem did before
+  double gslist = nsPerLookup([&](in_addr ipv4) {
+    return g_slist_find(list, GUINT_TO_POINTER(ipv4.s_addr)) != nullptr;
+  });
+  g_slist_free(list);
+
+  printf("Blacklist    %8.1f ns/lookup (%d entries)\n", engine, kEntries);
+  printf("g_slist_find %8.1f ns/lookup (%d entries)\n", gslist, kEntries);
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+
+#include "iptux-core/internal/Blacklist.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+bool contains(const Blacklist& blacklist, const char* ip) {
+  return blacklist.Contains(inAddrFromString(ip));
+}
+}  // namespace
+
+TEST(Blacklist, ParseEntry) {
+  uint32_t network;
+  int prefixLen;
+  ASSERT_TRUE(Blacklist::ParseEntry("1.2.3.4", network, prefixLen));
+  EXPECT_EQ(network, inAddrToUint32(inAddrFromString("1.2.3.4")));
+  EXPECT_EQ(prefixLen, 32);
+  ASSERT_TRUE(Blacklist::ParseEntry("10.1.2.3/8", network, prefixLen));
+  EXPECT_EQ(network, inAddrToUint32(inAddrFromString("10.0.0.0")));
+  EXPECT_EQ(prefixLen, 8);
+  ASSERT_TRUE(Blacklist::ParseEntry("1.2.3.4/0", network, prefixLen));
+  EXPECT_EQ(network, 0u);
+  EXPECT_EQ(prefixLen, 0);
+
+  EXPECT_FALSE(Blacklist::ParseEntry("", network, prefixLen));
+  EXPECT_FALSE(Blacklist::ParseEntry("1.2.3", network, prefixLen));
+  EXPECT_FALSE(Blacklist::ParseEntry("1.2.3.4/", network, prefixLen));
+  EXPECT_FALSE(Blacklist::ParseEntry("1.2.3.4/33", network, prefixLen));
+  EXPECT_FALSE(Blacklist::ParseEntry("1.2.3.4/-1", network, prefixLen));
+  EXPECT_FALSE(Blacklist::ParseEntry("1.2.3.4/8x", network, prefixLen));
+}
+
+TEST(Blacklist, Contains) {
+  Blacklist blacklist;
+  EXPECT_FALSE(contains(blacklist, "1.2.3.4"));
+
+  EXPECT_TRUE(blacklist.Add("1.2.3.4"));
+  EXPECT_FALSE(blacklist.Add("1.2.3.4"));
+  EXPECT_TRUE(blacklist.Add("10.20.0.0/16"));
+  EXPECT_TRUE(blacklist.Add("192.168.1.128/25"));
+  EXPECT_FALSE(blacklist.Add("not an ip"));
+
+  EXPECT_TRUE(contains(blacklist, "1.2.3.4"));
+  EXPECT_FALSE(contains(blacklist, "1.2.3.5"));
+  EXPECT_TRUE(contains(blacklist, "10.20.0.0"));
+  EXPECT_TRUE(contains(blacklist, "10.20.255.255"));
+  EXPECT_FALSE(contains(blacklist, "10.21.0.0"));
+  EXPECT_FALSE(contains(blacklist, "192.168.1.127"));
+  EXPECT_TRUE(contains(blacklist, "192.168.1.128"));
+  EXPECT_TRUE(contains(blacklist, "192.168.1.255"));
+
+  // a shorter prefix covers longer ones, whatever the order
+  EXPECT_TRUE(blacklist.Add("10.0.0.0/8"));
+  EXPECT_TRUE(contains(blacklist, "10.21.0.0"));
+  EXPECT_TRUE(blacklist.Remove("10.0.0.0/8"));
+  EXPECT_FALSE(contains(blacklist, "10.21.0.0"));
+  EXPECT_TRUE(contains(blacklist, "10.20.1.1"));
+
+  EXPECT_TRUE(blacklist.Add("0.0.0.0/0"));
+  EXPECT_TRUE(contains(blacklist, "8.8.8.8"));
+}
+
+TEST(Blacklist, RemoveAndList) {
+  Blacklist blacklist;
+  blacklist.Assign({"1.2.3.4", "10.1.2.3/8", "bad", "1.2.3.4", "5.6.7.8/32"});
+  EXPECT_EQ(blacklist.List(),
+            vector<string>({"1.2.3.4", "10.0.0.0/8", "5.6.7.8"}));
+
+  EXPECT_FALSE(blacklist.Remove("1.2.3.5"));
+  EXPECT_TRUE(blacklist.Remove("1.2.3.4/32"));
+  EXPECT_TRUE(blacklist.Remove("10.9.9.9/8"));
+  EXPECT_FALSE(contains(blacklist, "1.2.3.4"));
+  EXPECT_FALSE(contains(blacklist, "10.0.0.1"));
+  EXPECT_EQ(blacklist.List(), vector<string>({"5.6.7.8"}));
+
+  blacklist.Assign({});
+  EXPECT_TRUE(blacklist.List().empty());
+  EXPECT_FALSE(contains(blacklist, "5.6.7.8"));
+}
+
+TEST(Blacklist, ConcurrentReaders) {
+  Blacklist blacklist;
+  blacklist.Add("1.2.3.4");
+  atomic_bool done{false};
+  atomic_int wrong{0};
+  vector<thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&] {
+      while (!done) {
+        if (!contains(blacklist, "1.2.3.4") || contains(blacklist, "4.3.2.1")) {
+          wrong++;
+        }
+      }
+    });
+  }
+  for (int i = 0; i < 1000; ++i) {
+    blacklist.Add("10." + to_string(i % 256) + ".0.0/16");
+    blacklist.Remove("10." + to_string(i % 256) + ".0.0/16");
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(wrong, 0);
+}
@@ -0,0 +1,80 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "iptux-core/internal/CharsetConverter.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+
+const int kIterations = 200000;
+const char kCandidates[] = "utf-8,gb18030,big5";
+
+// IPMSG_SENDMSG packets as sent by a utf-8 iptux and a gb18030 ipmsg peer
+vector<string> makePackets() {
+  const char header[] = "1:1700000000:user:host:288:";
+  string utf8 = string(header) + "今天下午三点开会, 请准时参加" + '\0';
+  string gb18030;
+  convertCharset(utf8, "gb18030", "utf-8", gb18030);
+  string ascii = string(header) + "meeting at 3pm, be on time" + '\0';
+  return {utf8, gb18030, ascii, utf8};
+}
+
+template <typename F>
+double nsPerPacket(const vector<string>& packets, F convert) {
+  auto start = chrono::steady_clock::now();
+  uint64_t sum = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    sum += convert(packets[i % packets.size()]);
+  }
+  auto elapsed = chrono::steady_clock::now() - start;
+  if (sum == 0) {
+    fprintf(stderr, "nothing converted\n");
+  }
+  return chrono::duration<double, nano>(elapsed).count() / kIterations;
+}
+
+}  // namespace
+
+int main() {
+  auto packets = makePackets();
+  CharsetConverter converter;
+  PalKey pal(inAddrFromString("127.0.0.1"), 2425);
+
+  double engine = nsPerPacket(packets, [&](const string& packet) {
+    string out;
+    auto codeset = converter.ToUtf8(pal, packet, "", kCandidates, out);
+    return codeset.size() + out.size();
+  });
+
+  // what UdpData::ConvertEncode did before: g_utf8_validate, then g_convert
+  // through each candidate, opening a new iconv each time
+  double gconvert = nsPerPacket(packets, [&](const string& packet) {
+    if (g_utf8_validate(packet.data(), packet.size(), nullptr)) {
+      return packet.size();
+    }
+    for (const char* cset : {"gb18030", "big5"}) {
+      gsize written;
+      char* out = g_convert(packet.data(), packet.size(), "utf-8", cset,
+                            nullptr, &written, nullptr);
+      if (out) {
+        g_free(out);
+        return written;
+      }
+    }
+    return size_t(0);
+  });
+
+  printf("CharsetConverter %8.1f ns/packet\n", engine);
+  printf("g_convert        %8.1f ns/packet\n", gconvert);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include "config.h"
+#include "CharsetConverter.h"
+
+#include <strings.h>
+
+#include "iptux-core/internal/PalRegistry.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+bool isUtf8Name(const string& codeset) {
+  return codeset.empty() || strcasecmp(codeset.c_str(), "utf-8") == 0;
+}
+}  // namespace
+
+string CharsetConverter::ToUtf8(const PalKey& pal,
+                                string_view s,
+                                const string& preferred,
+                                const string& candidates,
+                                string& out) {
+  bool preferUtf8 = isUtf8Name(preferred);
+  /* ASCII在各候选编码下都相同, 无需转换 */
+  if (isAscii(s)) {
+    return preferUtf8 ? "utf-8" : preferred;
+  }
+  if (!preferUtf8 && convertCharset(s, "utf-8", preferred.c_str(), out)) {
+    return preferred;
+  }
+  if (isValidUtf8(s)) {
+    return "utf-8";
+  }
+
+  string remembered = GetPalCodeset(pal);
+  if (!remembered.empty() &&
+      convertCharset(s, "utf-8", remembered.c_str(), out)) {
+    return remembered;
+  }
+  size_t pos = 0;
+  while ((pos = candidates.find_first_not_of(",; \t", pos)) != string::npos) {
+    size_t end = candidates.find_first_of(",; \t", pos);
+    string codeset = candidates.substr(pos, end - pos);
+    pos = end;
+    if (isUtf8Name(codeset) ||
+        strcasecmp(codeset.c_str(), remembered.c_str()) == 0 ||
+        strcasecmp(codeset.c_str(), preferred.c_str()) == 0) {
+      continue;
+    }
+    if (convertCharset(s, "utf-8", codeset.c_str(), out)) {
+      remember(pal, codeset);
+      return codeset;
+    }
+  }
+  return "";
+}
+
+string CharsetConverter::GetPalCodeset(const PalKey& pal) const {
+  lock_guard<std::mutex> l(mutex);
+  auto it = palCodesets.find(PalRegistry::KeyOf(pal));
+  return it == palCodesets.end() ? "" : it->second;
+}
+
+void CharsetConverter::remember(const PalKey& pal, const string& codeset) {
+  lock_guard<std::mutex> l(mutex);
+  palCodesets[PalRegistry::KeyOf(pal)] = codeset;
+}
+
+}  // namespace iptux
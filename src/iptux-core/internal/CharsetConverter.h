@@ -0,0 +1,59 @@
+#ifndef IPTUX_CHARSET_CONVERTER_H
+#define IPTUX_CHARSET_CONVERTER_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "iptux-core/Models.h"
+
+namespace iptux {
+
+/**
+ * @brief converts incoming packets to utf-8.
+ *
+ * ASCII and valid utf-8 packets are passed through without conversion.
+ * Otherwise the codesets are tried in turn (see ToUtf8) and the one that
+ * worked is remembered per pal, so it's tried first next time.
+ */
+class CharsetConverter {
+ public:
+  CharsetConverter() = default;
+
+  CharsetConverter(const CharsetConverter&) = delete;
+  CharsetConverter& operator=(const CharsetConverter&) = delete;
+
+  /**
+   * @brief convert s to utf-8.
+   *
+   * Tried in order: preferred (unless utf-8), s as utf-8, the codeset
+   * remembered for pal, then each of candidates (e.g. "gb18030,utf-16").
+   *
+   * @param out the utf-8 text, left unchanged when s needs no conversion
+   * (ASCII, or valid utf-8)
+   * @return the codeset s was in (preferred for ASCII, "utf-8" for valid
+   * utf-8), empty if nothing worked
+   */
+  std::string ToUtf8(const PalKey& pal,
+                     std::string_view s,
+                     const std::string& preferred,
+                     const std::string& candidates,
+                     std::string& out);
+
+  /**
+   * @brief the codeset remembered for pal, empty if none
+   */
+  std::string GetPalCodeset(const PalKey& pal) const;
+
+ private:
+  void remember(const PalKey& pal, const std::string& codeset);
+
+  mutable std::mutex mutex;
+  std::unordered_map<uint64_t, std::string> palCodesets;
+};
+
+}  // namespace iptux
+
+#endif
@@ -0,0 +1,67 @@
+#include "gtest/gtest.h"
+
+#include "iptux-core/internal/CharsetConverter.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+PalKey palKey(const char* ip) {
+  return PalKey(inAddrFromString(ip), 2425);
+}
+}  // namespace
+
+TEST(CharsetConverter, Passthrough) {
+  CharsetConverter converter;
+  string out = "unchanged";
+
+  EXPECT_EQ(converter.ToUtf8(palKey("1.2.3.4"), "hello", "", "gb18030", out),
+            "utf-8");
+  EXPECT_EQ(
+      converter.ToUtf8(palKey("1.2.3.4"), "hello", "GB18030", "gb18030", out),
+      "GB18030");
+  EXPECT_EQ(converter.ToUtf8(palKey("1.2.3.4"), "中文", "utf-8", "gb18030", out),
+            "utf-8");
+  EXPECT_EQ(out, "unchanged");
+  EXPECT_EQ(converter.GetPalCodeset(palKey("1.2.3.4")), "");
+}
+
+TEST(CharsetConverter, Preferred) {
+  CharsetConverter converter;
+  string out;
+
+  EXPECT_EQ(converter.ToUtf8(palKey("1.2.3.4"), "\xd6\xd0\xce\xc4", "gb18030",
+                             "", out),
+            "gb18030");
+  EXPECT_EQ(out, "中文");
+}
+
+TEST(CharsetConverter, Candidates) {
+  CharsetConverter converter;
+  string out;
+
+  EXPECT_EQ(converter.ToUtf8(palKey("1.2.3.4"), "\xd6\xd0\xce\xc4", "",
+                             "utf-8, gb18030;big5", out),
+            "gb18030");
+  EXPECT_EQ(out, "中文");
+  EXPECT_EQ(converter.GetPalCodeset(palKey("1.2.3.4")), "gb18030");
+  EXPECT_EQ(converter.GetPalCodeset(palKey("1.2.3.5")), "");
+
+  // the remembered codeset is tried before the candidates
+  out.clear();
+  EXPECT_EQ(converter.ToUtf8(palKey("1.2.3.4"), "\xce\xc4", "", "big5", out),
+            "gb18030");
+  EXPECT_EQ(out, "文");
+}
+
+TEST(CharsetConverter, Failed) {
+  CharsetConverter converter;
+  string out;
+
+  EXPECT_EQ(converter.ToUtf8(palKey("1.2.3.4"), "\xd6\xd0\xce", "", "gb18030",
+                             out),
+            "");
+  EXPECT_EQ(converter.ToUtf8(palKey("1.2.3.4"), "\xd6\xd0", "", "", out), "");
+  EXPECT_EQ(converter.GetPalCodeset(palKey("1.2.3.4")), "");
+}
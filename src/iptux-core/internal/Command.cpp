@@ -12,7 +12,10 @@
 #include "config.h"
 #include "Command.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <map>
+
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -22,6 +25,7 @@
 
 #include "iptux-core/Exception.h"
 #include "iptux-core/Models.h"
+#include "iptux-core/internal/PacketBuilder.h"
 #include "iptux-core/internal/TransAbstract.h"
 #include "iptux-core/internal/support.h"
 #include "iptux-utils/output.h"
@@ -31,7 +35,7 @@ using namespace std;
 
 namespace iptux {
 
-uint32_t Command::packetn = 1;
+std::atomic<uint32_t> Command::packetn{1};
 
 static PPalInfo getAndCheckPalInfo(CoreThread& coreThread,
                                    const PalKey& palKey) {
@@ -135,9 +139,8 @@ Command::~Command() {}
  */
 void Command::BroadCast(GSocket* sock, uint16_t port) {
   auto programData = coreThread.getProgramData();
-  CreateCommand(IPMSG_ABSENCEOPT | IPMSG_BR_ENTRY,
-                programData->nickname.c_str());
-  ConvertEncode(programData->encode);
+  CreateCommandWithNickname(IPMSG_ABSENCEOPT | IPMSG_BR_ENTRY,
+                            programData->encode);
   CreateIptuxExtra(programData->encode);
 
   auto addrs = get_sys_broadcast_addr(sock);
@@ -148,31 +151,6 @@ void Command::BroadCast(GSocket* sock, uint16_t port) {
   }
 }
 
-/**
- * 向局域网某些计算机单独发送上线信息.
- * @param sock udp socket
- */
-void Command::DialUp(int sock, uint16_t port) {
-  auto programData = coreThread.getProgramData();
-  CreateCommand(IPMSG_DIALUPOPT | IPMSG_ABSENCEOPT | IPMSG_BR_ENTRY,
-                programData->nickname.c_str());
-  ConvertEncode(programData->encode);
-  CreateIptuxExtra(programData->encode);
-
-  // 与某些代码片段的获取网段描述相冲突，必须复制出来使用
-  programData->Lock();
-  vector<NetSegment> list = programData->getNetSegments();
-  programData->Unlock();
-  for (const NetSegment& ns : list) {
-    uint64_t c = ns.Count();
-    for (uint64_t j = 0; j < c; ++j) {
-      auto ip = ns.NthIp(j);
-      commandSendTo(sock, buf, size, 0, inAddrFromString(ip), port);
-      g_usleep(999);
-    }
-  }
-}
-
 /**
  * 回复好友本人在线.
  * @param sock udp socket
@@ -181,9 +159,8 @@ void Command::DialUp(int sock, uint16_t port) {
 void Command::SendAnsentry(int sock, CPPalInfo pal) {
   auto programData = coreThread.getProgramData();
 
-  CreateCommand(IPMSG_ABSENCEOPT | IPMSG_ANSENTRY,
-                programData->nickname.c_str());
-  ConvertEncode(pal->getEncode());
+  CreateCommandWithNickname(IPMSG_ABSENCEOPT | IPMSG_ANSENTRY,
+                            pal->getEncode());
   CreateIptuxExtra(pal->getEncode());
   commandSendTo(sock, buf, size, 0, pal);
 }
@@ -194,8 +171,7 @@ void Command::SendAnsentry(int sock, CPPalInfo pal) {
  * @param pal class PalInfo
  */
 void Command::SendExit(int sock, CPPalInfo pal) {
-  CreateCommand(IPMSG_DIALUPOPT | IPMSG_BR_EXIT, NULL);
-  ConvertEncode(pal->getEncode());
+  CreateCommand(IPMSG_DIALUPOPT | IPMSG_BR_EXIT, NULL, pal->getEncode());
   commandSendTo(sock, buf, size, 0, pal);
 }
 
@@ -206,57 +182,78 @@ void Command::SendExit(int sock, CPPalInfo pal) {
  */
 void Command::SendAbsence(int sock, CPPalInfo pal) {
   auto programData = coreThread.getProgramData();
-  CreateCommand(IPMSG_ABSENCEOPT | IPMSG_BR_ABSENCE,
-                programData->nickname.c_str());
-  ConvertEncode(pal->getEncode());
+  CreateCommandWithNickname(IPMSG_ABSENCEOPT | IPMSG_BR_ABSENCE,
+                            pal->getEncode());
   CreateIptuxExtra(pal->getEncode());
   commandSendTo(sock, buf, size, 0, pal);
 }
 
+/**
+ * 通告多个好友本人个人信息已变, 编码相同的好友共用一个数据包.
+ * @param sock udp socket
+ * @param pals 好友
+ */
+void Command::SendAbsence(int sock, const vector<CPPalInfo>& pals) {
+  SendToAll(sock, pals, [this](const string& encode) {
+    CreateCommandWithNickname(IPMSG_ABSENCEOPT | IPMSG_BR_ABSENCE, encode);
+    CreateIptuxExtra(encode);
+  });
+}
+
 /**
  * 尝试着给某计算机发送一个上线信息数据包.
  * @param sock udp socket
  * @param ipv4 ipv4 address
  */
 void Command::SendDetectPacket(int sock, in_addr ipv4, uint16_t port) {
+  CreateDetectPacket();
+  commandSendTo(sock, buf, size, 0, ipv4, port);
+}
+
+/**
+ * 上线信息数据包, 网段扫描时发给每个地址.
+ * @return 数据包
+ */
+string Command::CreateDetectPacket() {
   auto programData = coreThread.getProgramData();
-  CreateCommand(IPMSG_DIALUPOPT | IPMSG_ABSENCEOPT | IPMSG_BR_ENTRY,
-                programData->nickname.c_str());
-  ConvertEncode(programData->encode);
+  CreateCommandWithNickname(
+      IPMSG_DIALUPOPT | IPMSG_ABSENCEOPT | IPMSG_BR_ENTRY, programData->encode);
   CreateIptuxExtra(programData->encode);
-  commandSendTo(sock, buf, size, 0, ipv4, port);
+  return string(buf, size);
 }
 
 /**
  * 给好友发送消息.
- * @param sock udp socket
+ * 消息交给 CoreThread 发送并跟踪, 未收到回复时由其重发, 不在此等待.
  * @param pal class PalInfo
  * @param msg 消息数据
+ * @return 消息的包编号
  */
-void Command::SendMessage(int sock, CPPalInfo pal, const char* msg) {
+uint32_t Command::SendMessage(CPPalInfo pal, const char* msg) {
   uint32_t packetno;
-  uint8_t count;
 
   auto pal2 = coreThread.GetPal(pal->GetKey());
   if (!pal2) {
     throw Exception(PAL_KEY_NOT_EXIST);
   }
 
-  pal2->rpacketn = packetno = packetn;  // 此数据包需要检验回复
-  CreateCommand(IPMSG_SENDCHECKOPT | IPMSG_SENDMSG, msg);
-  ConvertEncode(pal->getEncode());
+  packetno =
+      CreateCommand(IPMSG_SENDCHECKOPT | IPMSG_SENDMSG, msg, pal->getEncode());
+  pal2->rpacketn = packetno;  // 此数据包需要检验回复
 
-  count = 0;
-  do {
-    commandSendTo(sock, buf, size, 0, pal);
-    g_usleep(coreThread.getProgramData()->getSendMessageRetryInUs());
-    count++;
-  } while (pal->rpacketn == packetno && count < MAX_RETRYTIMES);
-  if (pal->rpacketn == packetno) {
-    FeedbackError(
-        pal, GROUP_BELONG_TYPE_REGULAR,
-        _("Your pal didn't receive the packet. He or she is offline maybe."));
-  }
+  coreThread.SendCheckedPacket(pal->GetKey(), packetno, string(buf, size));
+  return packetno;
+}
+
+/**
+ * 发送已编码好的数据包(重发).
+ * @param sock udp socket
+ * @param pal 好友
+ * @param packet 数据包
+ */
+void Command::SendPacket(int sock, const PalKey& pal, const string& packet) {
+  commandSendTo(sock, packet.data(), packet.size(), 0, pal.GetIpv4(),
+                pal.GetPort());
 }
 
 /**
@@ -269,8 +266,8 @@ void Command::SendReply(int sock, CPPalInfo pal, uint32_t packetno) {
   char packetstr[11];  // 10 +1 =11
 
   snprintf(packetstr, 11, "%" PRIu32, packetno);
-  CreateCommand(IPMSG_SENDCHECKOPT | IPMSG_RECVMSG, packetstr);
-  ConvertEncode(pal->getEncode());
+  CreateCommand(IPMSG_SENDCHECKOPT | IPMSG_RECVMSG, packetstr,
+                pal->getEncode());
 
   commandSendTo(sock, buf, size, 0, pal);
 }
@@ -287,11 +284,24 @@ void Command::SendReply(int sock, const PalKey& palKey, uint32_t packetno) {
  * @param msg 消息数据
  */
 void Command::SendGroupMsg(int sock, CPPalInfo pal, const char* msg) {
-  CreateCommand(IPMSG_BROADCASTOPT | IPMSG_SENDMSG, msg);
-  ConvertEncode(pal->getEncode());
+  CreateCommand(IPMSG_BROADCASTOPT | IPMSG_SENDMSG, msg, pal->getEncode());
   commandSendTo(sock, buf, size, 0, pal);
 }
 
+/**
+ * 向多个好友群发消息, 编码相同的好友共用一个数据包.
+ * @param sock udp socket
+ * @param pals 好友
+ * @param msg 消息数据
+ */
+void Command::SendGroupMsg(int sock,
+                           const vector<CPPalInfo>& pals,
+                           const char* msg) {
+  SendToAll(sock, pals, [this, msg](const string& encode) {
+    CreateCommand(IPMSG_BROADCASTOPT | IPMSG_SENDMSG, msg, encode);
+  });
+}
+
 /**
  * 发送群组消息(被其他函数调用).
  * @param sock udp socket
@@ -303,11 +313,26 @@ void Command::SendUnitMsg(int sock,
                           CPPalInfo pal,
                           uint32_t opttype,
                           const char* msg) {
-  CreateCommand(opttype | IPTUX_SENDMSG, msg);
-  ConvertEncode(pal->getEncode());
+  CreateCommand(opttype | IPTUX_SENDMSG, msg, pal->getEncode());
   commandSendTo(sock, buf, size, 0, pal);
 }
 
+/**
+ * 向多个好友发送群组消息, 编码相同的好友共用一个数据包.
+ * @param sock udp socket
+ * @param pals 好友
+ * @param opttype 命令额外选项
+ * @param msg 消息数据
+ */
+void Command::SendUnitMsg(int sock,
+                          const vector<CPPalInfo>& pals,
+                          uint32_t opttype,
+                          const char* msg) {
+  SendToAll(sock, pals, [this, opttype, msg](const string& encode) {
+    CreateCommand(opttype | IPTUX_SENDMSG, msg, encode);
+  });
+}
+
 /**
  * Request file data from peer.
  * @param sock GSocket tcp socket
@@ -315,48 +340,37 @@ void Command::SendUnitMsg(int sock,
  * @param packetno packet number
  * @param fileid file ID
  * @param offset file offset
+ * @param length bytes wanted from offset, 0 for up to the end; only for pals
+ * with IPTUX_FEATURE_SEGMENT
+ * @param compress ask for the data compressed in blocks; only for pals with
+ * IPTUX_FEATURE_COMPRESS
  * @return true on success
  */
 bool Command::SendAskData(GSocket* sock,
                           const PalKey& palKey,
                           uint32_t packetno,
                           uint32_t fileid,
-                          int64_t offset) {
+                          int64_t offset,
+                          int64_t length,
+                          bool compress) {
   auto pal = getAndCheckPalInfo(coreThread, palKey);
-  char attrstr[35];  // 8+1+8+1+16 +1 =35
+  char attrstr[52];  // 8+1+8+1+16+1+16 +1 =52
   const char* iptuxstr = "iptux";
+  uint32_t opttype = compress ? IPTUX_COMPRESSOPT : 0;
 
-  snprintf(attrstr, 35, "%" PRIx32 ":%" PRIx32 ":%" PRIx64, packetno, fileid,
-           offset);
+  if (length > 0)
+    snprintf(attrstr, 52, "%" PRIx32 ":%" PRIx32 ":%" PRIx64 ":%" PRIx64,
+             packetno, fileid, offset, length);
+  else
+    snprintf(attrstr, 52, "%" PRIx32 ":%" PRIx32 ":%" PRIx64, packetno, fileid,
+             offset);
   if (strstr(pal->getVersion().c_str(), iptuxstr))
-    CreateCommand(IPMSG_FILEATTACHOPT | IPMSG_GETFILEDATA, attrstr);
+    CreateCommand(opttype | IPMSG_FILEATTACHOPT | IPMSG_GETFILEDATA, attrstr,
+                  pal->getEncode());
   else
-    CreateCommand(IPMSG_GETFILEDATA, attrstr);
-  ConvertEncode(pal->getEncode());
-
-  in_addr ipv4 = pal->ipv4();
-  GInetAddress* addr =
-      g_inet_address_new_from_bytes((const guint8*)&ipv4, G_SOCKET_FAMILY_IPV4);
-  GSocketAddress* sockAddr = g_inet_socket_address_new(addr, pal->port());
-  g_object_unref(addr);
-
-  GError* error = nullptr;
-  if (!g_socket_connect(sock, sockAddr, nullptr, &error)) {
-    LOG_WARN("g_socket_connect failed: %s", error->message);
-    g_error_free(error);
-    g_object_unref(sockAddr);
-    return false;
-  }
-  g_object_unref(sockAddr);
-
-  gssize sent = g_socket_send(sock, buf, size, nullptr, &error);
-  if (sent == -1) {
-    LOG_WARN("g_socket_send failed: %s", error->message);
-    g_error_free(error);
-    return false;
-  }
+    CreateCommand(opttype | IPMSG_GETFILEDATA, attrstr, pal->getEncode());
 
-  return true;
+  return SendTcpRequest(sock, pal);
 }
 
 /**
@@ -365,19 +379,50 @@ bool Command::SendAskData(GSocket* sock,
  * @param palKey peer key
  * @param packetno packet number
  * @param fileid file ID
+ * @param compress ask for the data compressed in blocks
  * @return true on success
  */
 bool Command::SendAskFiles(GSocket* sock,
                            const PalKey& palKey,
                            uint32_t packetno,
-                           uint32_t fileid) {
+                           uint32_t fileid,
+                           bool compress) {
   auto pal = getAndCheckPalInfo(coreThread, palKey);
   char attrstr[20];  // 8+1+8+1+1 +1  =20
+  uint32_t opttype = compress ? IPTUX_COMPRESSOPT : 0;
 
   snprintf(attrstr, 20, "%" PRIx32 ":%" PRIx32 ":0", packetno, fileid);
-  CreateCommand(IPMSG_FILEATTACHOPT | IPMSG_GETDIRFILES, attrstr);
-  ConvertEncode(pal->getEncode());
+  CreateCommand(opttype | IPMSG_FILEATTACHOPT | IPMSG_GETDIRFILES, attrstr,
+                pal->getEncode());
 
+  return SendTcpRequest(sock, pal);
+}
+
+/**
+ * Fetch the file infos that did not fit into the packet packetno.
+ * @param sock GSocket tcp socket
+ * @param palKey peer key
+ * @param packetno packet number of the file infos
+ * @return true on success
+ */
+bool Command::SendAskManifest(GSocket* sock,
+                              const PalKey& palKey,
+                              uint32_t packetno) {
+  auto pal = getAndCheckPalInfo(coreThread, palKey);
+  char attrstr[9];  // 8+1 =9
+
+  snprintf(attrstr, sizeof(attrstr), "%" PRIx32, packetno);
+  CreateCommand(IPTUX_ASKMANIFEST, attrstr, pal->getEncode());
+  return SendTcpRequest(sock, pal);
+}
+
+/**
+ * Connect to pal and send the command in buf.
+ * @param sock GSocket tcp socket
+ * @param pal peer
+ * @return true on success
+ */
+bool Command::SendTcpRequest(GSocket* sock, CPPalInfo pal) {
   in_addr ipv4 = pal->ipv4();
   GInetAddress* addr =
       g_inet_address_new_from_bytes((const guint8*)&ipv4, G_SOCKET_FAMILY_IPV4);
@@ -414,8 +459,7 @@ void Command::SendAskShared(int sock,
                             CPPalInfo pal,
                             uint32_t opttype,
                             const char* attach) {
-  CreateCommand(opttype | IPTUX_ASKSHARED, attach);
-  ConvertEncode(pal->getEncode());
+  CreateCommand(opttype | IPTUX_ASKSHARED, attach, pal->getEncode());
   commandSendTo(sock, buf, size, 0, pal);
 }
 
@@ -432,22 +476,31 @@ void Command::SendAskShared(int sock,
  * @param pal class PalInfo
  * @param opttype 命令额外选项
  * @param extra 扩展数据，即文件信息
+ * @param manifest 放不下的文件信息, 非空时在发送前按本包编号登记
+ * @return 本包的包编号
  */
-void Command::SendFileInfo(int sock,
-                           CPPalInfo pal,
-                           uint32_t opttype,
-                           const char* extra) {
-  CreateCommand(opttype | IPMSG_FILEATTACHOPT | IPMSG_SENDMSG, NULL);
-  ConvertEncode(pal->getEncode());
+uint32_t Command::SendFileInfo(int sock,
+                               CPPalInfo pal,
+                               uint32_t opttype,
+                               const char* extra,
+                               string manifest) {
+  uint32_t packetno = CreateCommand(
+      opttype | IPMSG_FILEATTACHOPT | IPMSG_SENDMSG, NULL, pal->getEncode());
   CreateIpmsgExtra(extra, pal->getEncode().c_str());
+  if (!manifest.empty()) {
+    coreThread.RegisterFileManifest(pal->GetKey(), packetno,
+                                    std::move(manifest));
+  }
   commandSendTo(sock, buf, size, 0, pal);
+  return packetno;
 }
-void Command::SendFileInfo(int sock,
-                           const PalKey& palKey,
-                           uint32_t opttype,
-                           const char* extra) {
+uint32_t Command::SendFileInfo(int sock,
+                               const PalKey& palKey,
+                               uint32_t opttype,
+                               const char* extra,
+                               string manifest) {
   auto palInfo = getAndCheckPalInfo(coreThread, palKey);
-  return SendFileInfo(sock, palInfo, opttype, extra);
+  return SendFileInfo(sock, palInfo, opttype, extra, std::move(manifest));
 }
 
 /**
@@ -456,8 +509,7 @@ void Command::SendFileInfo(int sock,
  * @param pal class PalInfo
  */
 void Command::SendMyIcon(int sock, CPPalInfo pal, istream& iss) {
-  CreateCommand(IPTUX_SENDICON, NULL);
-  ConvertEncode(pal->getEncode());
+  CreateCommand(IPTUX_SENDICON, NULL, pal->getEncode());
   CreateIconExtra(iss);
   commandSendTo(sock, buf, size, 0, pal);
 }
@@ -469,30 +521,11 @@ void Command::SendMyIcon(int sock, CPPalInfo pal, istream& iss) {
  */
 void Command::SendMySign(int sock, CPPalInfo pal) {
   auto programData = coreThread.getProgramData();
-  CreateCommand(IPTUX_SEND_SIGN, programData->sign.c_str());
-  ConvertEncode(pal->getEncode());
+  CreateCommand(IPTUX_SEND_SIGN, programData->sign.c_str(),
+                pal->getEncode());
   commandSendTo(sock, buf, size, 0, pal);
 }
 
-/**
- * 回馈错误消息.
- * @param pal class PalInfo
- * @param btype 消息归属类型
- * @param error 错误串
- */
-void Command::FeedbackError(CPPalInfo pal,
-                            GroupBelongType btype,
-                            const char* error) {
-  MsgPara para(coreThread.GetPal(pal->GetKey()));
-  para.stype = MessageSourceType::ERROR;
-  para.btype = btype;
-
-  ChipData chip(MESSAGE_CONTENT_TYPE_STRING, error);
-  para.dtlist.push_back(std::move(chip));
-  /* 交给某人处理吧 */
-  coreThread.InsertMessage(std::move(para));
-}
-
 /**
  * Send sublayer data (file data invisible to end users).
  * @param sock GSocket tcp socket
@@ -510,8 +543,7 @@ bool Command::SendSublayer(GSocket* sock,
   int fd;
   bool ret;
 
-  CreateCommand(opttype | IPTUX_SENDSUBLAYER, NULL);
-  ConvertEncode(pal->getEncode());
+  CreateCommand(opttype | IPTUX_SENDSUBLAYER, NULL, pal->getEncode());
 
   in_addr ipv4 = pal->ipv4();
   GInetAddress* addr =
@@ -571,62 +603,63 @@ bool Command::SendSublayerData(GSocket* sock, int fd) {
 }
 
 /**
- * 将缓冲区中的字符串转换为指定的编码.
- * @param encode 字符集编码
+ * 按编码将好友分组, 每组创建一次数据包并发给组内所有好友.
+ * @param sock udp socket
+ * @param pals 好友
+ * @param create 以指定编码创建数据包
  */
-void Command::ConvertEncode(const string& encode) {
-  char* ptr;
-
-  if (encode.empty()) {
-    return;
+void Command::SendToAll(int sock,
+                        const vector<CPPalInfo>& pals,
+                        const function<void(const string&)>& create) {
+  map<string, vector<CPPalInfo>> groups;
+  for (auto& pal : pals) {
+    if (pal) {
+      groups[pal->getEncode()].push_back(pal);
+    }
   }
-
-  if (strcasecmp(encode.c_str(), "utf-8") != 0 &&
-      (ptr = convert_encode(buf, encode.c_str(), "utf-8"))) {
-    size = strlen(ptr) + 1;
-    memcpy(buf, ptr, size);
-    g_free(ptr);
+  for (auto& group : groups) {
+    create(group.second.front()->getEncode());
+    for (auto& pal : group.second) {
+      commandSendTo(sock, buf, size, 0, pal);
+    }
   }
 }
 
+/**
+ * 将数据包复制到缓冲区, 超长部分截断.
+ * @param packet 数据包
+ */
+void Command::SetPacket(const string& packet) {
+  size = packet.size() < MAX_UDPLEN ? packet.size() : MAX_UDPLEN;
+  memcpy(buf, packet.data(), size);
+  buf[size - 1] = '\0';
+}
+
 /**
  * 创建命令数据.
  * @param command 命令字
  * @param attach 附加数据
+ * @param encode 好友的字符集编码
+ * @return 所用的包编号
  */
-void Command::CreateCommand(uint32_t command, const char* attach) {
-  const gchar* env;
-  char* ptr;
-
-  snprintf(buf, MAX_UDPLEN, "%s", IPTUX_VERSION);
-  size = strlen(buf);
-  ptr = buf + size;
-
-  snprintf(ptr, MAX_UDPLEN - size, ":%" PRIu32, packetn);
-  packetn++;
-  size += strlen(ptr);
-  ptr = buf + size;
-
-  env = g_get_user_name();
-  snprintf(ptr, MAX_UDPLEN - size, ":%s", env);
-  size += strlen(ptr);
-  ptr = buf + size;
-
-  env = g_get_host_name();
-  snprintf(ptr, MAX_UDPLEN - size, ":%s", env);
-  size += strlen(ptr);
-  ptr = buf + size;
-
-  if (command == IPMSG_GETFILEDATA) {
-    snprintf(ptr, MAX_UDPLEN - size, ":%u", command);
-  } else {
-    snprintf(ptr, MAX_UDPLEN - size, ":%u", command);
-  }
-  size += strlen(ptr);
-  ptr = buf + size;
+uint32_t Command::CreateCommand(uint32_t command,
+                                const char* attach,
+                                const string& encode) {
+  uint32_t packetno = packetn++;
+  SetPacket(
+      coreThread.getPacketBuilder().Build(packetno, command, attach, encode));
+  return packetno;
+}
 
-  snprintf(ptr, MAX_UDPLEN - size, ":%s", attach ? attach : "");
-  size += strlen(ptr) + 1;
+/**
+ * 创建以本人昵称为附加数据的命令数据.
+ * @param command 命令字
+ * @param encode 好友的字符集编码
+ */
+void Command::CreateCommandWithNickname(uint32_t command,
+                                        const string& encode) {
+  SetPacket(coreThread.getPacketBuilder().BuildWithNickname(packetn++, command,
+                                                            encode));
 }
 
 /**
@@ -654,26 +687,10 @@ void Command::CreateIpmsgExtra(const char* extra, const char* encode) {
  * @param encode 字符集编码
  */
 void Command::CreateIptuxExtra(const string& encode) {
-  char *pptr, *ptr;
-
-  auto programData = coreThread.getProgramData();
-  pptr = buf + size;
-  if (!encode.empty() && strcasecmp(encode.c_str(), "utf-8") != 0 &&
-      (ptr = convert_encode(programData->mygroup.c_str(), encode.c_str(),
-                            "utf-8"))) {
-    snprintf(pptr, MAX_UDPLEN - size, "%s", ptr);
-    g_free(ptr);
-  } else
-    snprintf(pptr, MAX_UDPLEN - size, "%s", programData->mygroup.c_str());
-  size += strlen(pptr) + 1;
-
-  pptr = buf + size;
-  snprintf(pptr, MAX_UDPLEN - size, "%s", programData->myicon.c_str());
-  size += strlen(pptr) + 1;
-
-  pptr = buf + size;
-  snprintf(pptr, MAX_UDPLEN - size, "utf-8");
-  size += strlen(pptr) + 1;
+  string extra = coreThread.getPacketBuilder().IptuxExtra(encode);
+  size_t len = min(extra.size(), MAX_UDPLEN - size);
+  memcpy(buf + size, extra.data(), len);
+  size += len;
 }
 
 /**
@@ -730,6 +747,19 @@ vector<FileInfo> Command::decodeFileInfos(const string& s) {
   return res;
 }
 
+vector<FileInfo> Command::decodeFileInfoStream(string& buffer) {
+  /* 跳过上一条末尾可能存在的':'字符 */
+  buffer.erase(0, buffer.find_first_not_of(':'));
+  size_t end = buffer.rfind('\a');
+  if (end == string::npos) {
+    return {};
+  }
+  auto res = decodeFileInfos(buffer.substr(0, end + 1));
+  buffer.erase(0, end + 1);
+  buffer.erase(0, buffer.find_first_not_of(':'));
+  return res;
+}
+
 string Command::encodeFileInfo(const FileInfo& fileInfo) {
   auto name =
       ipmsg_get_filename_pal(fileInfo.filepath);  // 获取面向好友的文件名
@@ -13,8 +13,11 @@
 #define IPTUX_COMMAND_H
 
 #include <gio/gio.h>
+#include <atomic>
+#include <functional>
 #include <istream>
 #include <string>
+#include <vector>
 
 #include "iptux-core/CoreThread.h"
 #include "iptux-core/Models.h"
@@ -34,26 +37,39 @@ class Command {
   using CPPalInfo = std::shared_ptr<const PalInfo>;
 
   void BroadCast(GSocket* sock, uint16_t port);
-  void DialUp(int sock, uint16_t port);
   void SendAnsentry(int sock, CPPalInfo pal);
   void SendExit(int sock, CPPalInfo pal);
   void SendAbsence(int sock, CPPalInfo pal);
+  void SendAbsence(int sock, const std::vector<CPPalInfo>& pals);
   void SendDetectPacket(int sock, in_addr ipv4, uint16_t port);
-  void SendMessage(int sock, CPPalInfo pal, const char* msg);
+  std::string CreateDetectPacket();
+  uint32_t SendMessage(CPPalInfo pal, const char* msg);
+  void SendPacket(int sock, const PalKey& pal, const std::string& packet);
   void SendReply(int sock, CPPalInfo pal, uint32_t packetno);
   void SendReply(int sock, const PalKey& pal, uint32_t packetno);
   void SendGroupMsg(int sock, CPPalInfo pal, const char* msg);
+  void SendGroupMsg(int sock,
+                    const std::vector<CPPalInfo>& pals,
+                    const char* msg);
   void SendUnitMsg(int sock, CPPalInfo pal, uint32_t opttype, const char* msg);
+  void SendUnitMsg(int sock,
+                   const std::vector<CPPalInfo>& pals,
+                   uint32_t opttype,
+                   const char* msg);
 
   bool SendAskData(GSocket* sock,
                    const PalKey& pal,
                    uint32_t packetno,
                    uint32_t fileid,
-                   int64_t offset);
+                   int64_t offset,
+                   int64_t length = 0,
+                   bool compress = false);
   bool SendAskFiles(GSocket* sock,
                     const PalKey& pal,
                     uint32_t packetno,
-                    uint32_t fileid);
+                    uint32_t fileid,
+                    bool compress = false);
+  bool SendAskManifest(GSocket* sock, const PalKey& pal, uint32_t packetno);
   void SendAskShared(int sock,
                      CPPalInfo pal,
                      uint32_t opttype,
@@ -62,14 +78,16 @@ class Command {
                      const PalKey& pal,
                      uint32_t opttype,
                      const char* attach);
-  void SendFileInfo(int sock,
-                    CPPalInfo pal,
-                    uint32_t opttype,
-                    const char* extra);
-  void SendFileInfo(int sock,
-                    const PalKey& pal,
-                    uint32_t opttype,
-                    const char* extra);
+  uint32_t SendFileInfo(int sock,
+                        CPPalInfo pal,
+                        uint32_t opttype,
+                        const char* extra,
+                        std::string manifest = "");
+  uint32_t SendFileInfo(int sock,
+                        const PalKey& pal,
+                        uint32_t opttype,
+                        const char* extra,
+                        std::string manifest = "");
   void SendMyIcon(int sock, CPPalInfo pal, std::istream& iss);
   void SendMySign(int sock, CPPalInfo pal);
   bool SendSublayer(GSocket* sock,
@@ -79,24 +97,35 @@ class Command {
 
   static std::string encodeFileInfo(const FileInfo& fileInfo);
   static std::vector<FileInfo> decodeFileInfos(const std::string& s);
+  /**
+   * @brief decode the complete file infos at the front of buffer, for data
+   * arriving in pieces; the incomplete tail is left in buffer.
+   */
+  static std::vector<FileInfo> decodeFileInfoStream(std::string& buffer);
 
  private:
-  void FeedbackError(CPPalInfo pal, GroupBelongType btype, const char* error);
   bool SendSublayerData(GSocket* sock, int fd);
-  void ConvertEncode(const std::string& encode);
-  void CreateCommand(uint32_t command, const char* attach);
+  bool SendTcpRequest(GSocket* sock, CPPalInfo pal);
+  void SendToAll(int sock,
+                 const std::vector<CPPalInfo>& pals,
+                 const std::function<void(const std::string&)>& create);
+  void SetPacket(const std::string& packet);
+  uint32_t CreateCommand(uint32_t command,
+                         const char* attach,
+                         const std::string& encode);
+  void CreateCommandWithNickname(uint32_t command, const std::string& encode);
   void CreateIpmsgExtra(const char* extra, const char* encode);
   void CreateIptuxExtra(const std::string& encode);
   void CreateIconExtra(std::istream& iss);
 
  private:
   CoreThread& coreThread;
-  size_t size;              // 当前已使用缓冲区的长度
-  char buf[MAX_UDPLEN];     // 数据缓冲区
-  static uint32_t packetn;  // 包编号
+  size_t size;                           // 当前已使用缓冲区的长度
+  char buf[MAX_UDPLEN];                  // 数据缓冲区
+  static std::atomic<uint32_t> packetn;  // 包编号, 各线程共用
 
  public:
-  inline uint32_t& Packetn() { return packetn; }
+  inline uint32_t Packetn() const { return packetn; }
 };
 
 }  // namespace iptux
@@ -35,6 +35,8 @@ string CommandMode::toString() const {
       return "GETFILEDATA";
     case IPTUX_SENDSUBLAYER:
       return "SEND_SUBLAYER";
+    case IPTUX_ASKMANIFEST:
+      return "ASKMANIFEST";
     default:
       return stringFormat(_("unknown command mode: %d"), mode);
   }
@@ -27,3 +27,37 @@ TEST(Command, encodeFileInfo) {
   fileInfos = Command::decodeFileInfos(b);
   ASSERT_EQ(int(fileInfos.size()), 0);
 }
+
+TEST(Command, decodeFileInfoStream) {
+  FileInfo fileInfo;
+  fileInfo.filepath = g_strdup("/etc/bashrc");
+  fileInfo.fileattr = FileAttr::REGULAR;
+  string data;
+  for (int i = 0; i < 3; ++i) {
+    fileInfo.fileid = i;
+    data += Command::encodeFileInfo(fileInfo);
+  }
+
+  // 逐字节到达, 每条完整后才解码出来
+  string pending;
+  vector<FileInfo> fileInfos;
+  for (char c : data) {
+    pending.push_back(c);
+    for (auto& file : Command::decodeFileInfoStream(pending)) {
+      fileInfos.push_back(file);
+    }
+  }
+  ASSERT_EQ(int(fileInfos.size()), 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(fileInfos[i].fileid, uint32_t(i));
+    EXPECT_STREQ(fileInfos[i].filepath, "bashrc");
+  }
+  EXPECT_TRUE(pending.empty());
+
+  pending = data.substr(0, data.size() - 5);
+  EXPECT_EQ(int(Command::decodeFileInfoStream(pending).size()), 2);
+  EXPECT_FALSE(pending.empty());
+  pending += data.substr(data.size() - 5);
+  EXPECT_EQ(int(Command::decodeFileInfoStream(pending).size()), 1);
+  EXPECT_TRUE(pending.empty());
+}
@@ -0,0 +1,361 @@
+#include "config.h"
+#include "CompressedStream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+#include "iptux-utils/output.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+const int kMaxLevel = 9;
+const uint32_t kDeflatedFlag = 0x80000000;
+/* 每尝试压缩这么多块后调整一次级别 */
+const int kAdaptWindow = 8;
+/* 遇到无法压缩的块后, 接下来的这么多块不再尝试 */
+const int kIncompressibleSkip = 8;
+/* 级别为1仍然是压缩拖慢了传输时, 这么多块只存储不压缩 */
+const int kStoreBackoff = 64;
+
+int64_t nowUs() {
+  return chrono::duration_cast<chrono::microseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * 读取count字节, 直到读满或遇到文件尾.
+ * @return 读取的数据量, -1表示出错
+ */
+ssize_t readFull(int fd, char* buf, size_t count) {
+  size_t offset = 0;
+  while (offset < count) {
+    ssize_t size = read(fd, buf + offset, count - offset);
+    if (size == 0) {
+      break;
+    }
+    if (size > 0) {
+      offset += size;
+    } else if (errno == EAGAIN) {
+      struct pollfd pfd = {fd, POLLIN, 0};
+      poll(&pfd, 1, -1);
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return offset;
+}
+
+bool sendAll(int fd, const char* buf, size_t count) {
+  size_t offset = 0;
+  while (offset < count) {
+    ssize_t size = send(fd, buf + offset, count - offset, MSG_NOSIGNAL);
+    if (size >= 0) {
+      offset += size;
+    } else if (errno == EAGAIN) {
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      poll(&pfd, 1, -1);
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * 一次转换整块数据.
+ * @return 输入全部转换完毕, 且输出放得下
+ */
+bool convertBlock(GConverter* converter,
+                  const char* in,
+                  size_t inLen,
+                  char* out,
+                  size_t outLen,
+                  size_t* written) {
+  gsize bytesRead = 0, bytesWritten = 0;
+  GError* error = nullptr;
+  GConverterResult res = g_converter_convert(
+      converter, in, inLen, out, outLen, G_CONVERTER_INPUT_AT_END, &bytesRead,
+      &bytesWritten, &error);
+  g_converter_reset(converter);
+  if (error) {
+    g_error_free(error);
+    return false;
+  }
+  *written = bytesWritten;
+  return res == G_CONVERTER_FINISHED && bytesRead == inLen;
+}
+}  // namespace
+
+struct CompressedStream::Impl {
+  int sock;
+  Mode mode;
+  int fds[2]{-1, -1};  // fds[0]交给调用者, fds[1]由转发线程读写
+  thread relay;
+  atomic<bool> ok{false};
+  atomic<int> level;
+  atomic<int64_t> rawBytes{0};
+  atomic<int64_t> wireBytes{0};
+  GConverter* compressors[kMaxLevel + 1]{};  // 按级别, 用到时才创建
+  GConverter* decompressor{nullptr};
+
+  Impl(int sock, Mode mode, int level)
+      : sock(sock), mode(mode), level(clamp(level, 0, kMaxLevel)) {}
+  ~Impl() {
+    for (auto compressor : compressors) {
+      if (compressor) {
+        g_object_unref(compressor);
+      }
+    }
+    if (decompressor) {
+      g_object_unref(decompressor);
+    }
+  }
+
+  bool compress();
+  bool decompress();
+  bool deflate(int lvl,
+               const char* in,
+               size_t len,
+               char* out,
+               size_t outLen,
+               size_t* size);
+  void adapt(int64_t compressUs, int64_t sendUs, int& storeBlocks);
+};
+
+/**
+ * 把本地一端写入的数据按块压缩后发到连接上, 直到本地一端关闭.
+ */
+bool CompressedStream::Impl::compress() {
+  vector<char> raw(kBlockSize);
+  vector<char> wire(kHeaderSize + kBlockSize);
+  int skipBlocks = 0, storeBlocks = 0, tried = 0;
+  int64_t compressUs = 0, sendUs = 0;
+
+  while (true) {
+    ssize_t len = readFull(fds[1], raw.data(), kBlockSize);
+    if (len <= 0) {
+      return len == 0;
+    }
+    size_t size = 0;
+    bool deflated = false;
+    int64_t start = nowUs();
+    bool attempt = level > 0 && skipBlocks == 0 && storeBlocks == 0;
+    if (attempt) {
+      /* 至少要省下一成, 否则不值得对方解压 */
+      deflated = deflate(level, raw.data(), len, wire.data() + kHeaderSize,
+                         len - len / 10, &size);
+      if (!deflated) {
+        skipBlocks = kIncompressibleSkip;
+      }
+    } else if (skipBlocks > 0) {
+      skipBlocks--;
+    } else if (storeBlocks > 0) {
+      storeBlocks--;
+    }
+    if (!deflated) {
+      memcpy(wire.data() + kHeaderSize, raw.data(), len);
+      size = len;
+    }
+    uint32_t flag = deflated ? kDeflatedFlag : 0;
+    uint32_t header[2] = {htonl(uint32_t(size) | flag), htonl(uint32_t(len))};
+    memcpy(wire.data(), header, kHeaderSize);
+    int64_t sendStart = nowUs();
+    if (!sendAll(sock, wire.data(), kHeaderSize + size)) {
+      LOG_WARN("send compressed block failed: %s", strerror(errno));
+      return false;
+    }
+    rawBytes += len;
+    wireBytes += kHeaderSize + size;
+
+    /* 只按尝试过压缩的块比较压缩与发送的耗时 */
+    if (attempt) {
+      compressUs += sendStart - start;
+      sendUs += nowUs() - sendStart;
+      if (++tried == kAdaptWindow) {
+        adapt(compressUs, sendUs, storeBlocks);
+        tried = 0;
+        compressUs = sendUs = 0;
+      }
+    }
+  }
+}
+
+/**
+ * 从连接上读取压缩的块, 解压后写到本地一端, 直到连接关闭.
+ */
+bool CompressedStream::Impl::decompress() {
+  vector<char> raw(kBlockSize);
+  vector<char> wire(kBlockSize);
+  uint32_t header[2];
+
+  while (true) {
+    ssize_t len = readFull(sock, (char*)header, kHeaderSize);
+    if (len <= 0) {
+      return len == 0;
+    }
+    if (len != ssize_t(kHeaderSize)) {
+      LOG_WARN("truncated compressed block header");
+      return false;
+    }
+    uint32_t size = ntohl(header[0]) & ~kDeflatedFlag;
+    bool deflated = ntohl(header[0]) & kDeflatedFlag;
+    uint32_t rawLen = ntohl(header[1]);
+    if (rawLen == 0 || rawLen > kBlockSize || size > rawLen ||
+        (!deflated && size != rawLen)) {
+      LOG_WARN("invalid compressed block: %u -> %u", size, rawLen);
+      return false;
+    }
+    if (readFull(sock, wire.data(), size) != ssize_t(size)) {
+      LOG_WARN("truncated compressed block");
+      return false;
+    }
+    const char* data = wire.data();
+    if (deflated) {
+      if (!decompressor) {
+        decompressor = G_CONVERTER(
+            g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+      }
+      size_t written = 0;
+      if (!convertBlock(decompressor, wire.data(), size, raw.data(), rawLen,
+                        &written) ||
+          written != rawLen) {
+        LOG_WARN("corrupted compressed block: %u -> %u", size, rawLen);
+        return false;
+      }
+      data = raw.data();
+    }
+    if (!sendAll(fds[1], data, rawLen)) {
+      return false;  // 接收方已不再读取
+    }
+    rawBytes += rawLen;
+    wireBytes += kHeaderSize + size;
+  }
+}
+
+bool CompressedStream::Impl::deflate(int lvl,
+                                     const char* in,
+                                     size_t len,
+                                     char* out,
+                                     size_t outLen,
+                                     size_t* size) {
+  if (!compressors[lvl]) {
+    compressors[lvl] = G_CONVERTER(
+        g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB, lvl));
+  }
+  return convertBlock(compressors[lvl], in, len, out, outLen, size);
+}
+
+/**
+ * 压缩耗时超过发送的两倍时降低级别, 发送耗时超过压缩的四倍时提高级别.
+ */
+void CompressedStream::Impl::adapt(int64_t compressUs,
+                                   int64_t sendUs,
+                                   int& storeBlocks) {
+  int current = level;
+  if (compressUs > 2 * sendUs) {
+    if (current > 1) {
+      level = current - 1;
+    } else {
+      storeBlocks = kStoreBackoff;
+    }
+  } else if (sendUs > 4 * compressUs && current < kMaxLevel) {
+    level = current + 1;
+  }
+  if (level != current) {
+    LOG_DEBUG("compression level %d -> %d (compress %jdus, send %jdus)",
+              current, int(level), (intmax_t)compressUs, (intmax_t)sendUs);
+  }
+}
+
+CompressedStream::CompressedStream(int sock, Mode mode, int level)
+    : pImpl(make_unique<Impl>(sock, mode, level)) {}
+
+CompressedStream::~CompressedStream() {
+  if (pImpl->relay.joinable()) {
+    Finish(true);
+  }
+}
+
+bool CompressedStream::Start() {
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pImpl->fds) == -1) {
+    LOG_WARN("socketpair failed: %s", strerror(errno));
+    return false;
+  }
+  Impl* impl = pImpl.get();
+  impl->relay = thread([impl] {
+    impl->ok = impl->mode == Mode::COMPRESS ? impl->compress()
+                                            : impl->decompress();
+    /* 出错时让另一端的读写立即失败, 否则只通知数据已结束 */
+    shutdown(impl->fds[1], impl->ok ? SHUT_WR : SHUT_RDWR);
+  });
+  return true;
+}
+
+int CompressedStream::GetFd() const {
+  return pImpl->fds[0];
+}
+
+bool CompressedStream::Finish(bool abort) {
+  if (!pImpl->relay.joinable()) {
+    return false;
+  }
+  bool compress = pImpl->mode == Mode::COMPRESS;
+  if (abort || !compress) {
+    shutdown(pImpl->sock, SHUT_RDWR);
+  }
+  shutdown(pImpl->fds[0], abort || !compress ? SHUT_RDWR : SHUT_WR);
+  pImpl->relay.join();
+  for (int& fd : pImpl->fds) {
+    close(fd);
+    fd = -1;
+  }
+  return pImpl->ok;
+}
+
+int CompressedStream::GetLevel() const {
+  return pImpl->level;
+}
+
+int64_t CompressedStream::GetRawBytes() const {
+  return pImpl->rawBytes;
+}
+
+int64_t CompressedStream::GetWireBytes() const {
+  return pImpl->wireBytes;
+}
+
+bool CompressedStream::IsPrecompressed(const string& filename) {
+  static const char* const extensions[] = {
+      "7z",  "apk", "avi",  "bz2",  "deb",  "docx", "epub", "flac", "flv",
+      "gif", "gz",  "heic", "jar",  "jpeg", "jpg",  "lz4",  "lzma", "m4a",
+      "mkv", "mov", "mp3",  "mp4",  "odt",  "ogg",  "opus", "png",  "pptx",
+      "rar", "rpm", "tgz",  "txz",  "webm", "webp", "xlsx", "xz",   "zip",
+      "zst"};
+  size_t pos = filename.rfind('.');
+  if (pos == string::npos || filename.find('/', pos) != string::npos) {
+    return false;
+  }
+  string ext = filename.substr(pos + 1);
+  transform(ext.begin(), ext.end(), ext.begin(),
+            [](unsigned char c) { return tolower(c); });
+  return any_of(begin(extensions), end(extensions),
+                [&ext](const char* e) { return ext == e; });
+}
+
+}  // namespace iptux
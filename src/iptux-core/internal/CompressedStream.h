@@ -0,0 +1,88 @@
+#ifndef IPTUX_COMPRESSED_STREAM_H
+#define IPTUX_COMPRESSED_STREAM_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace iptux {
+
+/**
+ * @brief compresses (or decompresses) a file transfer connection on a relay
+ * thread, so the transfer code keeps reading and writing plain data.
+ *
+ * The transfer code uses GetFd(), one end of a socket pair; the relay moves
+ * the data between the other end and the real connection. On the wire the
+ * data is cut into blocks of at most kBlockSize bytes, each preceded by an
+ * 8 byte header: the payload length (big endian, top bit set if the payload
+ * is zlib compressed) and the original length. Blocks are compressed
+ * independently with GZlibCompressor, a block is sent as is unless
+ * compressing saves at least a tenth of it.
+ *
+ * When compressing, the level adapts to the measured throughput. The time
+ * spent compressing and sending is summed over every 8 blocks that were
+ * tried: the level goes down by one when compressing took more than twice
+ * as long as sending, and up by one when sending took more than four times
+ * as long as compressing. When compressing is still too slow at level 1,
+ * the next 64 blocks are stored without trying. After a block that did not
+ * compress, the next 8 blocks are not tried either.
+ */
+class CompressedStream {
+ public:
+  enum class Mode { COMPRESS, DECOMPRESS };
+
+  static constexpr size_t kBlockSize = 256 * 1024;
+  static constexpr size_t kHeaderSize = 8;
+  /* 初始压缩级别, 0为只存储不压缩 */
+  static constexpr int kDefaultLevel = 3;
+
+  /**
+   * @param sock the real connection, not owned
+   * @param level initial compression level, 0 to never compress
+   */
+  CompressedStream(int sock, Mode mode, int level = kDefaultLevel);
+  ~CompressedStream();
+
+  CompressedStream(const CompressedStream&) = delete;
+  CompressedStream& operator=(const CompressedStream&) = delete;
+
+  /**
+   * @brief create the socket pair and start the relay thread.
+   */
+  bool Start();
+
+  /**
+   * @brief the local end carrying the uncompressed data, owned by this
+   * object.
+   */
+  int GetFd() const;
+
+  /**
+   * @brief stop the relay and wait for it.
+   *
+   * When compressing, the local end is closed for writing and the pending
+   * data is sent, unless abort is set. When decompressing, the connection
+   * is shut down since nothing more is read from it.
+   *
+   * @return whether the relay moved all data without error
+   */
+  bool Finish(bool abort = false);
+
+  int GetLevel() const;
+  int64_t GetRawBytes() const;
+  int64_t GetWireBytes() const;
+
+  /**
+   * @brief whether the file name has the extension of an already
+   * compressed format (archives, images, audio, video...).
+   */
+  static bool IsPrecompressed(const std::string& filename);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> pImpl;
+};
+
+}  // namespace iptux
+
+#endif
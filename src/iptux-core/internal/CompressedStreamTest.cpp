@@ -0,0 +1,127 @@
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "iptux-core/internal/CompressedStream.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+using Mode = CompressedStream::Mode;
+
+vector<char> readAll(int fd) {
+  vector<char> result;
+  char buf[65536];
+  ssize_t size;
+  while ((size = read(fd, buf, sizeof(buf))) > 0) {
+    result.insert(result.end(), buf, buf + size);
+  }
+  return result;
+}
+
+// 压缩端写入data, 解压端读出的数据
+vector<char> transfer(const vector<char>& data,
+                      int level,
+                      int64_t* wireBytes) {
+  int link[2];
+  EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, link), 0);
+  CompressedStream sender(link[0], Mode::COMPRESS, level);
+  CompressedStream receiver(link[1], Mode::DECOMPRESS);
+  EXPECT_TRUE(sender.Start());
+  EXPECT_TRUE(receiver.Start());
+
+  thread writer([&] {
+    size_t offset = 0;
+    while (offset < data.size()) {
+      ssize_t size = write(sender.GetFd(), data.data() + offset,
+                           min<size_t>(data.size() - offset, 100000));
+      ASSERT_GT(size, 0);
+      offset += size;
+    }
+    EXPECT_TRUE(sender.Finish());
+    close(link[0]);
+  });
+  vector<char> result = readAll(receiver.GetFd());
+  writer.join();
+  EXPECT_TRUE(receiver.Finish());
+  close(link[1]);
+
+  EXPECT_EQ(sender.GetRawBytes(), int64_t(data.size()));
+  EXPECT_EQ(receiver.GetRawBytes(), int64_t(data.size()));
+  EXPECT_EQ(sender.GetWireBytes(), receiver.GetWireBytes());
+  *wireBytes = sender.GetWireBytes();
+  return result;
+}
+
+// 可压缩的文本后接不可压缩的数据
+vector<char> testData() {
+  vector<char> data;
+  for (int i = 0; data.size() < 1500 * 1024; ++i) {
+    string line = "line " + to_string(i) + ": the quick brown fox\n";
+    data.insert(data.end(), line.begin(), line.end());
+  }
+  uint32_t seed = 12345;
+  for (int i = 0; i < 700 * 1024; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data.push_back(char(seed >> 16));
+  }
+  return data;
+}
+}  // namespace
+
+TEST(CompressedStream, RoundTrip) {
+  vector<char> data = testData();
+  int64_t wireBytes = 0;
+  EXPECT_TRUE(transfer(data, CompressedStream::kDefaultLevel, &wireBytes) ==
+              data);
+  EXPECT_LT(wireBytes, int64_t(data.size()) / 2);
+}
+
+TEST(CompressedStream, StoreOnly) {
+  vector<char> data = testData();
+  int64_t wireBytes = 0;
+  EXPECT_TRUE(transfer(data, 0, &wireBytes) == data);
+  size_t blocks = (data.size() + CompressedStream::kBlockSize - 1) /
+                  CompressedStream::kBlockSize;
+  EXPECT_EQ(wireBytes,
+            int64_t(data.size() + blocks * CompressedStream::kHeaderSize));
+}
+
+TEST(CompressedStream, Empty) {
+  int64_t wireBytes = -1;
+  EXPECT_TRUE(transfer({}, CompressedStream::kDefaultLevel, &wireBytes)
+                  .empty());
+  EXPECT_EQ(wireBytes, 0);
+}
+
+TEST(CompressedStream, Corrupted) {
+  int link[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, link), 0);
+  CompressedStream receiver(link[1], Mode::DECOMPRESS);
+  ASSERT_TRUE(receiver.Start());
+
+  // 标记为已压缩, 数据却不是zlib格式
+  uint32_t header[2] = {htonl(0x80000000 | 4), htonl(16)};
+  ASSERT_EQ(write(link[0], header, sizeof(header)), ssize_t(sizeof(header)));
+  ASSERT_EQ(write(link[0], "abcd", 4), 4);
+  EXPECT_TRUE(readAll(receiver.GetFd()).empty());
+  EXPECT_FALSE(receiver.Finish());
+  close(link[0]);
+  close(link[1]);
+}
+
+TEST(CompressedStream, IsPrecompressed) {
+  EXPECT_TRUE(CompressedStream::IsPrecompressed("a.zip"));
+  EXPECT_TRUE(CompressedStream::IsPrecompressed("/tmp/photo.JPG"));
+  EXPECT_TRUE(CompressedStream::IsPrecompressed("backup.tar.gz"));
+  EXPECT_FALSE(CompressedStream::IsPrecompressed("notes.txt"));
+  EXPECT_FALSE(CompressedStream::IsPrecompressed("Makefile"));
+  EXPECT_FALSE(CompressedStream::IsPrecompressed("/tmp/a.zip/data"));
+}
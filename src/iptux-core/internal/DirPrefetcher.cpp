@@ -0,0 +1,238 @@
+#include "config.h"
+#include "DirPrefetcher.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "iptux-utils/output.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+// read ahead at most this much of each regular file
+const off_t READAHEAD_LIMIT = 1024 * 1024;
+
+void adviseSequential(int fd, off_t size) {
+#if HAVE_POSIX_FADVISE
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if (size > 0) {
+    posix_fadvise(fd, 0, size < READAHEAD_LIMIT ? size : READAHEAD_LIMIT,
+                  POSIX_FADV_WILLNEED);
+  }
+#else
+  (void)fd;
+  (void)size;
+#endif
+}
+}  // namespace
+
+DirPrefetcher::DirPrefetcher(const string& dir,
+                             const string& name,
+                             size_t maxEntries,
+                             int64_t maxBytes,
+                             size_t maxOpenFiles)
+    : maxEntries(maxEntries > 0 ? maxEntries : 1),
+      maxBytes(maxBytes),
+      maxOpenFiles(maxOpenFiles) {
+  walker = thread(&DirPrefetcher::walk, this, dir, name);
+}
+
+DirPrefetcher::~DirPrefetcher() {
+  Stop();
+}
+
+bool DirPrefetcher::Next(Entry& entry) {
+  unique_lock<std::mutex> l(mutex);
+  cond.wait(l, [this] { return stopping || done || !entries.empty(); });
+  if (stopping || entries.empty()) {
+    return false;
+  }
+  entry = std::move(entries.front());
+  entries.pop_front();
+  if (entry.kind == Kind::REGULAR) {
+    bufferedBytes -= entry.st.st_size;
+    if (entry.fd != -1) {
+      openFiles--;
+    }
+  }
+  cond.notify_all();
+  l.unlock();
+
+  if (entry.kind == Kind::REGULAR && entry.fd == -1) {
+    entry.fd = open(entry.path.c_str(), O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+    if (entry.fd == -1) {
+      LOG_WARN("open \"%s\" failed: %s", entry.path.c_str(), strerror(errno));
+      lock_guard<std::mutex> l2(mutex);
+      failed = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t DirPrefetcher::Ready() const {
+  lock_guard<std::mutex> l(mutex);
+  return entries.size();
+}
+
+bool DirPrefetcher::Failed() const {
+  lock_guard<std::mutex> l(mutex);
+  return failed;
+}
+
+void DirPrefetcher::Stop() {
+  deque<Entry> dropped;
+  {
+    lock_guard<std::mutex> l(mutex);
+    stopping = true;
+    dropped.swap(entries);
+    bufferedBytes = 0;
+  }
+  cond.notify_all();
+  if (walker.joinable()) {
+    walker.join();
+  }
+  for (auto& entry : dropped) {
+    if (entry.fd != -1) {
+      close(entry.fd);
+    }
+  }
+}
+
+/**
+ * 缓冲中打开的文件未达上限时占用一个名额.
+ */
+bool DirPrefetcher::reserveOpenFile() {
+  lock_guard<std::mutex> l(mutex);
+  if (openFiles >= maxOpenFiles) {
+    return false;
+  }
+  openFiles++;
+  return true;
+}
+
+/**
+ * 放入一个条目, 缓冲已满时等待消费者.
+ * @return false if stopped, the entry's file is closed then
+ */
+bool DirPrefetcher::push(Entry&& entry) {
+  unique_lock<std::mutex> l(mutex);
+  int64_t size = entry.kind == Kind::REGULAR ? entry.st.st_size : 0;
+  cond.wait(l, [&] {
+    return stopping || entries.empty() ||
+           (entries.size() < maxEntries && bufferedBytes + size <= maxBytes);
+  });
+  if (stopping) {
+    if (entry.fd != -1) {
+      close(entry.fd);
+    }
+    return false;
+  }
+  bufferedBytes += size;
+  entries.push_back(std::move(entry));
+  cond.notify_all();
+  return true;
+}
+
+/**
+ * 深度优先遍历目录树 (生产者线程).
+ */
+void DirPrefetcher::walk(string dir, string name) {
+  struct Frame {
+    DIR* dir;
+    struct ::stat st;
+    string path;
+  };
+  vector<Frame> stack;
+
+  /* 访问一个条目, 返回false表示需要终止遍历 */
+  auto visit = [&](int parentfd, const string& parent,
+                   const char* fname) -> bool {
+    Entry entry;
+    entry.name = fname;
+    if (fstatat(parentfd, fname, &entry.st, 0) == -1) {
+      LOG_WARN("stat \"%s\" failed: %s", fname, strerror(errno));
+      return true;
+    }
+    if (S_ISREG(entry.st.st_mode)) {
+      entry.kind = Kind::REGULAR;
+      entry.fd = openat(parentfd, fname, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+      if (entry.fd == -1) {
+        LOG_WARN("open \"%s\" failed: %s", fname, strerror(errno));
+        return false;
+      }
+      adviseSequential(entry.fd, entry.st.st_size);
+      entry.path = parent + "/" + fname;
+      /* 预读已经发出, 超出上限的文件先关闭, 由消费者重新打开 */
+      if (!reserveOpenFile()) {
+        close(entry.fd);
+        entry.fd = -1;
+      }
+      return push(std::move(entry));
+    }
+    if (S_ISDIR(entry.st.st_mode)) {
+      entry.kind = Kind::DIRECTORY;
+      struct ::stat st = entry.st;
+      if (!push(std::move(entry))) {
+        return false;
+      }
+      int fd = openat(parentfd, fname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      DIR* subdir = fd == -1 ? nullptr : fdopendir(fd);
+      if (!subdir) {
+        LOG_WARN("open directory \"%s\" failed: %s", fname, strerror(errno));
+        if (fd != -1) {
+          close(fd);
+        }
+        return false;
+      }
+      stack.push_back(Frame{subdir, st, parent + "/" + fname});
+    }
+    return true;
+  };
+
+  bool ok = false;
+  int rootfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (rootfd == -1) {
+    LOG_WARN("open directory \"%s\" failed: %s", dir.c_str(), strerror(errno));
+  } else {
+    ok = visit(rootfd, dir, name.c_str());
+    close(rootfd);
+  }
+
+  while (ok && !stack.empty()) {
+    DIR* top = stack.back().dir;
+    struct dirent* dirt = readdir(top);
+    if (!dirt) {
+      /* 目录已读完, 通知对方向上转 */
+      Entry entry;
+      entry.kind = Kind::RETPARENT;
+      entry.name = ".";
+      entry.st = stack.back().st;
+      closedir(top);
+      stack.pop_back();
+      ok = push(std::move(entry));
+      continue;
+    }
+    if (strcmp(dirt->d_name, ".") == 0 || strcmp(dirt->d_name, "..") == 0) {
+      continue;
+    }
+    ok = visit(dirfd(top), stack.back().path, dirt->d_name);
+  }
+  for (auto& frame : stack) {
+    closedir(frame.dir);
+  }
+
+  lock_guard<std::mutex> l(mutex);
+  done = true;
+  failed = !ok && !stopping;
+  cond.notify_all();
+}
+
+}  // namespace iptux
@@ -0,0 +1,100 @@
+#ifndef IPTUX_DIR_PREFETCHER_H
+#define IPTUX_DIR_PREFETCHER_H
+
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace iptux {
+
+/**
+ * @brief walks a directory tree ahead of the directory sender.
+ *
+ * A producer thread visits the tree depth first with openat/fstatat, opens
+ * the regular files and asks the kernel to read them ahead, while the
+ * consumer pops the entries in IPMSG directory order: a directory is
+ * followed by its content, then by a RETPARENT entry. At most maxEntries
+ * entries, and maxBytes of regular file data, are buffered. Only
+ * maxOpenFiles of the buffered files are kept open, the others are closed
+ * after the read ahead and opened again by Next().
+ */
+class DirPrefetcher {
+ public:
+  enum class Kind { REGULAR, DIRECTORY, RETPARENT };
+
+  struct Entry {
+    Kind kind{Kind::REGULAR};
+    std::string name;  // local file name, "." for RETPARENT
+    struct ::stat st{};
+    int fd{-1};        // opened regular file, to be closed by the consumer
+    std::string path;  // to open the file again if it was closed
+  };
+
+  static constexpr size_t DEFAULT_MAX_ENTRIES = 256;
+  static constexpr int64_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+  static constexpr size_t DEFAULT_MAX_OPEN_FILES = 16;
+
+  /**
+   * @param dir directory containing name
+   * @param name the file or directory to walk
+   */
+  DirPrefetcher(const std::string& dir,
+                const std::string& name,
+                size_t maxEntries = DEFAULT_MAX_ENTRIES,
+                int64_t maxBytes = DEFAULT_MAX_BYTES,
+                size_t maxOpenFiles = DEFAULT_MAX_OPEN_FILES);
+  ~DirPrefetcher();
+
+  DirPrefetcher(const DirPrefetcher&) = delete;
+  DirPrefetcher& operator=(const DirPrefetcher&) = delete;
+
+  /**
+   * @brief pop the next entry, waiting for the walker if needed.
+   *
+   * @return false once the walk is over, check Failed() then
+   */
+  bool Next(Entry& entry);
+
+  /**
+   * @brief count of entries ready to be popped without waiting
+   */
+  size_t Ready() const;
+
+  /**
+   * @brief true if a file or directory could not be opened
+   */
+  bool Failed() const;
+
+  /**
+   * @brief stop the walker and close the buffered files
+   */
+  void Stop();
+
+ private:
+  void walk(std::string dir, std::string name);
+  bool push(Entry&& entry);
+  bool reserveOpenFile();
+
+  const size_t maxEntries;
+  const int64_t maxBytes;
+  const size_t maxOpenFiles;
+
+  mutable std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<Entry> entries;
+  int64_t bufferedBytes{0};
+  size_t openFiles{0};  // buffered entries holding an fd
+  bool done{false};
+  bool failed{false};
+  bool stopping{false};
+  std::thread walker;
+};
+
+}  // namespace iptux
+
+#endif
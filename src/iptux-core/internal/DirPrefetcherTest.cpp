@@ -0,0 +1,107 @@
+#include "gtest/gtest.h"
+
+#include <set>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "iptux-core/internal/DirPrefetcher.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+// root/{a, sub/{b, empty/}}
+string makeTree() {
+  gchar* tmp = g_dir_make_tmp("iptux-prefetch-XXXXXX", nullptr);
+  string base(tmp);
+  g_free(tmp);
+  g_mkdir(string(base + "/root").c_str(), 0755);
+  g_mkdir(string(base + "/root/sub").c_str(), 0755);
+  g_mkdir(string(base + "/root/sub/empty").c_str(), 0755);
+  g_file_set_contents(string(base + "/root/a").c_str(), "hello", -1, nullptr);
+  g_file_set_contents(string(base + "/root/sub/b").c_str(), "world!", -1,
+                      nullptr);
+  return base;
+}
+
+void removeTree(const string& base) {
+  g_remove(string(base + "/root/sub/b").c_str());
+  g_remove(string(base + "/root/a").c_str());
+  g_rmdir(string(base + "/root/sub/empty").c_str());
+  g_rmdir(string(base + "/root/sub").c_str());
+  g_rmdir(string(base + "/root").c_str());
+  g_rmdir(base.c_str());
+}
+
+void checkWalk(const string& base,
+               size_t maxEntries,
+               size_t maxOpenFiles = DirPrefetcher::DEFAULT_MAX_OPEN_FILES) {
+  DirPrefetcher walker(base, "root", maxEntries,
+                       DirPrefetcher::DEFAULT_MAX_BYTES, maxOpenFiles);
+  DirPrefetcher::Entry entry;
+  vector<string> dirs;
+  set<string> files;
+  int depth = 0, retparents = 0;
+  while (walker.Next(entry)) {
+    switch (entry.kind) {
+      case DirPrefetcher::Kind::DIRECTORY:
+        dirs.push_back(entry.name);
+        depth++;
+        break;
+      case DirPrefetcher::Kind::RETPARENT:
+        EXPECT_GT(depth, 0);
+        depth--;
+        retparents++;
+        break;
+      case DirPrefetcher::Kind::REGULAR: {
+        EXPECT_GT(depth, 0);
+        ASSERT_NE(entry.fd, -1);
+        char buf[16];
+        ssize_t size = read(entry.fd, buf, sizeof(buf));
+        close(entry.fd);
+        EXPECT_EQ(size, entry.st.st_size);
+        files.insert(entry.name + "=" + string(buf, size > 0 ? size : 0));
+        break;
+      }
+    }
+  }
+  EXPECT_FALSE(walker.Failed());
+  EXPECT_EQ(depth, 0);
+  EXPECT_EQ(retparents, 3);
+  ASSERT_EQ(dirs.size(), 3u);
+  EXPECT_EQ(dirs[0], "root");
+  EXPECT_EQ(files, (set<string>{"a=hello", "b=world!"}));
+}
+}  // namespace
+
+TEST(DirPrefetcher, Walk) {
+  auto base = makeTree();
+  checkWalk(base, DirPrefetcher::DEFAULT_MAX_ENTRIES);
+  // the walker has to wait for the consumer on every entry
+  checkWalk(base, 1);
+  // every file is closed by the walker and opened again by Next()
+  checkWalk(base, DirPrefetcher::DEFAULT_MAX_ENTRIES, 0);
+  removeTree(base);
+}
+
+TEST(DirPrefetcher, Failed) {
+  DirPrefetcher walker("/non/existent/dir", "root");
+  DirPrefetcher::Entry entry;
+  EXPECT_FALSE(walker.Next(entry));
+  EXPECT_TRUE(walker.Failed());
+}
+
+TEST(DirPrefetcher, Stop) {
+  auto base = makeTree();
+  {
+    DirPrefetcher walker(base, "root", 1);
+    DirPrefetcher::Entry entry;
+    EXPECT_TRUE(walker.Next(entry));
+    walker.Stop();
+    EXPECT_FALSE(walker.Next(entry));
+    EXPECT_FALSE(walker.Failed());
+  }
+  removeTree(base);
+}
@@ -0,0 +1,194 @@
+#include "config.h"
+#include "DiscoveryScanner.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "iptux-utils/output.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+const size_t kMaxBatch = 64;
+/* 发送缓冲区满时等待可写的最长时间 */
+const int kWritableTimeoutMs = 100;
+const int kMaxRetries = 3;
+const auto kProgressInterval = chrono::milliseconds(100);
+}  // namespace
+
+DiscoveryScanner::DiscoveryScanner(int sock,
+                                   uint16_t port,
+                                   uint32_t packetsPerSecond)
+    : sock(sock), port(port), packetsPerSecond(packetsPerSecond) {}
+
+vector<DiscoveryScanner::Range> DiscoveryScanner::MakeRanges(
+    const vector<NetSegment>& segments) {
+  vector<Range> ranges;
+  for (const NetSegment& segment : segments) {
+    if (segment.IsValid()) {
+      ranges.emplace_back(segment.getStart(), segment.getEnd());
+    } else {
+      LOG_WARN("skip invalid net segment %s-%s", segment.getStartIp().c_str(),
+               segment.getEndIp().c_str());
+    }
+  }
+  sort(ranges.begin(), ranges.end());
+
+  vector<Range> merged;
+  for (const Range& range : ranges) {
+    if (!merged.empty() &&
+        uint64_t(range.first) <= uint64_t(merged.back().second) + 1) {
+      merged.back().second = max(merged.back().second, range.second);
+    } else {
+      merged.push_back(range);
+    }
+  }
+  return merged;
+}
+
+DiscoveryStats DiscoveryScanner::Scan(const vector<Range>& ranges,
+                                      const string& packet,
+                                      const Progress& progress) {
+  DiscoveryStats stats;
+  for (const Range& range : ranges) {
+    stats.total += uint64_t(range.second) - range.first + 1;
+  }
+
+  /* 限速时每批约10ms的量, 以便均匀发送并及时响应取消 */
+  size_t batch = kMaxBatch;
+  if (packetsPerSecond > 0) {
+    batch = max<size_t>(1, min<size_t>(kMaxBatch, packetsPerSecond / 100));
+  }
+  vector<sockaddr_in> addrs(batch);
+  for (auto& addr : addrs) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+  }
+
+  auto start = chrono::steady_clock::now();
+  auto lastProgress = start;
+  auto range = ranges.begin();
+  uint32_t next = range != ranges.end() ? range->first : 0;
+  uint64_t done = 0;
+  unique_lock<std::mutex> l(mutex);
+  while (range != ranges.end() && !cancelled) {
+    l.unlock();
+    size_t count = 0;
+    while (count < batch && range != ranges.end()) {
+      addrs[count++].sin_addr = inAddrFromUint32(next);
+      if (next == range->second) {
+        if (++range != ranges.end()) {
+          next = range->first;
+        }
+      } else {
+        ++next;
+      }
+    }
+    size_t sent = sendBatch(addrs.data(), count, packet);
+    stats.sent += sent;
+    stats.failed += count - sent;
+    done += count;
+
+    auto now = chrono::steady_clock::now();
+    if (progress && now - lastProgress >= kProgressInterval) {
+      progress(done, stats.total);
+      lastProgress = now;
+    }
+    l.lock();
+    if (packetsPerSecond > 0) {
+      auto due =
+          start + chrono::microseconds(done * 1000000 / packetsPerSecond);
+      cond.wait_until(l, due, [this] { return cancelled; });
+    }
+  }
+  stats.cancelled = done < stats.total;
+  l.unlock();
+
+  stats.elapsedUs = chrono::duration_cast<chrono::microseconds>(
+                        chrono::steady_clock::now() - start)
+                        .count();
+  if (progress) {
+    progress(done, stats.total);
+  }
+  return stats;
+}
+
+void DiscoveryScanner::Cancel() {
+  lock_guard<std::mutex> l(mutex);
+  cancelled = true;
+  cond.notify_all();
+}
+
+/**
+ * 发送一批数据包.
+ * @return 成功发送的个数
+ */
+size_t DiscoveryScanner::sendBatch(const sockaddr_in* addrs,
+                                   size_t count,
+                                   const string& packet) {
+  size_t done = 0, failed = 0;
+  int retries = 0;
+
+#if HAVE_SENDMMSG
+  struct iovec iov;
+  iov.iov_base = (void*)packet.data();
+  iov.iov_len = packet.size();
+  struct mmsghdr msgs[kMaxBatch];
+  for (size_t i = 0; i < count; ++i) {
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    msgs[i].msg_hdr.msg_name = (void*)&addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    msgs[i].msg_hdr.msg_iov = &iov;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+#endif
+
+  while (done < count) {
+#if HAVE_SENDMMSG
+    int ret = sendmmsg(sock, msgs + done, count - done, 0);
+#else
+    int ret = sendto(sock, packet.data(), packet.size(), 0,
+                     (const struct sockaddr*)&addrs[done],
+                     sizeof(addrs[done])) < 0
+                  ? -1
+                  : 1;
+#endif
+    if (ret > 0) {
+      done += ret;
+      retries = 0;
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) &&
+        retries++ < kMaxRetries && waitWritable()) {
+      continue;
+    }
+    LOG_WARN("send detect packet to %s failed: %s",
+             inAddrToString(addrs[done].sin_addr).c_str(), strerror(errno));
+    done++;
+    failed++;
+    retries = 0;
+  }
+  return count - failed;
+}
+
+bool DiscoveryScanner::waitWritable() {
+  struct pollfd pfd;
+  pfd.fd = sock;
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+  return poll(&pfd, 1, kWritableTimeoutMs) > 0;
+}
+
+}  // namespace iptux
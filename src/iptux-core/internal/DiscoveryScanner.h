@@ -0,0 +1,74 @@
+#ifndef IPTUX_DISCOVERY_SCANNER_H
+#define IPTUX_DISCOVERY_SCANNER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "iptux-core/Event.h"
+#include "iptux-core/Models.h"
+
+namespace iptux {
+
+/**
+ * @brief sends a detect packet to every address of the net segments.
+ *
+ * The segments are turned into sorted, merged numeric ranges up front, and
+ * packets go out in batches (sendmmsg where available) paced to at most
+ * packetsPerSecond. Scan() runs on the caller's thread until done or
+ * Cancel() is called from another one.
+ */
+class DiscoveryScanner {
+ public:
+  /* [first, last] in host byte order */
+  using Range = std::pair<uint32_t, uint32_t>;
+  using Progress = std::function<void(uint64_t done, uint64_t total)>;
+
+  /**
+   * @param packetsPerSecond 0 for no limit
+   */
+  DiscoveryScanner(int sock, uint16_t port, uint32_t packetsPerSecond);
+
+  DiscoveryScanner(const DiscoveryScanner&) = delete;
+  DiscoveryScanner& operator=(const DiscoveryScanner&) = delete;
+
+  /**
+   * @brief sorted ranges of the segments, overlapping ones merged, invalid
+   * ones skipped
+   */
+  static std::vector<Range> MakeRanges(const std::vector<NetSegment>& segments);
+
+  /**
+   * @brief send packet to each address of ranges.
+   *
+   * progress is called at most every 100ms, and once at the end.
+   */
+  DiscoveryStats Scan(const std::vector<Range>& ranges,
+                      const std::string& packet,
+                      const Progress& progress);
+  void Cancel();
+
+ private:
+  size_t sendBatch(const sockaddr_in* addrs,
+                   size_t count,
+                   const std::string& packet);
+  bool waitWritable();
+
+  const int sock;
+  const uint16_t port;
+  const uint32_t packetsPerSecond;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool cancelled{false};
+};
+
+}  // namespace iptux
+
+#endif
@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "iptux-core/internal/DiscoveryScanner.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace iptux;
+
+namespace {
+uint32_t ip(const char* s) {
+  return inAddrToUint32(inAddrFromString(s));
+}
+
+/* 绑定在回环地址随机端口上的udp套接口 */
+struct UdpSocket {
+  int fd;
+  uint16_t port;
+
+  UdpSocket() {
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+  }
+  ~UdpSocket() { close(fd); }
+
+  int Drain() {
+    char buf[64];
+    int count = 0;
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+      count++;
+    }
+    return count;
+  }
+};
+}  // namespace
+
+TEST(DiscoveryScanner, MakeRanges) {
+  auto ranges = DiscoveryScanner::MakeRanges({
+      NetSegment("10.0.1.0", "10.0.1.255", ""),
+      NetSegment("10.0.0.0", "10.0.0.255", ""),
+      NetSegment("10.0.0.10", "10.0.0.20", ""),
+      NetSegment("192.168.0.9", "192.168.0.1", ""),
+      NetSegment("not an ip", "192.168.0.1", ""),
+      NetSegment("192.168.0.1", "192.168.0.1", ""),
+  });
+  ASSERT_EQ(ranges.size(), 2u);
+  EXPECT_EQ(ranges[0],
+            DiscoveryScanner::Range(ip("10.0.0.0"), ip("10.0.1.255")));
+  EXPECT_EQ(ranges[1],
+            DiscoveryScanner::Range(ip("192.168.0.1"), ip("192.168.0.1")));
+
+  EXPECT_TRUE(DiscoveryScanner::MakeRanges({}).empty());
+}
+
+TEST(DiscoveryScanner, Scan) {
+  UdpSocket receiver, sender;
+  DiscoveryScanner scanner(sender.fd, receiver.port, 0);
+
+  uint64_t lastDone = 0, lastTotal = 0;
+  auto stats = scanner.Scan({{ip("127.0.0.1"), ip("127.0.0.100")},
+                             {ip("127.0.1.1"), ip("127.0.1.5")}},
+                            "hello", [&](uint64_t done, uint64_t total) {
+                              lastDone = done;
+                              lastTotal = total;
+                            });
+  EXPECT_EQ(stats.total, 105u);
+  EXPECT_EQ(stats.sent, 105u);
+  EXPECT_EQ(stats.failed, 0u);
+  EXPECT_FALSE(stats.cancelled);
+  EXPECT_EQ(lastDone, 105u);
+  EXPECT_EQ(lastTotal, 105u);
+  EXPECT_EQ(receiver.Drain(), 105);
+}
+
+TEST(DiscoveryScanner, RateLimit) {
+  UdpSocket receiver, sender;
+  DiscoveryScanner scanner(sender.fd, receiver.port, 1000);
+
+  auto start = steady_clock::now();
+  auto stats =
+      scanner.Scan({{ip("127.0.0.1"), ip("127.0.0.200")}}, "hello", nullptr);
+  EXPECT_EQ(stats.sent, 200u);
+  EXPECT_GE(steady_clock::now() - start, milliseconds(190));
+}
+
+TEST(DiscoveryScanner, Cancel) {
+  UdpSocket receiver, sender;
+  DiscoveryScanner scanner(sender.fd, receiver.port, 100);
+
+  thread canceller([&] {
+    this_thread::sleep_for(milliseconds(50));
+    scanner.Cancel();
+  });
+  auto start = steady_clock::now();
+  auto stats =
+      scanner.Scan({{ip("127.0.0.1"), ip("127.0.3.255")}}, "hello", nullptr);
+  canceller.join();
+  EXPECT_LT(steady_clock::now() - start, seconds(2));
+  EXPECT_TRUE(stats.cancelled);
+  EXPECT_EQ(stats.total, 1023u);
+  EXPECT_LT(stats.sent, stats.total);
+}
@@ -0,0 +1,121 @@
+#include "config.h"
+#include "PacketBuilder.h"
+
+#include <cinttypes>
+#include <cstring>
+
+#include <glib.h>
+
+#include "iptux-core/internal/ipmsg.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+bool isUtf8(const string& encode) {
+  return encode.empty() || g_ascii_strcasecmp(encode.c_str(), "utf-8") == 0;
+}
+
+/* 将utf8串s转换为encode编码, 纯ASCII串无需转换 */
+bool convertTo(const char* s, const string& encode, string& out) {
+  if (isUtf8(encode) || isAscii(s)) {
+    out = s;
+    return true;
+  }
+  return convertCharset(s, encode.c_str(), "utf-8", out);
+}
+
+void appendNumber(string& out, uint32_t number) {
+  char str[11];
+  out.append(str, snprintf(str, sizeof(str), "%" PRIu32, number));
+}
+}  // namespace
+
+PacketBuilder::PacketBuilder(shared_ptr<ProgramData> programData)
+    : programData(programData) {}
+
+void PacketBuilder::Invalidate() {
+  lock_guard<std::mutex> l(mutex);
+  cache.clear();
+}
+
+const PacketBuilder::Cached& PacketBuilder::cachedLocked(
+    const string& encode) {
+  string key = isUtf8(encode) ? "utf-8" : encode;
+  for (auto& c : key) {
+    c = g_ascii_tolower(c);
+  }
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
+  }
+
+  Cached cached;
+  string userHost =
+      stringFormat(":%s:%s", g_get_user_name(), g_get_host_name());
+  if (!convertTo(userHost.c_str(), key, cached.userHost)) {
+    cached.userHost = userHost;
+  }
+  convertTo(programData->nickname.c_str(), key, cached.nickname);
+  if (!convertTo(programData->mygroup.c_str(), key, cached.iptuxExtra)) {
+    cached.iptuxExtra = programData->mygroup;
+  }
+  cached.iptuxExtra.append(1, '\0');
+  cached.iptuxExtra.append(programData->myicon).append(1, '\0');
+  cached.iptuxExtra.append("utf-8").append(1, '\0');
+  cached.iptuxExtra.append(stringFormat("%lx", IPTUX_FEATURES)).append(1, '\0');
+  return cache.emplace(key, std::move(cached)).first->second;
+}
+
+void PacketBuilder::appendHeader(string& out,
+                                 uint32_t packetno,
+                                 const string& userHost,
+                                 uint32_t commandno) {
+  out.append(IPTUX_VERSION).append(1, ':');
+  appendNumber(out, packetno);
+  out.append(userHost).append(1, ':');
+  appendNumber(out, commandno);
+  out.append(1, ':');
+}
+
+string PacketBuilder::Build(uint32_t packetno,
+                            uint32_t commandno,
+                            const char* attach,
+                            const string& encode) {
+  attach = attach ? attach : "";
+  string converted;
+  bool ok = convertTo(attach, encode, converted);
+
+  string packet;
+  packet.reserve(64 + converted.size());
+  {
+    lock_guard<std::mutex> l(mutex);
+    appendHeader(packet, packetno, cachedLocked(ok ? encode : "").userHost,
+                 commandno);
+  }
+  packet.append(ok ? converted : string(attach)).append(1, '\0');
+  return packet;
+}
+
+string PacketBuilder::BuildWithNickname(uint32_t packetno,
+                                        uint32_t commandno,
+                                        const string& encode) {
+  string packet;
+  lock_guard<std::mutex> l(mutex);
+  const Cached* cached = &cachedLocked(encode);
+  if (cached->nickname.empty() && !programData->nickname.empty()) {
+    cached = &cachedLocked("");
+  }
+  appendHeader(packet, packetno, cached->userHost, commandno);
+  packet.append(cached->nickname).append(1, '\0');
+  return packet;
+}
+
+string PacketBuilder::IptuxExtra(const string& encode) {
+  lock_guard<std::mutex> l(mutex);
+  return cachedLocked(encode).iptuxExtra;
+}
+
+}  // namespace iptux
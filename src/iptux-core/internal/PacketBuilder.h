@@ -0,0 +1,78 @@
+#ifndef IPTUX_PACKET_BUILDER_H
+#define IPTUX_PACKET_BUILDER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "iptux-core/ProgramData.h"
+
+namespace iptux {
+
+/**
+ * @brief builds the text part of ipmsg packets in the pal's encoding.
+ *
+ * version:packetno:user:host:commandno:attach\0
+ *
+ * The parts which only depend on me (":user:host", nickname and the iptux
+ * extra sections) are converted once per encoding and cached until
+ * Invalidate() is called, so a packet is built with plain appends and the
+ * attach is the only part converted each time.
+ */
+class PacketBuilder {
+ public:
+  explicit PacketBuilder(std::shared_ptr<ProgramData> programData);
+
+  PacketBuilder(const PacketBuilder&) = delete;
+  PacketBuilder& operator=(const PacketBuilder&) = delete;
+
+  /**
+   * @brief drop the cached parts, called when my info changed
+   */
+  void Invalidate();
+
+  /**
+   * @brief the packet header with attach in encode, '\0' terminated.
+   *
+   * An empty encode means utf-8. If attach can't be converted the whole
+   * packet is sent in utf-8, as before.
+   */
+  std::string Build(uint32_t packetno,
+                    uint32_t commandno,
+                    const char* attach,
+                    const std::string& encode);
+  /**
+   * @brief like Build(), with my nickname as the attach
+   */
+  std::string BuildWithNickname(uint32_t packetno,
+                                uint32_t commandno,
+                                const std::string& encode);
+  /**
+   * @brief group\0icon\0utf-8\0, with the group in encode
+   */
+  std::string IptuxExtra(const std::string& encode);
+
+ private:
+  /* 某编码下的不变部分 */
+  struct Cached {
+    std::string userHost;  // ":user:host"
+    std::string nickname;  // empty when it can't be converted
+    std::string iptuxExtra;
+  };
+
+  const Cached& cachedLocked(const std::string& encode);
+  static void appendHeader(std::string& out,
+                           uint32_t packetno,
+                           const std::string& userHost,
+                           uint32_t commandno);
+
+  std::shared_ptr<ProgramData> programData;
+  std::mutex mutex;
+  std::map<std::string, Cached> cache;  // 小写编码名 -> 不变部分
+};
+
+}  // namespace iptux
+
+#endif
@@ -0,0 +1,63 @@
+#include "gtest/gtest.h"
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "iptux-core/TestHelper.h"
+#include "iptux-core/internal/PacketBuilder.h"
+#include "iptux-core/internal/PacketView.h"
+
+using namespace std;
+using namespace iptux;
+
+TEST(PacketBuilder, Build) {
+  auto programData = make_shared<ProgramData>(newTestIptuxConfig());
+  PacketBuilder builder(programData);
+
+  auto packet = builder.Build(5, 32, "hello", "utf-8");
+  string header = string(IPTUX_VERSION) + ":5:" + g_get_user_name() + ":" +
+                  g_get_host_name() + ":32:";
+  EXPECT_EQ(packet, header + "hello" + string(1, '\0'));
+  EXPECT_EQ(builder.Build(5, 32, nullptr, ""), header + string(1, '\0'));
+
+  PacketView view(packet.data(), packet.size());
+  EXPECT_EQ(view.packetno, 5U);
+  EXPECT_EQ(view.commandno, 32U);
+  EXPECT_EQ(view.attach, "hello");
+}
+
+TEST(PacketBuilder, Encode) {
+  auto programData = make_shared<ProgramData>(newTestIptuxConfig());
+  PacketBuilder builder(programData);
+
+  auto packet = builder.Build(1, 32, "中文", "GB18030");
+  PacketView view(packet.data(), packet.size());
+  EXPECT_EQ(view.attach, "\xd6\xd0\xce\xc4");
+
+  // not representable in the pal's encoding, sent as utf-8
+  packet = builder.Build(1, 32, "中文", "ISO-8859-1");
+  view.Parse(packet.data(), packet.size());
+  EXPECT_EQ(view.attach, "中文");
+}
+
+TEST(PacketBuilder, Invalidate) {
+  auto programData = make_shared<ProgramData>(newTestIptuxConfig());
+  programData->nickname = "foo";
+  programData->mygroup = "bar";
+  programData->myicon = "icon-tux.png";
+  PacketBuilder builder(programData);
+
+  auto packet = builder.BuildWithNickname(1, 1, "utf-8");
+  EXPECT_EQ(PacketView(packet.data(), packet.size()).attach, "foo");
+  EXPECT_EQ(builder.IptuxExtra("utf-8"),
+            string("bar\0icon-tux.png\0utf-8\0" "3\0", 25));
+
+  programData->nickname = "foo2";
+  packet = builder.BuildWithNickname(2, 1, "utf-8");
+  EXPECT_EQ(PacketView(packet.data(), packet.size()).attach, "foo");
+
+  builder.Invalidate();
+  packet = builder.BuildWithNickname(3, 1, "utf-8");
+  EXPECT_EQ(PacketView(packet.data(), packet.size()).attach, "foo2");
+}
@@ -0,0 +1,96 @@
+#include "config.h"
+#include "PacketView.h"
+
+#include <cstring>
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+/* 从ptr开始取一个以'\0'结尾的段, 不超过end */
+string_view takeString(const char* ptr, const char* end) {
+  auto nul = (const char*)memchr(ptr, '\0', end - ptr);
+  return string_view(ptr, (nul ? nul : end) - ptr);
+}
+}  // namespace
+
+PacketView::PacketView(const char* buf, size_t size) {
+  Parse(buf, size);
+}
+
+void PacketView::Parse(const char* buf, size_t size) {
+  *this = PacketView();
+  const char* end = buf + size;
+  string_view header = takeString(buf, end);
+
+  string_view sections[5];
+  size_t pos = 0;
+  for (int i = 0; i < 5; ++i) {
+    size_t colon = header.find(':', pos);
+    if (colon == string_view::npos) {
+      sections[i] = header.substr(pos);
+      pos = string_view::npos;
+      break;
+    }
+    sections[i] = header.substr(pos, colon - pos);
+    pos = colon + 1;
+  }
+  version = sections[0];
+  packetno = ToNumber(sections[1]);
+  user = sections[2];
+  host = sections[3];
+  commandno = ToNumber(sections[4]);
+  if (pos != string_view::npos) {
+    attach = header.substr(pos);
+  }
+
+  const char* ptr = header.data() + header.size() + 1;
+  if (ptr >= end) {
+    return;
+  }
+  body = string_view(ptr, end - ptr);
+  while (ptr < end && extraCount < MAX_EXTRAS) {
+    extras[extraCount] = takeString(ptr, end);
+    ptr += extras[extraCount].size() + 1;
+    extraCount++;
+  }
+}
+
+uint32_t PacketView::ToNumber(string_view s) {
+  size_t i = 0;
+  while (i < s.size() && (s[i] == ' ' || s[i] == '\t')) {
+    i++;
+  }
+  uint32_t number = 0;
+  for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; ++i) {
+    number = number * 10 + uint32_t(s[i] - '0');
+  }
+  return number;
+}
+
+string_view PacketView::GetExtra(size_t n) const {
+  if (n == 0) {
+    return {};
+  }
+  if (n <= extraCount) {
+    return extras[n - 1];
+  }
+  if (extraCount < MAX_EXTRAS) {
+    return {};
+  }
+  /* 超出缓存的段, 从最后一个缓存段继续查找 */
+  const char* end = body.data() + body.size();
+  const char* ptr = extras[MAX_EXTRAS - 1].data() +
+                    extras[MAX_EXTRAS - 1].size() + 1;
+  for (size_t i = MAX_EXTRAS + 1; ptr < end; ++i) {
+    string_view extra = takeString(ptr, end);
+    if (i == n) {
+      return extra;
+    }
+    ptr += extra.size() + 1;
+  }
+  return {};
+}
+
+}  // namespace iptux
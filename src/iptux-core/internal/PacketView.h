@@ -0,0 +1,64 @@
+#ifndef IPTUX_PACKET_VIEW_H
+#define IPTUX_PACKET_VIEW_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace iptux {
+
+/**
+ * @brief the fields of an ipmsg packet, parsed in one pass.
+ *
+ * version:packetno:user:host:commandno:attach\0extra\0extra...
+ *
+ * The fields point into the parsed buffer and nothing is copied, so the
+ * view must be parsed again whenever the buffer is changed (e.g. after an
+ * encoding conversion).
+ */
+class PacketView {
+ public:
+  static constexpr size_t MAX_EXTRAS = 4;
+
+  PacketView() = default;
+  PacketView(const char* buf, size_t size);
+
+  void Parse(const char* buf, size_t size);
+
+  /**
+   * @brief whether the header has all five leading sections
+   */
+  bool IsValid() const { return attach.data() != nullptr; }
+
+  std::string_view version;
+  uint32_t packetno{0};
+  std::string_view user;
+  std::string_view host;
+  uint32_t commandno{0};
+  std::string_view attach;  ///< 附加数据, data()为nullptr表示不存在
+
+  /**
+   * @brief the n-th '\0' separated section after the header (1 based, as
+   * with iptux_skip_string), nullptr data when absent
+   */
+  std::string_view GetExtra(size_t n) const;
+  /**
+   * @brief all bytes after the header, for binary payloads (e.g. icons)
+   */
+  std::string_view GetBody() const { return body; }
+
+  /**
+   * @brief decimal number at the start of s (like iptux_get_dec_number)
+   */
+  static uint32_t ToNumber(std::string_view s);
+
+ private:
+  std::string_view body;
+  std::array<std::string_view, MAX_EXTRAS> extras;
+  size_t extraCount{0};
+};
+
+}  // namespace iptux
+
+#endif
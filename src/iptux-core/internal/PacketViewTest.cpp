@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+
+#include "iptux-core/internal/PacketView.h"
+
+using namespace iptux;
+
+TEST(PacketView, Parse) {
+  const char data[] =
+      "1_iptux 0.8.0:6:user:host:259:nick:name\0group\0icon-tux.png\0utf-8\0";
+  PacketView packet(data, sizeof(data) - 1);
+  ASSERT_TRUE(packet.IsValid());
+  EXPECT_EQ(packet.version, "1_iptux 0.8.0");
+  EXPECT_EQ(packet.packetno, 6U);
+  EXPECT_EQ(packet.user, "user");
+  EXPECT_EQ(packet.host, "host");
+  EXPECT_EQ(packet.commandno, 259U);
+  EXPECT_EQ(packet.attach, "nick:name");
+  EXPECT_EQ(packet.GetExtra(1), "group");
+  EXPECT_EQ(packet.GetExtra(2), "icon-tux.png");
+  EXPECT_EQ(packet.GetExtra(3), "utf-8");
+  EXPECT_EQ(packet.GetExtra(4).data(), nullptr);
+  EXPECT_EQ(packet.GetBody().size(), 25U);
+}
+
+TEST(PacketView, Incomplete) {
+  PacketView empty("", 0);
+  EXPECT_FALSE(empty.IsValid());
+  EXPECT_EQ(empty.commandno, 0U);
+  EXPECT_EQ(empty.GetExtra(1).data(), nullptr);
+  EXPECT_TRUE(empty.GetBody().empty());
+
+  PacketView packet("1:2:user:host:32", 16);
+  EXPECT_FALSE(packet.IsValid());
+  EXPECT_EQ(packet.packetno, 2U);
+  EXPECT_EQ(packet.commandno, 32U);
+  EXPECT_EQ(packet.attach.data(), nullptr);
+
+  PacketView emptyAttach("1:2:user:host:32:", 17);
+  EXPECT_TRUE(emptyAttach.IsValid());
+  EXPECT_TRUE(emptyAttach.attach.empty());
+}
+
+TEST(PacketView, ExtrasWithoutTrailingNul) {
+  const char data[] = "1:2:u:h:3:a\0b\0c\0d\0e\0f";
+  PacketView packet(data, sizeof(data) - 1);
+  EXPECT_EQ(packet.GetExtra(1), "b");
+  EXPECT_EQ(packet.GetExtra(4), "e");
+  EXPECT_EQ(packet.GetExtra(5), "f");
+  EXPECT_EQ(packet.GetExtra(6).data(), nullptr);
+}
+
+TEST(PacketView, ToNumber) {
+  EXPECT_EQ(PacketView::ToNumber("123"), 123U);
+  EXPECT_EQ(PacketView::ToNumber(" 42:7"), 42U);
+  EXPECT_EQ(PacketView::ToNumber("abc"), 0U);
+  EXPECT_EQ(PacketView::ToNumber(""), 0U);
+}
@@ -0,0 +1,43 @@
+#include "config.h"
+#include "PalRegistry.h"
+
+using namespace std;
+
+namespace iptux {
+
+uint64_t PalRegistry::KeyOf(const PalKey& key) {
+  return (uint64_t(key.GetIpv4().s_addr) << 16) | uint16_t(key.GetPort());
+}
+
+void PalRegistry::Attach(PPalInfo pal) {
+  uint64_t key = KeyOf(pal->GetKey());
+  lock_guard<std::mutex> l(mutex);
+  auto it = index.find(key);
+  if (it != index.end()) {
+    pals[it->second] = pal;
+    return;
+  }
+  index.emplace(key, pals.size());
+  pals.push_back(pal);
+}
+
+PPalInfo PalRegistry::Find(const PalKey& key) const {
+  lock_guard<std::mutex> l(mutex);
+  auto it = index.find(KeyOf(key));
+  if (it == index.end()) {
+    return {};
+  }
+  return pals[it->second];
+}
+
+vector<PPalInfo> PalRegistry::Snapshot() const {
+  lock_guard<std::mutex> l(mutex);
+  return pals;
+}
+
+size_t PalRegistry::Size() const {
+  lock_guard<std::mutex> l(mutex);
+  return pals.size();
+}
+
+}  // namespace iptux
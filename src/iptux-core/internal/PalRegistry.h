@@ -0,0 +1,46 @@
+#ifndef IPTUX_PAL_REGISTRY_H
+#define IPTUX_PAL_REGISTRY_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "iptux-core/Models.h"
+
+namespace iptux {
+
+/**
+ * @brief pal list with a hash index on (ipv4, port).
+ *
+ * The list keeps the attach order and its members are never removed,
+ * offline pals are only marked as such.
+ */
+class PalRegistry {
+ public:
+  PalRegistry() = default;
+
+  /**
+   * @brief add the pal, a pal with the same key is replaced in place.
+   */
+  void Attach(PPalInfo pal);
+  PPalInfo Find(const PalKey& key) const;
+
+  /**
+   * @brief a copy of the list, Attach() may run on another thread.
+   */
+  std::vector<PPalInfo> Snapshot() const;
+  size_t Size() const;
+
+  static uint64_t KeyOf(const PalKey& key);
+
+ private:
+  mutable std::mutex mutex;
+  std::vector<PPalInfo> pals;
+  std::unordered_map<uint64_t, size_t> index;  // key -> position in pals
+};
+
+}  // namespace iptux
+
+#endif
@@ -0,0 +1,72 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "iptux-core/internal/PalRegistry.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+
+const int kPalCount = 10000;
+const int kIndexedLookups = 1000000;
+const int kLinearLookups = 10000;
+
+vector<PalKey> makeKeys() {
+  vector<PalKey> keys;
+  for (int i = 0; i < kPalCount; ++i) {
+    // 10.x.y.z, spread over a /16 like a large office LAN
+    keys.emplace_back(inAddrFromUint32(0x0a000000u + uint32_t(i) * 7), 2425);
+  }
+  return keys;
+}
+
+template <typename F>
+double nsPerOp(int lookups, F f) {
+  auto start = chrono::steady_clock::now();
+  int found = 0;
+  for (int i = 0; i < lookups; ++i) {
+    found += f(i) ? 1 : 0;
+  }
+  auto elapsed = chrono::steady_clock::now() - start;
+  if (found != lookups) {
+    fprintf(stderr, "lookup missed: %d/%d\n", found, lookups);
+  }
+  return chrono::duration<double, nano>(elapsed).count() / lookups;
+}
+
+}  // namespace
+
+int main() {
+  auto keys = makeKeys();
+  PalRegistry registry;
+  vector<PPalInfo> pallist;
+  for (auto& key : keys) {
+    auto pal = make_shared<PalInfo>(key.GetIpv4(), key.GetPort());
+    registry.Attach(pal);
+    pallist.push_back(pal);
+  }
+
+  double indexed = nsPerOp(kIndexedLookups, [&](int i) {
+    return bool(registry.Find(keys[(i * 7919) % kPalCount]));
+  });
+
+  // the linear scan used before PalRegistry, for comparison
+  double linear = nsPerOp(kLinearLookups, [&](int i) {
+    const PalKey& key = keys[(i * 7919) % kPalCount];
+    for (auto& pal : pallist) {
+      if (ipv4Equal(pal->ipv4(), key.GetIpv4())) {
+        return true;
+      }
+    }
+    return false;
+  });
+
+  printf("PalRegistry::Find   pals=%d  %10.1f ns/op\n", kPalCount, indexed);
+  printf("linear scan         pals=%d  %10.1f ns/op\n", kPalCount, linear);
+  return 0;
+}
@@ -0,0 +1,42 @@
+#include "gtest/gtest.h"
+
+#include "iptux-core/internal/PalRegistry.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+TEST(PalRegistry, AttachAndFind) {
+  PalRegistry registry;
+  auto pal1 = make_shared<PalInfo>("127.0.0.1", 2425);
+  auto pal2 = make_shared<PalInfo>("127.0.0.2", 2425);
+  registry.Attach(pal1);
+  registry.Attach(pal2);
+
+  EXPECT_EQ(registry.Size(), 2u);
+  EXPECT_EQ(registry.Find(pal1->GetKey()), pal1);
+  EXPECT_EQ(registry.Find(pal2->GetKey()), pal2);
+  EXPECT_FALSE(registry.Find(PalKey(inAddrFromString("127.0.0.3"), 2425)));
+  EXPECT_FALSE(registry.Find(PalKey(inAddrFromString("127.0.0.1"), 2426)));
+}
+
+TEST(PalRegistry, KeepOrder) {
+  PalRegistry registry;
+  auto pal1 = make_shared<PalInfo>("10.0.0.9", 2425);
+  auto pal2 = make_shared<PalInfo>("10.0.0.1", 2425);
+  auto pal3 = make_shared<PalInfo>("10.0.0.5", 2425);
+  registry.Attach(pal1);
+  registry.Attach(pal2);
+  registry.Attach(pal3);
+
+  // re-attach replaces in place
+  auto pal2b = make_shared<PalInfo>("10.0.0.1", 2425);
+  registry.Attach(pal2b);
+
+  auto list = registry.Snapshot();
+  ASSERT_EQ(list.size(), 3u);
+  EXPECT_EQ(list[0], pal1);
+  EXPECT_EQ(list[1], pal2b);
+  EXPECT_EQ(list[2], pal3);
+  EXPECT_EQ(registry.Find(pal2->GetKey()), pal2b);
+}
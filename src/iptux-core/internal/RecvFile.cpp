@@ -20,6 +20,7 @@
 #include "iptux-core/Exception.h"
 #include "iptux-core/internal/Command.h"
 #include "iptux-core/internal/TransAbstract.h"
+#include "iptux-utils/output.h"
 #include "iptux-utils/utils.h"
 
 using namespace std;
@@ -38,20 +39,84 @@ RecvFile::~RecvFile() {}
 
 FileInfo* DivideFileinfo(char** extra);
 
+namespace {
+/* 清单中单条文件信息的长度上限, 超出视为数据有误 */
+const size_t kMaxManifestEntryLen = 64 * 1024;
+/* 等待清单数据的超时(秒) */
+const guint kManifestTimeout = 30;
+
+void emitFileInfos(CoreThread* coreThread,
+                   PPalInfo pal,
+                   vector<FileInfo>&& fileInfos,
+                   int packetno) {
+  for (auto& fileInfo : fileInfos) {
+    fileInfo.packetn = packetno;
+    fileInfo.fileown = pal;
+    coreThread->emitEvent(
+        make_shared<NewShareFileFromFriendEvent>(pal->GetKey(), fileInfo));
+  }
+}
+}  // namespace
+
 /**
  * 文件接受入口.
  * @param para 文件参数
+ * @param hasManifest 余下的文件信息需经TCP取回
  */
 void RecvFile::RecvEntry(CoreThread* coreThread,
                          PPalInfo pal,
                          const std::string extra,
-                         int packetno) {
-  auto fileInfos = Command::decodeFileInfos(extra);
-  for (auto fileInfo : fileInfos) {
-    fileInfo.packetn = packetno;
-    fileInfo.fileown = pal;
-    coreThread->emitEvent(make_shared<NewShareFileFromFriendEvent>(pal->GetKey(), fileInfo));
+                         int packetno,
+                         bool hasManifest) {
+  emitFileInfos(coreThread, pal, Command::decodeFileInfos(extra), packetno);
+  if (hasManifest) {
+    RecvManifest(coreThread, pal, packetno);
+  }
+}
+
+/**
+ * 经TCP取回一个UDP包放不下的文件信息, 边收边解码.
+ * @param pal class PalInfo
+ * @param packetno 文件信息所在的包编号
+ */
+void RecvFile::RecvManifest(CoreThread* coreThread,
+                            PPalInfo pal,
+                            int packetno) {
+  GError* error = nullptr;
+  GSocket* sock = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM,
+                               G_SOCKET_PROTOCOL_TCP, &error);
+  if (!sock) {
+    LOG_WARN("g_socket_new failed: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+  g_socket_set_timeout(sock, kManifestTimeout);
+
+  Command cmd(*coreThread);
+  if (cmd.SendAskManifest(sock, pal->GetKey(), packetno)) {
+    char buf[MAX_SOCKLEN];
+    string pending;
+    size_t count = 0;
+    gssize len;
+    while ((len = g_socket_receive(sock, buf, sizeof(buf), nullptr, &error)) >
+           0) {
+      pending.append(buf, len);
+      auto fileInfos = Command::decodeFileInfoStream(pending);
+      count += fileInfos.size();
+      emitFileInfos(coreThread, pal, std::move(fileInfos), packetno);
+      if (pending.size() > kMaxManifestEntryLen) {
+        LOG_WARN("invalid manifest from %s", pal->GetKey().ToString().c_str());
+        break;
+      }
+    }
+    if (error) {
+      LOG_WARN("receive manifest failed: %s", error->message);
+      g_clear_error(&error);
+    }
+    LOG_INFO("received %zu file infos of packet %d from %s's manifest", count,
+             packetno, pal->GetKey().ToString().c_str());
   }
+  g_object_unref(sock);
 }
 
 }  // namespace iptux
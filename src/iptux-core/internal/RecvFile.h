@@ -31,9 +31,11 @@ class RecvFile {
   static void RecvEntry(CoreThread* coreThread,
                         PPalInfo pal,
                         const std::string extra,
-                        int packeno);
+                        int packeno,
+                        bool hasManifest = false);
 
  private:
+  static void RecvManifest(CoreThread* coreThread, PPalInfo pal, int packetno);
   void ParseFilePara(GData** para);
   FileInfo* DivideFileinfo(char** extra);
 };
@@ -12,20 +12,29 @@
 #include "config.h"
 #include "RecvFileData.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
 #include <memory>
+#include <thread>
 
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <utime.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include "iptux-core/Event.h"
 #include "iptux-core/Exception.h"
 #include "iptux-core/internal/AnalogFS.h"
 #include "iptux-core/internal/Command.h"
+#include "iptux-core/internal/CompressedStream.h"
+#include "iptux-core/internal/TransScheduler.h"
 #include "iptux-core/internal/ipmsg.h"
 #include "iptux-utils/output.h"
 #include "iptux-utils/utils.h"
@@ -39,7 +48,12 @@ namespace iptux {
  * @param fl 文件信息数据
  */
 RecvFileData::RecvFileData(CoreThread* coreThread, FileInfo* fl)
-    : coreThread(coreThread), file(fl), terminate(false), sumsize(0) {
+    : coreThread(coreThread),
+      file(fl),
+      terminate(false),
+      sumsize(0),
+      bytesReceived(
+          coreThread->getMetrics().GetCounter("trans.bytes_received")) {
   buf[0] = '\0';
   gettimeofday(&tasktime, NULL);
   /* gettimeofday(&filetime, NULL);//个人感觉没必要 */
@@ -67,16 +81,18 @@ void RecvFileData::RecvFileDataEntry() {
   // }
   // gdk_threads_leave();
 
-  /* 分类处理 */
-  switch (file->fileattr) {
-    case FileAttr::REGULAR:
-      RecvRegularFile();
-      break;
-    case FileAttr::DIRECTORY:
-      RecvDirFiles();
-      break;
-    default:
-      break;
+  /* 分类处理, 排队时已被终止的任务直接结束 */
+  if (!terminate) {
+    switch (file->fileattr) {
+      case FileAttr::REGULAR:
+        RecvRegularFile();
+        break;
+      case FileAttr::DIRECTORY:
+        RecvDirFiles();
+        break;
+      default:
+        break;
+    }
   }
 
   UpdateUIParaToOver();
@@ -107,8 +123,17 @@ void RecvFileData::TerminateTrans() {
   terminate = true;
 }
 
+/**
+ * 文件所属好友的地址, 用于传输调度.
+ * @return ipv4 (network byte order)
+ */
+uint32_t RecvFileData::GetPeerIpv4() const {
+  return file->fileown->ipv4().s_addr;
+}
+
 /**
  * 创建UI参考数据.
+ * 排队时即创建, 以便在任务列表中显示.
  */
 void RecvFileData::CreateUIPara() {
   struct in_addr addr = file->fileown->ipv4();
@@ -136,6 +161,17 @@ void RecvFileData::RecvRegularFile() {
   int fd;
   struct utimbuf timebuf;
 
+  /* 每段占用一个下载名额, 不超过调度时得到的名额 */
+  int segments = SegmentCount();
+  size_t slots = coreThread->getTransScheduler().GetSlots(GetTaskId());
+  if (slots > 0) {
+    segments = min<int>(segments, slots);
+  }
+  if (segments > 1) {
+    RecvSegmentedFile(segments);
+    return;
+  }
+
   GError* error = nullptr;
   GSocket* sock = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM,
                                G_SOCKET_PROTOCOL_TCP, &error);
@@ -146,22 +182,50 @@ void RecvFileData::RecvRegularFile() {
     throw Exception(CREATE_TCP_SOCKET_FAILED);
   }
 
+  /* 若存在上次未完成的数据，则从断点处续传 */
+  int64_t offset = GetResumeOffset();
+  bool compress = file->fileown->hasFeature(IPTUX_FEATURE_COMPRESS);
   if (!cmd.SendAskData(sock, file->fileown->GetKey(), file->packetn,
-                       file->fileid, 0)) {
+                       file->fileid, offset, 0, compress)) {
+    g_object_unref(sock);
+    terminate = true;
+    return;
+  }
+  /* 好友按块压缩发送时, 经解压线程读取 */
+  unique_ptr<CompressedStream> stream;
+  GSocket* conn = sock;
+  if (compress && !(conn = OpenDecompressed(sock, stream))) {
     g_object_unref(sock);
     terminate = true;
     return;
   }
 
-  if ((fd = afs.open(file->filepath, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE,
-                     00644)) == -1) {
+  if (offset > 0) {
+    fd = afs.open(file->filepath, O_WRONLY | O_LARGEFILE, 00644);
+    if (fd != -1 && lseek(fd, offset, SEEK_SET) == -1) {
+      close(fd);
+      fd = -1;
+    }
+  } else {
+    fd = afs.open(file->filepath, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE,
+                  00644);
+  }
+  if (fd == -1) {
+    CloseDecompressed(conn, stream);
     g_object_unref(sock);
     terminate = true;
     return;
   }
+  if (offset > 0) {
+    LOG_INFO("resume receiving file \"%s\" from offset %jd", file->filepath,
+             (intmax_t)offset);
+  } else {
+    WriteResumeMarker();
+  }
 
   gettimeofday(&filetime, NULL);
-  finishsize = RecvData(sock, fd, file->filesize, 0);
+  sumsize = offset;
+  finishsize = RecvData(conn, fd, file->filesize, offset);
   close(fd);
   if (file->filectime != 0) {
     timebuf.actime = int(file->filectime);
@@ -176,13 +240,300 @@ void RecvFileData::RecvRegularFile() {
               file->filepath, file->fileown->getName().c_str(),
               (intmax_t)file->filesize, (intmax_t)finishsize);
   } else {
+    g_unlink(ResumeMarkerPath().c_str());
     LOG_INFO(_("Receive the file \"%s\" from %s successfully!"), file->filepath,
              file->fileown->getName().c_str());
   }
 
+  CloseDecompressed(conn, stream);
   g_object_unref(sock);
 }
 
+/**
+ * 分段并行下载的段数, 提交任务时据此申请下载名额.
+ * @return 段数, 1表示用一个连接接收整个文件
+ */
+int RecvFileData::SegmentCount() const {
+  if (file->fileattr != FileAttr::REGULAR ||
+      !file->fileown->hasFeature(IPTUX_FEATURE_SEGMENT) ||
+      file->filesize < kSegmentMinSize || GetResumeOffset() > 0) {
+    return 1;
+  }
+  int64_t segments = coreThread->getProgramData()->getConfig()->GetInt(
+      "download_segments", DEFAULT_DOWNLOAD_SEGMENTS);
+  segments = min(segments, file->filesize / kSegmentMinLength);
+  return int(clamp<int64_t>(segments, 1, MAX_DOWNLOAD_SEGMENTS));
+}
+
+namespace {
+bool pwriteAll(int fd, const char* data, size_t size, int64_t offset) {
+  while (size > 0) {
+    ssize_t len = pwrite(fd, data, size, offset);
+    if (len == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += len;
+    size -= len;
+    offset += len;
+  }
+  return true;
+}
+}  // namespace
+
+/**
+ * 分段经多个连接并行接收常规文件.
+ * 文件预先分配好空间, 各段直接写入各自的位置; 未收全的段(如连接被对方
+ * 拒绝)之后再用一个连接依次补齐. 仍未收全时文件截断到开头连续收到的部分,
+ * 并留下断点续传标记.
+ * @param segments 段数
+ */
+void RecvFileData::RecvSegmentedFile(int segments) {
+  AnalogFS afs;
+  struct timeval val1, val2;
+  int64_t tmpsize;
+  struct utimbuf timebuf;
+  int fd;
+
+  if ((fd = afs.open(file->filepath, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE,
+                     00644)) == -1) {
+    terminate = true;
+    return;
+  }
+  int ret = -1;
+#if HAVE_FALLOCATE
+  ret = fallocate(fd, 0, 0, file->filesize);
+#endif
+  if (ret == -1 && ftruncate(fd, file->filesize) == -1) {
+    LOG_ERROR("allocate %jd bytes for \"%s\" failed: %s",
+              (intmax_t)file->filesize, file->filepath, strerror(errno));
+    close(fd);
+    terminate = true;
+    return;
+  }
+
+  vector<Segment> parts(segments);
+  int64_t step = file->filesize / segments;
+  for (int i = 0; i < segments; ++i) {
+    parts[i].offset = i * step;
+    parts[i].length = i + 1 < segments ? step : file->filesize - i * step;
+  }
+  LOG_INFO("receive file \"%s\" in %d segments", file->filepath, segments);
+
+  gettimeofday(&filetime, NULL);
+  val1 = filetime;
+  tmpsize = 0;
+  auto updateProgress = [&] {
+    int64_t received = 0;
+    for (auto& part : parts) {
+      received += part.done;
+    }
+    AddFinishedSize(received - sumsize, false);
+    gettimeofday(&val2, NULL);
+    float difftime = difftimeval(val2, val1);
+    if (difftime >= 1) {
+      uint32_t rate = (uint32_t)((sumsize - tmpsize) / difftime);
+      para.setFinishedLength(sumsize)
+          .setCost(numeric_to_time((uint32_t)(difftimeval(val2, filetime))))
+          .setRemain(numeric_to_time(
+              rate ? (uint32_t)((file->filesize - sumsize) / rate) : 0))
+          .setRate(numeric_to_rate(rate));
+      val1 = val2;
+      tmpsize = sumsize;
+    }
+  };
+
+  for (int round = 0; round <= kSegmentCatchUpRounds && !terminate; ++round) {
+    /* 首轮每段一个连接, 之后一个连接补齐余下的段 */
+    vector<vector<Segment*>> jobs;
+    for (auto& part : parts) {
+      if (part.done < part.length) {
+        if (round == 0 || jobs.empty())
+          jobs.emplace_back();
+        jobs.back().push_back(&part);
+      }
+    }
+    if (jobs.empty())
+      break;
+    if (round > 1) {
+      /* 对方的上传数已满, 稍后再试 */
+      this_thread::sleep_for(chrono::seconds(1));
+    }
+    atomic<size_t> running(jobs.size());
+    vector<thread> workers;
+    for (auto& job : jobs) {
+      workers.emplace_back([this, fd, &job, &running] {
+        for (auto part : job) {
+          RecvSegment(fd, *part);
+        }
+        running--;
+      });
+    }
+    while (running > 0) {
+      this_thread::sleep_for(chrono::milliseconds(200));
+      updateProgress();
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    updateProgress();
+  }
+  if (sumsize < file->filesize) {
+    int64_t prefix = 0;
+    for (auto& part : parts) {
+      prefix += part.done;
+      if (part.done < part.length)
+        break;
+    }
+    if (ftruncate(fd, prefix) == 0 && prefix > 0) {
+      WriteResumeMarker();
+    }
+  }
+  close(fd);
+  if (file->filectime != 0) {
+    timebuf.actime = int(file->filectime);
+    timebuf.modtime = int(file->filectime);
+    utime(file->filepath, &timebuf);
+  }
+
+  if (sumsize < file->filesize) {
+    terminate = true;
+    LOG_ERROR(_("Failed to receive the file \"%s\" from %s! expect length %jd, "
+                "received %jd"),
+              file->filepath, file->fileown->getName().c_str(),
+              (intmax_t)file->filesize, (intmax_t)sumsize);
+  } else {
+    LOG_INFO(_("Receive the file \"%s\" from %s successfully!"), file->filepath,
+             file->fileown->getName().c_str());
+  }
+}
+
+/**
+ * 用一个连接接收一段数据, 写入文件中对应的位置.
+ * @param fd file descriptor
+ * @param segment 数据段, 从其已接收的位置继续
+ * @return 是否已收全
+ */
+bool RecvFileData::RecvSegment(int fd, Segment& segment) {
+  Command cmd(*coreThread);
+  GError* error = nullptr;
+  GSocket* sock = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM,
+                               G_SOCKET_PROTOCOL_TCP, &error);
+  if (!sock) {
+    LOG_WARN("g_socket_new failed: %s", error->message);
+    g_error_free(error);
+    return false;
+  }
+  if (!cmd.SendAskData(sock, file->fileown->GetKey(), file->packetn,
+                       file->fileid, segment.offset + segment.done,
+                       segment.length - segment.done)) {
+    g_object_unref(sock);
+    return false;
+  }
+
+  vector<char> buffer(kSegmentBufferSize);
+  while (!terminate && segment.done < segment.length) {
+    gssize size = min<int64_t>(buffer.size(), segment.length - segment.done);
+    size = g_socket_receive(sock, buffer.data(), size, nullptr, &error);
+    if (size <= 0) {
+      if (error) {
+        LOG_WARN("g_socket_receive failed: %s", error->message);
+        g_clear_error(&error);
+      }
+      break;
+    }
+    if (!pwriteAll(fd, buffer.data(), size, segment.offset + segment.done)) {
+      LOG_WARN("pwrite \"%s\" failed: %s", file->filepath, strerror(errno));
+      break;
+    }
+    segment.done += size;
+    if (!coreThread->getTransScheduler().Throttle(GetTaskId(), size)) {
+      terminate = true;
+    }
+  }
+  g_object_unref(sock);
+  return segment.done == segment.length;
+}
+
+/**
+ * 断点续传标记文件的路径.
+ * @return 与目标文件同目录的标记文件
+ */
+string RecvFileData::ResumeMarkerPath() const {
+  return string(file->filepath) + RESUME_MARKER_SUFFIX;
+}
+
+/**
+ * 标记文件内容，用于确认已有的部分数据属于同一个文件.
+ */
+string RecvFileData::ResumeMarkerContent() const {
+  return stringFormat("%s:%" PRIx32 ":%" PRIx32 ":%" PRIx64 "\n",
+                      file->fileown->GetKey().ToString().c_str(), file->packetn,
+                      file->fileid, file->filesize);
+}
+
+/**
+ * 写入断点续传标记文件.
+ */
+void RecvFileData::WriteResumeMarker() const {
+  string content = ResumeMarkerContent();
+  GError* error = nullptr;
+  if (!g_file_set_contents(ResumeMarkerPath().c_str(), content.c_str(),
+                           content.size(), &error)) {
+    LOG_WARN("write resume marker failed: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+/**
+ * 获取可续传的起始偏移量.
+ * 原版iptux等不解析偏移量的好友总是从头发送, 只能从头接收.
+ * @return 已接收的数据量，0表示需要从头开始
+ */
+int64_t RecvFileData::GetResumeOffset() const {
+  if (!file->fileown->hasFeature(IPTUX_FEATURE_SEGMENT)) {
+    return 0;
+  }
+  gchar* content = nullptr;
+  if (!g_file_get_contents(ResumeMarkerPath().c_str(), &content, nullptr,
+                           nullptr)) {
+    return 0;
+  }
+  bool match = ResumeMarkerContent() == content;
+  g_free(content);
+  if (!match) {
+    return 0;
+  }
+
+  struct stat st;
+  if (stat(file->filepath, &st) == -1 || !S_ISREG(st.st_mode) ||
+      st.st_size >= file->filesize) {
+    return 0;
+  }
+  return st.st_size;
+}
+
+/**
+ * 任务是否可以续传.
+ * @return 任务已失败且留有断点续传标记
+ */
+bool RecvFileData::IsResumable() const {
+  return para.isFinished() && terminate &&
+         file->fileattr == FileAttr::REGULAR && GetResumeOffset() > 0;
+}
+
+/**
+ * 重置任务状态以便续传.
+ */
+void RecvFileData::PrepareResume() {
+  terminate = false;
+  sumsize = 0;
+  para = TransFileModel();
+  gettimeofday(&tasktime, NULL);
+  CreateUIPara();
+}
+
 /**
  * Receive directory files.
  */
@@ -208,8 +559,16 @@ void RecvFileData::RecvDirFiles() {
     throw Exception(CREATE_TCP_SOCKET_FAILED);
   }
 
+  bool compress = file->fileown->hasFeature(IPTUX_FEATURE_COMPRESS);
   if (!cmd.SendAskFiles(sock, file->fileown->GetKey(), file->packetn,
-                        file->fileid)) {
+                        file->fileid, compress)) {
+    g_object_unref(sock);
+    terminate = true;
+    return;
+  }
+  unique_ptr<CompressedStream> stream;
+  GSocket* conn = sock;
+  if (compress && !(conn = OpenDecompressed(sock, stream))) {
     g_object_unref(sock);
     terminate = true;
     return;
@@ -225,7 +584,7 @@ void RecvFileData::RecvDirFiles() {
   len = 0;         // 预设缓冲区有效数据量为0
   while (!terminate) {
     /* 读取足够的数据，并分析数据头 */
-    if ((size = read_ipmsg_fileinfo(sock, buf, MAX_SOCKLEN, len)) == -1)
+    if ((size = read_ipmsg_fileinfo(conn, buf, MAX_SOCKLEN, len)) == -1)
       break;
     headsize = iptux_get_hex_number(buf, ':', 0);
     filename = ipmsg_get_filename(buf, ':', 1);
@@ -298,7 +657,7 @@ void RecvFileData::RecvDirFiles() {
       finishsize = size;
     } else {    // 尚需继续读取文件数据
       len = 0;  // 首先标记缓冲区已无有效数据
-      finishsize = RecvData(sock, fd, filesize, size);
+      finishsize = RecvData(conn, fd, filesize, size);
       if (finishsize < filesize) {
         close(fd);
         goto end;
@@ -326,9 +685,55 @@ end:
              file->filepath, file->fileown->getName().c_str());
   }
 
+  CloseDecompressed(conn, stream);
   g_object_unref(sock);
 }
 
+/**
+ * 在数据连接上启动解压线程.
+ * @param sock GSocket tcp socket, 仍由调用者持有
+ * @param stream 解压线程
+ * @return 读取解压后数据的套接口, 失败时为nullptr
+ */
+GSocket* RecvFileData::OpenDecompressed(GSocket* sock,
+                                        unique_ptr<CompressedStream>& stream) {
+  stream = make_unique<CompressedStream>(g_socket_get_fd(sock),
+                                         CompressedStream::Mode::DECOMPRESS);
+  if (!stream->Start()) {
+    stream.reset();
+    return nullptr;
+  }
+  GError* error = nullptr;
+  int fd = dup(stream->GetFd());
+  GSocket* conn = fd == -1 ? nullptr : g_socket_new_from_fd(fd, &error);
+  if (!conn) {
+    if (error) {
+      LOG_WARN("g_socket_new_from_fd failed: %s", error->message);
+      g_error_free(error);
+    }
+    if (fd != -1) {
+      close(fd);
+    }
+    stream.reset();
+  }
+  return conn;
+}
+
+/**
+ * 关闭解压后数据的套接口并结束解压线程, 未压缩时不做处理.
+ */
+void RecvFileData::CloseDecompressed(GSocket* conn,
+                                     unique_ptr<CompressedStream>& stream) {
+  if (!stream) {
+    return;
+  }
+  g_object_unref(conn);
+  stream->Finish();
+  LOG_INFO("decompressed %jd -> %jd bytes", (intmax_t)stream->GetWireBytes(),
+           (intmax_t)stream->GetRawBytes());
+  stream.reset();
+}
+
 /**
  * 接收文件数据.
  * @param sock tcp socket
@@ -363,8 +768,7 @@ int64_t RecvFileData::RecvData(int sock,
     if (size > 0 && xwrite(fd, buf, size) == -1)
       return finishsize;
     finishsize += size;
-    sumsize += size;
-    file->finishedsize = sumsize;
+    AddFinishedSize(size);
     /* 判断是否需要更新UI参考值 */
     gettimeofday(&val2, NULL);
     difftime = difftimeval(val2, val1);
@@ -373,8 +777,8 @@ int64_t RecvFileData::RecvData(int sock,
       rate = (uint32_t)((finishsize - tmpsize) / difftime);
       para.setFinishedLength(finishsize)
           .setCost(numeric_to_time((uint32_t)(difftimeval(val2, filetime))))
-          .setRemain(
-              numeric_to_time((uint32_t)((filesize - finishsize) / rate)))
+          .setRemain(numeric_to_time(
+              rate ? (uint32_t)((filesize - finishsize) / rate) : 0))
           .setRate(numeric_to_rate(rate));
       val1 = val2;           // 更新时间参考点
       tmpsize = finishsize;  // 更新下载量
@@ -405,6 +809,13 @@ int64_t RecvFileData::RecvData(GSocket* sock,
   if (offset == filesize)
     return filesize;
 
+  /* 大文件优先使用io_uring，使网络接收与写盘重叠进行 */
+  if (filesize - offset >= kUringMinSize) {
+    finishsize = RecvDataUring(sock, fd, filesize, offset);
+    if (finishsize >= 0)
+      return finishsize;
+  }
+
   tmpsize = finishsize = offset;
   gettimeofday(&val1, NULL);
   do {
@@ -422,8 +833,7 @@ int64_t RecvFileData::RecvData(GSocket* sock,
     if (size > 0 && xwrite(fd, buf, size) == -1)
       return finishsize;
     finishsize += size;
-    sumsize += size;
-    file->finishedsize = sumsize;
+    AddFinishedSize(size);
 
     gettimeofday(&val2, NULL);
     difftime = difftimeval(val2, val1);
@@ -431,8 +841,8 @@ int64_t RecvFileData::RecvData(GSocket* sock,
       rate = (uint32_t)((finishsize - tmpsize) / difftime);
       para.setFinishedLength(finishsize)
           .setCost(numeric_to_time((uint32_t)(difftimeval(val2, filetime))))
-          .setRemain(
-              numeric_to_time((uint32_t)((filesize - finishsize) / rate)))
+          .setRemain(numeric_to_time(
+              rate ? (uint32_t)((filesize - finishsize) / rate) : 0))
           .setRate(numeric_to_rate(rate));
       val1 = val2;
       tmpsize = finishsize;
@@ -442,6 +852,57 @@ int64_t RecvFileData::RecvData(GSocket* sock,
   return finishsize;
 }
 
+/**
+ * Receive file data with io_uring, starting at the current position of fd.
+ * @param sock GSocket tcp socket
+ * @param fd file descriptor
+ * @param filesize total file size
+ * @param offset starting offset
+ * @return received data size, -1 if io_uring is not available
+ */
+int64_t RecvFileData::RecvDataUring(GSocket* sock,
+                                    int fd,
+                                    int64_t filesize,
+                                    int64_t offset) {
+  int64_t tmpsize, reported;
+  struct timeval val1, val2;
+  float difftime;
+  uint32_t rate;
+  off_t pos;
+
+  if (!uring)
+    uring = make_unique<UringReceiver>();
+  if (!uring->IsReady() || (pos = lseek(fd, 0, SEEK_CUR)) == -1)
+    return -1;
+
+  tmpsize = reported = 0;
+  gettimeofday(&val1, NULL);
+  int64_t size = uring->Receive(
+      g_socket_get_fd(sock), fd, pos, filesize - offset,
+      [&](int64_t written) {
+        AddFinishedSize(written - reported);
+        reported = written;
+        gettimeofday(&val2, NULL);
+        difftime = difftimeval(val2, val1);
+        if (difftime >= 1) {
+          rate = (uint32_t)((written - tmpsize) / difftime);
+          para.setFinishedLength(offset + written)
+              .setCost(
+                  numeric_to_time((uint32_t)(difftimeval(val2, filetime))))
+              .setRemain(numeric_to_time(
+                  rate ? (uint32_t)((filesize - offset - written) / rate) : 0))
+              .setRate(numeric_to_rate(rate));
+          val1 = val2;
+          tmpsize = written;
+        }
+        return !terminate;
+      });
+  if (size < 0)
+    return -1;
+  lseek(fd, pos + size, SEEK_SET);
+  return offset + size;
+}
+
 /**
  * Update UI parameters when task is finished.
  */
@@ -468,4 +929,18 @@ void RecvFileData::UpdateUIParaToOver() {
   para.finish();
 }
 
+/**
+ * 累加已传输的数据量.
+ * @param throttle 是否按传输调度限速及暂停, 失败时终止任务
+ */
+void RecvFileData::AddFinishedSize(int64_t size, bool throttle) {
+  sumsize += size;
+  file->finishedsize = sumsize;
+  bytesReceived.Inc(size);
+  if (throttle &&
+      !coreThread->getTransScheduler().Throttle(GetTaskId(), size)) {
+    terminate = true;
+  }
+}
+
 }  // namespace iptux
@@ -14,37 +14,87 @@
 
 #include <gio/gio.h>
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "iptux-core/CoreThread.h"
 #include "iptux-core/Models.h"
 #include "iptux-core/internal/TransAbstract.h"
+#include "iptux-core/internal/UringReceiver.h"
 #include "iptux-core/internal/ipmsg.h"
 
 namespace iptux {
 
+class CompressedStream;
+
+/* 未完成文件的断点续传标记文件后缀 */
+#define RESUME_MARKER_SUFFIX ".iptux-resume"
+
 class RecvFileData : public TransAbstract {
  public:
+  /* 剩余数据量不小于此值时尝试使用io_uring接收 */
+  static constexpr int64_t kUringMinSize = 1024 * 1024;
+  /* 好友支持时, 不小于此值的文件分段经多个连接并行下载 */
+  static constexpr int64_t kSegmentMinSize = 64 * 1024 * 1024;
+  /* 每段的最小长度 */
+  static constexpr int64_t kSegmentMinLength = 16 * 1024 * 1024;
+  /* 分段下载时每个连接的接收缓冲区大小 */
+  static constexpr size_t kSegmentBufferSize = 256 * 1024;
+  /* 首轮之后用一个连接补齐未收全的段的最多轮数 */
+  static constexpr int kSegmentCatchUpRounds = 3;
+
   RecvFileData(CoreThread* coreThread, FileInfo* fl);
   virtual ~RecvFileData();
 
   void RecvFileDataEntry();
   virtual const TransFileModel& getTransFileModel() const;
   virtual void TerminateTrans();
+  void CreateUIPara();
+  uint32_t GetPeerIpv4() const;
+
+  bool IsResumable() const;
+  void PrepareResume();
+  int SegmentCount() const;
 
  private:
-  void CreateUIPara();
   void RecvRegularFile();
   void RecvDirFiles();
 
+  struct Segment {
+    int64_t offset{0};
+    int64_t length{0};
+    std::atomic<int64_t> done{0};  // 已接收的数据量
+  };
+  void RecvSegmentedFile(int segments);
+  bool RecvSegment(int fd, Segment& segment);
+
   int64_t RecvData(int sock, int fd, int64_t filesize, int64_t offset);
   int64_t RecvData(GSocket* sock, int fd, int64_t filesize, int64_t offset);
+  int64_t RecvDataUring(GSocket* sock,
+                        int fd,
+                        int64_t filesize,
+                        int64_t offset);
+  static GSocket* OpenDecompressed(GSocket* sock,
+                                   std::unique_ptr<CompressedStream>& stream);
+  static void CloseDecompressed(GSocket* conn,
+                                std::unique_ptr<CompressedStream>& stream);
   void UpdateUIParaToOver();
+  void AddFinishedSize(int64_t size, bool throttle = true);
+
+  std::string ResumeMarkerPath() const;
+  std::string ResumeMarkerContent() const;
+  void WriteResumeMarker() const;
+  int64_t GetResumeOffset() const;
 
   CoreThread* coreThread;
   FileInfo* file;  //文件信息
   TransFileModel para;
   bool terminate;                     //终止标志(也作处理结果标识)
   int64_t sumsize;                    //文件(目录)总大小
+  Counter& bytesReceived;             //全局已接收字节数
   char buf[MAX_SOCKLEN];              //数据缓冲区
+  std::unique_ptr<UringReceiver> uring;  // io_uring接收器(按需创建)
   struct timeval tasktime, filetime;  //任务开始时间&文件开始时间
 };
 
@@ -15,11 +15,14 @@
 #include <cinttypes>
 #include <cstring>
 #include <memory>
+#include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include "iptux-core/internal/Command.h"
 #include "iptux-core/internal/SendFileData.h"
+#include "iptux-core/internal/ShareCatalog.h"
+#include "iptux-core/internal/TransScheduler.h"
 #include "iptux-utils/output.h"
 #include "iptux-utils/utils.h"
 
@@ -27,6 +30,11 @@ using namespace std;
 
 namespace iptux {
 
+namespace {
+/* 一个UDP包中文件信息的长度上限, 为包头留出余量 */
+const size_t kMaxFileInfoLen = MAX_UDPLEN - 1024;
+}  // namespace
+
 SendFile::SendFile(CoreThread* coreThread) : coreThread(coreThread) {}
 
 SendFile::~SendFile() {}
@@ -36,10 +44,8 @@ SendFile::~SendFile() {}
  * @param pal class PalInfo
  */
 void SendFile::SendSharedInfoEntry(CoreThread* coreThread, PPalInfo pal) {
-  coreThread->Lock();
-  auto fileInfos = coreThread->getProgramData()->GetSharedFileInfos();
-  SendFile(coreThread).SendFileInfo(pal, IPTUX_SHAREDOPT, fileInfos);
-  coreThread->Unlock();
+  auto& catalog = coreThread->getProgramData()->GetShareCatalog();
+  SendFile(coreThread).SendFileInfo(pal, IPTUX_SHAREDOPT, catalog);
 }
 
 /**
@@ -59,11 +65,13 @@ void SendFile::BcstFileInfoEntry(CoreThread* coreThread,
  * @param sock tcp socket
  * @param fileattr 文件类型
  * @param attach 附加数据
+ * @param compress 对方要求按块压缩发送
  */
 void SendFile::RequestDataEntry(CoreThread* coreThread,
                                 int sock,
                                 FileAttr fileattr,
-                                char* attach) {
+                                char* attach,
+                                bool compress) {
   struct sockaddr_in addr;
   socklen_t len;
   uint32_t fileid;
@@ -85,6 +93,12 @@ void SendFile::RequestDataEntry(CoreThread* coreThread,
   }
   if (!file || file->fileattr != fileattr)
     return;
+  /* 续传时的起始偏移量与分段下载的长度(仅常规文件) */
+  int64_t offset = 0, length = 0;
+  if (fileattr == FileAttr::REGULAR) {
+    offset = iptux_get_hex64_number(attach, ':', 2);
+    length = iptux_get_hex64_number(attach, ':', 3);
+  }
   /* 检查好友数据是否存在 */
   len = sizeof(addr);
   getpeername(sock, (struct sockaddr*)&addr, &len);
@@ -96,7 +110,7 @@ void SendFile::RequestDataEntry(CoreThread* coreThread,
     // for public shared file, there need one owner
     file->fileown = coreThread->getMe();
   }
-  SendFile(coreThread).ThreadSendFile(sock, file);
+  SendFile(coreThread).ThreadSendFile(sock, file, offset, length, compress);
 }
 
 /**
@@ -107,36 +121,28 @@ void SendFile::RequestDataEntry(CoreThread* coreThread,
  */
 void SendFile::SendFileInfo(PPalInfo pal,
                             uint32_t opttype,
-                            vector<FileInfo>& fileInfos) {
+                            ShareCatalog& catalog) {
   Command cmd(*coreThread);
-  char buf[MAX_UDPLEN];
-  size_t len;
-  char *ptr, *name;
-
-  /* 初始化 */
-  len = 0;
-  ptr = buf;
-  buf[0] = '\0';
-
-  /* 将文件信息写入缓冲区 */
-  for (FileInfo& fileInfo : fileInfos) {
-    auto file = &fileInfo;
-    if (!fileInfo.isExist()) {
-      continue;
+  vector<string> entries;
+  vector<pair<uint32_t, uint32_t>> packets;
+
+  /* 编码文件信息, 快照中只有存在的文件, 元数据已缓存 */
+  for (auto& file : catalog.Get()->files) {
+    int64_t filesize = file->filesize;
+    if (filesize < 0) {  // 目录大小尚未统计出来
+      filesize = utils::fileOrDirectorySize(file->filepath);
     }
-    fileInfo.ensureFilesizeFilled();
-    name = ipmsg_get_filename_pal(file->filepath);  //获取面向好友的文件名
-    file->packetn = cmd.Packetn();
-    snprintf(ptr, MAX_UDPLEN - len,
-             "%" PRIu32 ":%s:%" PRIx64 ":%" PRIx32 ":%x:\a", file->fileid, name,
-             file->filesize, file->filectime, (unsigned int)file->fileattr);
+    char* name = ipmsg_get_filename_pal(file->filepath);  //面向好友的文件名
+    packets.emplace_back(file->fileid, cmd.Packetn());
+    entries.push_back(stringFormat(
+        "%" PRIu32 ":%s:%" PRIx64 ":%" PRIx32 ":%x:\a", file->fileid, name,
+        filesize, file->filectime, (unsigned int)file->fileattr));
     g_free(name);
-    len += strlen(ptr);
-    ptr = buf + len;
   }
+  catalog.SetPacketNumbers(packets);
 
   /* 发送文件信息 */
-  cmd.SendFileInfo(coreThread->getUdpSock(), pal->GetKey(), opttype, buf);
+  SendEntries(*pal, opttype, entries);
 }
 
 /**
@@ -163,27 +169,81 @@ void SendFile::BcstFileInfo(const std::vector<const PalInfo*>& pals,
       buffer.push_back(Command::encodeFileInfo(*file));
     }
 
-    string res;
-    for (auto b : buffer) {
-      if (res.length() + b.length() > MAX_UDPLEN)
-        break;
-      res += b;
-    }
+    SendEntries(*pal, opttype, buffer);
+  }
+}
 
-    cmd.SendFileInfo(coreThread->getUdpSock(), pal->GetKey(), opttype,
-                     res.c_str());
+/**
+ * 发送编码后的文件信息.
+ * 一个UDP包放不下时, iptux好友会收到IPTUX_MANIFESTOPT标记, 余下的部分
+ * 作为清单留待其经TCP取走; 其他好友只能收到放得下的部分.
+ * @param pal class PalInfo
+ * @param opttype 命令字选项
+ * @param entries 文件信息
+ */
+void SendFile::SendEntries(const PalInfo& pal,
+                           uint32_t opttype,
+                           const vector<string>& entries) {
+  Command cmd(*coreThread);
+  string extra, manifest;
+
+  for (auto& entry : entries) {
+    if (manifest.empty() && extra.size() + entry.size() <= kMaxFileInfoLen) {
+      extra += entry;
+    } else if (pal.isCompatible()) {
+      manifest += entry;
+    } else {
+      break;
+    }
   }
+  if (!manifest.empty()) {
+    LOG_INFO("%zu bytes of file infos for %s left to manifest",
+             manifest.size(), pal.GetKey().ToString().c_str());
+    opttype |= IPTUX_MANIFESTOPT;
+  }
+  cmd.SendFileInfo(coreThread->getUdpSock(), pal.GetKey(), opttype,
+                   extra.c_str(), std::move(manifest));
 }
 
 /**
- * 发送文件数据.
+ * 发送文件数据, 传输调度允许时在当前线程中发送.
+ * 上传数已满时不排队等待, 以免占住TCP处理线程, 连接关闭后由对方续传.
+ * 被拒绝的分段请求对方会用其他连接补齐, 不作为失败的任务显示.
  * @param sock tcp socket
  * @param file 文件信息
+ * @param offset 文件起始偏移量
+ * @param length 发送的数据量, 0表示直到文件末尾
+ * @param compress 是否按块压缩发送
  */
-void SendFile::ThreadSendFile(int sock, PFileInfo file) {
-  auto sfdt = make_shared<SendFileData>(coreThread, sock, file);
+void SendFile::ThreadSendFile(int sock,
+                              PFileInfo file,
+                              int64_t offset,
+                              int64_t length,
+                              bool compress) {
+  auto sfdt = make_shared<SendFileData>(coreThread, sock, file, offset, length,
+                                        compress);
   coreThread->RegisterTransTask(sfdt);
-  sfdt->SendFileDataEntry();
+  sfdt->CreateUIPara();
+
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  uint32_t peer = 0;
+  if (getpeername(sock, (struct sockaddr*)&addr, &len) == 0) {
+    peer = addr.sin_addr.s_addr;
+  }
+  if (!coreThread->getTransScheduler().TryRun(
+          sfdt->GetTaskId(), TransScheduler::Direction::UPLOAD, peer,
+          [sfdt] { sfdt->SendFileDataEntry(); })) {
+    if (length > 0) {
+      LOG_INFO("too many uploads, refuse segment of \"%s\"", file->filepath);
+      coreThread->UnregisterTransTask(sfdt->GetTaskId());
+      return;
+    }
+    LOG_WARN("too many uploads, refuse send task %d", sfdt->GetTaskId());
+    /* 不发送数据, 只把任务标为失败 */
+    sfdt->TerminateTrans();
+    sfdt->SendFileDataEntry();
+  }
 }
 
 }  // namespace iptux
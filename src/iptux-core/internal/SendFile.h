@@ -12,6 +12,7 @@
 #ifndef IPTUX_SENDFILE_H
 #define IPTUX_SENDFILE_H
 
+#include <string>
 #include <vector>
 
 #include "iptux-core/CoreThread.h"
@@ -19,6 +20,8 @@
 
 namespace iptux {
 
+class ShareCatalog;
+
 class SendFile {
  private:
   explicit SendFile(CoreThread* coreThread);
@@ -32,16 +35,22 @@ class SendFile {
   static void RequestDataEntry(CoreThread* coreThread,
                                int sock,
                                FileAttr fileattr,
-                               char* attach);
+                               char* attach,
+                               bool compress = false);
 
  private:
-  void SendFileInfo(PPalInfo pal,
-                    uint32_t opttype,
-                    std::vector<FileInfo>& filist);
+  void SendFileInfo(PPalInfo pal, uint32_t opttype, ShareCatalog& catalog);
   void BcstFileInfo(const std::vector<const PalInfo*>& pals,
                     uint32_t opttype,
                     const std::vector<FileInfo*>& files);
-  void ThreadSendFile(int sock, PFileInfo file);
+  void SendEntries(const PalInfo& pal,
+                   uint32_t opttype,
+                   const std::vector<std::string>& entries);
+  void ThreadSendFile(int sock,
+                      PFileInfo file,
+                      int64_t offset,
+                      int64_t length,
+                      bool compress);
 
  private:
   CoreThread* coreThread;
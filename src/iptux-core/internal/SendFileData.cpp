@@ -12,20 +12,30 @@
 #include "config.h"
 #include "SendFileData.h"
 
+#include <cerrno>
 #include <cinttypes>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
+#if HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 
 #include <glib/gi18n.h>
 
-#include "iptux-core/internal/AnalogFS.h"
+#include "iptux-core/internal/CompressedStream.h"
+#include "iptux-core/internal/DirPrefetcher.h"
+#include "iptux-core/internal/TransScheduler.h"
 
 #include "iptux-core/Event.h"
 #include "iptux-utils/output.h"
@@ -35,13 +45,33 @@ using namespace std;
 
 namespace iptux {
 
+/* 同一文件的各个分段由不同线程发送, 共同累加文件的已完成量 */
+static std::mutex segmentFinishedMutex;
+
 /**
  * 类构造函数.
  * @param sk tcp socket
  * @param fl 文件信息数据
+ * @param offset 常规文件的起始偏移量
+ * @param length 发送的数据量, 0表示直到文件末尾
+ * @param compress 是否按块压缩发送
  */
-SendFileData::SendFileData(CoreThread* coreThread, int sk, PFileInfo fl)
-    : coreThread(coreThread), sock(sk), file(fl), terminate(false), sumsize(0) {
+SendFileData::SendFileData(CoreThread* coreThread,
+                           int sk,
+                           PFileInfo fl,
+                           int64_t offset,
+                           int64_t length,
+                           bool compress)
+    : coreThread(coreThread),
+      sock(sk),
+      file(fl),
+      offset(offset),
+      length(length),
+      compress(compress),
+      terminate(false),
+      zeroCopy(true),
+      sumsize(0),
+      bytesSent(coreThread->getMetrics().GetCounter("trans.bytes_sent")) {
   buf[0] = '\0';
   gettimeofday(&tasktime, NULL);
 }
@@ -59,17 +89,21 @@ void SendFileData::SendFileDataEntry() {
   CreateUIPara();
   coreThread->emitEvent(make_shared<SendFileStartedEvent>(GetTaskId()));
 
-  /* 分类处理 */
-  switch (file->fileattr) {
-    case FileAttr::REGULAR:
-      SendRegularFile();
-      break;
-    case FileAttr::DIRECTORY:
-      SendDirFiles();
-      break;
-    default:
-      g_assert(false);
-      break;
+  /* 分类处理, 排队时已被终止的任务直接结束 */
+  if (!terminate && compress) {
+    SendCompressed();
+  } else if (!terminate) {
+    switch (file->fileattr) {
+      case FileAttr::REGULAR:
+        SendRegularFile();
+        break;
+      case FileAttr::DIRECTORY:
+        SendDirFiles();
+        break;
+      default:
+        g_assert(false);
+        break;
+    }
   }
   UpdateUIParaToOver();
   coreThread->emitEvent(make_shared<SendFileFinishedEvent>(GetTaskId()));
@@ -92,6 +126,7 @@ void SendFileData::TerminateTrans() {
 
 /**
  * 创建UI参考数据.
+ * 排队时即创建, 以便在任务列表中显示.
  */
 void SendFileData::CreateUIPara() {
   struct in_addr addr = file->fileown->ipv4();
@@ -124,14 +159,39 @@ void SendFileData::SendRegularFile() {
 
   file->ensureFilesizeFilled();
 
+  /* 续传，跳过对方已接收的数据 */
+  if (offset > 0) {
+    if (offset > file->filesize || lseek(fd, offset, SEEK_SET) == -1) {
+      LOG_WARN("invalid offset %jd for file \"%s\" (size %jd)",
+               (intmax_t)offset, file->filepath, (intmax_t)file->filesize);
+      close(fd);
+      terminate = true;
+      return;
+    }
+    /* 分段只计本段的数据量, 与显示的文件长度一致 */
+    if (length == 0) {
+      LOG_INFO("resume sending file \"%s\" from offset %jd", file->filepath,
+               (intmax_t)offset);
+      sumsize = offset;
+    }
+  }
+  /* 分段下载, 只发送其中一段 */
+  int64_t size = file->filesize - offset;
+  if (length > 0) {
+    size = min(size, length);
+    LOG_INFO("send segment [%jd, %jd) of file \"%s\"", (intmax_t)offset,
+             (intmax_t)(offset + size), file->filepath);
+    para.setFileLength(size);
+  }
+
   /* 发送文件数据 */
   gettimeofday(&filetime, NULL);
-  finishsize = SendData(fd, file->filesize);
+  finishsize = SendData(fd, size);
   close(fd);
   //        sumsize += finishsize;
 
   /* 考察处理结果 */
-  if (finishsize < file->filesize) {
+  if (finishsize < size) {
     terminate = true;
     LOG_INFO(_("Failed to send the file \"%s\" to %s!"), file->filepath,
              file->fileown->getName().c_str());
@@ -145,129 +205,157 @@ void SendFileData::SendRegularFile() {
   }
 }
 
-static void _dirstack_free(gpointer data, gpointer) {
-  DIR* dir = (DIR*)data;
-  if (dir) {
-    closedir(dir);
+/**
+ * 按块压缩发送.
+ * 数据经 CompressedStream 的转发线程压缩后发出, 发送代码照常写入其本地一端.
+ * 已是压缩格式的常规文件只存储不压缩, 目录中的这类文件由自适应逻辑跳过.
+ */
+void SendFileData::SendCompressed() {
+  bool precompressed = file->fileattr == FileAttr::REGULAR &&
+                       CompressedStream::IsPrecompressed(file->filepath);
+  CompressedStream stream(sock, CompressedStream::Mode::COMPRESS,
+                          precompressed ? 0 : CompressedStream::kDefaultLevel);
+  if (!stream.Start()) {
+    terminate = true;
+    return;
   }
+
+  int tcpSock = sock;
+  sock = stream.GetFd();
+  if (file->fileattr == FileAttr::REGULAR) {
+    SendRegularFile();
+  } else {
+    SendDirFiles();
+  }
+  sock = tcpSock;
+
+  if (!stream.Finish(terminate)) {
+    terminate = true;
+  }
+  LOG_INFO("compressed \"%s\": %jd -> %jd bytes, level %d", file->filepath,
+           (intmax_t)stream.GetRawBytes(), (intmax_t)stream.GetWireBytes(),
+           stream.GetLevel());
+}
+
+/**
+ * 构造目录传输的数据头.
+ * @param buf 缓冲区(MAX_SOCKLEN)
+ * @param entry 目录条目
+ * @param encode 好友的编码
+ * @return 数据头长度
+ */
+static size_t createDirEntryHeader(char* buf,
+                                   const DirPrefetcher::Entry& entry,
+                                   const string& encode) {
+  const struct stat& st = entry.st;
+  gchar *dirname, *filename;
+  uint32_t headsize;
+
+  if (entry.kind == DirPrefetcher::Kind::RETPARENT) {
+    snprintf(buf, MAX_SOCKLEN,
+             "0000:.:0:%lx:%lx=%jx:%lx=%jx:", IPMSG_FILE_RETPARENT,
+             IPMSG_FILE_MTIME, (uintmax_t)st.st_mtime, IPMSG_FILE_CREATETIME,
+             (uintmax_t)st.st_ctime);
+  } else {
+    /* 转码 */
+    if (strcasecmp(encode.c_str(), "utf-8") != 0 &&
+        (filename =
+             convert_encode(entry.name.c_str(), encode.c_str(), "utf-8"))) {
+      dirname = ipmsg_get_filename_pal(filename);
+      g_free(filename);
+    } else
+      dirname = ipmsg_get_filename_pal(entry.name.c_str());
+    bool regular = entry.kind == DirPrefetcher::Kind::REGULAR;
+    snprintf(buf, MAX_SOCKLEN, "0000:%s:%.9jx:%lx:%lx=%jx:%lx=%jx:", dirname,
+             (uintmax_t)(regular ? st.st_size : 0),
+             regular ? IPMSG_FILE_REGULAR : IPMSG_FILE_DIR, IPMSG_FILE_MTIME,
+             (uintmax_t)st.st_mtime, IPMSG_FILE_CREATETIME,
+             (uintmax_t)st.st_ctime);
+    g_free(dirname);
+  }
+  headsize = strlen(buf);
+  snprintf(buf, MAX_SOCKLEN, "%.4" PRIx32, headsize);
+  *(buf + 4) = ':';
+  return headsize;
 }
 
 /**
  * 发送目录文件.
+ * 目录树由 DirPrefetcher 在另一线程中预先遍历并预读, 本线程把数据头与
+ * 小文件的数据合并到批量缓冲区中一次写出, 大文件则直接发送.
  */
 void SendFileData::SendDirFiles() {
-  AnalogFS afs;
-  GQueue dirstack = G_QUEUE_INIT;  // @see DIR
-  struct stat st;
-  struct dirent *dirt, vdirt;
-  DIR* dir;
-  gchar *dirname, *pathname, *filename;
+  gchar *dirname, *pathname;
+  DirPrefetcher::Entry entry;
+  vector<char> batch;
+  size_t headsize;
   int64_t finishsize;
-  uint32_t headsize;
-  int fd;
   bool result;
 
-  /* 转到上传目录位置 */
+  /* 从上传目录位置开始遍历 */
   dirname = ipmsg_get_filename_me(file->filepath, &pathname);
-  afs.chdir(pathname);
+  DirPrefetcher walker(
+      pathname ? pathname : (file->filepath[0] == '/' ? "/" : "."), dirname);
   g_free(pathname);
-  strcpy(vdirt.d_name, dirname);
-  dirt = &vdirt;
   g_free(dirname);
 
-  result = false;  // 预设任务处理失败
-  dir = NULL;      // 预设当前目录流无效
-  goto start;
-  while (!g_queue_is_empty(&dirstack)) {
-    /* 取出最后一次压入堆栈的目录流 */
-    dir = (DIR*)g_queue_pop_head(&dirstack);
-    /* 发送目录流中的下属数据 */
-    while (dir && (dirt = readdir(dir))) {
-      if (strcmp(dirt->d_name, ".") == 0 || strcmp(dirt->d_name, "..") == 0)
-        continue;
+  /* 写出批量缓冲区 */
+  auto flush = [&]() -> bool {
+    if (batch.empty())
+      return true;
+    bool ok = xwrite(sock, batch.data(), batch.size()) != -1;
+    batch.clear();
+    return ok;
+  };
 
-      /* 检查文件是否可用 */
-    start:
-      if (afs.stat(dirt->d_name, &st) == -1 ||
-          !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)))
-        continue;
-      /* 更新UI参考值 */
-      para.setFilename(dirt->d_name)
-          .setFileLength(st.st_size)
+  result = false;  // 预设任务处理失败
+  batch.reserve(kDirBatchSize);
+  while (!terminate && walker.Next(entry)) {
+    /* 更新UI参考值 */
+    if (entry.kind != DirPrefetcher::Kind::RETPARENT) {
+      para.setFilename(entry.name)
+          .setFileLength(entry.st.st_size)
           .setFinishedLength(0)
           .setCost("00:00:00")
           .setRemain(_("Unknown"))
           .setRate("0B/s");
-      /* 转码 */
-      if (strcasecmp(file->fileown->getEncode().c_str(), "utf-8") != 0 &&
-          (filename = convert_encode(
-               dirt->d_name, file->fileown->getEncode().c_str(), "utf-8"))) {
-        dirname = ipmsg_get_filename_pal(filename);
-        g_free(filename);
-      } else
-        dirname = ipmsg_get_filename_pal(dirt->d_name);
-      /* 构造数据头并发送 */
-      snprintf(buf, MAX_SOCKLEN, "0000:%s:%.9jx:%lx:%lx=%jx:%lx=%jx:", dirname,
-               (uintmax_t)(S_ISREG(st.st_mode) ? st.st_size : 0),
-               S_ISREG(st.st_mode) ? IPMSG_FILE_REGULAR : IPMSG_FILE_DIR,
-               IPMSG_FILE_MTIME, (uintmax_t)st.st_mtime, IPMSG_FILE_CREATETIME,
-               (uintmax_t)st.st_ctime);
-      g_free(dirname);
-      headsize = strlen(buf);
-      snprintf(buf, MAX_SOCKLEN, "%.4" PRIx32, headsize);
-      *(buf + 4) = ':';
-      if (xwrite(sock, buf, headsize) == -1)
-        goto end;
-      /* 选择处理方案 */
-      gettimeofday(&filetime, NULL);
-      if (S_ISREG(st.st_mode)) {  // 常规文件
-        if ((fd = afs.open(dirt->d_name, O_RDONLY | O_LARGEFILE)) == -1)
-          goto end;
-        finishsize = SendData(fd, st.st_size);
-        close(fd);
-        if (finishsize < st.st_size)
-          goto end;
-        //                                sumsize += finishsize;
-      } else if (S_ISDIR(st.st_mode)) {  // 目录文件
-        if (dir)  // 若当前目录流有效则须压入堆栈
-          g_queue_push_head(&dirstack, dir);
-        /* 打开下属目录 */
-        if (!(dir = afs.opendir(dirt->d_name)))
-          goto end;
-        /* 本地端也须转至下属目录 */
-        afs.chdir(dirt->d_name);
+    }
+    /* 构造数据头 */
+    headsize = createDirEntryHeader(buf, entry, file->fileown->getEncode());
+    batch.insert(batch.end(), buf, buf + headsize);
+
+    gettimeofday(&filetime, NULL);
+    if (entry.kind == DirPrefetcher::Kind::REGULAR) {
+      int64_t filesize = entry.st.st_size;
+      if (filesize <= int64_t(kDirBatchSize - batch.size())) {
+        /* 小文件, 数据直接读入批量缓冲区 */
+        size_t used = batch.size();
+        batch.resize(used + filesize);
+        finishsize = filesize ? xread(entry.fd, batch.data() + used, filesize)
+                              : 0;
+        if (finishsize > 0) {
+          AddFinishedSize(finishsize);
+        }
+      } else {
+        /* 大文件, 先写出已缓冲的数据, 再走sendfile */
+        finishsize = flush() ? SendData(entry.fd, filesize) : -1;
       }
+      close(entry.fd);
+      if (finishsize < filesize)
+        goto end;
     }
-    /* 目录流有效才可向上转 */
-    if (dir) {
-      /* 关闭当前操作的目录流 */
-      closedir(dir);
-      dir = NULL;
-      /* 构造向上转的数据头并发送 */
-      snprintf(buf, MAX_SOCKLEN,
-               "0000:.:0:%lx:%lx=%jx:%lx=%jx:", IPMSG_FILE_RETPARENT,
-               IPMSG_FILE_MTIME, (uintmax_t)st.st_mtime, IPMSG_FILE_CREATETIME,
-               (uintmax_t)st.st_ctime);
-      headsize = strlen(buf);
-      snprintf(buf, MAX_SOCKLEN, "%.4" PRIx32, headsize);
-      *(buf + 4) = ':';
-      if (xwrite(sock, buf, headsize) == -1)
+    /* 缓冲区将满, 或预读线程跟不上时写出 */
+    if (batch.size() >= kDirBatchSize / 2 || walker.Ready() == 0) {
+      if (!flush())
         goto end;
-      /* 本地端也须向上转一层 */
-      afs.chdir("..");
     }
   }
-  result = true;
+  result = !terminate && !walker.Failed() && flush();
 
   /* 考察处理结果 */
 end:
   if (!result) {
-    /* 若当前目录流有效，则必须关闭 */
-    if (dir)
-      closedir(dir);
-    /* 关闭堆栈中所有的目录流，并清空堆栈 */
-    g_queue_foreach(&dirstack, _dirstack_free, NULL);
-    g_queue_clear(&dirstack);
+    terminate = true;  // 标记处理过程失败
     LOG_INFO(_("Failed to send the directory \"%s\" to %s!"), file->filepath,
              file->fileown->getName().c_str());
     // g_cthrd->SystemLog(_("Failed to send the directory \"%s\" to %s!"),
@@ -282,6 +370,7 @@ end:
 
 /**
  * 发送文件数据.
+ * 优先使用sendfile(2)零拷贝发送，不支持时退回到read/write循环.
  * @param fd file descriptor
  * @param filesize 文件总长度
  * @return 完成数据量
@@ -301,15 +390,19 @@ int64_t SendFileData::SendData(int fd, int64_t filesize) {
   gettimeofday(&val1, NULL);  // 初始化起始时间
   do {
     /* 读取文件数据并发送 */
-    size = MAX_SOCKLEN < filesize - finishsize ? MAX_SOCKLEN
-                                               : filesize - finishsize;
-    if ((size = xread(fd, buf, MAX_SOCKLEN)) == -1)
-      return finishsize;
-    if (size > 0 && xwrite(sock, buf, size) == -1)
+    size = SendChunkZeroCopy(fd, filesize - finishsize);
+    if (size == -1)
       return finishsize;
+    if (size == kZeroCopyUnsupported) {
+      /* 与零拷贝一样不超出请求的范围 */
+      size = min<int64_t>(MAX_SOCKLEN, filesize - finishsize);
+      if ((size = xread(fd, buf, size)) == -1)
+        return finishsize;
+      if (size > 0 && xwrite(sock, buf, size) == -1)
+        return finishsize;
+    }
     finishsize += size;
-    sumsize += size;
-    file->finishedsize = sumsize;
+    AddFinishedSize(size);
     /* 判断是否需要更新UI参考值 */
     gettimeofday(&val2, NULL);
     difftime = difftimeval(val2, val1);
@@ -318,8 +411,8 @@ int64_t SendFileData::SendData(int fd, int64_t filesize) {
       rate = (uint32_t)((finishsize - tmpsize) / difftime);
       para.setFinishedLength(finishsize)
           .setCost(numeric_to_time((uint32_t)(difftimeval(val2, filetime))))
-          .setRemain(
-              numeric_to_time((uint32_t)((filesize - finishsize) / rate)))
+          .setRemain(numeric_to_time(
+              rate ? (uint32_t)((filesize - finishsize) / rate) : 0))
           .setRate(numeric_to_rate(rate));
       val1 = val2;           // 更新时间参考点
       tmpsize = finishsize;  // 更新下载量
@@ -329,6 +422,53 @@ int64_t SendFileData::SendData(int fd, int64_t filesize) {
   return finishsize;
 }
 
+/**
+ * 用sendfile(2)发送一块文件数据，从文件当前位置开始.
+ * @param fd file descriptor
+ * @param remain 剩余数据量
+ * @return 发送的数据量；-1 表示出错；kZeroCopyUnsupported
+ * 表示此文件/套接口不支持零拷贝，应使用read/write发送
+ */
+ssize_t SendFileData::SendChunkZeroCopy(int fd, int64_t remain) {
+#if HAVE_SENDFILE
+  if (!zeroCopy)
+    return kZeroCopyUnsupported;
+
+  size_t count =
+      remain < (int64_t)kZeroCopyChunk ? (size_t)remain : kZeroCopyChunk;
+  while (!terminate) {
+    ssize_t size = sendfile(sock, fd, NULL, count);
+    if (size >= 0)
+      return size;
+    switch (errno) {
+      case EINTR:
+        continue;
+      case EAGAIN: {
+        /* 套接口为非阻塞模式，等待可写 */
+        struct pollfd pfd = {sock, POLLOUT, 0};
+        poll(&pfd, 1, 1000);
+        continue;
+      }
+      case EINVAL:
+      case ENOSYS:
+      case EOPNOTSUPP:
+        LOG_INFO("sendfile not supported for %s, fall back to read/write",
+                 file->filepath);
+        zeroCopy = false;
+        return kZeroCopyUnsupported;
+      default:
+        LOG_ERROR("sendfile to %d failed: %s", sock, strerror(errno));
+        return -1;
+    }
+  }
+  return -1;
+#else
+  (void)fd;
+  (void)remain;
+  return kZeroCopyUnsupported;
+#endif
+}
+
 /**
  * 更新UI参考数据到任务结束.
  */
@@ -353,4 +493,22 @@ void SendFileData::UpdateUIParaToOver() {
   para.finish();
 }
 
+/**
+ * 累加已传输的数据量.
+ */
+void SendFileData::AddFinishedSize(int64_t size) {
+  sumsize += size;
+  if (length > 0) {
+    lock_guard<std::mutex> l(segmentFinishedMutex);
+    file->finishedsize = min(file->filesize, file->finishedsize + size);
+  } else {
+    file->finishedsize = sumsize;
+  }
+  bytesSent.Inc(size);
+  /* 按传输调度限速及暂停 */
+  if (!coreThread->getTransScheduler().Throttle(GetTaskId(), size)) {
+    terminate = true;
+  }
+}
+
 }  // namespace iptux
@@ -21,27 +21,47 @@ namespace iptux {
 
 class SendFileData : public TransAbstract {
  public:
-  SendFileData(CoreThread* coreThread, int sk, PFileInfo fl);
+  /* SendChunkZeroCopy() 返回此值表示需要退回到read/write */
+  static constexpr ssize_t kZeroCopyUnsupported = -2;
+  /* 每次sendfile(2)的最大数据量，保证进度与终止标志能及时更新 */
+  static constexpr size_t kZeroCopyChunk = 1024 * 1024;
+  /* 发送目录时合并数据头与小文件数据的缓冲区大小 */
+  static constexpr size_t kDirBatchSize = 256 * 1024;
+
+  SendFileData(CoreThread* coreThread,
+               int sk,
+               PFileInfo fl,
+               int64_t offset = 0,
+               int64_t length = 0,
+               bool compress = false);
   ~SendFileData();
 
   void SendFileDataEntry();
   virtual const TransFileModel& getTransFileModel() const;
   virtual void TerminateTrans();
+  void CreateUIPara();
 
  private:
-  void CreateUIPara();
   void SendRegularFile();
   void SendDirFiles();
+  void SendCompressed();
 
   int64_t SendData(int fd, int64_t filesize);
+  ssize_t SendChunkZeroCopy(int fd, int64_t remain);
   void UpdateUIParaToOver();
+  void AddFinishedSize(int64_t size);
 
   CoreThread* coreThread;
   int sock;        //数据套接口
   PFileInfo file;  //文件信息
+  int64_t offset;  //常规文件的起始偏移量(续传)
+  int64_t length;  //分段下载时的数据量, 0表示直到文件末尾
+  bool compress;   //是否按块压缩发送
   TransFileModel para;
   bool terminate;                     //终止标志(也作处理结果标识)
+  bool zeroCopy;                      //是否尝试sendfile零拷贝
   int64_t sumsize;                    //文件(目录)总大小
+  Counter& bytesSent;                 //全局已发送字节数
   char buf[MAX_SOCKLEN];              //数据缓冲区
   struct timeval tasktime, filetime;  //任务开始时间&文件开始时间
 };
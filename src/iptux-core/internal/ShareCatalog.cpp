@@ -0,0 +1,414 @@
+#include "config.h"
+#include "ShareCatalog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <set>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+#include "iptux-utils/DirSizeService.h"
+#include "iptux-utils/output.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+/* 收到inotify事件后再等一会儿, 把连续的改动合并成一次刷新 */
+const int kSettleMs = 200;
+/* 有inotify时完整重新统计目录大小的间隔 */
+const int64_t kDeepRescanMs = 6 * 3600 * 1000;
+
+uint64_t packetKey(uint32_t packetn, uint32_t filenum) {
+  return uint64_t(packetn) << 32 | filenum;
+}
+
+int64_t nowMs() {
+  return chrono::duration_cast<chrono::milliseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
+
+shared_ptr<const FileInfo> ShareCatalog::Snapshot::FindById(
+    uint32_t fileId) const {
+  auto it = byId.find(fileId);
+  return it == byId.end() ? nullptr : files[it->second];
+}
+
+shared_ptr<const FileInfo> ShareCatalog::Snapshot::FindByPacket(
+    uint32_t packetn,
+    uint32_t filenum) const {
+  auto it = byPacket.find(packetKey(packetn, filenum));
+  return it == byPacket.end() ? nullptr : files[it->second];
+}
+
+ShareCatalog::ShareCatalog(int rescanIntervalMs)
+    : rescanIntervalMs(rescanIntervalMs), snapshot(make_shared<Snapshot>()) {}
+
+ShareCatalog::~ShareCatalog() {
+  Stop();
+}
+
+void ShareCatalog::Reset(const vector<FileInfo>& newFiles) {
+  lock_guard<std::mutex> l(mutex);
+  map<string, Meta> newMetas;
+  items.clear();
+  for (auto& file : newFiles) {
+    if (!file.filepath) {
+      continue;
+    }
+    string path(file.filepath);
+    if (!newMetas.count(path)) {
+      auto it = metas.find(path);
+      newMetas[path] =
+          it != metas.end() ? it->second : statFile(path, nullptr, false);
+    }
+    items.push_back(merge(file, newMetas[path]));
+  }
+  metas.swap(newMetas);
+  watchesDirty = true;
+  publishLocked();
+  wakeLocked();
+}
+
+void ShareCatalog::Add(const FileInfo& file) {
+  if (!file.filepath) {
+    return;
+  }
+  lock_guard<std::mutex> l(mutex);
+  string path(file.filepath);
+  auto it = metas.find(path);
+  if (it == metas.end()) {
+    it = metas.emplace(path, statFile(path, nullptr, false)).first;
+    watchesDirty = true;
+  }
+  items.push_back(merge(file, it->second));
+  publishLocked();
+  wakeLocked();
+}
+
+void ShareCatalog::Clear() {
+  Reset({});
+}
+
+shared_ptr<const ShareCatalog::Snapshot> ShareCatalog::Get() const {
+  return atomic_load(&snapshot);
+}
+
+void ShareCatalog::SetPacketNumbers(
+    const vector<pair<uint32_t, uint32_t>>& packets) {
+  lock_guard<std::mutex> l(mutex);
+  for (auto& packet : packets) {
+    for (auto& item : items) {
+      if (item->fileid == packet.first) {
+        auto file = make_shared<FileInfo>(*item);
+        file->packetn = packet.second;
+        item = file;
+      }
+    }
+  }
+  publishLocked();
+}
+
+void ShareCatalog::Refresh() {
+  rescan(true);
+}
+
+/**
+ * 重新读取所有共享文件的元数据并统计目录大小.
+ * @param recursive 是否丢弃目录下全部的缓存; 否则只重读修改时间变了的目录
+ */
+void ShareCatalog::rescan(bool recursive) {
+  vector<string> paths;
+  {
+    lock_guard<std::mutex> l(mutex);
+    for (auto& it : metas) {
+      paths.push_back(it.first);
+    }
+  }
+  /* 目录中的文件原地改写不会改变目录的修改时间, 整体重新统计 */
+  if (recursive) {
+    for (auto& path : paths) {
+      DirSizeService::Instance().Invalidate(path, true);
+    }
+  }
+  refreshPaths(paths, true);
+}
+
+void ShareCatalog::Start() {
+  lock_guard<std::mutex> l(mutex);
+  if (running) {
+    return;
+  }
+  if (pipe(wakeFds) != 0) {
+    LOG_WARN("create pipe failed: %s", strerror(errno));
+    return;
+  }
+  fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+  fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+#if HAVE_INOTIFY
+  inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotifyFd == -1) {
+    LOG_WARN("inotify_init1 failed, fall back to rescan: %s",
+             strerror(errno));
+  }
+#endif
+  watchesDirty = true;
+  running = true;
+  refresher = thread([this] { run(); });
+}
+
+void ShareCatalog::Stop() {
+  {
+    lock_guard<std::mutex> l(mutex);
+    if (!running) {
+      return;
+    }
+    running = false;
+    wakeLocked();
+  }
+  refresher.join();
+
+  lock_guard<std::mutex> l(mutex);
+  if (inotifyFd != -1) {
+    close(inotifyFd);
+    inotifyFd = -1;
+  }
+  watches.clear();
+  close(wakeFds[0]);
+  close(wakeFds[1]);
+  wakeFds[0] = wakeFds[1] = -1;
+}
+
+/**
+ * 读取文件元数据.
+ * @param old 上次的结果, 目录的修改时间未变时沿用其大小
+ * @param deep 是否重新计算目录大小
+ */
+ShareCatalog::Meta ShareCatalog::statFile(const string& path,
+                                          const Meta* old,
+                                          bool deep) {
+  Meta meta;
+  struct stat st;
+  if (stat(path.c_str(), &st) == -1 ||
+      !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+    return meta;
+  }
+  meta.exists = true;
+  meta.filectime = st.st_ctime;
+  meta.filemtime = st.st_mtime;
+  if (S_ISREG(st.st_mode)) {
+    meta.fileattr = FileAttr::REGULAR;
+    meta.filesize = st.st_size;
+  } else {
+    meta.fileattr = FileAttr::DIRECTORY;
+    if (deep) {
+      meta.filesize = utils::fileOrDirectorySize(path);
+    } else if (old && old->exists && old->filemtime == meta.filemtime) {
+      meta.filesize = old->filesize;
+    }
+  }
+  return meta;
+}
+
+shared_ptr<const FileInfo> ShareCatalog::merge(const FileInfo& file,
+                                               const Meta& meta) {
+  auto res = make_shared<FileInfo>(file);
+  if (meta.exists) {
+    res->fileattr = meta.fileattr;
+    res->filesize = meta.filesize;
+    res->filectime = meta.filectime;
+    res->filemtime = meta.filemtime;
+  }
+  return res;
+}
+
+/**
+ * 重新读取paths的元数据, 耗时的统计不持锁进行.
+ */
+void ShareCatalog::refreshPaths(const vector<string>& paths, bool deep) {
+  vector<pair<string, Meta>> olds;
+  {
+    lock_guard<std::mutex> l(mutex);
+    for (auto& path : paths) {
+      auto it = metas.find(path);
+      if (it != metas.end()) {
+        olds.emplace_back(path, it->second);
+      }
+    }
+  }
+  vector<pair<string, Meta>> news;
+  for (auto& old : olds) {
+    news.emplace_back(old.first, statFile(old.first, &old.second, deep));
+  }
+
+  lock_guard<std::mutex> l(mutex);
+  bool changed = false;
+  for (auto& it : news) {
+    auto meta = metas.find(it.first);
+    if (meta == metas.end()) {
+      continue;  // 刷新期间被移出了共享
+    }
+    const Meta& old = meta->second;
+    const Meta& now = it.second;
+    if (old.exists == now.exists && old.fileattr == now.fileattr &&
+        old.filesize == now.filesize && old.filectime == now.filectime &&
+        old.filemtime == now.filemtime) {
+      continue;
+    }
+    if (old.exists != now.exists) {
+      watchesDirty = true;
+    }
+    meta->second = now;
+    for (auto& item : items) {
+      if (it.first == item->filepath) {
+        item = merge(*item, now);
+      }
+    }
+    changed = true;
+  }
+  if (changed) {
+    publishLocked();
+  }
+}
+
+void ShareCatalog::publishLocked() {
+  auto res = make_shared<Snapshot>();
+  for (auto& item : items) {
+    if (!metas[item->filepath].exists) {
+      continue;
+    }
+    res->byId.emplace(item->fileid, res->files.size());
+    if (item->packetn != 0) {  // 尚未通告过
+      res->byPacket.emplace(packetKey(item->packetn, item->filenum),
+                            res->files.size());
+    }
+    res->files.push_back(item);
+  }
+  atomic_store(&snapshot, shared_ptr<const Snapshot>(res));
+}
+
+void ShareCatalog::wakeLocked() {
+  if (wakeFds[1] != -1) {
+    char c = 0;
+    (void)!write(wakeFds[1], &c, 1);
+  }
+}
+
+void ShareCatalog::run() {
+  int64_t nextRescan = nowMs() + rescanIntervalMs;
+  int64_t nextDeepRescan = nowMs() + kDeepRescanMs;
+  while (running) {
+    /* 新加入的目录还没有大小 */
+    vector<string> unsized;
+    {
+      lock_guard<std::mutex> l(mutex);
+      if (watchesDirty) {
+        updateWatchesLocked();
+      }
+      for (auto& it : metas) {
+        if (it.second.exists && it.second.filesize < 0) {
+          unsized.push_back(it.first);
+        }
+      }
+    }
+    if (!unsized.empty()) {
+      refreshPaths(unsized, true);
+    }
+
+    struct pollfd fds[2] = {{wakeFds[0], POLLIN, 0}, {inotifyFd, POLLIN, 0}};
+    int timeout = int(max<int64_t>(nextRescan - nowMs(), 0));
+    if (poll(fds, inotifyFd == -1 ? 1 : 2, timeout) > 0) {
+      char buf[64];
+      while (read(wakeFds[0], buf, sizeof(buf)) > 0) {
+      }
+      if (fds[1].revents & POLLIN) {
+        poll(fds, 1, kSettleMs);
+        vector<string> paths = readEvents();
+        for (auto& path : paths) {
+          DirSizeService::Instance().Invalidate(path, false);
+        }
+        refreshPaths(paths, true);
+      }
+    }
+    if (running && nowMs() >= nextRescan) {
+      /* 有inotify时按目录修改时间检查下层的改动即可, 原地改写的文件
+       * 留给间隔很长的完整统计 */
+      bool deep = inotifyFd == -1 || nowMs() >= nextDeepRescan;
+      rescan(deep);
+      if (deep) {
+        nextDeepRescan = nowMs() + kDeepRescanMs;
+      }
+      nextRescan = nowMs() + rescanIntervalMs;
+    }
+  }
+}
+
+/**
+ * 取出inotify事件, 返回有改动的共享路径.
+ */
+vector<string> ShareCatalog::readEvents() {
+  set<string> paths;
+#if HAVE_INOTIFY
+  alignas(struct inotify_event) char buf[4096];
+  ssize_t len;
+  while ((len = read(inotifyFd, buf, sizeof(buf))) > 0) {
+    lock_guard<std::mutex> l(mutex);
+    for (char* ptr = buf; ptr < buf + len;) {
+      auto event = reinterpret_cast<struct inotify_event*>(ptr);
+      auto it = watches.find(event->wd);
+      if (it != watches.end()) {
+        paths.insert(it->second);
+        if (event->mask & IN_IGNORED) {
+          watches.erase(it);
+          watchesDirty = true;
+        }
+      }
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+#endif
+  return vector<string>(paths.begin(), paths.end());
+}
+
+void ShareCatalog::updateWatchesLocked() {
+  watchesDirty = false;
+#if HAVE_INOTIFY
+  if (inotifyFd == -1) {
+    return;
+  }
+  for (auto& it : watches) {
+    inotify_rm_watch(inotifyFd, it.first);
+  }
+  watches.clear();
+  for (auto& it : metas) {
+    if (!it.second.exists) {
+      continue;
+    }
+    uint32_t mask = IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF |
+                    IN_MOVE_SELF;
+    if (it.second.fileattr == FileAttr::DIRECTORY) {
+      mask |= IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+    }
+    int wd = inotify_add_watch(inotifyFd, it.first.c_str(), mask);
+    if (wd == -1) {
+      LOG_INFO("watch %s failed: %s", it.first.c_str(), strerror(errno));
+      continue;
+    }
+    watches[wd] = it.first;
+  }
+#endif
+}
+
+}  // namespace iptux
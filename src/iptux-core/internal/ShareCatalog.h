@@ -0,0 +1,115 @@
+#ifndef IPTUX_SHARE_CATALOG_H
+#define IPTUX_SHARE_CATALOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "iptux-core/Models.h"
+
+namespace iptux {
+
+/**
+ * @brief the shared files, indexed by fileid and by (packetn, filenum),
+ * with their size and times cached.
+ *
+ * Readers take an immutable snapshot without locking. Writers build a new
+ * snapshot and publish it. While Start()ed, a background thread refreshes
+ * the cached metadata: right after a shared path changes when inotify is
+ * available, and by a rescan every rescanIntervalMs, since changes deep
+ * inside shared directories are not watched. With inotify the rescan only
+ * rereads the directories whose mtime changed, and drops the cached
+ * directory sizes every few hours to catch files rewritten in place;
+ * without it every rescan recounts everything.
+ */
+class ShareCatalog {
+ public:
+  struct Snapshot {
+    /* 存在的共享文件, 大小与时间已填好; 目录大小未算出时filesize为-1 */
+    std::vector<std::shared_ptr<const FileInfo>> files;
+    std::unordered_map<uint32_t, size_t> byId;
+    std::unordered_map<uint64_t, size_t> byPacket;
+
+    std::shared_ptr<const FileInfo> FindById(uint32_t fileId) const;
+    std::shared_ptr<const FileInfo> FindByPacket(uint32_t packetn,
+                                                 uint32_t filenum) const;
+  };
+
+  explicit ShareCatalog(int rescanIntervalMs);
+  ~ShareCatalog();
+
+  ShareCatalog(const ShareCatalog&) = delete;
+  ShareCatalog& operator=(const ShareCatalog&) = delete;
+
+  /**
+   * @brief replace the shared files.
+   *
+   * Metadata of paths already in the catalog is kept, new paths are
+   * stat()ed here and their directory sizes are left to the refresher.
+   */
+  void Reset(const std::vector<FileInfo>& files);
+  void Add(const FileInfo& file);
+  void Clear();
+  std::shared_ptr<const Snapshot> Get() const;
+  /**
+   * @brief record the packet numbers the files were last announced with
+   *
+   * @param packets (fileid, packetn) pairs
+   */
+  void SetPacketNumbers(
+      const std::vector<std::pair<uint32_t, uint32_t>>& packets);
+
+  /**
+   * @brief re-stat every file and recompute directory sizes, synchronously
+   */
+  void Refresh();
+
+  void Start();
+  void Stop();
+
+ private:
+  struct Meta {
+    bool exists{false};
+    FileAttr fileattr{FileAttr::UNKNOWN};
+    int64_t filesize{-1};
+    uint32_t filectime{0};
+    uint32_t filemtime{0};
+  };
+
+  static Meta statFile(const std::string& path, const Meta* old, bool deep);
+  static std::shared_ptr<const FileInfo> merge(const FileInfo& file,
+                                               const Meta& meta);
+  void rescan(bool recursive);
+  void refreshPaths(const std::vector<std::string>& paths, bool deep);
+  void publishLocked();
+  void wakeLocked();
+  void run();
+  std::vector<std::string> readEvents();
+  void updateWatchesLocked();
+
+  const int rescanIntervalMs;
+
+  mutable std::mutex mutex;
+  // 共享的文件, 按加入顺序, 已合并元数据
+  std::vector<std::shared_ptr<const FileInfo>> items;
+  std::map<std::string, Meta> metas;  // 路径 -> 缓存的元数据
+  std::shared_ptr<const Snapshot> snapshot;
+
+  std::thread refresher;
+  std::atomic_bool running{false};
+  int wakeFds[2]{-1, -1};  // 唤醒refresher的管道
+  int inotifyFd{-1};
+  std::unordered_map<int, std::string> watches;  // inotify wd -> 路径
+  bool watchesDirty{false};
+};
+
+}  // namespace iptux
+
+#endif
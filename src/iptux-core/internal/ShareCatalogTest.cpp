@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <thread>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "iptux-core/internal/ShareCatalog.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+// base/{a, dir/b}
+string makeTree() {
+  gchar* tmp = g_dir_make_tmp("iptux-share-XXXXXX", nullptr);
+  string base(tmp);
+  g_free(tmp);
+  g_mkdir(string(base + "/dir").c_str(), 0755);
+  g_file_set_contents(string(base + "/a").c_str(), "hello", -1, nullptr);
+  g_file_set_contents(string(base + "/dir/b").c_str(), "world!", -1, nullptr);
+  return base;
+}
+
+void removeTree(const string& base) {
+  g_remove(string(base + "/dir/b").c_str());
+  g_remove(string(base + "/dir/c").c_str());
+  g_rmdir(string(base + "/dir").c_str());
+  g_remove(string(base + "/a").c_str());
+  g_rmdir(base.c_str());
+}
+
+FileInfo makeFile(uint32_t fileid, const string& path) {
+  FileInfo file;
+  file.fileid = fileid;
+  file.filepath = g_strdup(path.c_str());
+  return file;
+}
+
+template <typename F>
+bool waitFor(F f) {
+  using namespace std::chrono_literals;
+  for (int i = 0; i < 300 && !f(); ++i) {
+    this_thread::sleep_for(10ms);
+  }
+  return f();
+}
+}  // namespace
+
+TEST(ShareCatalog, Lookup) {
+  string base = makeTree();
+  ShareCatalog catalog(60000);
+  catalog.Reset({makeFile(1, base + "/a"), makeFile(2, base + "/dir"),
+                 makeFile(3, base + "/missing")});
+
+  auto snapshot = catalog.Get();
+  ASSERT_EQ(snapshot->files.size(), 2u);
+  auto a = snapshot->FindById(1);
+  ASSERT_TRUE(a);
+  EXPECT_EQ(a->fileattr, FileAttr::REGULAR);
+  EXPECT_EQ(a->filesize, 5);
+  EXPECT_GT(a->filemtime, 0u);
+  auto dir = snapshot->FindById(2);
+  ASSERT_TRUE(dir);
+  EXPECT_EQ(dir->fileattr, FileAttr::DIRECTORY);
+  EXPECT_EQ(dir->filesize, -1);
+  EXPECT_FALSE(snapshot->FindById(3));
+  EXPECT_FALSE(snapshot->FindByPacket(0, 0));
+
+  catalog.Refresh();
+  EXPECT_EQ(catalog.Get()->FindById(2)->filesize, 6);
+  // 旧快照不受影响
+  EXPECT_EQ(snapshot->FindById(2)->filesize, -1);
+
+  catalog.SetPacketNumbers({{1, 100}, {2, 101}});
+  EXPECT_EQ(catalog.Get()->FindByPacket(101, 0)->fileid, 2u);
+  EXPECT_FALSE(catalog.Get()->FindByPacket(102, 0));
+
+  catalog.Add(makeFile(4, base + "/a"));
+  EXPECT_EQ(catalog.Get()->FindById(4)->filesize, 5);
+  catalog.Clear();
+  EXPECT_TRUE(catalog.Get()->files.empty());
+  removeTree(base);
+}
+
+TEST(ShareCatalog, BackgroundRefresh) {
+  string base = makeTree();
+  ShareCatalog catalog(HAVE_INOTIFY ? 60000 : 100);
+  catalog.Reset({makeFile(1, base + "/a"), makeFile(2, base + "/dir")});
+  catalog.Start();
+
+  auto sizeOf = [&catalog](uint32_t fileid) {
+    auto file = catalog.Get()->FindById(fileid);
+    return file ? file->filesize : -2;
+  };
+  // 新目录的大小由后台线程统计
+  EXPECT_TRUE(waitFor([&] { return sizeOf(2) == 6; }));
+
+  g_file_set_contents(string(base + "/a").c_str(), "hello world", -1, nullptr);
+  EXPECT_TRUE(waitFor([&] { return sizeOf(1) == 11; }));
+  g_file_set_contents(string(base + "/dir/c").c_str(), "abc", -1, nullptr);
+  EXPECT_TRUE(waitFor([&] { return sizeOf(2) == 9; }));
+
+  g_remove(string(base + "/a").c_str());
+  EXPECT_TRUE(waitFor([&] { return !catalog.Get()->FindById(1); }));
+  catalog.Stop();
+  removeTree(base);
+}
@@ -17,6 +17,7 @@
 #include <unistd.h>
 
 #include "iptux-core/internal/CommandMode.h"
+#include "iptux-core/internal/PacketView.h"
 #include "iptux-core/internal/SendFile.h"
 #include "iptux-utils/output.h"
 #include "iptux-utils/utils.h"
@@ -85,20 +86,23 @@ void TcpData::DispatchTcpData() {
 
   /* 分派消息 */
   size = len;  // 设置缓冲区数据的有效长度
-  commandno = iptux_get_dec_number(buf, ':', 4);  // 获取命令字
+  commandno = PacketView(buf, size).commandno;  // 获取命令字
   LOG_INFO("recv TCP request from %s, command NO.: [0x%x] %s", addrStr,
            commandno, CommandMode(GET_MODE(commandno)).toString().c_str());
   g_free(addrStr);
   switch (GET_MODE(commandno)) {
     case IPMSG_GETFILEDATA:
-      RequestData(FileAttr::REGULAR);
+      RequestData(FileAttr::REGULAR, GET_OPT(commandno));
       break;
     case IPMSG_GETDIRFILES:
-      RequestData(FileAttr::DIRECTORY);
+      RequestData(FileAttr::DIRECTORY, GET_OPT(commandno));
       break;
     case IPTUX_SENDSUBLAYER:
       RecvSublayer(GET_OPT(commandno));
       break;
+    case IPTUX_ASKMANIFEST:
+      SendManifest();
+      break;
     default:
       break;
   }
@@ -107,8 +111,9 @@ void TcpData::DispatchTcpData() {
 /**
  * 请求文件(目录)数据.
  * @param fileattr 文件类型
+ * @param cmdopt 命令字选项
  */
-void TcpData::RequestData(FileAttr fileattr) {
+void TcpData::RequestData(FileAttr fileattr, uint32_t cmdopt) {
   const char* attachptr;
   char* attach;
 
@@ -127,7 +132,8 @@ void TcpData::RequestData(FileAttr fileattr) {
   }
 
   attach = ipmsg_get_attach(buf, ':', 5);
-  SendFile::RequestDataEntry(coreThread, sock, fileattr, attach);
+  SendFile::RequestDataEntry(coreThread, sock, fileattr, attach,
+                             cmdopt & IPTUX_COMPRESSOPT);
   g_free(attach);
 }
 
@@ -139,27 +145,11 @@ void TcpData::RecvSublayer(uint32_t cmdopt) {
   static uint32_t count = 0;
   char path[MAX_PATHLEN];
   PPalInfo pal;
+  in_addr ipv4;
   int fd;
 
   /* 检查好友是否存在 */
-  GError* error = nullptr;
-  GSocketAddress* remoteAddr = g_socket_get_remote_address(socket, &error);
-  if (!remoteAddr) {
-    LOG_WARN("Failed to get remote address: %s",
-             error ? error->message : "unknown");
-    if (error)
-      g_error_free(error);
-    return;
-  }
-
-  GInetSocketAddress* inetAddr = G_INET_SOCKET_ADDRESS(remoteAddr);
-  GInetAddress* gaddr = g_inet_socket_address_get_address(inetAddr);
-  char* addrStr = g_inet_address_to_string(gaddr);
-  in_addr ipv4 = inAddrFromString(addrStr);
-  g_free(addrStr);
-  g_object_unref(remoteAddr);
-
-  if (!(pal = coreThread->GetPal(ipv4))) {
+  if (!GetPeerIpv4(&ipv4) || !(pal = coreThread->GetPal(ipv4))) {
     return;
   }
 
@@ -206,6 +196,52 @@ void TcpData::RecvSublayer(uint32_t cmdopt) {
   }
 }
 
+/**
+ * 发送一个UDP包放不下的文件信息, 发完即关闭连接.
+ */
+void TcpData::SendManifest() {
+  in_addr ipv4;
+  if (!GetPeerIpv4(&ipv4)) {
+    return;
+  }
+
+  char* attach = ipmsg_get_attach(buf, ':', 5);
+  uint32_t packetno = attach ? iptux_get_hex_number(attach, ':', 0) : 0;
+  g_free(attach);
+  string manifest = coreThread->GetFileManifest(ipv4, packetno);
+  if (manifest.empty()) {
+    LOG_INFO("no manifest of packet %" PRIu32 " for %s", packetno,
+             inAddrToString(ipv4).c_str());
+    return;
+  }
+  xwrite(sock, manifest.data(), manifest.size());
+}
+
+/**
+ * 获取连接对方的地址.
+ * @param ipv4 对方的ipv4地址
+ * @return 是否成功
+ */
+bool TcpData::GetPeerIpv4(in_addr* ipv4) {
+  GError* error = nullptr;
+  GSocketAddress* remoteAddr = g_socket_get_remote_address(socket, &error);
+  if (!remoteAddr) {
+    LOG_WARN("Failed to get remote address: %s",
+             error ? error->message : "unknown");
+    if (error)
+      g_error_free(error);
+    return false;
+  }
+
+  GInetSocketAddress* inetAddr = G_INET_SOCKET_ADDRESS(remoteAddr);
+  GInetAddress* gaddr = g_inet_socket_address_get_address(inetAddr);
+  char* addrStr = g_inet_address_to_string(gaddr);
+  *ipv4 = inAddrFromString(addrStr);
+  g_free(addrStr);
+  g_object_unref(remoteAddr);
+  return true;
+}
+
 /**
  * 接收数据.
  * @param fd file descriptor
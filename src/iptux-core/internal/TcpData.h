@@ -30,8 +30,10 @@ class TcpData {
  private:
   void DispatchTcpData();
 
-  void RequestData(FileAttr fileattr);
+  void RequestData(FileAttr fileattr, uint32_t cmdopt);
   void RecvSublayer(uint32_t cmdopt);
+  void SendManifest();
+  bool GetPeerIpv4(in_addr* ipv4);
 
   void RecvSublayerData(int fd, size_t len);
   void RecvPhotoPic(PalInfo* pal, const char* path);
@@ -0,0 +1,136 @@
+#include "config.h"
+#include "TcpWorkerPool.h"
+
+#include <algorithm>
+
+#include "iptux-utils/output.h"
+
+using namespace std;
+
+namespace iptux {
+
+TcpWorkerPool::TcpWorkerPool(size_t workerCount,
+                             size_t maxQueued,
+                             size_t maxPerPeer,
+                             Handler handler)
+    : maxQueued(max<size_t>(maxQueued, 1)),
+      maxPerPeer(maxPerPeer),
+      handler(std::move(handler)) {
+  workerCount = max<size_t>(workerCount, 1);
+  workers.reserve(workerCount);
+  for (size_t i = 0; i < workerCount; ++i) {
+    workers.emplace_back(&TcpWorkerPool::workerLoop, this);
+  }
+}
+
+TcpWorkerPool::~TcpWorkerPool() {
+  stop();
+}
+
+bool TcpWorkerPool::submit(GSocket* clientSocket, uint32_t peer) {
+  {
+    lock_guard<std::mutex> l(mutex);
+    const char* reason = nullptr;
+    if (stopping) {
+      reason = "pool stopped";
+    } else if (queue.size() >= maxQueued) {
+      reason = "accept queue full";
+    } else if (maxPerPeer > 0 && peer != 0 &&
+               peerConnections[peer] >= maxPerPeer) {
+      reason = "too many connections from peer";
+    }
+    if (!reason) {
+      if (peer != 0) {
+        peerConnections[peer]++;
+      }
+      queue.push_back(Job{clientSocket, peer});
+      cond.notify_one();
+      return true;
+    }
+    rejected++;
+    LOG_WARN("reject tcp connection: %s (queued=%zu, active=%zu)", reason,
+             queue.size(), active);
+  }
+  g_object_unref(clientSocket);
+  return false;
+}
+
+void TcpWorkerPool::stop() {
+  deque<Job> dropped;
+  {
+    lock_guard<std::mutex> l(mutex);
+    if (stopping && workers.empty()) {
+      return;
+    }
+    stopping = true;
+    dropped.swap(queue);
+    for (auto& job : dropped) {
+      if (job.peer != 0 && --peerConnections[job.peer] == 0) {
+        peerConnections.erase(job.peer);
+      }
+    }
+  }
+  cond.notify_all();
+  for (auto& job : dropped) {
+    g_object_unref(job.socket);
+  }
+  for (auto& worker : workers) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers.clear();
+}
+
+size_t TcpWorkerPool::activeCount() const {
+  lock_guard<std::mutex> l(mutex);
+  return active;
+}
+
+size_t TcpWorkerPool::queuedCount() const {
+  lock_guard<std::mutex> l(mutex);
+  return queue.size();
+}
+
+uint64_t TcpWorkerPool::rejectedCount() const {
+  lock_guard<std::mutex> l(mutex);
+  return rejected;
+}
+
+void TcpWorkerPool::releasePeer(uint32_t peer) {
+  if (peer == 0) {
+    return;
+  }
+  auto it = peerConnections.find(peer);
+  if (it != peerConnections.end() && --it->second == 0) {
+    peerConnections.erase(it);
+  }
+}
+
+void TcpWorkerPool::workerLoop() {
+  unique_lock<std::mutex> l(mutex);
+  while (true) {
+    cond.wait(l, [this] { return stopping || !queue.empty(); });
+    if (queue.empty()) {
+      return;
+    }
+    Job job = queue.front();
+    queue.pop_front();
+    active++;
+    l.unlock();
+
+    try {
+      handler(job.socket);
+    } catch (const std::exception& e) {
+      LOG_ERROR("Exception in TCP handler: %s", e.what());
+    } catch (...) {
+      LOG_ERROR("Unknown exception in TCP handler");
+    }
+
+    l.lock();
+    active--;
+    releasePeer(job.peer);
+  }
+}
+
+}  // namespace iptux
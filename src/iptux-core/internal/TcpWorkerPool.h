@@ -0,0 +1,83 @@
+#ifndef IPTUX_TCP_WORKER_POOL_H
+#define IPTUX_TCP_WORKER_POOL_H
+
+#include <gio/gio.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace iptux {
+
+/**
+ * @brief fixed-size pool of workers serving accepted TCP connections.
+ *
+ * Connections are queued (bounded by maxQueued) and handed to one of
+ * workerCount reusable threads; a peer may hold at most maxPerPeer
+ * connections (queued + running) at the same time.
+ */
+class TcpWorkerPool {
+ public:
+  using Handler = std::function<void(GSocket* clientSocket)>;
+
+  TcpWorkerPool(size_t workerCount,
+                size_t maxQueued,
+                size_t maxPerPeer,
+                Handler handler);
+  ~TcpWorkerPool();
+
+  TcpWorkerPool(const TcpWorkerPool&) = delete;
+  TcpWorkerPool& operator=(const TcpWorkerPool&) = delete;
+
+  /**
+   * @brief queue a connection, the pool takes ownership of clientSocket.
+   *
+   * @param clientSocket accepted socket
+   * @param peer peer ipv4 address (network byte order), 0 if unknown
+   * @return false if rejected (pool stopped, queue full or per-peer cap
+   * reached), the socket has been closed in that case
+   */
+  bool submit(GSocket* clientSocket, uint32_t peer);
+
+  /**
+   * @brief reject new connections, drop the queued ones and wait for the
+   * running handlers to finish.
+   */
+  void stop();
+
+  size_t workerCount() const { return workers.size(); }
+  size_t activeCount() const;
+  size_t queuedCount() const;
+  uint64_t rejectedCount() const;
+
+ private:
+  struct Job {
+    GSocket* socket;
+    uint32_t peer;
+  };
+
+  void workerLoop();
+  void releasePeer(uint32_t peer);
+
+  const size_t maxQueued;
+  const size_t maxPerPeer;
+  Handler handler;
+
+  mutable std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<Job> queue;
+  std::map<uint32_t, size_t> peerConnections;
+  std::vector<std::thread> workers;
+  size_t active{0};
+  uint64_t rejected{0};
+  bool stopping{false};
+};
+
+}  // namespace iptux
+
+#endif
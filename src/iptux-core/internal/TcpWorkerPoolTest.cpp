@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "iptux-core/internal/TcpWorkerPool.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+GSocket* newSocket() {
+  GError* error = nullptr;
+  GSocket* sock = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+                               G_SOCKET_PROTOCOL_UDP, &error);
+  EXPECT_EQ(error, nullptr);
+  return sock;
+}
+
+// Blocks handlers until release() is called
+struct Gate {
+  mutex m;
+  condition_variable cv;
+  bool open{false};
+
+  void wait() {
+    unique_lock<mutex> l(m);
+    cv.wait(l, [this] { return open; });
+  }
+  void release() {
+    lock_guard<mutex> l(m);
+    open = true;
+    cv.notify_all();
+  }
+};
+
+void waitUntil(function<bool()> cond) {
+  for (int i = 0; i < 200 && !cond(); ++i) {
+    this_thread::sleep_for(chrono::milliseconds(5));
+  }
+}
+}  // namespace
+
+TEST(TcpWorkerPool, RunsHandlers) {
+  atomic<int> handled{0};
+  TcpWorkerPool pool(2, 8, 0, [&](GSocket* sock) {
+    handled++;
+    g_object_unref(sock);
+  });
+  EXPECT_EQ(pool.workerCount(), 2u);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(pool.submit(newSocket(), 0x0100007f));
+  }
+  waitUntil([&] { return handled == 5; });
+  EXPECT_EQ(handled, 5);
+  pool.stop();
+  EXPECT_EQ(pool.activeCount(), 0u);
+  EXPECT_EQ(pool.rejectedCount(), 0u);
+}
+
+TEST(TcpWorkerPool, QueueAndPeerLimits) {
+  Gate gate;
+  TcpWorkerPool pool(1, 2, 2, [&](GSocket* sock) {
+    gate.wait();
+    g_object_unref(sock);
+  });
+
+  // one running, one queued for peer A
+  EXPECT_TRUE(pool.submit(newSocket(), 1));
+  waitUntil([&] { return pool.activeCount() == 1; });
+  EXPECT_TRUE(pool.submit(newSocket(), 1));
+  EXPECT_EQ(pool.queuedCount(), 1u);
+
+  // peer A reached its cap
+  EXPECT_FALSE(pool.submit(newSocket(), 1));
+
+  // peer B fills the queue, then the queue is full for everyone
+  EXPECT_TRUE(pool.submit(newSocket(), 2));
+  EXPECT_FALSE(pool.submit(newSocket(), 3));
+  EXPECT_EQ(pool.queuedCount(), 2u);
+  EXPECT_EQ(pool.rejectedCount(), 2u);
+
+  gate.release();
+  waitUntil([&] { return pool.queuedCount() == 0 && pool.activeCount() == 0; });
+  EXPECT_EQ(pool.activeCount(), 0u);
+
+  // slots are released once handled
+  EXPECT_TRUE(pool.submit(newSocket(), 1));
+  pool.stop();
+}
+
+TEST(TcpWorkerPool, StopDropsQueued) {
+  Gate gate;
+  atomic<int> handled{0};
+  TcpWorkerPool pool(1, 8, 0, [&](GSocket* sock) {
+    gate.wait();
+    handled++;
+    g_object_unref(sock);
+  });
+  EXPECT_TRUE(pool.submit(newSocket(), 0));
+  waitUntil([&] { return pool.activeCount() == 1; });
+  EXPECT_TRUE(pool.submit(newSocket(), 0));
+  EXPECT_TRUE(pool.submit(newSocket(), 0));
+
+  thread stopper([&] { pool.stop(); });
+  waitUntil([&] { return pool.queuedCount() == 0; });
+  gate.release();
+  stopper.join();
+
+  EXPECT_EQ(handled, 1);
+  EXPECT_FALSE(pool.submit(newSocket(), 0));
+}
@@ -0,0 +1,356 @@
+#include "config.h"
+#include "TransScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "iptux-utils/output.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+int64_t nowUs() {
+  return chrono::duration_cast<chrono::microseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
+
+TransScheduler::TransScheduler(const Options& options) : options(options) {}
+
+TransScheduler::~TransScheduler() {
+  Stop();
+}
+
+void TransScheduler::SetOptions(const Options& options) {
+  lock_guard<std::mutex> l(mutex);
+  this->options = options;
+  dispatchLocked();
+}
+
+TransScheduler::Options TransScheduler::GetOptions() const {
+  lock_guard<std::mutex> l(mutex);
+  return options;
+}
+
+bool TransScheduler::Submit(int taskId,
+                            Direction direction,
+                            uint32_t peer,
+                            Job job,
+                            int priority,
+                            size_t slots) {
+  if (!job) {
+    return false;
+  }
+  lock_guard<std::mutex> l(mutex);
+  if (!enqueueLocked(taskId, direction, peer, std::move(job), priority,
+                     slots)) {
+    return false;
+  }
+  dispatchLocked();
+  return true;
+}
+
+bool TransScheduler::Run(int taskId,
+                         Direction direction,
+                         uint32_t peer,
+                         Job job,
+                         int priority,
+                         size_t slots) {
+  unique_lock<std::mutex> l(mutex);
+  if (!enqueueLocked(taskId, direction, peer, nullptr, priority, slots)) {
+    return false;
+  }
+  dispatchLocked();
+  cond.wait(l, [this, taskId] {
+    auto it = tasks.find(taskId);
+    return it == tasks.end() || it->second.running;
+  });
+  if (tasks.find(taskId) == tasks.end()) {
+    return false;  // 排队时被Stop()丢弃
+  }
+  l.unlock();
+  job();
+  finish(taskId);
+  return true;
+}
+
+bool TransScheduler::TryRun(int taskId,
+                            Direction direction,
+                            uint32_t peer,
+                            Job job) {
+  {
+    lock_guard<std::mutex> l(mutex);
+    if (!enqueueLocked(taskId, direction, peer, nullptr, 0, 1)) {
+      return false;
+    }
+    dispatchLocked();
+    auto it = tasks.find(taskId);
+    if (!it->second.running) {
+      tasks.erase(it);
+      return false;
+    }
+  }
+  job();
+  finish(taskId);
+  return true;
+}
+
+bool TransScheduler::Throttle(int taskId, int64_t bytes) {
+  unique_lock<std::mutex> l(mutex);
+  auto it = tasks.find(taskId);
+  if (it == tasks.end()) {
+    return true;
+  }
+  Task& task = it->second;
+  int64_t waitUs = 0;
+  if (bytes > 0) {
+    bool upload = task.direction == Direction::UPLOAD;
+    waitUs = chargeLocked(buckets[int(task.direction)],
+                          upload ? options.uploadRate : options.downloadRate,
+                          bytes);
+    if (options.peerRate > 0) {
+      waitUs = max(waitUs,
+                   chargeLocked(peerBuckets[peerKey(task.direction, task.peer)],
+                                options.peerRate, bytes));
+    }
+  }
+  auto deadline = chrono::steady_clock::now() + chrono::microseconds(waitUs);
+  while (true) {
+    if (task.cancelled || stopping) {
+      return false;
+    }
+    if (task.paused) {
+      cond.wait(l);
+    } else if (cond.wait_until(l, deadline) == cv_status::timeout) {
+      return !(task.cancelled || stopping);
+    }
+  }
+}
+
+bool TransScheduler::Pause(int taskId) {
+  lock_guard<std::mutex> l(mutex);
+  auto it = tasks.find(taskId);
+  if (it == tasks.end() || it->second.cancelled) {
+    return false;
+  }
+  it->second.paused = true;
+  LOG_INFO("pause trans task %d", taskId);
+  return true;
+}
+
+bool TransScheduler::Resume(int taskId) {
+  lock_guard<std::mutex> l(mutex);
+  auto it = tasks.find(taskId);
+  if (it == tasks.end() || !it->second.paused) {
+    return false;
+  }
+  it->second.paused = false;
+  LOG_INFO("continue trans task %d", taskId);
+  dispatchLocked();
+  return true;
+}
+
+bool TransScheduler::SetPriority(int taskId, int priority) {
+  lock_guard<std::mutex> l(mutex);
+  auto it = tasks.find(taskId);
+  if (it == tasks.end() || it->second.running) {
+    return false;
+  }
+  it->second.priority = priority;
+  dispatchLocked();
+  return true;
+}
+
+bool TransScheduler::Cancel(int taskId) {
+  lock_guard<std::mutex> l(mutex);
+  auto it = tasks.find(taskId);
+  if (it == tasks.end()) {
+    return false;
+  }
+  it->second.cancelled = true;
+  it->second.paused = false;
+  dispatchLocked();
+  return true;
+}
+
+TransScheduler::State TransScheduler::GetState(int taskId) const {
+  lock_guard<std::mutex> l(mutex);
+  auto it = tasks.find(taskId);
+  if (it == tasks.end()) {
+    return State::NONE;
+  }
+  if (it->second.paused) {
+    return State::PAUSED;
+  }
+  return it->second.running ? State::RUNNING : State::QUEUED;
+}
+
+size_t TransScheduler::GetSlots(int taskId) const {
+  lock_guard<std::mutex> l(mutex);
+  auto it = tasks.find(taskId);
+  return it == tasks.end() || !it->second.running ? 0 : it->second.slots;
+}
+
+size_t TransScheduler::QueuedCount() const {
+  lock_guard<std::mutex> l(mutex);
+  return count_if(tasks.begin(), tasks.end(),
+                  [](const pair<const int, Task>& it) {
+                    return !it.second.running;
+                  });
+}
+
+size_t TransScheduler::RunningCount(Direction direction) const {
+  lock_guard<std::mutex> l(mutex);
+  return running[int(direction)];
+}
+
+void TransScheduler::Stop() {
+  lock_guard<std::mutex> l(mutex);
+  stopping = true;
+  for (auto it = tasks.begin(); it != tasks.end();) {
+    if (it->second.running) {
+      ++it;
+    } else {
+      it = tasks.erase(it);
+    }
+  }
+  cond.notify_all();
+}
+
+bool TransScheduler::enqueueLocked(int taskId,
+                                   Direction direction,
+                                   uint32_t peer,
+                                   Job job,
+                                   int priority,
+                                   size_t slots) {
+  if (stopping || tasks.count(taskId)) {
+    return false;
+  }
+  Task task{direction, peer, priority, max<size_t>(slots, 1), ++lastSeq,
+            std::move(job)};
+  tasks.emplace(taskId, std::move(task));
+  return true;
+}
+
+/**
+ * 任务运行时占用的名额, 不超过限制, 以免永远无法运行.
+ */
+size_t TransScheduler::slotsLocked(const Task& task) const {
+  size_t slots = task.slots;
+  size_t limit = task.direction == Direction::UPLOAD ? options.maxUploads
+                                                     : options.maxDownloads;
+  if (limit > 0) {
+    slots = min(slots, limit);
+  }
+  if (options.maxPerPeer > 0) {
+    slots = min(slots, options.maxPerPeer);
+  }
+  return slots;
+}
+
+bool TransScheduler::admissibleLocked(const Task& task) const {
+  if (task.cancelled) {
+    return true;
+  }
+  if (task.paused) {
+    return false;
+  }
+  size_t slots = slotsLocked(task);
+  size_t limit = task.direction == Direction::UPLOAD ? options.maxUploads
+                                                     : options.maxDownloads;
+  if (limit > 0 && running[int(task.direction)] + slots > limit) {
+    return false;
+  }
+  auto it = peerRunning.find(peerKey(task.direction, task.peer));
+  return options.maxPerPeer == 0 || it == peerRunning.end() ||
+         it->second + slots <= options.maxPerPeer;
+}
+
+/**
+ * 按优先级启动可以运行的任务, 直到没有空位.
+ * 某个好友的任务已满时不妨碍其他好友的任务.
+ */
+void TransScheduler::dispatchLocked() {
+  while (!stopping) {
+    int taskId = 0;
+    Task* best = nullptr;
+    for (auto& it : tasks) {
+      Task& task = it.second;
+      if (task.running || !admissibleLocked(task)) {
+        continue;
+      }
+      if (!best || task.priority > best->priority ||
+          (task.priority == best->priority && task.seq < best->seq)) {
+        taskId = it.first;
+        best = &task;
+      }
+    }
+    if (!best) {
+      break;
+    }
+    best->running = true;
+    best->slots = slotsLocked(*best);
+    running[int(best->direction)] += best->slots;
+    peerRunning[peerKey(best->direction, best->peer)] += best->slots;
+    if (best->job) {
+      Job job = std::move(best->job);
+      auto self = shared_from_this();
+      thread([self, taskId, job] {
+        job();
+        self->finish(taskId);
+      }).detach();
+    }
+  }
+  cond.notify_all();
+}
+
+void TransScheduler::finish(int taskId) {
+  lock_guard<std::mutex> l(mutex);
+  auto it = tasks.find(taskId);
+  if (it == tasks.end()) {
+    return;
+  }
+  Task& task = it->second;
+  if (task.running) {
+    running[int(task.direction)] -= task.slots;
+    uint64_t key = peerKey(task.direction, task.peer);
+    if ((peerRunning[key] -= task.slots) == 0) {
+      peerRunning.erase(key);
+      peerBuckets.erase(key);
+    }
+  }
+  tasks.erase(it);
+  dispatchLocked();
+}
+
+/**
+ * 从令牌桶中扣除bytes, 桶容量为一秒的量, 允许透支.
+ * @return 还清透支需等待的微秒数
+ */
+int64_t TransScheduler::chargeLocked(Bucket& bucket,
+                                     int64_t rate,
+                                     int64_t bytes) {
+  if (rate <= 0) {
+    return 0;
+  }
+  int64_t now = nowUs();
+  if (bucket.lastUs == 0) {
+    bucket.tokens = double(rate);
+  } else {
+    double refill = double(now - bucket.lastUs) * rate / 1000000;
+    bucket.tokens = min(double(rate), bucket.tokens + refill);
+  }
+  bucket.lastUs = now;
+  bucket.tokens -= double(bytes);
+  return bucket.tokens >= 0 ? 0 : int64_t(-bucket.tokens * 1000000 / rate);
+}
+
+uint64_t TransScheduler::peerKey(Direction direction, uint32_t peer) {
+  return uint64_t(direction) << 32 | peer;
+}
+
+}  // namespace iptux
@@ -0,0 +1,161 @@
+#ifndef IPTUX_TRANS_SCHEDULER_H
+#define IPTUX_TRANS_SCHEDULER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace iptux {
+
+/**
+ * @brief schedules file transfers: how many run at once and how fast.
+ *
+ * Tasks wait in a priority queue (higher priority first, then in order of
+ * arrival) until their direction has a free slot, both in total and for
+ * their peer. A task may take several slots, a download split into
+ * segments takes one per connection; it is granted at most the limits so
+ * it can always run alone. Downloads run on threads started by the
+ * scheduler. Uploads
+ * already own a connection handler thread; they use TryRun() and are turned
+ * away instead of holding that thread while they wait. A running task
+ * reports the data it moved to Throttle(), which sleeps while the token
+ * buckets of its direction or of its peer are in debt, and while the task
+ * is paused.
+ *
+ * Always held by a shared_ptr, download threads keep it alive.
+ */
+class TransScheduler : public std::enable_shared_from_this<TransScheduler> {
+ public:
+  enum class Direction { UPLOAD, DOWNLOAD };
+  enum class State { NONE, QUEUED, RUNNING, PAUSED };
+  /* 数量为0表示不限制, 速率单位为字节/秒, 0表示不限速 */
+  struct Options {
+    size_t maxUploads{0};
+    size_t maxDownloads{0};
+    size_t maxPerPeer{0};  // 每个好友每个方向
+    int64_t uploadRate{0};
+    int64_t downloadRate{0};
+    int64_t peerRate{0};  // 每个好友每个方向
+  };
+  using Job = std::function<void()>;
+
+  explicit TransScheduler(const Options& options);
+  ~TransScheduler();
+
+  TransScheduler(const TransScheduler&) = delete;
+  TransScheduler& operator=(const TransScheduler&) = delete;
+
+  void SetOptions(const Options& options);
+  Options GetOptions() const;
+
+  /**
+   * @brief queue a download, job runs on its own thread once admitted.
+   *
+   * @param peer peer ipv4 address (network byte order)
+   * @param slots number of slots the task wants, see GetSlots()
+   * @return false if the scheduler is stopped or taskId is already known
+   */
+  bool Submit(int taskId,
+              Direction direction,
+              uint32_t peer,
+              Job job,
+              int priority = 0,
+              size_t slots = 1);
+  /**
+   * @brief queue a task and run job on the calling thread once admitted.
+   *
+   * @return false if the scheduler stopped before job could run
+   */
+  bool Run(int taskId,
+           Direction direction,
+           uint32_t peer,
+           Job job,
+           int priority = 0,
+           size_t slots = 1);
+  /**
+   * @brief run job on the calling thread if the task can start right away,
+   * the task is not queued otherwise.
+   *
+   * @return false if job did not run
+   */
+  bool TryRun(int taskId, Direction direction, uint32_t peer, Job job);
+  /**
+   * @brief account bytes moved by a running task, sleep as long as its
+   * rate limits require or it is paused.
+   *
+   * @return false if the task has been cancelled, true for unknown tasks
+   */
+  bool Throttle(int taskId, int64_t bytes);
+
+  bool Pause(int taskId);
+  bool Resume(int taskId);
+  bool SetPriority(int taskId, int priority);
+  /**
+   * @brief wake the task from Throttle(); a queued task is started at once
+   * regardless of the limits, it only has to wind down.
+   */
+  bool Cancel(int taskId);
+  State GetState(int taskId) const;
+  /**
+   * @return the slots granted to a running task, 0 if it is not running
+   */
+  size_t GetSlots(int taskId) const;
+
+  size_t QueuedCount() const;
+  // slots taken by the running tasks
+  size_t RunningCount(Direction direction) const;
+
+  /**
+   * @brief drop the queued tasks and wake the throttled ones, running jobs
+   * are not waited for.
+   */
+  void Stop();
+
+ private:
+  struct Task {
+    Direction direction;
+    uint32_t peer;
+    int priority;
+    size_t slots;
+    uint64_t seq;
+    Job job;  // 为空表示在Run()的调用线程中执行
+    bool running{false};
+    bool paused{false};
+    bool cancelled{false};
+  };
+  struct Bucket {
+    double tokens{0};
+    int64_t lastUs{0};
+  };
+
+  bool enqueueLocked(int taskId,
+                     Direction direction,
+                     uint32_t peer,
+                     Job job,
+                     int priority,
+                     size_t slots);
+  void dispatchLocked();
+  size_t slotsLocked(const Task& task) const;
+  bool admissibleLocked(const Task& task) const;
+  void finish(int taskId);
+  int64_t chargeLocked(Bucket& bucket, int64_t rate, int64_t bytes);
+  static uint64_t peerKey(Direction direction, uint32_t peer);
+
+  Options options;
+  mutable std::mutex mutex;
+  std::condition_variable cond;
+  std::map<int, Task> tasks;
+  uint64_t lastSeq{0};
+  size_t running[2]{0, 0};                 // 按方向, 运行中占用的名额
+  std::map<uint64_t, size_t> peerRunning;  // peerKey() -> 占用的名额
+  Bucket buckets[2];                       // 按方向
+  std::map<uint64_t, Bucket> peerBuckets;  // peerKey() -> 令牌桶
+  bool stopping{false};
+};
+
+}  // namespace iptux
+
+#endif
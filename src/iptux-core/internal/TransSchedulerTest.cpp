@@ -0,0 +1,279 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "iptux-core/internal/TransScheduler.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+using Direction = TransScheduler::Direction;
+using State = TransScheduler::State;
+
+const uint32_t kPeer1 = 0x0100007f;
+const uint32_t kPeer2 = 0x0200007f;
+
+// Blocks jobs until release() is called
+struct Gate {
+  mutex m;
+  condition_variable cv;
+  bool open{false};
+
+  void wait() {
+    unique_lock<mutex> l(m);
+    cv.wait(l, [this] { return open; });
+  }
+  void release() {
+    lock_guard<mutex> l(m);
+    open = true;
+    cv.notify_all();
+  }
+};
+
+void waitUntil(function<bool()> cond) {
+  for (int i = 0; i < 400 && !cond(); ++i) {
+    this_thread::sleep_for(chrono::milliseconds(5));
+  }
+}
+
+shared_ptr<TransScheduler> newScheduler(size_t maxDownloads,
+                                        size_t maxPerPeer) {
+  TransScheduler::Options options;
+  options.maxDownloads = maxDownloads;
+  options.maxPerPeer = maxPerPeer;
+  return make_shared<TransScheduler>(options);
+}
+}  // namespace
+
+TEST(TransScheduler, Limits) {
+  auto scheduler = newScheduler(2, 1);
+  Gate gate;
+  atomic<int> done{0};
+  auto job = [&] {
+    gate.wait();
+    done++;
+  };
+  EXPECT_TRUE(scheduler->Submit(1, Direction::DOWNLOAD, kPeer1, job));
+  EXPECT_TRUE(scheduler->Submit(2, Direction::DOWNLOAD, kPeer1, job));
+  EXPECT_TRUE(scheduler->Submit(3, Direction::DOWNLOAD, kPeer2, job));
+  EXPECT_TRUE(scheduler->Submit(4, Direction::DOWNLOAD, kPeer2, job));
+  EXPECT_FALSE(scheduler->Submit(4, Direction::DOWNLOAD, kPeer2, job));
+
+  // 每个好友一个, 第二个任务不妨碍另一个好友的任务
+  EXPECT_EQ(scheduler->GetState(1), State::RUNNING);
+  EXPECT_EQ(scheduler->GetState(2), State::QUEUED);
+  EXPECT_EQ(scheduler->GetState(3), State::RUNNING);
+  EXPECT_EQ(scheduler->RunningCount(Direction::DOWNLOAD), 2u);
+  EXPECT_EQ(scheduler->RunningCount(Direction::UPLOAD), 0u);
+  EXPECT_EQ(scheduler->QueuedCount(), 2u);
+
+  gate.release();
+  waitUntil([&] { return done == 4; });
+  EXPECT_EQ(done, 4);
+  waitUntil([&] { return scheduler->GetState(4) == State::NONE; });
+  EXPECT_EQ(scheduler->QueuedCount(), 0u);
+}
+
+TEST(TransScheduler, Priority) {
+  auto scheduler = newScheduler(1, 0);
+  Gate gate;
+  mutex m;
+  vector<int> order;
+  auto job = [&](int id) {
+    return [&, id] {
+      gate.wait();
+      lock_guard<mutex> l(m);
+      order.push_back(id);
+    };
+  };
+  scheduler->Submit(1, Direction::DOWNLOAD, kPeer1, job(1));
+  scheduler->Submit(2, Direction::DOWNLOAD, kPeer1, job(2));
+  scheduler->Submit(3, Direction::DOWNLOAD, kPeer1, job(3), 1);
+  scheduler->Submit(4, Direction::DOWNLOAD, kPeer1, job(4));
+  EXPECT_TRUE(scheduler->SetPriority(4, 2));
+  EXPECT_FALSE(scheduler->SetPriority(1, 2));
+
+  gate.release();
+  waitUntil([&] {
+    return scheduler->QueuedCount() == 0 &&
+           scheduler->GetState(2) == State::NONE;
+  });
+  lock_guard<mutex> l(m);
+  EXPECT_EQ(order, vector<int>({1, 4, 3, 2}));
+}
+
+TEST(TransScheduler, PauseResume) {
+  auto scheduler = newScheduler(1, 0);
+  Gate gate;
+  atomic<int> step{0};
+  atomic<bool> throttled{false};
+  scheduler->Submit(1, Direction::DOWNLOAD, kPeer1, [&] {
+    gate.wait();
+    throttled = scheduler->Throttle(1, 100);
+    step = 2;
+  });
+  scheduler->Submit(2, Direction::DOWNLOAD, kPeer1, [&] {});
+  EXPECT_TRUE(scheduler->Pause(2));
+  EXPECT_EQ(scheduler->GetState(2), State::PAUSED);
+
+  gate.release();
+  waitUntil([&] { return step == 2 && scheduler->QueuedCount() == 1; });
+  // 暂停的任务排在队列中不会启动
+  EXPECT_EQ(scheduler->GetState(2), State::PAUSED);
+  EXPECT_TRUE(throttled);
+  EXPECT_TRUE(scheduler->Resume(2));
+  waitUntil([&] { return scheduler->GetState(2) == State::NONE; });
+  EXPECT_EQ(scheduler->GetState(2), State::NONE);
+  EXPECT_FALSE(scheduler->Resume(2));
+
+  // 运行中的任务暂停在Throttle()中
+  Gate gate2;
+  step = 0;
+  scheduler->Submit(3, Direction::DOWNLOAD, kPeer1, [&] {
+    step = 1;
+    gate2.wait();
+    scheduler->Throttle(3, 100);
+    step = 2;
+  });
+  waitUntil([&] { return step == 1; });
+  EXPECT_TRUE(scheduler->Pause(3));
+  gate2.release();
+  this_thread::sleep_for(chrono::milliseconds(50));
+  EXPECT_EQ(scheduler->GetState(3), State::PAUSED);
+  EXPECT_EQ(step, 1);
+  EXPECT_TRUE(scheduler->Resume(3));
+  waitUntil([&] { return step == 2; });
+  EXPECT_EQ(step, 2);
+}
+
+TEST(TransScheduler, RunAndCancel) {
+  auto scheduler = newScheduler(0, 0);
+  TransScheduler::Options options = scheduler->GetOptions();
+  options.maxUploads = 1;
+  scheduler->SetOptions(options);
+
+  Gate gate;
+  atomic<bool> cancelled{false};
+  thread first([&] {
+    scheduler->Run(1, Direction::UPLOAD, kPeer1, [&] {
+      gate.wait();
+      cancelled = !scheduler->Throttle(1, 0);
+    });
+  });
+  waitUntil([&] { return scheduler->GetState(1) == State::RUNNING; });
+
+  atomic<bool> ran{false};
+  thread second([&] {
+    EXPECT_TRUE(
+        scheduler->Run(2, Direction::UPLOAD, kPeer2, [&] { ran = true; }));
+  });
+  waitUntil([&] { return scheduler->GetState(2) == State::QUEUED; });
+  EXPECT_EQ(scheduler->GetState(2), State::QUEUED);
+
+  // 排队的任务被取消时立即启动, 以便收尾
+  EXPECT_TRUE(scheduler->Cancel(2));
+  second.join();
+  EXPECT_TRUE(ran);
+
+  EXPECT_TRUE(scheduler->Cancel(1));
+  gate.release();
+  first.join();
+  EXPECT_TRUE(cancelled);
+  EXPECT_FALSE(scheduler->Cancel(1));
+}
+
+TEST(TransScheduler, TryRun) {
+  auto scheduler = newScheduler(0, 0);
+  TransScheduler::Options options = scheduler->GetOptions();
+  options.maxUploads = 1;
+  scheduler->SetOptions(options);
+
+  Gate gate;
+  thread first([&] {
+    EXPECT_TRUE(scheduler->TryRun(1, Direction::UPLOAD, kPeer1,
+                                  [&] { gate.wait(); }));
+  });
+  waitUntil([&] { return scheduler->GetState(1) == State::RUNNING; });
+
+  // 没有空位时不排队, 直接拒绝
+  bool ran = false;
+  EXPECT_FALSE(
+      scheduler->TryRun(2, Direction::UPLOAD, kPeer2, [&] { ran = true; }));
+  EXPECT_FALSE(ran);
+  EXPECT_EQ(scheduler->GetState(2), State::NONE);
+  EXPECT_EQ(scheduler->QueuedCount(), 0u);
+
+  gate.release();
+  first.join();
+  EXPECT_TRUE(
+      scheduler->TryRun(2, Direction::UPLOAD, kPeer2, [&] { ran = true; }));
+  EXPECT_TRUE(ran);
+}
+
+TEST(TransScheduler, Slots) {
+  auto scheduler = newScheduler(4, 3);
+  Gate gate;
+  auto job = [&] { gate.wait(); };
+  // 分段下载每段占一个名额, 超过限制时按限制计
+  EXPECT_TRUE(scheduler->Submit(1, Direction::DOWNLOAD, kPeer1, job, 0, 8));
+  EXPECT_TRUE(scheduler->Submit(2, Direction::DOWNLOAD, kPeer1, job));
+  EXPECT_TRUE(scheduler->Submit(3, Direction::DOWNLOAD, kPeer2, job, 0, 2));
+  EXPECT_EQ(scheduler->GetState(1), State::RUNNING);
+  EXPECT_EQ(scheduler->GetSlots(1), 3u);
+  EXPECT_EQ(scheduler->GetState(2), State::QUEUED);
+  EXPECT_EQ(scheduler->GetSlots(2), 0u);
+  // 总共只剩一个名额
+  EXPECT_EQ(scheduler->GetState(3), State::QUEUED);
+  EXPECT_EQ(scheduler->RunningCount(Direction::DOWNLOAD), 3u);
+
+  gate.release();
+  waitUntil([&] { return scheduler->QueuedCount() == 0; });
+  waitUntil([&] { return scheduler->RunningCount(Direction::DOWNLOAD) == 0; });
+  EXPECT_EQ(scheduler->RunningCount(Direction::DOWNLOAD), 0u);
+}
+
+TEST(TransScheduler, RateLimit) {
+  auto scheduler = newScheduler(0, 0);
+  TransScheduler::Options options = scheduler->GetOptions();
+  options.downloadRate = 1024 * 1024;
+  scheduler->SetOptions(options);
+
+  int64_t elapsedMs = 0;
+  // 在当前线程中执行, 不依赖等待超时
+  EXPECT_TRUE(scheduler->Run(1, Direction::DOWNLOAD, kPeer1, [&] {
+    auto start = chrono::steady_clock::now();
+    // 第一秒的量不必等待, 之后按速率
+    scheduler->Throttle(1, 1024 * 1024);
+    scheduler->Throttle(1, 256 * 1024);
+    scheduler->Throttle(1, 256 * 1024);
+    elapsedMs = chrono::duration_cast<chrono::milliseconds>(
+                    chrono::steady_clock::now() - start)
+                    .count();
+  }));
+  // 机器繁忙时只会更慢, 所以只检查下限
+  EXPECT_GE(elapsedMs, 400);
+}
+
+TEST(TransScheduler, Stop) {
+  auto scheduler = newScheduler(1, 0);
+  Gate gate;
+  atomic<bool> throttled{true};
+  scheduler->Submit(1, Direction::DOWNLOAD, kPeer1, [&] {
+    gate.wait();
+    throttled = scheduler->Throttle(1, 0);
+  });
+  scheduler->Submit(2, Direction::DOWNLOAD, kPeer1, [&] {});
+  EXPECT_EQ(scheduler->QueuedCount(), 1u);
+  scheduler->Stop();
+  EXPECT_EQ(scheduler->QueuedCount(), 0u);
+  EXPECT_FALSE(scheduler->Submit(3, Direction::DOWNLOAD, kPeer1, [&] {}));
+  gate.release();
+  waitUntil([&] { return !throttled; });
+  EXPECT_FALSE(throttled);
+}
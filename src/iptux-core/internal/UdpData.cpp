@@ -24,6 +24,7 @@
 #include <glib/gi18n.h>
 
 #include "iptux-core/CoreThread.h"
+#include "iptux-core/internal/CharsetConverter.h"
 #include "iptux-core/internal/Command.h"
 #include "iptux-core/internal/CommandMode.h"
 #include "iptux-core/internal/RecvFile.h"
@@ -31,13 +32,17 @@
 #include "iptux-utils/output.h"
 #include "iptux-utils/utils.h"
 
-#define NULL_OBJECT 0x02
-
 using namespace std;
 using namespace std::placeholders;
 
 namespace iptux {
 
+namespace {
+string orDefault(string_view field, const char* def) {
+  return field.empty() ? def : string(field);
+}
+}  // namespace
+
 /**
  * 类构造函数.
  */
@@ -53,6 +58,7 @@ UdpData::UdpData(CoreThread& coreThread,
   if (size != MAX_UDPLEN) {
     buf[size] = '\0';
   }
+  packet.Parse(buf, size);
 }
 
 /**
@@ -75,13 +81,10 @@ void UdpData::SomeoneLost() {
   /* 创建好友数据 */
   pal = new PalInfo(ipv4, coreThread.port());
   pal->segdes = g_strdup(g_progdt->FindNetSegDescription(ipv4).c_str());
-  auto version = iptux_get_section_string(buf, ':', 0);
-  auto user = iptux_get_section_string(buf, ':', 2);
-  auto host = iptux_get_section_string(buf, ':', 3);
   (*pal)
-      .setVersion(version ? version : "?")
-      .setUser(user ? user : "???")
-      .setHost(host ? host : "???")
+      .setVersion(orDefault(packet.version, "?"))
+      .setUser(orDefault(packet.user, "???"))
+      .setHost(orDefault(packet.host, "???"))
       .setEncode(encode ? encode : "utf-8")
       .setName(_("mysterious"))
       .setGroup(_("mysterious"))
@@ -144,13 +147,11 @@ void UdpData::SomeoneExit() {
  */
 void UdpData::SomeoneAnsEntry() {
   Command cmd(coreThread);
-  const char* ptr;
 
   auto g_progdt = coreThread.getProgramData();
 
   /* 若好友不兼容iptux协议，则需转码 */
-  ptr = iptux_skip_string(buf, size, 3);
-  if (!ptr || *ptr == '\0')
+  if (packet.GetExtra(3).empty())
     ConvertEncode(g_progdt->encode);
 
   /* 加入或更新好友列表 */
@@ -181,14 +182,12 @@ void UdpData::SomeoneAnsEntry() {
  */
 void UdpData::SomeoneAbsence() {
   PPalInfo pal;
-  const char* ptr;
 
   auto g_progdt = coreThread.getProgramData();
 
   /* 若好友不兼容iptux协议，则需转码 */
   pal = coreThread.GetPal(ipv4);  // 利用好友链表只增不减的特性，无须加锁
-  ptr = iptux_skip_string(buf, size, 3);
-  if (!ptr || *ptr == '\0') {
+  if (packet.GetExtra(3).empty()) {
     if (pal) {
       string s(pal->getEncode());
       ConvertEncode(s);
@@ -214,8 +213,6 @@ void UdpData::SomeoneAbsence() {
  */
 void UdpData::SomeoneSendmsg() {
   Command cmd(coreThread);
-  uint32_t commandno, packetno;
-  char* text;
 
   auto g_progdt = coreThread.getProgramData();
 
@@ -235,8 +232,8 @@ void UdpData::SomeoneSendmsg() {
   }
 
   /* 回复好友并检查此消息是否过时 */
-  commandno = iptux_get_dec_number(buf, ':', 4);
-  packetno = iptux_get_dec_number(buf, ':', 1);
+  uint32_t commandno = packet.commandno;
+  uint32_t packetno = packet.packetno;
   if (commandno & IPMSG_SENDCHECKOPT) {
     cmd.SendReply(coreThread.getUdpSock(), pal->GetKey(), packetno);
   }
@@ -245,11 +242,9 @@ void UdpData::SomeoneSendmsg() {
   pal->packetn = packetno;
 
   /* 插入消息&在消息队列中注册 */
-  text = ipmsg_get_attach(buf, ':', 5);
-  if (text && *text != '\0') {
-    InsertMessage(pal, GROUP_BELONG_TYPE_REGULAR, text);
+  if (!packet.attach.empty()) {
+    InsertMessage(pal, GROUP_BELONG_TYPE_REGULAR, string(packet.attach));
   }
-  g_free(text);
 
   /* 标记位处理 先处理底层数据，后面显示窗口*/
   if (commandno & IPMSG_FILEATTACHOPT) {
@@ -275,9 +270,10 @@ void UdpData::SomeoneRecvmsg() {
   PPalInfo pal;
 
   if ((pal = coreThread.GetPal(ipv4))) {
-    packetno = iptux_get_dec_number(buf, ':', 5);
+    packetno = PacketView::ToNumber(packet.attach);
     if (packetno == pal->rpacketn)
       pal->rpacketn = 0;  // 标记此包编号已经被回复
+    coreThread.AckPacket(pal->GetKey(), packetno);
   } else {
     LOG_WARN("message from unknown pal: %s", inAddrToString(ipv4).c_str());
   }
@@ -289,7 +285,6 @@ void UdpData::SomeoneRecvmsg() {
 void UdpData::SomeoneAskShared() {
   Command cmd(coreThread);
   PPalInfo pal;
-  char* passwd;
 
   if (!(pal = coreThread.GetPal(ipv4)))
     return;
@@ -300,17 +295,14 @@ void UdpData::SomeoneAskShared() {
               PPalInfo pal) { ThreadAskSharedFile(coreThread, pal); },
            &coreThread, pal)
         .detach();
-  } else if (!(iptux_get_dec_number(buf, ':', 4) & IPTUX_PASSWDOPT)) {
+  } else if (!(packet.commandno & IPTUX_PASSWDOPT)) {
     cmd.SendFileInfo(coreThread.getUdpSock(), pal->GetKey(),
                      IPTUX_SHAREDOPT | IPTUX_PASSWDOPT, "");
-  } else if ((passwd = ipmsg_get_attach(buf, ':', 5))) {
-    if (limit == passwd) {
-      thread([](CoreThread* coreThread,
-                PPalInfo pal) { ThreadAskSharedFile(coreThread, pal); },
-             &coreThread, pal)
-          .detach();
-    }
-    g_free(passwd);
+  } else if (packet.IsValid() && limit == packet.attach) {
+    thread([](CoreThread* coreThread,
+              PPalInfo pal) { ThreadAskSharedFile(coreThread, pal); },
+           &coreThread, pal)
+        .detach();
   }
 }
 
@@ -338,7 +330,6 @@ void UdpData::SomeoneSendIcon() {
  */
 void UdpData::SomeoneSendSign() {
   PPalInfo pal;
-  char* sign;
 
   if (!(pal = coreThread.GetPal(ipv4)))
     return;
@@ -352,9 +343,9 @@ void UdpData::SomeoneSendSign() {
     pal->setEncode(encode ? encode : "utf-8");
   }
   /* 更新 */
-  if ((sign = ipmsg_get_attach(buf, ':', 5))) {
+  if (packet.IsValid()) {
     g_free(pal->sign);
-    pal->sign = sign;
+    pal->sign = g_strndup(packet.attach.data(), packet.attach.size());
     coreThread.Lock();
     coreThread.UpdatePalToList(ipv4);
     coreThread.Unlock();
@@ -366,9 +357,6 @@ void UdpData::SomeoneSendSign() {
  * 好友广播消息.
  */
 void UdpData::SomeoneBcstmsg() {
-  uint32_t commandno, packetno;
-  char* text;
-
   auto g_progdt = coreThread.getProgramData();
 
   /* 如果对方兼容iptux协议，则无须再转换编码 */
@@ -387,18 +375,16 @@ void UdpData::SomeoneBcstmsg() {
   }
 
   /* 检查此消息是否过时 */
-  packetno = iptux_get_dec_number(buf, ':', 1);
-  if (packetno <= pal->packetn) {
+  if (packet.packetno <= pal->packetn) {
     return;
   }
-  pal->packetn = packetno;
+  pal->packetn = packet.packetno;
 
   /* 插入消息&在消息队列中注册 */
-  text = ipmsg_get_attach(buf, ':', 5);
-  if (text && *text != '\0') {
-    commandno = iptux_get_dec_number(buf, ':', 4);
+  if (!packet.attach.empty()) {
+    string text(packet.attach);
     /* 插入消息 */
-    switch (GET_OPT(commandno)) {
+    switch (GET_OPT(packet.commandno)) {
       case IPTUX_BROADCASTOPT:
         InsertMessage(pal, GROUP_BELONG_TYPE_BROADCAST, text);
         break;
@@ -414,7 +400,6 @@ void UdpData::SomeoneBcstmsg() {
         break;
     }
   }
-  g_free(text);
 }
 
 /**
@@ -425,30 +410,27 @@ shared_ptr<PalInfo> UdpData::CreatePalInfo() {
   auto programData = coreThread.getProgramData();
   auto pal = make_shared<PalInfo>(ipv4, coreThread.port());
   pal->segdes = g_strdup(programData->FindNetSegDescription(ipv4).c_str());
-  auto version = iptux_get_section_string(buf, ':', 0);
-  auto user = iptux_get_section_string(buf, ':', 2);
-  auto host = iptux_get_section_string(buf, ':', 3);
   (*pal)
-      .setVersion(version ? version : "?")
-      .setUser(user ? user : "???")
-      .setHost(host ? host : "???");
-  auto name = ipmsg_get_attach(buf, ':', 5);
-  if (!name) {
+      .setVersion(orDefault(packet.version, "?"))
+      .setUser(orDefault(packet.user, "???"))
+      .setHost(orDefault(packet.host, "???"));
+  if (!packet.IsValid()) {
     pal->setName(_("mysterious"));
   } else {
-    pal->setName(name);
+    pal->setName(string(packet.attach));
   }
   pal->setGroup(GetPalGroup());
   pal->photo = NULL;
   pal->sign = NULL;
   pal->set_icon_file(GetPalIcon(), programData->palicon);
   auto localEncode = GetPalEncode();
-  if (localEncode) {
+  if (!localEncode.empty()) {
     pal->setEncode(localEncode);
     pal->setCompatible(true);
   } else {
     pal->setEncode(encode ? encode : "utf-8");
   }
+  pal->setFeatures(GetPalFeatures());
   pal->setOnline(true);
   pal->packetn = 0;
   pal->rpacketn = 0;
@@ -465,31 +447,28 @@ void UdpData::UpdatePalInfo(PalInfo* pal) {
 
   g_free(pal->segdes);
   pal->segdes = g_strdup(g_progdt->FindNetSegDescription(ipv4).c_str());
-  auto version = iptux_get_section_string(buf, ':', 0);
-  auto user = iptux_get_section_string(buf, ':', 2);
-  auto host = iptux_get_section_string(buf, ':', 3);
   (*pal)
-      .setVersion(version ? version : "?")
-      .setUser(user ? user : "???")
-      .setHost(host ? host : "???");
+      .setVersion(orDefault(packet.version, "?"))
+      .setUser(orDefault(packet.user, "???"))
+      .setHost(orDefault(packet.host, "???"));
   if (!pal->isChanged()) {
-    auto name = ipmsg_get_attach(buf, ':', 5);
-    if (!name) {
+    if (!packet.IsValid()) {
       pal->setName(_("mysterious"));
     } else {
-      pal->setName(name);
+      pal->setName(string(packet.attach));
     }
     pal->setGroup(GetPalGroup());
     pal->set_icon_file(GetPalIcon(), g_progdt->palicon);
     pal->setCompatible(false);
     auto localEncode = GetPalEncode();
-    if (localEncode) {
+    if (!localEncode.empty()) {
       pal->setEncode(localEncode);
       pal->setCompatible(true);
     } else {
       pal->setEncode(encode ? encode : "utf-8");
     }
   }
+  pal->setFeatures(GetPalFeatures());
   pal->setOnline(true);
   pal->packetn = 0;
   pal->rpacketn = 0;
@@ -503,7 +482,7 @@ void UdpData::UpdatePalInfo(PalInfo* pal) {
  */
 void UdpData::InsertMessage(PPalInfo pal,
                             GroupBelongType btype,
-                            const char* msg) {
+                            const string& msg) {
   MsgPara para(coreThread.GetPal(pal->GetKey()));
 
   /* 构建消息封装包 */
@@ -526,42 +505,27 @@ void UdpData::ConvertEncode(const char* enc) {
  * @param enc 原数据首选编码
  */
 void UdpData::ConvertEncode(const string& enc) {
-  char* ptr;
-  size_t len;
-
-  /* 将缓冲区内有效的'\0'字符转换为ASCII字符 */
-  ptr = buf + strlen(buf) + 1;
-  while ((size_t)(ptr - buf) <= size) {
-    *(ptr - 1) = NULL_OBJECT;
-    ptr += strlen(ptr) + 1;
-  }
+  string converted;
 
-  /* 转换字符集编码 */
+  /* 转换字符集编码, 缓冲区内的'\0'一并转换 */
   /**
-   * @note 请不要采用以下做法，它在某些环境下将导致致命错误: \n
-   * if (g_utf8_validate(buf, -1, NULL)) {encode = g_strdup("utf-8")} \n
-   * e.g. 系统编码为GB18030的xx发送来纯ASCII字符串 \n
+   * @note 纯ASCII串的编码仍记为enc, 而非utf8, 否则: \n
+   * e.g. 系统编码为GB18030的xx发送来纯ASCII字符串, 将被误认为utf8 \n
    */
-  if (!enc.empty() && strcasecmp(enc.c_str(), "utf-8") != 0 &&
-      (ptr = convert_encode(buf, "utf-8", enc.c_str())))
-    encode = g_strdup(enc.c_str());
-  else
-    ptr = iptux_string_validate(buf, coreThread.getProgramData()->codeset,
-                                &encode);
-  if (ptr) {
-    len = strlen(ptr);
-    size = len < MAX_UDPLEN ? len : MAX_UDPLEN;
-    memcpy(buf, ptr, size);
+  auto codeset = coreThread.getCharsetConverter().ToUtf8(
+      PalKey(ipv4, coreThread.port()), string_view(buf, size), enc,
+      coreThread.getProgramData()->codeset, converted);
+  g_free(encode);
+  encode = NULL;
+  if (!codeset.empty() && strcasecmp(codeset.c_str(), "utf-8") != 0) {
+    encode = g_strdup(codeset.c_str());
+  }
+  if (!converted.empty()) {
+    size = converted.size() < MAX_UDPLEN ? converted.size() : MAX_UDPLEN;
+    memcpy(buf, converted.data(), size);
     if (size < MAX_UDPLEN)
       buf[size] = '\0';
-    g_free(ptr);
-  }
-
-  /* 将缓冲区内的ASCII字符还原为'\0'字符 */
-  ptr = buf;
-  while ((ptr = (char*)memchr(ptr, NULL_OBJECT, buf + size - ptr))) {
-    *ptr = '\0';
-    ptr++;
+    packet.Parse(buf, size);
   }
 }
 
@@ -570,11 +534,7 @@ void UdpData::ConvertEncode(const string& enc) {
  * @return 群组
  */
 string UdpData::GetPalGroup() {
-  const char* ptr;
-
-  if ((ptr = iptux_skip_string(buf, size, 1)) && *ptr != '\0')
-    return ptr;
-  return "";
+  return string(packet.GetExtra(1));
 }
 
 /**
@@ -582,26 +542,31 @@ string UdpData::GetPalGroup() {
  * @return 头像
  */
 string UdpData::GetPalIcon() {
-  const char* ptr;
+  string icon(packet.GetExtra(2));
 
-  if ((ptr = iptux_skip_string(buf, size, 2)) && *ptr != '\0') {
-    string res = stringFormat(__PIXMAPS_PATH "/icon/%s", ptr);
+  if (!icon.empty()) {
+    string res = stringFormat(__PIXMAPS_PATH "/icon/%s", icon.c_str());
     if (access(res.c_str(), F_OK) == 0)
-      return ptr;
+      return icon;
   }
   return "";
 }
 
 /**
  * 获取好友系统编码.
- * @return 编码
+ * @return 编码, 空串表示未提供
  */
-char* UdpData::GetPalEncode() {
-  const char* ptr;
+string UdpData::GetPalEncode() {
+  return string(packet.GetExtra(3));
+}
 
-  if ((ptr = iptux_skip_string(buf, size, 3)) && *ptr != '\0')
-    return g_strdup(ptr);
-  return NULL;
+/**
+ * 获取好友通告的iptux扩展功能.
+ * @return IPTUX_FEATURE_*
+ */
+uint32_t UdpData::GetPalFeatures() {
+  string features(packet.GetExtra(4));
+  return features.empty() ? 0 : strtoul(features.c_str(), nullptr, 16);
 }
 
 /**
@@ -609,14 +574,14 @@ char* UdpData::GetPalEncode() {
  * @return 头像文件名
  */
 string UdpData::RecvPalIcon() {
-  size_t len;
   int fd;
 
   /* 若无头像数据则返回null */
-  if ((len = strlen(buf) + 1) >= size)
+  auto icon = packet.GetBody();
+  if (icon.empty())
     return "";
 
-  auto hash = sha256(buf + len, size - len);
+  auto hash = sha256(icon.data(), icon.size());
 
   /* 将头像数据刷入磁盘 */
   auto path = stringFormat("%s" ICON_PATH "/%s.png", g_get_user_cache_dir(),
@@ -626,7 +591,7 @@ string UdpData::RecvPalIcon() {
     LOG_ERROR("write icon to path failed: %s", path.c_str());
     return "";
   }
-  xwrite(fd, buf + len, size - len);
+  xwrite(fd, icon.data(), icon.size());
   close(fd);
   return hash;
 }
@@ -659,20 +624,18 @@ PPalInfo UdpData::AssertPalOnline() {
  * 接收好友文件信息.
  */
 void UdpData::RecvPalFile() {
-  uint32_t packetno, commandno;
-  const char* ptr;
-
-  packetno = iptux_get_dec_number(buf, ':', 1);
-  commandno = iptux_get_dec_number(buf, ':', 4);
-  ptr = iptux_skip_string(buf, size, 1);
+  uint32_t packetno = packet.packetno;
+  auto files = packet.GetExtra(1);
   /* 只有当此为共享文件信息或文件信息不为空才需要接收 */
-  if ((commandno & IPTUX_SHAREDOPT) || (ptr && *ptr != '\0')) {
-    string data = ptr;
+  if ((packet.commandno & IPTUX_SHAREDOPT) || !files.empty()) {
+    string data(files);
+    bool hasManifest = packet.commandno & IPTUX_MANIFESTOPT;
     thread(
-        [](CoreThread* coreThread, PPalInfo pal, string data, int packetno) {
-          RecvFile::RecvEntry(coreThread, pal, data, packetno);
+        [](CoreThread* coreThread, PPalInfo pal, string data, int packetno,
+           bool hasManifest) {
+          RecvFile::RecvEntry(coreThread, pal, data, packetno, hasManifest);
         },
-        &coreThread, coreThread.GetPal(ipv4), data, packetno)
+        &coreThread, coreThread.GetPal(ipv4), data, packetno, hasManifest)
         .detach();
   }
 }
@@ -692,7 +655,7 @@ void UdpData::ThreadAskSharedFile(CoreThread* coreThread, PPalInfo pal) {
 }
 
 uint32_t UdpData::getCommandNo() const {
-  return iptux_get_dec_number(buf, ':', 4);
+  return packet.commandno;
 }
 
 string UdpData::getIpv4String() const {
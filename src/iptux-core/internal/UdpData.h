@@ -18,6 +18,7 @@
 #include "iptux-core/IptuxConfig.h"
 #include "iptux-core/Models.h"
 #include "iptux-core/internal/CommandMode.h"
+#include "iptux-core/internal/PacketView.h"
 #include "iptux-core/internal/ipmsg.h"
 
 namespace iptux {
@@ -27,11 +28,15 @@ class UdpData {
   UdpData(CoreThread& coreThread, in_addr ipv4, const char buf[], size_t size);
   ~UdpData();
 
+  UdpData(const UdpData&) = delete;
+  UdpData& operator=(const UdpData&) = delete;
+
   in_addr getIpv4() const { return ipv4; }
   std::string getIpv4String() const;
 
   uint32_t getCommandNo() const;
   CommandMode getCommandMode() const;
+  const PacketView& getPacket() const { return packet; }
 
  public:
   std::shared_ptr<PalInfo> CreatePalInfo();
@@ -52,12 +57,15 @@ class UdpData {
  private:
   void UpdatePalInfo(PalInfo* pal);
 
-  void InsertMessage(PPalInfo pal, GroupBelongType btype, const char* msg);
+  void InsertMessage(PPalInfo pal,
+                     GroupBelongType btype,
+                     const std::string& msg);
   void ConvertEncode(const std::string& enc);
   void ConvertEncode(const char* enc);
   std::string GetPalGroup();
   std::string GetPalIcon();
-  char* GetPalEncode();
+  std::string GetPalEncode();
+  uint32_t GetPalFeatures();
   std::string RecvPalIcon();
   PPalInfo AssertPalOnline();
   void RecvPalFile();
@@ -68,6 +76,7 @@ class UdpData {
   size_t size;           // 缓冲区数据有效长度
   char buf[MAX_UDPLEN];  // 数据缓冲区
   char* encode;          // 原数据编码(NULL意味着utf8)
+  PacketView packet;     // buf的解析结果, buf改动后需重新解析
 
  private:
   static void ThreadAskSharedFile(CoreThread* coreThread, PPalInfo pal);
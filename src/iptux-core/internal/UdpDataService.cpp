@@ -1,14 +1,41 @@
 #include "UdpDataService.h"
 
+#include <arpa/inet.h>
+
 #include "gio/gio.h"
+#include "iptux-core/internal/ipmsg.h"
 #include "iptux-utils/output.h"
 #include "iptux-utils/utils.h"
 
 using namespace std;
 namespace iptux {
 
+namespace {
+const struct {
+  int mode;
+  const char* name;
+} kPacketModes[] = {
+    {IPMSG_BR_ENTRY, "BR_ENTRY"},     {IPMSG_BR_EXIT, "BR_EXIT"},
+    {IPMSG_ANSENTRY, "ANSENTRY"},     {IPMSG_BR_ABSENCE, "BR_ABSENCE"},
+    {IPMSG_SENDMSG, "SENDMSG"},       {IPMSG_RECVMSG, "RECVMSG"},
+    {IPTUX_ASKSHARED, "ASKSHARED"},   {IPTUX_SENDICON, "SENDICON"},
+    {IPTUX_SEND_SIGN, "SEND_SIGN"},   {IPTUX_SENDMSG, "IPTUX_SENDMSG"},
+};
+}  // namespace
+
 UdpDataService::UdpDataService(CoreThread& coreThread)
-    : core_thread_(coreThread) {}
+    : core_thread_(coreThread),
+      blocked_(coreThread.getMetrics().GetCounter("udp.packets.blocked")),
+      latency_(coreThread.getMetrics().GetHistogram("udp.process_us")) {
+  auto& metrics = coreThread.getMetrics();
+  Counter* unknown = &metrics.GetCounter("udp.packets.UNKNOWN");
+  for (auto& packets : packets_) {
+    packets = unknown;
+  }
+  for (auto& it : kPacketModes) {
+    packets_[it.mode] = &metrics.GetCounter(string("udp.packets.") + it.name);
+  }
+}
 
 unique_ptr<UdpData> UdpDataService::process(in_addr ipv4,
                                             int port,
@@ -20,15 +47,14 @@ unique_ptr<UdpData> UdpDataService::process(in_addr ipv4,
 unique_ptr<UdpData> UdpDataService::process(GSocketAddress* peer,
                                             const char buf[],
                                             size_t size) {
-  GInetSocketAddress* isa = G_INET_SOCKET_ADDRESS(peer);
-  guint16 port = g_inet_socket_address_get_port(isa);
-  GInetAddress* ia = g_inet_socket_address_get_address(isa);
-  char* ip = g_inet_address_to_string(ia);
-
-  // TODO: too many conversions, optimize it
-  in_addr ipv4 = inAddrFromString(ip);
-  g_free(ip);
-  return process(ipv4, port, buf, size, true);
+  struct sockaddr_in addr;
+  GError* error = nullptr;
+  if (!g_socket_address_to_native(peer, &addr, sizeof(addr), &error)) {
+    LOG_WARN("unsupported peer address: %s", error->message);
+    g_error_free(error);
+    return {};
+  }
+  return process(addr.sin_addr, ntohs(addr.sin_port), buf, size, true);
 }
 
 unique_ptr<UdpData> UdpDataService::process(in_addr ipv4,
@@ -53,14 +79,22 @@ unique_ptr<UdpData> UdpDataService::process(in_addr ipv4,
 }
 
 void UdpDataService::process(UdpData& udata) {
+  gint64 start = g_get_monotonic_time();
+  dispatch(udata);
+  latency_.Observe(g_get_monotonic_time() - start);
+}
+
+void UdpDataService::dispatch(UdpData& udata) {
   /* 如果开启了黑名单处理功能，且此地址正好被列入了黑名单 */
   if (core_thread_.IsBlocked(udata.getIpv4())) {
     LOG_INFO("address is blocked: %s", udata.getIpv4String().c_str());
+    blocked_.Inc();
     return;
   }
 
   /* 决定消息去向 */
   auto commandMode = udata.getCommandMode();
+  packets_[commandMode.getMode()]->Inc();
   LOG_INFO("command NO.: [0x%x] %s", udata.getCommandNo(),
            commandMode.toString().c_str());
   switch (commandMode.getMode()) {
@@ -3,6 +3,7 @@
 
 #include "gio/gio.h"
 #include "iptux-core/CoreThread.h"
+#include "iptux-core/Metrics.h"
 #include "iptux-core/internal/UdpData.h"
 
 namespace iptux {
@@ -29,7 +30,12 @@ class UdpDataService {
   void process(UdpData& udpData);
 
  private:
+  void dispatch(UdpData& udpData);
+
   CoreThread& core_thread_;
+  Counter* packets_[256];  // 按命令字(GET_MODE)计数
+  Counter& blocked_;
+  Histogram& latency_;
 };
 
 using UdpDataService_U = std::unique_ptr<UdpDataService>;
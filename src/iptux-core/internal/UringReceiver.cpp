@@ -0,0 +1,231 @@
+#include "config.h"
+#include "UringReceiver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#if HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "iptux-utils/output.h"
+
+using namespace std;
+
+namespace iptux {
+
+#if HAVE_LIBURING
+
+namespace {
+enum : uint64_t { OP_POLL = 1, OP_RECV, OP_WRITE };
+
+uint64_t makeUserData(uint64_t op, unsigned idx) {
+  return (op << 32) | idx;
+}
+}  // namespace
+
+struct UringReceiver::Impl {
+  struct io_uring ring;
+  bool ready{false};
+  size_t bufferSize{0};
+  vector<char> memory;
+  vector<struct iovec> iovs;
+
+  /* 一个缓冲区对应文件中的一段数据 */
+  struct Buffer {
+    int64_t fileOffset{0};
+    size_t len{0};
+    size_t written{0};
+  };
+
+  int64_t receive(int sock,
+                  int fd,
+                  int64_t offset,
+                  int64_t count,
+                  const Progress& progress);
+};
+
+UringReceiver::UringReceiver(unsigned bufferCount, size_t bufferSize)
+    : pImpl(make_unique<Impl>()) {
+  bufferCount = max(bufferCount, 2u);
+  int ret = io_uring_queue_init(bufferCount + 2, &pImpl->ring, 0);
+  if (ret < 0) {
+    LOG_INFO("io_uring not available: %s", strerror(-ret));
+    return;
+  }
+  pImpl->bufferSize = bufferSize;
+  pImpl->memory.resize(bufferCount * bufferSize);
+  for (unsigned i = 0; i < bufferCount; ++i) {
+    pImpl->iovs.push_back({pImpl->memory.data() + i * bufferSize, bufferSize});
+  }
+  ret = io_uring_register_buffers(&pImpl->ring, pImpl->iovs.data(),
+                                  pImpl->iovs.size());
+  if (ret < 0) {
+    LOG_INFO("io_uring_register_buffers failed: %s", strerror(-ret));
+    io_uring_queue_exit(&pImpl->ring);
+    return;
+  }
+  pImpl->ready = true;
+}
+
+UringReceiver::~UringReceiver() {
+  if (pImpl->ready) {
+    io_uring_queue_exit(&pImpl->ring);
+  }
+}
+
+bool UringReceiver::IsReady() const {
+  return pImpl->ready;
+}
+
+int64_t UringReceiver::Receive(int sock,
+                               int fd,
+                               int64_t offset,
+                               int64_t count,
+                               const Progress& progress) {
+  if (!pImpl->ready) {
+    return -1;
+  }
+  return pImpl->receive(sock, fd, offset, count, progress);
+}
+
+int64_t UringReceiver::Impl::receive(int sock,
+                                     int fd,
+                                     int64_t offset,
+                                     int64_t count,
+                                     const Progress& progress) {
+  vector<Buffer> buffers(iovs.size());
+  vector<unsigned> freeList;
+  for (unsigned i = iovs.size(); i > 0; --i) {
+    freeList.push_back(i - 1);
+  }
+  /* 非阻塞套接口上的recv不会等待数据, 需先挂一个poll */
+  bool nonblocking = fcntl(sock, F_GETFL) & O_NONBLOCK;
+  int64_t received = 0, written = 0;
+  int64_t failedAt = offset + count;  // 首个写入失败的文件位置
+  unsigned inflight = 0;
+  bool receiving = false, stop = false;
+
+  auto submitRecv = [&](unsigned idx) {
+    struct io_uring_sqe* sqe;
+    if (nonblocking) {
+      sqe = io_uring_get_sqe(&ring);
+      io_uring_prep_poll_add(sqe, sock, POLLIN);
+      sqe->flags |= IOSQE_IO_LINK;
+      sqe->user_data = makeUserData(OP_POLL, idx);
+      inflight++;
+    }
+    sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_recv(sqe, sock, iovs[idx].iov_base,
+                       size_t(min<int64_t>(bufferSize, count - received)), 0);
+    sqe->user_data = makeUserData(OP_RECV, idx);
+    inflight++;
+    receiving = true;
+  };
+  auto submitWrite = [&](unsigned idx) {
+    Buffer& buffer = buffers[idx];
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_write_fixed(
+        sqe, fd, (char*)iovs[idx].iov_base + buffer.written,
+        buffer.len - buffer.written, buffer.fileOffset + buffer.written, idx);
+    sqe->user_data = makeUserData(OP_WRITE, idx);
+    inflight++;
+  };
+
+  while (true) {
+    if (!stop && !receiving && received < count && !freeList.empty()) {
+      unsigned idx = freeList.back();
+      freeList.pop_back();
+      buffers[idx].fileOffset = offset + received;
+      submitRecv(idx);
+    }
+    if (inflight == 0) {
+      break;
+    }
+
+    io_uring_submit(&ring);
+    struct io_uring_cqe* cqe;
+    int ret = io_uring_wait_cqe(&ring, &cqe);
+    if (ret == -EINTR) {
+      continue;
+    }
+    if (ret < 0) {
+      /* 内核仍可能使用缓冲区, 此后不再复用本实例 */
+      LOG_ERROR("io_uring_wait_cqe failed: %s", strerror(-ret));
+      ready = false;
+      return min(failedAt - offset, written);
+    }
+
+    do {
+      uint64_t op = cqe->user_data >> 32;
+      unsigned idx = cqe->user_data & 0xffffffff;
+      int res = cqe->res;
+      io_uring_cqe_seen(&ring, cqe);
+      inflight--;
+
+      if (op == OP_RECV) {
+        receiving = false;
+        if ((res == -EAGAIN || res == -EINTR) && !stop) {
+          submitRecv(idx);
+        } else if (res <= 0) {
+          if (res < 0 && res != -ECANCELED) {
+            LOG_WARN("io_uring recv failed: %s", strerror(-res));
+          }
+          stop = true;
+          freeList.push_back(idx);
+        } else {
+          buffers[idx].len = res;
+          buffers[idx].written = 0;
+          received += res;
+          submitWrite(idx);
+        }
+      } else if (op == OP_WRITE) {
+        Buffer& buffer = buffers[idx];
+        if (res == -EINTR || res == -EAGAIN) {
+          submitWrite(idx);
+        } else if (res <= 0) {
+          LOG_ERROR("io_uring write failed: %s",
+                    res ? strerror(-res) : "no space written");
+          failedAt = min(failedAt, buffer.fileOffset + int64_t(buffer.written));
+          stop = true;
+          freeList.push_back(idx);
+        } else if ((buffer.written += res) < buffer.len) {
+          submitWrite(idx);
+        } else {
+          written += buffer.len;
+          freeList.push_back(idx);
+          if (progress && !progress(written)) {
+            stop = true;
+          }
+        }
+      }
+    } while (io_uring_peek_cqe(&ring, &cqe) == 0);
+  }
+
+  return min(failedAt - offset, received);
+}
+
+#else  // HAVE_LIBURING
+
+struct UringReceiver::Impl {};
+
+UringReceiver::UringReceiver(unsigned, size_t) {}
+
+UringReceiver::~UringReceiver() {}
+
+bool UringReceiver::IsReady() const {
+  return false;
+}
+
+int64_t UringReceiver::Receive(int, int, int64_t, int64_t, const Progress&) {
+  return -1;
+}
+
+#endif  // HAVE_LIBURING
+
+}  // namespace iptux
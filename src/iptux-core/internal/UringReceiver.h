@@ -0,0 +1,64 @@
+#ifndef IPTUX_URING_RECEIVER_H
+#define IPTUX_URING_RECEIVER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace iptux {
+
+/**
+ * @brief receives file data with io_uring, overlapping socket reads and
+ * disk writes.
+ *
+ * One recv is in flight at a time (to keep the stream order) while the
+ * filled buffers are written with write_fixed at their file offsets, so
+ * the next receive runs while the previous data is still being written.
+ * Buffers are registered once for the life of the receiver.
+ *
+ * Only available when built with liburing (HAVE_LIBURING) and allowed by
+ * the kernel, callers fall back to read/write otherwise.
+ */
+class UringReceiver {
+ public:
+  /**
+   * @brief called with the count of bytes written so far, return false to
+   * stop the transfer
+   */
+  using Progress = std::function<bool(int64_t written)>;
+
+  static constexpr unsigned DEFAULT_BUFFER_COUNT = 8;
+  static constexpr size_t DEFAULT_BUFFER_SIZE = 256 * 1024;
+
+  explicit UringReceiver(unsigned bufferCount = DEFAULT_BUFFER_COUNT,
+                         size_t bufferSize = DEFAULT_BUFFER_SIZE);
+  ~UringReceiver();
+
+  UringReceiver(const UringReceiver&) = delete;
+  UringReceiver& operator=(const UringReceiver&) = delete;
+
+  /**
+   * @brief whether the ring has been set up
+   */
+  bool IsReady() const;
+
+  /**
+   * @brief receive count bytes from sock into fd, starting at file offset.
+   *
+   * @return bytes written contiguously from offset (less than count on
+   * error, EOF or when progress returned false), -1 if not ready
+   */
+  int64_t Receive(int sock,
+                  int fd,
+                  int64_t offset,
+                  int64_t count,
+                  const Progress& progress);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> pImpl;
+};
+
+}  // namespace iptux
+
+#endif
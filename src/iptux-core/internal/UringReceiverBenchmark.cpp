@@ -0,0 +1,113 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "iptux-core/internal/UringReceiver.h"
+#include "iptux-core/internal/ipmsg.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+
+const int64_t kTransferSize = 256 * 1024 * 1024;
+
+// a connected loopback tcp pair, like a file transfer between two peers
+bool loopbackPair(int& client, int& server) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (bind(listener, (struct sockaddr*)&addr, len) == -1 ||
+      listen(listener, 1) == -1 ||
+      getsockname(listener, (struct sockaddr*)&addr, &len) == -1) {
+    close(listener);
+    return false;
+  }
+  client = socket(AF_INET, SOCK_STREAM, 0);
+  if (connect(client, (struct sockaddr*)&addr, len) == -1) {
+    close(listener);
+    return false;
+  }
+  server = accept(listener, nullptr, nullptr);
+  close(listener);
+  return server != -1;
+}
+
+template <typename F>
+double mbPerSecond(F receive) {
+  int client, server;
+  if (!loopbackPair(client, server)) {
+    perror("loopback");
+    exit(1);
+  }
+  char path[] = "/tmp/iptux-bench-XXXXXX";
+  int fd = mkstemp(path);
+  unlink(path);
+
+  thread sender([client] {
+    vector<char> chunk(1024 * 1024, 'x');
+    for (int64_t sent = 0; sent < kTransferSize; sent += chunk.size()) {
+      if (xwrite(client, chunk.data(), chunk.size()) == -1) {
+        break;
+      }
+    }
+  });
+  auto start = chrono::steady_clock::now();
+  int64_t received = receive(server, fd);
+  fsync(fd);
+  auto elapsed = chrono::steady_clock::now() - start;
+  sender.join();
+  close(client);
+  close(server);
+  close(fd);
+
+  if (received != kTransferSize) {
+    fprintf(stderr, "short transfer: %jd/%jd\n", (intmax_t)received,
+            (intmax_t)kTransferSize);
+  }
+  return received / 1048576.0 / chrono::duration<double>(elapsed).count();
+}
+
+}  // namespace
+
+int main() {
+  // the read/write loop RecvFileData falls back to
+  double plain = mbPerSecond([](int sock, int fd) {
+    char buf[MAX_SOCKLEN];
+    int64_t finished = 0;
+    while (finished < kTransferSize) {
+      ssize_t size = read(sock, buf, sizeof(buf));
+      if (size <= 0 || xwrite(fd, buf, size) == -1) {
+        break;
+      }
+      finished += size;
+    }
+    return finished;
+  });
+  printf("read/write %5d B buffer   %10.1f MB/s\n", MAX_SOCKLEN, plain);
+
+  UringReceiver receiver;
+  if (!receiver.IsReady()) {
+    printf("io_uring                   not available\n");
+    return 0;
+  }
+  double uring = mbPerSecond([&](int sock, int fd) {
+    return receiver.Receive(sock, fd, 0, kTransferSize, nullptr);
+  });
+  printf("io_uring %u x %zu KB        %10.1f MB/s\n",
+         UringReceiver::DEFAULT_BUFFER_COUNT,
+         UringReceiver::DEFAULT_BUFFER_SIZE / 1024, uring);
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "iptux-core/internal/UringReceiver.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+void checkReceive(bool nonblocking) {
+  UringReceiver receiver(4, 64 * 1024);
+  if (!receiver.IsReady()) {
+    GTEST_SKIP() << "io_uring not available";
+  }
+
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  if (nonblocking) {
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+  }
+  vector<char> data(3 * 1024 * 1024 + 123);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = char(i * 7 + i / 4096);
+  }
+  thread writer([&] {
+    EXPECT_EQ(xwrite(fds[1], data.data(), data.size()), ssize_t(data.size()));
+  });
+
+  gchar* path = nullptr;
+  int fd = g_file_open_tmp("iptux-uring-XXXXXX", &path, nullptr);
+  ASSERT_NE(fd, -1);
+  int64_t lastProgress = 0;
+  int64_t size = receiver.Receive(fds[0], fd, 100, data.size(),
+                                  [&](int64_t written) {
+                                    EXPECT_GT(written, lastProgress);
+                                    lastProgress = written;
+                                    return true;
+                                  });
+  writer.join();
+  EXPECT_EQ(size, int64_t(data.size()));
+  EXPECT_EQ(lastProgress, int64_t(data.size()));
+
+  vector<char> result(data.size());
+  EXPECT_EQ(pread(fd, result.data(), result.size(), 100),
+            ssize_t(result.size()));
+  EXPECT_TRUE(result == data);
+
+  close(fd);
+  close(fds[0]);
+  close(fds[1]);
+  g_unlink(path);
+  g_free(path);
+}
+}  // namespace
+
+TEST(UringReceiver, Receive) {
+  checkReceive(false);
+}
+
+TEST(UringReceiver, ReceiveNonBlocking) {
+  checkReceive(true);
+}
+
+TEST(UringReceiver, PeerClosed) {
+  UringReceiver receiver;
+  if (!receiver.IsReady()) {
+    GTEST_SKIP() << "io_uring not available";
+  }
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  EXPECT_EQ(write(fds[1], "hello", 5), 5);
+  close(fds[1]);
+
+  gchar* path = nullptr;
+  int fd = g_file_open_tmp("iptux-uring-XXXXXX", &path, nullptr);
+  ASSERT_NE(fd, -1);
+  EXPECT_EQ(receiver.Receive(fds[0], fd, 0, 100, nullptr), 5);
+  close(fd);
+  close(fds[0]);
+  g_unlink(path);
+  g_free(path);
+}
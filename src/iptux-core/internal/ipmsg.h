@@ -164,11 +164,16 @@
 #define IPTUX_SENDSUBLAYER 0x000000FDUL
 #define IPTUX_SEND_SIGN 0x000000FCUL
 #define IPTUX_SENDMSG 0x000000FBUL
+#define IPTUX_ASKMANIFEST 0x000000FAUL
 /* option for IPTUX_SENDSUBLAYER */
 #define IPTUX_PHOTOPICOPT 0x00000100UL
 #define IPTUX_MSGPICOPT 0x00000200UL
 /* option for IPMSG_SENDMSG */
 #define IPTUX_SHAREDOPT 0x80000000UL
+/* option for IPMSG_SENDMSG, 文件信息没有发完, 余下的用IPTUX_ASKMANIFEST取 */
+#define IPTUX_MANIFESTOPT 0x20000000UL
+/* option for IPMSG_GETFILEDATA & IPMSG_GETDIRFILES, 数据按块压缩后发送 */
+#define IPTUX_COMPRESSOPT 0x10000000UL
 /* option for IPMSG_SENDMSG & IPTUX_ASKSHARED */
 #define IPTUX_PASSWDOPT 0x40000000UL
 /* option for IPTUX_SENDMSG */
@@ -177,6 +182,11 @@
 // #define IPTUX_GROUPOPT 0x00000300UL
 // #define IPTUX_BROADCASTOPT 0x00000400UL
 
+/* iptux扩展功能, 在上线数据包的iptux扩展段中通告(16进制) */
+#define IPTUX_FEATURE_SEGMENT 0x00000001UL   // 请求数据时可指定偏移和长度
+#define IPTUX_FEATURE_COMPRESS 0x00000002UL  // 支持IPTUX_COMPRESSOPT
+#define IPTUX_FEATURES (IPTUX_FEATURE_SEGMENT | IPTUX_FEATURE_COMPRESS)
+
 /* data */
 // #define MAX_PREVIEWSIZE 150
 #define MAX_SOCKLEN 8192
@@ -0,0 +1,389 @@
+#include "config.h"
+#include "AsyncLogger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "iptux-utils/utils.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+
+const size_t kRingSize = 256 * 1024;
+const size_t kMaxMessage = 4096;
+const auto kFlushInterval = chrono::milliseconds(20);
+
+/**
+ * 环形缓冲区中的记录头, 后接消息正文.
+ * fname和func来自__FILE__和__func__, 是静态字符串, 只保存指针.
+ */
+struct RecordHeader {
+  uint32_t size;  // 含头部, 8字节对齐; 0表示余下部分空闲, 下一条在开头
+  uint32_t line;
+  int64_t monoNs;
+  const char* fname;
+  const char* func;
+  int32_t level;
+  uint32_t textLen;
+};
+
+int64_t monotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+char logLevelAsChar(GLogLevelFlags logLevel) {
+  switch (logLevel) {
+    case G_LOG_LEVEL_DEBUG:
+      return 'D';
+    case G_LOG_LEVEL_INFO:
+      return 'I';
+    case G_LOG_LEVEL_MESSAGE:
+      return 'M';
+    case G_LOG_LEVEL_WARNING:
+      return 'W';
+    case G_LOG_LEVEL_ERROR:
+      return 'E';
+    default:
+      return 'U';
+  }
+}
+
+const char* prettyFname(const char* fname) {
+  const char* pos = strrchr(fname, '/');
+  return pos ? pos + 1 : fname;
+}
+
+string currentThreadName() {
+  char name[16] = "";
+  pthread_getname_np(pthread_self(), name, sizeof(name));
+  return stringFormat("%s/%ld", name, long(syscall(SYS_gettid)));
+}
+
+}  // namespace
+
+/**
+ * 单生产者单消费者的字节环形缓冲区, 生产者是所属线程, 消费者是flusher.
+ */
+class AsyncLogger::Ring {
+ public:
+  explicit Ring(string threadName)
+      : threadName(std::move(threadName)), buf(kRingSize) {}
+
+  bool Push(RecordHeader& header, const char* text) {
+    size_t need = (sizeof(header) + header.textLen + 7) & ~size_t(7);
+    uint64_t h = head.load(memory_order_relaxed);
+    uint64_t t = tail.load(memory_order_acquire);
+    size_t pos = h % kRingSize;
+    size_t skip = kRingSize - pos < need ? kRingSize - pos : 0;
+    if (h + skip + need - t > kRingSize) {
+      return false;
+    }
+    if (skip > 0) {
+      memset(&buf[pos], 0, sizeof(uint32_t));
+      h += skip;
+      pos = 0;
+    }
+    header.size = need;
+    memcpy(&buf[pos], &header, sizeof(header));
+    memcpy(&buf[pos + sizeof(header)], text, header.textLen);
+    head.store(h + need, memory_order_release);
+    return true;
+  }
+
+  template <typename F>
+  void Drain(F f) {
+    uint64_t t = tail.load(memory_order_relaxed);
+    uint64_t h = head.load(memory_order_acquire);
+    while (t < h) {
+      size_t pos = t % kRingSize;
+      uint32_t size;
+      memcpy(&size, &buf[pos], sizeof(size));
+      if (size == 0) {
+        t += kRingSize - pos;
+        continue;
+      }
+      RecordHeader header;
+      memcpy(&header, &buf[pos], sizeof(header));
+      f(header, &buf[pos + sizeof(header)]);
+      t += size;
+    }
+    tail.store(t, memory_order_release);
+  }
+
+  const string threadName;
+  atomic_bool orphaned{false};  // 线程已退出, 排空后即可回收
+  atomic<uint64_t> dropped{0};
+
+ private:
+  vector<char> buf;
+  alignas(64) atomic<uint64_t> head{0};
+  alignas(64) atomic<uint64_t> tail{0};
+};
+
+namespace {
+struct ThreadRing {
+  shared_ptr<AsyncLogger::Ring> ring;
+  ~ThreadRing() {
+    if (ring) {
+      ring->orphaned = true;
+    }
+  }
+};
+thread_local ThreadRing threadRingHolder;
+}  // namespace
+
+AsyncLogger& AsyncLogger::Instance() {
+  /* 不析构, 其他静态对象析构时仍可记录日志 */
+  static AsyncLogger* instance = new AsyncLogger();
+  return *instance;
+}
+
+AsyncLogger::AsyncLogger() {
+  running = true;
+  flusher = thread([this] { run(); });
+  atexit([] { AsyncLogger::Instance().Stop(); });
+}
+
+void AsyncLogger::Log(const char* fname,
+                      int line,
+                      const char* func,
+                      GLogLevelFlags level,
+                      const char* format,
+                      va_list ap) {
+  char msg[kMaxMessage];
+  int n = vsnprintf(msg, sizeof(msg), format, ap);
+  size_t len = n < 0 ? 0 : min<size_t>(n, sizeof(msg) - 1);
+  if (n >= int(sizeof(msg))) {
+    memcpy(msg + len - 3, "...", 3);
+  }
+
+  RecordHeader header;
+  header.line = line;
+  header.monoNs = monotonicNs();
+  header.fname = fname;
+  header.func = func;
+  header.level = level;
+  header.textLen = len;
+
+  if (!running) {
+    lock_guard<std::mutex> l(flushMutex);
+    rebaseLocked();
+    writeLocked(formatLine(header.monoNs, currentThreadName(), level, fname,
+                           line, func, msg, len));
+    return;
+  }
+  Ring* ring = threadRing();
+  if (!ring->Push(header, msg)) {
+    /* 每个线程单独计数, 丢弃频繁时不争用同一缓存行 */
+    ring->dropped.store(ring->dropped.load(memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+  }
+  /* 严重错误之后进程可能很快退出, 立即写出 */
+  if (int(level) <= int(G_LOG_LEVEL_CRITICAL)) {
+    Flush();
+  }
+}
+
+void AsyncLogger::Flush() {
+  lock_guard<std::mutex> l(flushMutex);
+  flushLocked();
+}
+
+void AsyncLogger::Stop() {
+  {
+    lock_guard<std::mutex> l(mutex);
+    if (stopping) {
+      return;
+    }
+    stopping = true;
+  }
+  cond.notify_all();
+  flusher.join();
+  running = false;
+  Flush();
+}
+
+bool AsyncLogger::SetFile(const string& path, size_t maxBytes, int keep) {
+  lock_guard<std::mutex> l(flushMutex);
+  flushLocked();
+  if (file) {
+    fclose(file);
+    file = nullptr;
+  }
+  filePath = path;
+  maxFileBytes = maxBytes;
+  keepFiles = keep;
+  if (path.empty()) {
+    return true;
+  }
+  file = fopen(path.c_str(), "a");
+  if (!file) {
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  fileBytes = ftell(file);
+  return true;
+}
+
+AsyncLogger::Ring* AsyncLogger::threadRing() {
+  auto& ring = threadRingHolder.ring;
+  if (!ring) {
+    ring = make_shared<Ring>(currentThreadName());
+    lock_guard<std::mutex> l(ringsMutex);
+    rings.push_back(ring);
+  }
+  return ring.get();
+}
+
+uint64_t AsyncLogger::DroppedCount() {
+  lock_guard<std::mutex> l(ringsMutex);
+  uint64_t count = retiredDropped;
+  for (auto& ring : rings) {
+    count += ring->dropped;
+  }
+  return count;
+}
+
+void AsyncLogger::run() {
+  pthread_setname_np(pthread_self(), "iptux-log");
+  unique_lock<std::mutex> l(mutex);
+  while (!stopping) {
+    cond.wait_for(l, kFlushInterval, [this] { return stopping; });
+    l.unlock();
+    Flush();
+    l.lock();
+  }
+}
+
+void AsyncLogger::flushLocked() {
+  rebaseLocked();
+  vector<shared_ptr<Ring>> snapshot;
+  {
+    lock_guard<std::mutex> l(ringsMutex);
+    snapshot = rings;
+  }
+
+  vector<pair<int64_t, string>> pending;
+  vector<shared_ptr<Ring>> exited;
+  for (auto& ring : snapshot) {
+    /* 先读标记再排空, 标记为真时排空后不会再有新记录 */
+    bool orphaned = ring->orphaned;
+    ring->Drain([&](const RecordHeader& header, const char* text) {
+      pending.emplace_back(
+          header.monoNs,
+          formatLine(header.monoNs, ring->threadName,
+                     GLogLevelFlags(header.level), header.fname, header.line,
+                     header.func, text, header.textLen));
+    });
+    if (orphaned) {
+      exited.push_back(ring);
+    }
+  }
+  stable_sort(pending.begin(), pending.end(),
+              [](const pair<int64_t, string>& a,
+                 const pair<int64_t, string>& b) { return a.first < b.first; });
+
+  string lines;
+  for (auto& it : pending) {
+    lines += it.second;
+  }
+  uint64_t lost = DroppedCount();
+  if (lost > droppedReported) {
+    string msg = stringFormat("dropped %" PRIu64 " log records",
+                              lost - droppedReported);
+    lines += formatLine(monotonicNs(), "iptux-log", G_LOG_LEVEL_WARNING,
+                        __FILE__, __LINE__, __func__, msg.data(), msg.size());
+    droppedReported = lost;
+  }
+  if (!lines.empty()) {
+    writeLocked(lines);
+  }
+
+  if (!exited.empty()) {
+    lock_guard<std::mutex> l(ringsMutex);
+    for (auto& ring : exited) {
+      retiredDropped += ring->dropped;
+      rings.erase(find(rings.begin(), rings.end(), ring));
+    }
+  }
+}
+
+void AsyncLogger::writeLocked(const string& lines) {
+  fwrite(lines.data(), 1, lines.size(), stderr);
+  if (!file) {
+    return;
+  }
+  if (maxFileBytes > 0 && fileBytes > 0 &&
+      fileBytes + lines.size() > maxFileBytes) {
+    rotateLocked();
+    if (!file) {
+      return;
+    }
+  }
+  fwrite(lines.data(), 1, lines.size(), file);
+  fflush(file);
+  fileBytes += lines.size();
+}
+
+void AsyncLogger::rebaseLocked() {
+  baseRealUs = g_get_real_time();
+  baseMonoNs = monotonicNs();
+}
+
+/**
+ * path -> path.1 -> ... -> path.keep, 最旧的被覆盖.
+ */
+void AsyncLogger::rotateLocked() {
+  fclose(file);
+  for (int i = keepFiles - 1; i >= 1; --i) {
+    rename(stringFormat("%s.%d", filePath.c_str(), i).c_str(),
+           stringFormat("%s.%d", filePath.c_str(), i + 1).c_str());
+  }
+  if (keepFiles > 0) {
+    rename(filePath.c_str(), (filePath + ".1").c_str());
+  }
+  file = fopen(filePath.c_str(), "w");
+  fileBytes = 0;
+}
+
+string AsyncLogger::formatLine(int64_t monoNs,
+                               const string& thread,
+                               GLogLevelFlags level,
+                               const char* fname,
+                               int line,
+                               const char* func,
+                               const char* msg,
+                               size_t len) {
+  int64_t realUs = baseRealUs + (monoNs - baseMonoNs) / 1000;
+  time_t sec = realUs / 1000000;
+  if (sec != cachedSecond) {
+    struct tm timeinfo;
+    localtime_r(&sec, &timeinfo);
+    strftime(cachedTime, sizeof(cachedTime), "%H:%M:%S", &timeinfo);
+    cachedSecond = sec;
+  }
+  char prefix[256];
+  int n = snprintf(prefix, sizeof(prefix), "[%s.%03d][%s][%c]%s:%d:%s:",
+                   cachedTime, int(realUs / 1000 % 1000), thread.c_str(),
+                   logLevelAsChar(level), prettyFname(fname), line, func);
+  string res(prefix, min<size_t>(max(n, 0), sizeof(prefix) - 1));
+  res.append(msg, len);
+  res += '\n';
+  return res;
+}
+
+}  // namespace iptux
@@ -0,0 +1,97 @@
+#ifndef IPTUX_ASYNC_LOGGER_H
+#define IPTUX_ASYNC_LOGGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glib.h>
+
+namespace iptux {
+
+/**
+ * @brief backend of the LOG_* macros.
+ *
+ * Every thread writes its records into its own single-producer ring, so
+ * logging never takes a lock or does io on the caller's thread. A flusher
+ * thread drains the rings every few milliseconds, merges the records by
+ * timestamp and writes them to stderr and, if set, a log file that is
+ * rotated by size. When a ring is full the record is dropped and counted.
+ */
+class AsyncLogger {
+ public:
+  static AsyncLogger& Instance();
+
+  void Log(const char* fname,
+           int line,
+           const char* func,
+           GLogLevelFlags level,
+           const char* format,
+           va_list ap);
+
+  /**
+   * @brief write out all pending records before returning
+   */
+  void Flush();
+  /**
+   * @brief flush and stop the flusher, later records are written directly
+   */
+  void Stop();
+
+  bool SetFile(const std::string& path, size_t maxBytes, int keep);
+  uint64_t DroppedCount();
+
+  class Ring;
+
+ private:
+  AsyncLogger();
+
+  Ring* threadRing();
+  void run();
+  void flushLocked();
+  void writeLocked(const std::string& lines);
+  void rotateLocked();
+  void rebaseLocked();
+  std::string formatLine(int64_t monoNs,
+                         const std::string& thread,
+                         GLogLevelFlags level,
+                         const char* fname,
+                         int line,
+                         const char* func,
+                         const char* msg,
+                         size_t len);
+
+  std::mutex ringsMutex;
+  std::vector<std::shared_ptr<Ring>> rings;
+  uint64_t retiredDropped = 0;  // 已回收的线程丢弃的
+
+  std::mutex flushMutex;  // 同一时间只有一个消费者
+  FILE* file = nullptr;
+  std::string filePath;
+  size_t fileBytes = 0;
+  size_t maxFileBytes = 0;
+  int keepFiles = 0;
+  uint64_t droppedReported = 0;
+  /* 记录只取单调时钟, 每次写出前重取对应的墙上时间, 跟随系统时间的调整 */
+  int64_t baseRealUs = 0;
+  int64_t baseMonoNs = 0;
+  time_t cachedSecond = -1;  // 时间前缀按秒缓存
+  char cachedTime[16] = "";
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool stopping = false;
+  std::atomic_bool running{false};
+  std::thread flusher;
+};
+
+}  // namespace iptux
+
+#endif
@@ -0,0 +1,145 @@
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <thread>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "iptux-utils/output.h"
+#include "iptux-utils/utils.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+class LogFile {
+ public:
+  LogFile() {
+    gchar* tmp = g_dir_make_tmp("iptux-log-XXXXXX", nullptr);
+    dir = tmp;
+    g_free(tmp);
+    path = dir + "/iptux.log";
+  }
+  ~LogFile() {
+    Log::setLogFile("");
+    for (int i = 0; i < 5; ++i) {
+      g_remove(name(i).c_str());
+    }
+    g_rmdir(dir.c_str());
+  }
+
+  vector<string> Lines(int index = 0) const {
+    ifstream in(name(index));
+    vector<string> lines;
+    string line;
+    while (getline(in, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  string name(int index) const {
+    return index == 0 ? path : stringFormat("%s.%d", path.c_str(), index);
+  }
+
+  string dir;
+  string path;
+};
+}  // namespace
+
+TEST(AsyncLogger, WriteToFile) {
+  LogFile file;
+  ASSERT_TRUE(Log::setLogFile(file.path));
+  LOG_WARN("hello %d", 42);
+  Log::flush();
+  auto lines = file.Lines();
+  ASSERT_EQ(lines.size(), 1u);
+  EXPECT_NE(lines[0].find("[W]AsyncLoggerTest.cpp:"), string::npos);
+  EXPECT_NE(lines[0].find(":TestBody:hello 42"), string::npos);
+  // 级别不够的不写
+  LOG_INFO("hidden");
+  Log::flush();
+  EXPECT_EQ(file.Lines().size(), 1u);
+}
+
+TEST(AsyncLogger, LongMessage) {
+  LogFile file;
+  ASSERT_TRUE(Log::setLogFile(file.path));
+  LOG_WARN("%s", string(10000, 'x').c_str());
+  Log::flush();
+  auto lines = file.Lines();
+  ASSERT_EQ(lines.size(), 1u);
+  EXPECT_LT(lines[0].size(), 4200u);
+  EXPECT_EQ(lines[0].substr(lines[0].size() - 4), "x...");
+}
+
+TEST(AsyncLogger, Threads) {
+  LogFile file;
+  ASSERT_TRUE(Log::setLogFile(file.path));
+  uint64_t dropped = Log::getDroppedCount();
+  vector<thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < 500; ++i) {
+        LOG_WARN("thread %d seq %d", t, i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  Log::flush();
+  ASSERT_EQ(Log::getDroppedCount(), dropped);
+
+  int next[4] = {0, 0, 0, 0};
+  for (const string& line : file.Lines()) {
+    int t, i;
+    size_t pos = line.find("thread ");
+    ASSERT_NE(pos, string::npos) << line;
+    ASSERT_EQ(sscanf(line.c_str() + pos, "thread %d seq %d", &t, &i), 2);
+    EXPECT_EQ(i, next[t]++);
+  }
+  for (int t = 0; t < 4; ++t) {
+    EXPECT_EQ(next[t], 500);
+  }
+}
+
+TEST(AsyncLogger, Overflow) {
+  LogFile file;
+  ASSERT_TRUE(Log::setLogFile(file.path));
+  uint64_t dropped = Log::getDroppedCount();
+  // 远超单个线程缓冲区的容量, 写不下的计入丢弃
+  thread producer([] {
+    for (int i = 0; i < 20000; ++i) {
+      LOG_WARN("overflow %d", i);
+    }
+  });
+  producer.join();
+  Log::flush();
+  size_t written = 0;
+  bool reported = false;
+  for (const string& line : file.Lines()) {
+    written += line.find(":overflow ") != string::npos;
+    reported = reported || line.find("log records") != string::npos;
+  }
+  EXPECT_EQ(written + Log::getDroppedCount() - dropped, 20000u);
+  EXPECT_EQ(reported, Log::getDroppedCount() > dropped);
+}
+
+TEST(AsyncLogger, Rotate) {
+  LogFile file;
+  ASSERT_TRUE(Log::setLogFile(file.path, 1000, 2));
+  for (int i = 0; i < 60; ++i) {
+    LOG_WARN("rotate %d", i);
+    Log::flush();
+  }
+  auto current = file.Lines();
+  auto older = file.Lines(2);
+  ASSERT_FALSE(current.empty());
+  ASSERT_FALSE(file.Lines(1).empty());
+  ASSERT_FALSE(older.empty());
+  EXPECT_TRUE(file.Lines(3).empty());
+  EXPECT_NE(current.back().find("rotate 59"), string::npos);
+  EXPECT_LT(older.back().size() * older.size(), 1000u);
+}
@@ -0,0 +1,309 @@
+#include "config.h"
+#include "DirSizeService.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <set>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib/gi18n.h>
+
+#include "iptux-utils/output.h"
+
+using namespace std;
+
+namespace iptux {
+
+namespace {
+const int64_t kProgressIntervalMs = 100;
+/* 缓存的目录数超过此值时整个丢弃, 避免无限增长 */
+const size_t kMaxCachedDirs = 1 << 20;
+
+int64_t nowMs() {
+  return chrono::duration_cast<chrono::milliseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int64_t mtimeNsOf(const struct stat& st) {
+#if SYSTEM_DARWIN
+  const struct timespec& ts = st.st_mtimespec;
+#else
+  const struct timespec& ts = st.st_mtim;
+#endif
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+}  // namespace
+
+/**
+ * 一次统计, 同一路径的并发请求共用.
+ */
+struct DirSizeService::Walk {
+  string root;
+  promise<int64_t> result;
+  shared_future<int64_t> future;
+  atomic<uint64_t> dirs{0};
+  atomic<uint64_t> files{0};
+  atomic<int64_t> bytes{0};
+  atomic<size_t> pending{0};  // 已入队还未处理完的目录数
+  atomic<int64_t> lastReportMs{0};
+
+  std::mutex mutex;
+  vector<ProgressFn> progress;
+  set<DirKey> visited;  // 跟随链接时避免环路
+};
+
+DirSizeService& DirSizeService::Instance() {
+  /* 不析构, 退出时可能还有统计在进行 */
+  static DirSizeService* instance = new DirSizeService(
+      clamp<size_t>(thread::hardware_concurrency(), 2, 8));
+  return *instance;
+}
+
+DirSizeService::DirSizeService(size_t threadCount) {
+  for (size_t i = 0; i < max<size_t>(threadCount, 1); ++i) {
+    workers.emplace_back([this] { run(); });
+  }
+}
+
+DirSizeService::~DirSizeService() {
+  {
+    lock_guard<std::mutex> l(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+shared_future<int64_t> DirSizeService::Compute(const string& path,
+                                               ProgressFn progress) {
+  struct stat st;
+  int ret = stat(path.c_str(), &st);
+  if (ret != 0 || !S_ISDIR(st.st_mode)) {
+    Progress res;
+    res.finished = true;
+    if (ret != 0) {
+      LOG_WARN(_("stat file \"%s\" failed: %s"), path.c_str(),
+               strerror(errno));
+    } else if (S_ISREG(st.st_mode)) {
+      res.files = 1;
+      res.bytes = st.st_size;
+    } else {
+      LOG_WARN(_("path %s is not file or directory: st_mode(%x)"),
+               path.c_str(), st.st_mode);
+    }
+    if (progress) {
+      progress(res);
+    }
+    promise<int64_t> p;
+    p.set_value(res.bytes);
+    return p.get_future().share();
+  }
+
+  lock_guard<std::mutex> l(mutex);
+  auto it = walks.find(path);
+  if (it != walks.end()) {
+    if (progress) {
+      lock_guard<std::mutex> wl(it->second->mutex);
+      it->second->progress.push_back(std::move(progress));
+    }
+    return it->second->future;
+  }
+  auto walk = make_shared<Walk>();
+  walk->root = path;
+  walk->future = walk->result.get_future().share();
+  if (progress) {
+    walk->progress.push_back(std::move(progress));
+  }
+  walk->pending = 1;
+  walks[path] = walk;
+  tasks.push_back({walk, path});
+  cond.notify_one();
+  return walk->future;
+}
+
+void DirSizeService::Invalidate(const string& path, bool recursive) {
+  lock_guard<std::mutex> l(cacheMutex);
+  invalidateLocked(path, recursive);
+}
+
+size_t DirSizeService::CachedDirCount() const {
+  lock_guard<std::mutex> l(cacheMutex);
+  return cache.size();
+}
+
+void DirSizeService::invalidateLocked(const string& path, bool recursive) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return;
+  }
+  auto it = cache.find(DirKey(st.st_dev, st.st_ino));
+  if (it == cache.end()) {
+    return;
+  }
+  vector<string> subdirs = std::move(it->second.subdirs);
+  cache.erase(it);
+  if (recursive) {
+    for (auto& name : subdirs) {
+      invalidateLocked(path + "/" + name, true);
+    }
+  }
+}
+
+void DirSizeService::run() {
+  unique_lock<std::mutex> l(mutex);
+  while (true) {
+    cond.wait(l, [this] { return stopping || !tasks.empty(); });
+    if (stopping) {
+      return;
+    }
+    /* 后进先出, 近似深度优先, 队列不会太长 */
+    Task task = std::move(tasks.back());
+    tasks.pop_back();
+    l.unlock();
+    processDir(task);
+    l.lock();
+  }
+}
+
+/**
+ * 统计一个目录的直属文件, 子目录作为新任务入队.
+ * 目录的修改时间未变时直接使用缓存, 不再逐个读取其中的文件.
+ */
+void DirSizeService::processDir(const Task& task) {
+  Walk& walk = *task.walk;
+  struct stat st;
+  int fd = open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    if (fd != -1) {
+      close(fd);
+    }
+    finishTask(walk);
+    return;
+  }
+  DirKey key(st.st_dev, st.st_ino);
+  bool visited;
+  {
+    lock_guard<std::mutex> l(walk.mutex);
+    visited = !walk.visited.insert(key).second;
+  }
+  if (visited) {
+    close(fd);
+    finishTask(walk);
+    return;
+  }
+
+  DirEntry entry;
+  bool cached = false;
+  {
+    lock_guard<std::mutex> l(cacheMutex);
+    auto it = cache.find(key);
+    if (it != cache.end() && it->second.mtimeNs == mtimeNsOf(st)) {
+      entry = it->second;
+      cached = true;
+    }
+  }
+  if (cached) {
+    close(fd);
+  } else {
+    entry.mtimeNs = mtimeNsOf(st);
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+      close(fd);
+      finishTask(walk);
+      return;
+    }
+    struct dirent* dirt;
+    while ((dirt = readdir(dir))) {
+      const char* name = dirt->d_name;
+      if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        continue;
+      }
+      if (dirt->d_type == DT_DIR) {
+        entry.subdirs.push_back(name);
+        continue;
+      }
+      struct stat est;
+      if (fstatat(dirfd(dir), name, &est, 0) == -1) {
+        continue;
+      }
+      if (S_ISDIR(est.st_mode)) {
+        entry.subdirs.push_back(name);
+      } else if (S_ISREG(est.st_mode)) {
+        entry.files++;
+        entry.bytes += est.st_size;
+      }
+    }
+    closedir(dir);
+    lock_guard<std::mutex> l(cacheMutex);
+    if (cache.size() >= kMaxCachedDirs) {
+      cache.clear();
+    }
+    cache[key] = entry;
+  }
+
+  walk.dirs++;
+  walk.files += entry.files;
+  walk.bytes += entry.bytes;
+  if (!entry.subdirs.empty()) {
+    walk.pending += entry.subdirs.size();
+    {
+      lock_guard<std::mutex> l(mutex);
+      for (auto& name : entry.subdirs) {
+        tasks.push_back({task.walk, task.path + "/" + name});
+      }
+    }
+    cond.notify_all();
+  }
+  reportProgress(walk, false);
+  finishTask(walk);
+}
+
+void DirSizeService::finishTask(Walk& walk) {
+  if (--walk.pending > 0) {
+    return;
+  }
+  {
+    lock_guard<std::mutex> l(mutex);
+    auto it = walks.find(walk.root);
+    if (it != walks.end() && it->second.get() == &walk) {
+      walks.erase(it);
+    }
+  }
+  reportProgress(walk, true);
+  walk.result.set_value(walk.bytes);
+}
+
+void DirSizeService::reportProgress(Walk& walk, bool finished) {
+  if (!finished) {
+    int64_t now = nowMs();
+    int64_t last = walk.lastReportMs;
+    if (now - last < kProgressIntervalMs ||
+        !walk.lastReportMs.compare_exchange_strong(last, now)) {
+      return;
+    }
+  }
+  vector<ProgressFn> callbacks;
+  {
+    lock_guard<std::mutex> l(walk.mutex);
+    callbacks = walk.progress;
+  }
+  Progress progress;
+  progress.dirs = walk.dirs;
+  progress.files = walk.files;
+  progress.bytes = walk.bytes;
+  progress.finished = finished;
+  for (auto& callback : callbacks) {
+    callback(progress);
+  }
+}
+
+}  // namespace iptux
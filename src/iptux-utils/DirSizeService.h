@@ -0,0 +1,100 @@
+#ifndef IPTUX_DIR_SIZE_SERVICE_H
+#define IPTUX_DIR_SIZE_SERVICE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace iptux {
+
+/**
+ * @brief computes the total size of the regular files under a directory.
+ *
+ * Directories are read by a pool of threads, their entries fstatat()ed
+ * relative to the directory fd. What each directory holds is cached by
+ * (dev, ino) with its mtime, so a later walk only opens the directories
+ * and rereads the ones whose mtime changed. A file resized in place does
+ * not change the mtime of its directory, Invalidate() it when that
+ * matters. Symlinks are followed like stat() does, each directory is
+ * counted once per walk.
+ */
+class DirSizeService {
+ public:
+  struct Progress {
+    uint64_t dirs{0};
+    uint64_t files{0};
+    int64_t bytes{0};
+    bool finished{false};  // bytes is the final size
+  };
+  /* 在工作线程中调用, 至多每100ms一次, 结束时必定调用一次 */
+  using ProgressFn = std::function<void(const Progress&)>;
+
+  static DirSizeService& Instance();
+
+  explicit DirSizeService(size_t threadCount);
+  ~DirSizeService();
+
+  DirSizeService(const DirSizeService&) = delete;
+  DirSizeService& operator=(const DirSizeService&) = delete;
+
+  /**
+   * @brief size of path: its size for a regular file, the sum of the
+   * regular files under it for a directory, 0 if it does not exist.
+   *
+   * Concurrent requests for the same path share one walk.
+   */
+  std::shared_future<int64_t> Compute(const std::string& path,
+                                      ProgressFn progress = nullptr);
+  /**
+   * @brief forget the cached content of the directory path, and of all
+   * directories below it if recursive
+   */
+  void Invalidate(const std::string& path, bool recursive);
+  size_t CachedDirCount() const;
+
+ private:
+  using DirKey = std::pair<dev_t, ino_t>;
+  struct DirEntry {
+    int64_t mtimeNs{0};
+    uint64_t files{0};
+    int64_t bytes{0};                  // 直属常规文件的大小之和
+    std::vector<std::string> subdirs;  // 子目录名(含指向目录的链接)
+  };
+  struct Walk;
+  struct Task {
+    std::shared_ptr<Walk> walk;
+    std::string path;
+  };
+
+  void run();
+  void processDir(const Task& task);
+  void finishTask(Walk& walk);
+  void reportProgress(Walk& walk, bool finished);
+  void invalidateLocked(const std::string& path, bool recursive);
+
+  mutable std::mutex cacheMutex;
+  std::map<DirKey, DirEntry> cache;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<Task> tasks;
+  std::map<std::string, std::shared_ptr<Walk>> walks;  // 进行中的, 按路径
+  bool stopping{false};
+  std::vector<std::thread> workers;
+};
+
+}  // namespace iptux
+
+#endif
@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "iptux-utils/DirSizeService.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+// base/{a, d1/{b, d2/c}}
+class Tree {
+ public:
+  Tree() {
+    gchar* tmp = g_dir_make_tmp("iptux-dirsize-XXXXXX", nullptr);
+    base = tmp;
+    g_free(tmp);
+    g_mkdir(path("d1").c_str(), 0755);
+    g_mkdir(path("d1/d2").c_str(), 0755);
+    write("a", "hello");
+    write("d1/b", "world!");
+    write("d1/d2/c", "abc");
+  }
+  ~Tree() {
+    for (auto& name : {"d1/d2/loop", "d1/d2/d", "d1/d2/c", "d1/b", "a"}) {
+      g_remove(path(name).c_str());
+    }
+    g_rmdir(path("d1/d2").c_str());
+    g_rmdir(path("d1").c_str());
+    g_rmdir(base.c_str());
+  }
+
+  string path(const string& name) const { return base + "/" + name; }
+  // 原地写入, 不经过改名
+  void write(const string& name, const char* content) {
+    FILE* file = fopen(path(name).c_str(), "w");
+    fputs(content, file);
+    fclose(file);
+  }
+
+  string base;
+};
+}  // namespace
+
+TEST(DirSizeService, Compute) {
+  Tree tree;
+  DirSizeService service(2);
+  EXPECT_EQ(service.Compute(tree.base).get(), 14);
+  EXPECT_EQ(service.Compute(tree.path("d1")).get(), 9);
+  EXPECT_EQ(service.Compute(tree.path("a")).get(), 5);
+  EXPECT_EQ(service.Compute(tree.path("missing")).get(), 0);
+}
+
+TEST(DirSizeService, Cache) {
+  Tree tree;
+  DirSizeService service(2);
+  EXPECT_EQ(service.Compute(tree.base).get(), 14);
+  EXPECT_EQ(service.CachedDirCount(), 3u);
+
+  // 新增文件改变了目录的修改时间, 自动重新读取
+  tree.write("d1/d2/d", "1234");
+  EXPECT_EQ(service.Compute(tree.base).get(), 18);
+
+  // 原地改写不改变目录的修改时间, 需要Invalidate
+  tree.write("d1/b", "world!!!");
+  service.Invalidate(tree.path("d1"), false);
+  EXPECT_EQ(service.Compute(tree.base).get(), 20);
+
+  service.Invalidate(tree.base, true);
+  EXPECT_EQ(service.CachedDirCount(), 0u);
+  EXPECT_EQ(service.Compute(tree.base).get(), 20);
+}
+
+TEST(DirSizeService, SymlinkLoop) {
+  Tree tree;
+  ASSERT_EQ(symlink(tree.base.c_str(), tree.path("d1/d2/loop").c_str()), 0);
+  DirSizeService service(2);
+  EXPECT_EQ(service.Compute(tree.base).get(), 14);
+}
+
+TEST(DirSizeService, Progress) {
+  Tree tree;
+  DirSizeService service(4);
+  atomic<int> finished{0};
+  atomic<int64_t> bytes{0};
+  auto progress = [&](const DirSizeService::Progress& progress) {
+    if (progress.finished) {
+      EXPECT_EQ(progress.dirs, 3u);
+      EXPECT_EQ(progress.files, 3u);
+      bytes = progress.bytes;
+      finished++;
+    }
+  };
+  vector<shared_future<int64_t>> futures;
+  for (int i = 0; i < 8; ++i) {
+    futures.push_back(service.Compute(tree.base, progress));
+  }
+  for (auto& future : futures) {
+    EXPECT_EQ(future.get(), 14);
+  }
+  // 共用一次统计时每个回调也都会收到结束通知
+  EXPECT_EQ(finished, 8);
+  EXPECT_EQ(bytes, 14);
+}
@@ -0,0 +1,71 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "iptux-utils/output.h"
+
+using namespace std;
+using namespace iptux;
+
+namespace {
+
+const int kThreads = 4;
+const int kRecords = 200000;
+
+template <typename F>
+double nsPerRecord(F log) {
+  auto start = chrono::steady_clock::now();
+  vector<thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&log, t] {
+      for (int i = 0; i < kRecords; ++i) {
+        log(t, i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto elapsed = chrono::steady_clock::now() - start;
+  return chrono::duration<double, nano>(elapsed).count() /
+         (kThreads * kRecords);
+}
+
+}  // namespace
+
+int main() {
+  // 日志重定向到文件时调用方线程上的开销
+  char path[] = "/tmp/iptux-log-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0 || !freopen(path, "w", stderr)) {
+    return 1;
+  }
+  close(fd);
+  Log::setLogLevel(LogLevel::INFO);
+  uint64_t dropped = Log::getDroppedCount();
+  double async = nsPerRecord([](int t, int i) {
+    LOG_INFO("recv udp datagram from 10.0.%d.%d: 1_iptux_0#%d#user", t, i % 256,
+             i);
+  });
+  Log::flush();
+  dropped = Log::getDroppedCount() - dropped;
+
+  // 改为异步之前DoLog的做法: 在调用线程上格式化并同步写stderr
+  double sync = nsPerRecord([](int t, int i) {
+    fprintf(stderr,
+            "[00:00:00.000][%lu][I]CoreThread.cpp:1:udpThreadCb:recv udp "
+            "datagram from 10.0.%d.%d: 1_iptux_0#%d#user\n",
+            (unsigned long)pthread_self(), t, i % 256, i);
+  });
+
+  unlink(path);
+  printf("LOG_INFO (async)   %8.1f ns/record, %d threads, %llu dropped\n",
+         async, kThreads, (unsigned long long)dropped);
+  printf("fprintf(stderr)    %8.1f ns/record, %d threads\n", sync, kThreads);
+  return 0;
+}
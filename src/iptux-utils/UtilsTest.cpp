@@ -130,3 +130,47 @@ TEST(Utils, dupPath) {
   ASSERT_EQ(dupPath("a.b", 2), "a (2).b");
   ASSERT_EQ(dupPath("a.b", 10), "a (10).b");
 }
+
+TEST(Utils, isAscii) {
+  EXPECT_TRUE(isAscii(""));
+  EXPECT_TRUE(isAscii("hello"));
+  EXPECT_TRUE(isAscii("a somewhat longer ascii string\t\n"));
+  EXPECT_FALSE(isAscii("中文"));
+  EXPECT_FALSE(isAscii("a somewhat longer string\x80"));
+  EXPECT_FALSE(isAscii("\xd6\xd0 and then a long ascii tail"));
+}
+
+TEST(Utils, isValidUtf8) {
+  EXPECT_TRUE(isValidUtf8(""));
+  EXPECT_TRUE(isValidUtf8("hello"));
+  EXPECT_TRUE(isValidUtf8("a long ascii prefix, then 中文"));
+  EXPECT_TRUE(isValidUtf8("\xf0\x9f\x98\x80"));
+  EXPECT_TRUE(isValidUtf8(string("a\0b", 3)));
+  EXPECT_FALSE(isValidUtf8("\xd6\xd0\xce\xc4"));  // gb18030
+  EXPECT_FALSE(isValidUtf8("\xe4\xb8"));          // truncated
+  EXPECT_FALSE(isValidUtf8("\xc0\xaf"));          // overlong
+  EXPECT_FALSE(isValidUtf8("\xe0\x80\xaf"));      // overlong
+  EXPECT_FALSE(isValidUtf8("\xed\xa0\x80"));      // surrogate
+  EXPECT_FALSE(isValidUtf8("\xf4\x90\x80\x80"));  // > U+10FFFF
+}
+
+TEST(Utils, convertCharset) {
+  string out;
+  ASSERT_TRUE(convertCharset("中文", "GB18030", "utf-8", out));
+  EXPECT_EQ(out, "\xd6\xd0\xce\xc4");
+  ASSERT_TRUE(convertCharset(out, "utf-8", "gb18030", out));
+  EXPECT_EQ(out, "中文");
+  ASSERT_TRUE(convertCharset("", "utf-8", "gb18030", out));
+  EXPECT_EQ(out, "");
+
+  // longer than the first guess of the output size
+  string big(1000, '\xa1');
+  ASSERT_TRUE(convertCharset(big, "utf-8", "iso-8859-1", out));
+  EXPECT_EQ(out.size(), 2000u);
+
+  out = "unchanged";
+  EXPECT_FALSE(convertCharset("\xd6\xd0\xce", "utf-8", "gb18030", out));
+  EXPECT_FALSE(convertCharset("\xff", "utf-8", "utf-8", out));
+  EXPECT_FALSE(convertCharset("abc", "utf-8", "no-such-charset", out));
+  EXPECT_EQ(out, "unchanged");
+}
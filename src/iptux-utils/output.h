@@ -12,6 +12,9 @@
 #ifndef IPTUX_OUTPUT_H
 #define IPTUX_OUTPUT_H
 
+#include <cstdint>
+#include <string>
+
 #include <glib.h>
 
 namespace iptux {
@@ -53,6 +56,23 @@ class Log {
   static bool IsDebugEnabled();
   static bool IsInfoEnabled();
   static bool IsWarnEnabled();
+
+  /**
+   * @brief also write the log to path, which is rotated to path.1 ..
+   * path.keep once it grows past maxBytes; an empty path turns it off
+   */
+  static bool setLogFile(const std::string& path,
+                         size_t maxBytes = 10 * 1024 * 1024,
+                         int keep = 3);
+  /**
+   * @brief the log is written by a background thread, wait until every
+   * record logged so far is out
+   */
+  static void flush();
+  /**
+   * @brief records lost because a thread logged faster than they were written
+   */
+  static uint64_t getDroppedCount();
 };
 
 void DoLog(const char* fname,
@@ -18,6 +18,7 @@
 #include <cstdint>
 #include <cstring>
 #include <sstream>
+#include <vector>
 
 #include <arpa/inet.h>
 #include <glib/gi18n.h>
@@ -31,6 +32,7 @@
 #endif
 
 #include "iptux-core/Exception.h"
+#include "iptux-utils/DirSizeService.h"
 #include "iptux-utils/output.h"
 
 using namespace std;
@@ -55,11 +57,11 @@ char* iptux_string_validate(const char* s,
                             char** encode) {
   const char *pptr, *ptr;
   char *tstring, *cset;
-  gsize rbytes, wbytes;
+  string converted;
 
   *encode = NULL;  // 设置字符集编码未知
   tstring = NULL;  // 设置utf8有效串尚未成功获取
-  if (!g_utf8_validate(s, -1, NULL) && !codeset.empty()) {
+  if (!isValidUtf8(s) && !codeset.empty()) {
     cset = NULL;
     ptr = codeset.c_str();
     do {
@@ -71,8 +73,10 @@ char* iptux_string_validate(const char* s,
       cset = g_strndup(pptr, ptr - pptr);
       if (strcasecmp(cset, "utf-8") == 0)
         continue;
-    } while (
-        !(tstring = g_convert(s, -1, "utf-8", cset, &rbytes, &wbytes, NULL)));
+    } while (!convertCharset(s, "utf-8", cset, converted));
+    if (*pptr != '\0') {
+      tstring = g_strndup(converted.data(), converted.size());
+    }
     *encode = cset;
   }
 
@@ -90,18 +94,13 @@ char* iptux_string_validate(const char* s,
 char* convert_encode(const char* string,
                      const char* tocode,
                      const char* fromcode) {
-  gsize rbytes, wbytes;
-  char* tstring;
-  GError* err = nullptr;
-
-  tstring = g_convert(string, -1, tocode, fromcode, &rbytes, &wbytes, &err);
-  if (err != nullptr) {
-    LOG_INFO("g_convert failed: %s-%d-%s", g_quark_to_string(err->domain),
-             err->code, err->message);
-    g_clear_error(&err);
+  std::string converted;
+
+  if (!convertCharset(string, tocode, fromcode, converted)) {
+    LOG_INFO("convert from %s to %s failed", fromcode, tocode);
     return nullptr;
   }
-  return tstring;
+  return g_strndup(converted.data(), converted.size());
 }
 
 /**
@@ -871,56 +870,145 @@ string utf8MakeValid(const string& str) {
   return res;
 }
 
-namespace utils {
-int64_t fileOrDirectorySize(const string& fileOrDirName) {
-  // 由于系统中存在使用此方法读取文件的大小的调用，因此需要判断文件dir_name是文件还是目录
-  struct stat st;
-  int result = stat(fileOrDirName.c_str(), &st);
-  if (result != 0) {
-    // Fail to determine file type, return 0 (判断文件类型失败，直接返回 0)
-    LOG_WARN(_("stat file \"%s\" failed: %s"), fileOrDirName.c_str(),
-             strerror(errno));
-    return 0;
+namespace {
+/* 每个线程缓存已打开的iconv描述符 */
+class IconvCache {
+ public:
+  ~IconvCache() {
+    for (auto& entry : entries) {
+      if (entry.cd != (GIConv)-1) {
+        g_iconv_close(entry.cd);
+      }
+    }
   }
-  if (S_ISREG(st.st_mode)) {
-    return st.st_size;
+
+  GIConv get(const char* tocode, const char* fromcode) {
+    for (auto& entry : entries) {
+      if (g_ascii_strcasecmp(entry.tocode.c_str(), tocode) == 0 &&
+          g_ascii_strcasecmp(entry.fromcode.c_str(), fromcode) == 0) {
+        return entry.cd;
+      }
+    }
+    /* 打开失败也缓存, 避免反复尝试不支持的编码 */
+    entries.push_back({tocode, fromcode, g_iconv_open(tocode, fromcode)});
+    return entries.back().cd;
   }
-  if (!S_ISDIR(st.st_mode)) {
-    LOG_WARN(_("path %s is not file or directory: st_mode(%x)"),
-             fileOrDirName.c_str(), st.st_mode);
-    return 0;
+
+ private:
+  struct Entry {
+    std::string tocode;
+    std::string fromcode;
+    GIConv cd;
+  };
+  std::vector<Entry> entries;
+};
+
+thread_local IconvCache iconvCache;
+
+const uint64_t kHighBits = 0x8080808080808080ull;
+
+/* 跳过开头的ASCII字符, 每次检查8字节 */
+size_t asciiPrefixLength(std::string_view s) {
+  size_t i = 0;
+  for (; i + 8 <= s.size(); i += 8) {
+    uint64_t word;
+    memcpy(&word, s.data() + i, 8);
+    if (word & kHighBits) {
+      break;
+    }
   }
-  // 到了这里就一定是目录了
-  DIR* dir = opendir(fileOrDirName.c_str());
-  if (dir == NULL) {
-    LOG_WARN(_("opendir on \"%s\" failed: %s"), fileOrDirName.c_str(),
-             strerror(errno));
-    return 0;
+  while (i < s.size() && (unsigned char)s[i] < 0x80) {
+    i++;
   }
+  return i;
+}
+}  // namespace
 
-  struct dirent* dirt;
-  int64_t sumsize = 0;
-  while ((dirt = readdir(dir))) {
-    if (strcmp(dirt->d_name, ".") == 0) {
-      continue;
-    }
-    if (strcmp(dirt->d_name, "..") == 0) {
-      continue;
+bool convertCharset(std::string_view s,
+                    const char* tocode,
+                    const char* fromcode,
+                    std::string& out) {
+  GIConv cd = iconvCache.get(tocode, fromcode);
+  if (cd == (GIConv)-1) {
+    return false;
+  }
+  g_iconv(cd, nullptr, nullptr, nullptr, nullptr);  // 重置转换状态
+
+  std::string res(s.size() + s.size() / 2 + 16, '\0');
+  gchar* inbuf = (gchar*)s.data();
+  gsize inleft = s.size();
+  size_t produced = 0;
+  bool flushing = false;
+  while (true) {
+    gchar* outbuf = &res[produced];
+    gsize outleft = res.size() - produced;
+    gsize ret = flushing ? g_iconv(cd, nullptr, nullptr, &outbuf, &outleft)
+                         : g_iconv(cd, &inbuf, &inleft, &outbuf, &outleft);
+    produced = res.size() - outleft;
+    if (ret != (gsize)-1) {
+      if (flushing) {
+        break;
+      }
+      flushing = true;  // 输出有状态编码的收尾序列
+    } else if (errno == E2BIG) {
+      res.resize(res.size() * 2);
+    } else {
+      return false;  // EILSEQ, EINVAL(输入不完整)
     }
-    string tpath = fileOrDirName + "/" + dirt->d_name;
-    struct stat st;
-    if (stat(tpath.c_str(), &st) == -1) {
-      continue;
+  }
+  res.resize(produced);
+  out = std::move(res);
+  return true;
+}
+
+bool isAscii(std::string_view s) {
+  return asciiPrefixLength(s) == s.size();
+}
+
+bool isValidUtf8(std::string_view s) {
+  size_t i = 0;
+  while (true) {
+    i += asciiPrefixLength(s.substr(i));
+    if (i == s.size()) {
+      return true;
     }
-    if (S_ISDIR(st.st_mode)) {
-      sumsize += fileOrDirectorySize(tpath);
-    } else if (S_ISREG(st.st_mode)) {
-      sumsize += st.st_size;
+    unsigned char c = s[i];
+    size_t len;
+    uint32_t cp;
+    if (c >= 0xc2 && c <= 0xdf) {
+      len = 2;
+      cp = c & 0x1f;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      len = 3;
+      cp = c & 0x0f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      len = 4;
+      cp = c & 0x07;
     } else {
-      // ignore other files
+      return false;
+    }
+    if (i + len > s.size()) {
+      return false;
+    }
+    for (size_t j = 1; j < len; ++j) {
+      unsigned char cc = s[i + j];
+      if ((cc & 0xc0) != 0x80) {
+        return false;
+      }
+      cp = (cp << 6) | (cc & 0x3f);
+    }
+    /* 过长编码, 代理区, 超出范围 */
+    if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+        (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) {
+      return false;
     }
+    i += len;
   }
-  return sumsize;
+}
+
+namespace utils {
+int64_t fileOrDirectorySize(const string& fileOrDirName) {
+  return DirSizeService::Instance().Compute(fileOrDirName).get();
 }
 
 }  // namespace utils
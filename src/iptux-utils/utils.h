@@ -17,6 +17,7 @@
 #include <memory>
 #include <netinet/in.h>
 #include <string>
+#include <string_view>
 
 namespace iptux {
 
@@ -130,12 +131,38 @@ ssize_t read_ipmsg_fileinfo(GSocket* sock,
  */
 std::string utf8MakeValid(const std::string& str);
 
+/**
+ * @brief convert s from fromcode to tocode, s may contain '\0'.
+ *
+ * The iconv descriptors are opened once per thread and (tocode, fromcode)
+ * and reused, unlike g_convert.
+ *
+ * @return false if s is not valid in fromcode or not representable in
+ * tocode (out is unchanged)
+ */
+bool convertCharset(std::string_view s,
+                    const char* tocode,
+                    const char* fromcode,
+                    std::string& out);
+
+/**
+ * @brief whether s only contains 7-bit ASCII, checked a word at a time
+ */
+bool isAscii(std::string_view s);
+
+/**
+ * @brief whether s is valid utf-8 ('\0' allowed), ASCII runs are checked a
+ * word at a time
+ */
+bool isValidUtf8(std::string_view s);
+
 namespace utils {
 
 /**
  * @brief calculate the file or directory size;
  *
- * return 0 if not exist.
+ * return 0 if not exist. Blocks until DirSizeService has walked the
+ * directory, use DirSizeService directly to avoid that.
  *
  * @param fileOrDirName
  * @return int64_t
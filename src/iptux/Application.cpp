@@ -102,8 +102,9 @@ Application::~Application() {
   }
   transModelDelete(transModel);
   delete notificationService;
-  if (this->process_events_source_id)
-    g_source_remove(this->process_events_source_id);
+  if (cthrd) {
+    cthrd->disconnectEventDispatcher();
+  }
 }
 
 int Application::run(int argc, char** argv) {
@@ -226,8 +227,9 @@ void Application::onActivate(Application& self) {
     return;
   }
   iptux_init(self.logSystem);
-  self.process_events_source_id =
-      g_idle_add(G_SOURCE_FUNC(Application::ProcessEvents), &self);
+  self.cthrd->connectEventDispatcher(
+      nullptr, [&self](shared_ptr<const Event> e) { self.processEvent(e); },
+      DEFAULT_EVENT_BATCH);
   self.activated = true;
 }
 
@@ -434,23 +436,21 @@ void Application::onOpenChat(GSimpleAction*,
   DialogPeer::PeerDialogEntry(&self, groupInfo);
 }
 
+void Application::processEvent(shared_ptr<const Event> e) {
+  auto start = chrono::high_resolution_clock::now();
+  onEvent(e);
+  getMainWindow()->ProcessEvent(e);
+  auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  LOG_INFO(
+      "type: %s, from: %s, time: %jdus", EventTypeToStr(e->getType()),
+      e->getSource().c_str(),
+      (intmax_t)chrono::duration_cast<chrono::microseconds>(elapsed).count());
+}
+
 gboolean Application::ProcessEvents(gpointer data) {
   auto self = static_cast<Application*>(data);
-  if (self->getCoreThread()->HasEvent()) {
-    auto start = chrono::high_resolution_clock::now();
-    auto e = self->getCoreThread()->PopEvent();
-    self->onEvent(e);
-    self->getMainWindow()->ProcessEvent(e);
-    auto elapsed = std::chrono::high_resolution_clock::now() - start;
-    LOG_INFO(
-        "type: %s, from: %s, time: %jdus", EventTypeToStr(e->getType()),
-        e->getSource().c_str(),
-        (intmax_t)chrono::duration_cast<chrono::microseconds>(elapsed).count());
-    self->process_events_source_id =
-        g_idle_add(Application::ProcessEvents, data);
-  } else {
-    self->process_events_source_id =
-        g_timeout_add(100, Application::ProcessEvents, data);  // 100ms
+  for (auto& e : self->getCoreThread()->PopEvents(DEFAULT_EVENT_BATCH)) {
+    self->processEvent(e);
   }
   return G_SOURCE_REMOVE;
 }
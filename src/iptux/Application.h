@@ -69,7 +69,6 @@ class Application {
   bool started{false};
   bool test_mode{false};
   bool activated{false};
-  guint process_events_source_id{0};
 
  public:
   // for test
@@ -80,6 +79,7 @@ class Application {
 
  private:
   void onEvent(std::shared_ptr<const Event> event);
+  void processEvent(std::shared_ptr<const Event> event);
   void onConfigChanged();
   void updateItemToTransTree(const TransFileModel& para);
   static gboolean ProcessEvents(gpointer data);
@@ -711,8 +711,9 @@ void DataSettings::FillNetworkModel(GtkTreeModel* model) {
   for (const NetSegment& pns : g_progdt->getNetSegments()) {
     GtkTreeIter iter;
     gtk_list_store_append(GTK_LIST_STORE(model), &iter);
-    gtk_list_store_set(GTK_LIST_STORE(model), &iter, 0, pns.startip.c_str(), 1,
-                       pns.endip.c_str(), 2, pns.description.c_str(), -1);
+    gtk_list_store_set(GTK_LIST_STORE(model), &iter, 0,
+                       pns.getStartIp().c_str(), 1, pns.getEndIp().c_str(), 2,
+                       pns.description.c_str(), -1);
   }
 }
 
@@ -1041,9 +1042,9 @@ void DataSettings::ObtainNetworkValue() {
                          -1);
       NetSegment ns;
       if (startip)
-        ns.startip = startip;
+        ns.setStartIp(startip);
       if (endip)
-        ns.endip = endip;
+        ns.setEndIp(endip);
       if (description)
         ns.description = description;
       netSegments.push_back(std::move(ns));
@@ -1078,8 +1079,8 @@ void DataSettings::WriteNetSegment(const char* filename, GSList* list) {
   tlist = list;
   while (tlist) {
     pns = (NetSegment*)tlist->data;
-    fprintf(stream, "\n%s - %s //%s\n", pns->startip.c_str(),
-            pns->endip.c_str(), pns->description.c_str());
+    fprintf(stream, "\n%s - %s //%s\n", pns->getStartIp().c_str(),
+            pns->getEndIp().c_str(), pns->description.c_str());
     tlist = g_slist_next(tlist);
   }
   fclose(stream);
@@ -1115,20 +1116,15 @@ void DataSettings::ReadNetSegment(const char* filename, GSList** list) {
         if (inet_pton(AF_INET, buf[0], &ipv4) <= 0 ||
             inet_pton(AF_INET, buf[1], &ipv4) <= 0)
           break;
-        ns = new NetSegment;
+        ns = new NetSegment(buf[0], buf[1], buf[2]);
         *list = g_slist_append(*list, ns);
-        ns->startip = g_strdup(buf[0]);
-        ns->endip = g_strdup(buf[1]);
-        ns->description = g_strdup(buf[2]);
         break;
       case 2:
         if (inet_pton(AF_INET, buf[0], &ipv4) <= 0 ||
             inet_pton(AF_INET, buf[1], &ipv4) <= 0)
           break;
-        ns = new NetSegment;
+        ns = new NetSegment(buf[0], buf[1], "");
         *list = g_slist_append(*list, ns);
-        ns->startip = g_strdup(buf[0]);
-        ns->endip = g_strdup(buf[1]);
         break;
       default:
         break;
@@ -1417,7 +1413,8 @@ void DataSettings::ImportNetSegment(DataSettings* dset) {
         pns = (NetSegment*)tlist->data;
         gtk_list_store_append(GTK_LIST_STORE(model), &iter);
         gtk_list_store_set(GTK_LIST_STORE(model), &iter, 0,
-                           pns->startip.c_str(), 1, pns->endip.c_str(), 2,
+                           pns->getStartIp().c_str(), 1,
+                           pns->getEndIp().c_str(), 2,
                            pns->description.c_str(), -1);
         tlist = g_slist_next(tlist);
       }
@@ -1465,9 +1462,9 @@ void DataSettings::ExportNetSegment(DataSettings* dset) {
                            &description, -1);
         ns = new NetSegment;
         if (startip)
-          ns->startip = startip;
+          ns->setStartIp(startip);
         if (endip)
-          ns->endip = endip;
+          ns->setEndIp(endip);
         if (description)
           ns->description = description;
         list = g_slist_append(list, ns);
@@ -436,32 +436,40 @@ void DialogGroup::BroadcastTextMsg(const gchar* msg) {
   if (!gtk_tree_model_get_iter_first(model, &iter))
     return;
 
-  /* 向选中的成员发送数据 */
+  switch (grpinf->getType()) {
+    case GROUP_BELONG_TYPE_BROADCAST:
+      opttype = IPTUX_BROADCASTOPT;
+      break;
+    case GROUP_BELONG_TYPE_GROUP:
+      opttype = IPTUX_GROUPOPT;
+      break;
+    case GROUP_BELONG_TYPE_SEGMENT:
+      opttype = IPTUX_SEGMENTOPT;
+      break;
+    case GROUP_BELONG_TYPE_REGULAR:
+    default:
+      opttype = IPTUX_REGULAROPT;
+      break;
+  }
+
+  /* 向选中的成员发送数据, 编码相同的成员共用一个数据包 */
+  vector<PalKey> compatiblePals, otherPals;
   do {
     gtk_tree_model_get(model, &iter, 0, &active, 3, &pal, -1);
     if (active) {
       if (pal->isCompatible()) {
-        switch (grpinf->getType()) {
-          case GROUP_BELONG_TYPE_BROADCAST:
-            opttype = IPTUX_BROADCASTOPT;
-            break;
-          case GROUP_BELONG_TYPE_GROUP:
-            opttype = IPTUX_GROUPOPT;
-            break;
-          case GROUP_BELONG_TYPE_SEGMENT:
-            opttype = IPTUX_SEGMENTOPT;
-            break;
-          case GROUP_BELONG_TYPE_REGULAR:
-          default:
-            opttype = IPTUX_REGULAROPT;
-            break;
-        }
-        app->getCoreThread()->SendUnitMessage(pal->GetKey(), opttype, msg);
+        compatiblePals.push_back(pal->GetKey());
       } else {
-        app->getCoreThread()->SendGroupMessage(pal->GetKey(), msg);
+        otherPals.push_back(pal->GetKey());
       }
     }
   } while (gtk_tree_model_iter_next(model, &iter));
+  if (!compatiblePals.empty()) {
+    app->getCoreThread()->SendUnitMessage(compatiblePals, opttype, msg);
+  }
+  if (!otherPals.empty()) {
+    app->getCoreThread()->SendGroupMessage(otherPals, msg);
+  }
 }
 
 /**
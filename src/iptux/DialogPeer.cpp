@@ -77,6 +77,7 @@ void DialogPeer::PeerDialogEntry(Application* app, GroupInfo* grpinf) {
 
 void DialogPeer::init() {
   auto dlgpr = this;
+  grpinf->loadHistory();
   auto window = GTK_WIDGET(dlgpr->CreateMainWindow());
   grpinf->setDialogBase(this);
   CreateTitle();
@@ -12,6 +12,7 @@
 #include "config.h"
 #include "LogSystem.h"
 
+#include <ctime>
 #include <fcntl.h>
 #include <glib/gi18n.h>
 
@@ -40,6 +41,7 @@ LogSystem::~LogSystem() {
 void LogSystem::InitSublayer() {
   fdc = open(getChatLogPath().c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
   fds = open(getSystemLogPath().c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  history = make_unique<ChatHistory>(getChatHistoryPath());
 }
 
 void LogSystem::communicateLog(const MsgPara* msgpara, const char* fmt, ...) {
@@ -90,6 +92,30 @@ void LogSystem::communicateLogv(const MsgPara* msgpara,
   g_free(msg);
 }
 
+bool LogSystem::historyLog(const MsgPara& msgpara, const ChipData& chip) {
+  if (!programData->IsSaveChatHistory()) {
+    return false;
+  }
+  if (msgpara.stype != MessageSourceType::PAL &&
+      msgpara.stype != MessageSourceType::SELF) {
+    return false;
+  }
+
+  ChatRecord record;
+  auto pal = msgpara.getPal();
+  if (pal) {
+    record.peer = pal->GetKey().ToString();
+  }
+  record.timestamp = time(nullptr);
+  record.outgoing = msgpara.stype == MessageSourceType::SELF;
+  if (pal && !record.outgoing) {
+    record.packetNo = pal->packetn;
+  }
+  record.type = chip.type;
+  record.text = chip.data;
+  return history->Append(record);
+}
+
 void LogSystem::systemLogv(const char* fmt, va_list ap) {
   gchar *log, *msg, *ptr;
 
@@ -118,4 +144,9 @@ string LogSystem::getSystemLogPath() const {
   return stringFormat("%s" LOG_PATH "/system.log", env);
 }
 
+string LogSystem::getChatHistoryPath() const {
+  auto env = g_get_user_config_dir();
+  return stringFormat("%s" LOG_PATH "/history", env);
+}
+
 }  // namespace iptux
@@ -15,6 +15,7 @@
 #include <glib.h>
 #include <memory>
 
+#include "iptux-core/ChatHistory.h"
 #include "iptux-core/Models.h"
 #include "iptux-core/ProgramData.h"
 
@@ -30,13 +31,21 @@ class LogSystem {
   void systemLog(const char* fmt, ...) G_GNUC_PRINTF(2, 3);
   void communicateLogv(const MsgPara* msgpara, const char* fmt, va_list args);
   void systemLogv(const char* fmt, va_list args);
+  /**
+   * @brief 写入聊天记录库, 打开好友对话框时从中加载最近的记录
+   * @return 是否写入了记录
+   */
+  bool historyLog(const MsgPara& msgpara, const ChipData& chip);
 
   std::string getChatLogPath() const;
   std::string getSystemLogPath() const;
+  std::string getChatHistoryPath() const;
+  ChatHistory* getChatHistory() const { return history.get(); }
 
  private:
   std::shared_ptr<const ProgramData> programData;
   int fdc, fds;
+  std::unique_ptr<ChatHistory> history;
 
  private:
   void InitSublayer();
@@ -1773,6 +1773,23 @@ void MainWindow::ProcessEvent(shared_ptr<const Event> _event) {
     return;
   }
 
+  if (type == EventType::DISCOVERY_PROGRESS ||
+      type == EventType::DISCOVERY_FINISHED) {
+    auto label =
+        stringFormat(_("Pals Online: %d"), coreThread.GetOnlineCount());
+    if (type == EventType::DISCOVERY_PROGRESS) {
+      auto event = (const DiscoveryProgressEvent*)(_event.get());
+      int percent =
+          event->GetTotal() ? int(event->GetDone() * 100 / event->GetTotal())
+                            : 100;
+      label += stringFormat(_(" (scanning %d%%)"), percent);
+    }
+    auto widget =
+        GTK_WIDGET(g_datalist_get_data(&widset, "online-label-widget"));
+    gtk_label_set_text(GTK_LABEL(widget), label.c_str());
+    return;
+  }
+
   LOG_DEBUG("event type %d is ignored by `MainWindow`", int(type));
 }
 
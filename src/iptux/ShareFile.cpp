@@ -15,6 +15,7 @@
 #include <glib/gi18n.h>
 #include <sys/stat.h>
 
+#include "iptux-utils/DirSizeService.h"
 #include "iptux-utils/utils.h"
 #include "iptux/UiCoreThread.h"
 #include "iptux/UiHelper.h"
@@ -54,6 +55,9 @@ static void DeleteFiles(ShareFile* self);
 static void AddFolder(ShareFile* sfile);
 static void ClearPassword(ShareFile* self);
 static void SetPassword(ShareFile* self);
+static void FillFileSize(GtkTreeModel* model,
+                         GtkTreeIter* iter,
+                         const char* filepath);
 static gint FileTreeCompareFunc(GtkTreeModel* model,
                                 GtkTreeIter* a,
                                 GtkTreeIter* b);
@@ -213,15 +217,11 @@ GtkTreeModel* CreateFileModel() {
 void ShareFilePrivate::FillFileModel(GtkTreeModel* model) {
   const char* iconname;
   GtkTreeIter iter;
-  char* filesize;
   const char* filetype;
 
   /* 将现在的共享文件填入model */
   for (FileInfo& file :
        app->getCoreThread()->getProgramData()->GetSharedFileInfos()) {
-    /* 获取文件大小 */
-    file.filesize = utils::fileOrDirectorySize(file.filepath);
-    filesize = numeric_to_size(file.filesize);
     /* 获取文件类型 */
     switch (file.fileattr) {
       case FileAttr::REGULAR:
@@ -240,13 +240,62 @@ void ShareFilePrivate::FillFileModel(GtkTreeModel* model) {
     /* 填入数据 */
     gtk_list_store_append(GTK_LIST_STORE(model), &iter);
     gtk_list_store_set(GTK_LIST_STORE(model), &iter, 0, iconname, 1,
-                       file.filepath, 2, filesize, 3, filetype, 4,
-                       file.fileattr, -1);
-    /* 烦，释放资源 */
-    g_free(filesize);
+                       file.filepath, 2, "...", 3, filetype, 4, file.fileattr,
+                       -1);
+    /* 大小在后台统计 */
+    FillFileSize(model, &iter, file.filepath);
   }
 }
 
+struct FileSizeUpdate {
+  GtkTreeRowReference* row;
+  int64_t bytes;
+  bool finished;
+};
+
+static gboolean UpdateFileSize(FileSizeUpdate* update) {
+  GtkTreePath* path = gtk_tree_row_reference_get_path(update->row);
+  if (path) {
+    GtkTreeModel* model = gtk_tree_row_reference_get_model(update->row);
+    GtkTreeIter iter;
+    if (gtk_tree_model_get_iter(model, &iter, path)) {
+      char* size = numeric_to_size(update->bytes);
+      char* filesize =
+          update->finished ? g_strdup(size) : g_strdup_printf("%s...", size);
+      gtk_list_store_set(GTK_LIST_STORE(model), &iter, 2, filesize, -1);
+      g_free(filesize);
+      g_free(size);
+    }
+    gtk_tree_path_free(path);
+  }
+  /* 结束通知总是最后一个 */
+  if (update->finished) {
+    gtk_tree_row_reference_free(update->row);
+  }
+  delete update;
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * 在后台统计文件大小, 统计中和结束时更新到所在行.
+ * @param model file-model
+ * @param iter 文件所在行
+ * @param filepath 文件路径
+ */
+void FillFileSize(GtkTreeModel* model,
+                  GtkTreeIter* iter,
+                  const char* filepath) {
+  GtkTreePath* path = gtk_tree_model_get_path(model, iter);
+  GtkTreeRowReference* row = gtk_tree_row_reference_new(model, path);
+  gtk_tree_path_free(path);
+  DirSizeService::Instance().Compute(
+      filepath, [row](const DirSizeService::Progress& progress) {
+        auto update =
+            new FileSizeUpdate{row, progress.bytes, progress.finished};
+        g_idle_add(GSourceFunc(UpdateFileSize), update);
+      });
+}
+
 /**
  * 创建文件树(file-tree).
  * @param model file-model
@@ -347,9 +396,7 @@ void AttachSharedFiles(ShareFile* self, GSList* list) {
   GtkTreeIter iter;
   const char* iconname;
   struct stat st;
-  int64_t pathsize;
   GSList* tlist;
-  char* filesize;
   const char* filetype;
   FileAttr fileattr;
 
@@ -364,9 +411,6 @@ void AttachSharedFiles(ShareFile* self, GSList* list) {
       tlist = g_slist_next(tlist);
       continue;
     }
-    /* 获取文件大小 */
-    pathsize = utils::fileOrDirectorySize((const char*)tlist->data);
-    filesize = numeric_to_size(pathsize);
     /* 获取文件类型 */
     if (S_ISREG(st.st_mode)) {
       filetype = _("regular");
@@ -384,9 +428,8 @@ void AttachSharedFiles(ShareFile* self, GSList* list) {
     /* 添加数据 */
     gtk_list_store_append(GTK_LIST_STORE(model), &iter);
     gtk_list_store_set(GTK_LIST_STORE(model), &iter, 0, iconname, 1,
-                       tlist->data, 2, filesize, 3, filetype, 4, fileattr, -1);
-    /* 释放资源 */
-    g_free(filesize);
+                       tlist->data, 2, "...", 3, filetype, 4, fileattr, -1);
+    FillFileSize(model, &iter, (const char*)tlist->data);
     /* 转到下一个节点 */
     tlist = g_slist_next(tlist);
   }
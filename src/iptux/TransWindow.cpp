@@ -43,11 +43,13 @@ class TransWindowPrivate {
       g_action_map_enable_actions(G_ACTION_MAP(window), "trans.open_file",
                                   nullptr);
       g_action_map_disable_actions(G_ACTION_MAP(window), "trans.terminate_task",
+                                   "trans.pause_task", "trans.resume_task",
                                    nullptr);
     } else {
       g_action_map_disable_actions(G_ACTION_MAP(window), "trans.open_file",
                                    nullptr);
       g_action_map_enable_actions(G_ACTION_MAP(window), "trans.terminate_task",
+                                  "trans.pause_task", "trans.resume_task",
                                   nullptr);
     }
   }
@@ -65,6 +67,8 @@ static shared_ptr<IptuxConfig> trans_window_get_config(GtkWindow* pWindow);
 static void onOpenFile(void*, void*, TransWindowPrivate* self);
 static void onOpenFolder(void*, void*, TransWindowPrivate* self);
 static void onTerminateTask(void*, void*, TransWindowPrivate* self);
+static void onPauseTask(void*, void*, TransWindowPrivate* self);
+static void onResumeTask(void*, void*, TransWindowPrivate* self);
 static void onTerminateAllTasks(void*, void*, TransWindowPrivate* self);
 
 TransWindow* trans_window_new(Application* app, GtkWindow* parent) {
@@ -105,6 +109,8 @@ TransWindow* trans_window_new(Application* app, GtkWindow* parent) {
       makeActionEntry("trans.open_folder", G_ACTION_CALLBACK(onOpenFolder)),
       makeActionEntry("trans.terminate_task",
                       G_ACTION_CALLBACK(onTerminateTask)),
+      makeActionEntry("trans.pause_task", G_ACTION_CALLBACK(onPauseTask)),
+      makeActionEntry("trans.resume_task", G_ACTION_CALLBACK(onResumeTask)),
       makeActionEntry("trans.terminate_all",
                       G_ACTION_CALLBACK(onTerminateAllTasks)),
   };
@@ -364,6 +370,54 @@ void onTerminateTask(void*, void*, TransWindowPrivate* self) {
   self->app->getCoreThread()->TerminateTransTask(taskId);
 }
 
+/**
+ * 暂停单个传输任务.
+ * @param model trans-model
+ */
+void onPauseTask(void*, void*, TransWindowPrivate* self) {
+  GtkTreePath* path;
+  GtkTreeIter iter;
+  gboolean finished;
+  int taskId;
+
+  auto model = self->model;
+
+  if (!(path = (GtkTreePath*)(g_object_get_data(G_OBJECT(model),
+                                                "selected-path"))))
+    return;
+  gtk_tree_model_get_iter(model, &iter, path);
+  gtk_tree_model_get(model, &iter, TransModelColumn::TASK_ID, &taskId,
+                     TransModelColumn::FINISHED, &finished, -1);
+  if (finished) {
+    return;
+  }
+  self->app->getCoreThread()->PauseTransTask(taskId);
+}
+
+/**
+ * 继续暂停的传输任务.
+ * @param model trans-model
+ */
+void onResumeTask(void*, void*, TransWindowPrivate* self) {
+  GtkTreePath* path;
+  GtkTreeIter iter;
+  gboolean finished;
+  int taskId;
+
+  auto model = self->model;
+
+  if (!(path = (GtkTreePath*)(g_object_get_data(G_OBJECT(model),
+                                                "selected-path"))))
+    return;
+  gtk_tree_model_get_iter(model, &iter, path);
+  gtk_tree_model_get(model, &iter, TransModelColumn::TASK_ID, &taskId,
+                     TransModelColumn::FINISHED, &finished, -1);
+  if (finished) {
+    return;
+  }
+  self->app->getCoreThread()->ResumeTransTask(taskId);
+}
+
 /**
  * 终止所有传输任务.
  * @param model trans-model
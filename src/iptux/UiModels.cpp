@@ -18,6 +18,10 @@ using namespace std;
 namespace iptux {
 
 const char* const kObjectKeyImagePath = "image-path";
+/* 打开好友对话框时加载的历史记录条数 */
+static const size_t kHistoryPageSize = 50;
+/* 等待聊天记录库打开的检查间隔(ms) */
+static const guint kHistoryRetryInterval = 200;
 
 /**
  * 文件传输树(trans-tree)底层数据结构.
@@ -378,6 +382,8 @@ const char* GtkSortTypeToStr(GtkSortType t) {
 //       buffer(NULL),
 //       dialog(NULL) {}
 GroupInfo::~GroupInfo() {
+  if (historySource_)
+    g_source_remove(historySource_);
   if (buffer)
     g_object_unref(buffer);
 }
@@ -414,6 +420,7 @@ GroupInfo::GroupInfo(PPalInfo pal, CPPalInfo me, LogSystemPtr logSystem)
   inputBuffer = gtk_text_buffer_new(NULL);
   name_ = pal->getName();
   host_ = pal->getHost();
+  created_ = time(NULL);
 }
 
 GroupInfo::GroupInfo(iptux::GroupBelongType t,
@@ -661,6 +668,15 @@ void GroupInfo::initBuffer(GtkTextTagTable* tag_table) {
                         (GConnectFlags)(G_CONNECT_AFTER | G_CONNECT_SWAPPED));
 }
 
+gboolean GroupInfo::OnHistoryOpenTimeout(GroupInfo* self) {
+  if (!self->logSystem->getChatHistory()->IsOpen()) {
+    return G_SOURCE_CONTINUE;
+  }
+  self->historySource_ = 0;
+  self->loadHistory();
+  return G_SOURCE_REMOVE;
+}
+
 void GroupInfo::OnBufferInsertChildAnchor(GroupInfo* self,
                                           const GtkTextIter*,
                                           GtkTextChildAnchor* anchor,
@@ -674,11 +690,13 @@ void GroupInfo::OnBufferInsertChildAnchor(GroupInfo* self,
 /**
  * 插入字符串到TextBuffer(非UI线程安全).
  * @param buffer text-buffer
+ * @param iter 插入位置, 返回时指向插入内容之后
  * @param string 字符串
  */
-static void InsertStringToBuffer(GtkTextBuffer* buffer, const gchar* s) {
+static void InsertStringToBuffer(GtkTextBuffer* buffer,
+                                 GtkTextIter* iter,
+                                 const gchar* s) {
   static uint32_t count = 0;
-  GtkTextIter iter;
   GtkTextTag* tag;
   GMatchInfo* matchinfo;
   gchar* substring;
@@ -691,7 +709,6 @@ static void InsertStringToBuffer(GtkTextBuffer* buffer, const gchar* s) {
 
   urlendp = 0;
   matchinfo = NULL;
-  gtk_text_buffer_get_end_iter(buffer, &iter);
   g_regex_match_full(getUrlRegex(), string, -1, 0, GRegexMatchFlags(0),
                      &matchinfo, NULL);
   while (g_match_info_matches(matchinfo)) {
@@ -701,28 +718,28 @@ static void InsertStringToBuffer(GtkTextBuffer* buffer, const gchar* s) {
     g_object_set_data_full(G_OBJECT(tag), "url", substring,
                            GDestroyNotify(g_free));
     g_match_info_fetch_pos(matchinfo, 0, &startp, &endp);
-    gtk_text_buffer_insert(buffer, &iter, string + urlendp, startp - urlendp);
+    gtk_text_buffer_insert(buffer, iter, string + urlendp, startp - urlendp);
     gtk_text_buffer_insert_with_tags_by_name(
-        buffer, &iter, string + startp, endp - startp, "url-link", name, NULL);
+        buffer, iter, string + startp, endp - startp, "url-link", name, NULL);
     urlendp = endp;
     g_match_info_next(matchinfo, NULL);
   }
   g_match_info_free(matchinfo);
-  gtk_text_buffer_insert(buffer, &iter, string + urlendp, -1);
-  gtk_text_buffer_get_end_iter(buffer, &iter);
-  gtk_text_buffer_insert(buffer, &iter, "\n", -1);
+  gtk_text_buffer_insert(buffer, iter, string + urlendp, -1);
+  gtk_text_buffer_insert(buffer, iter, "\n", -1);
 }
 
 /**
  * 插入消息头到TextBuffer(非UI线程安全).
  * @param buffer text-buffer
+ * @param iter 插入位置, 返回时指向插入内容之后
  * @param para 消息参数
  */
 static void InsertHeaderToBuffer(GtkTextBuffer* buffer,
+                                 GtkTextIter* iter,
                                  const MsgPara* para,
                                  CPPalInfo me,
                                  time_t now) {
-  GtkTextIter iter;
   gchar* header;
 
   /**
@@ -732,47 +749,42 @@ static void InsertHeaderToBuffer(GtkTextBuffer* buffer,
     case MessageSourceType::PAL:
       header =
           getformattime2(now, FALSE, "%s", para->getPal()->getName().c_str());
-      gtk_text_buffer_get_end_iter(buffer, &iter);
-      gtk_text_buffer_insert_with_tags_by_name(buffer, &iter, header, -1,
+      gtk_text_buffer_insert_with_tags_by_name(buffer, iter, header, -1,
                                                "pal-color", NULL);
       g_free(header);
       break;
     case MessageSourceType::SELF:
       header = getformattime2(now, FALSE, "%s", me->getName().c_str());
-      gtk_text_buffer_get_end_iter(buffer, &iter);
-      gtk_text_buffer_insert_with_tags_by_name(buffer, &iter, header, -1,
+      gtk_text_buffer_insert_with_tags_by_name(buffer, iter, header, -1,
                                                "me-color", NULL);
       g_free(header);
       break;
     case MessageSourceType::ERROR:
       header = getformattime2(now, FALSE, "%s", _("<ERROR>"));
-      gtk_text_buffer_get_end_iter(buffer, &iter);
-      gtk_text_buffer_insert_with_tags_by_name(buffer, &iter, header, -1,
+      gtk_text_buffer_insert_with_tags_by_name(buffer, iter, header, -1,
                                                "error-color", NULL);
       g_free(header);
       break;
     default:
       break;
   }
-  gtk_text_buffer_get_end_iter(buffer, &iter);
-  gtk_text_buffer_insert(buffer, &iter, "\n", -1);
+  gtk_text_buffer_insert(buffer, iter, "\n", -1);
 }
 
 /**
  * 插入图片到TextBuffer.
  * @param buffer text-buffer
+ * @param iter 插入位置, 返回时指向插入内容之后
  * @param path 图片路径
  */
-static void InsertPixbufToBuffer(GtkTextBuffer* buffer, const gchar* path) {
-  GtkTextIter iter;
-
-  gtk_text_buffer_get_end_iter(buffer, &iter);
+static void InsertPixbufToBuffer(GtkTextBuffer* buffer,
+                                 GtkTextIter* iter,
+                                 const gchar* path) {
   GtkTextChildAnchor* anchor = gtk_text_child_anchor_new();
   g_object_set_data_full(G_OBJECT(anchor), kObjectKeyImagePath, g_strdup(path),
                          GDestroyNotify(g_free));
-  gtk_text_buffer_insert_child_anchor(buffer, &iter, anchor);
-  gtk_text_buffer_get_end_iter(buffer, &iter);
-  gtk_text_buffer_insert(buffer, &iter, "\n", -1);
+  gtk_text_buffer_insert_child_anchor(buffer, iter, anchor);
+  gtk_text_buffer_insert(buffer, iter, "\n", -1);
 }
 
 void GroupInfo::addMsgPara(const MsgPara& para) {
@@ -782,27 +794,35 @@ void GroupInfo::addMsgPara(const MsgPara& para) {
 
 void GroupInfo::_addMsgPara(const MsgPara& para, time_t now) {
   const gchar* data;
+  GtkTextIter iter;
 
   time(&last_activity_);
 
   for (size_t i = 0; i < para.dtlist.size(); ++i) {
     const ChipData* chipData = &para.dtlist[i];
     data = chipData->data.c_str();
+    gtk_text_buffer_get_end_iter(buffer, &iter);
     switch (chipData->type) {
       case MESSAGE_CONTENT_TYPE_STRING:
-        InsertHeaderToBuffer(buffer, &para, me, now);
-        InsertStringToBuffer(buffer, data);
+        InsertHeaderToBuffer(buffer, &iter, &para, me, now);
+        InsertStringToBuffer(buffer, &iter, data);
         last_message_ = StrFirstNonEmptyLine(chipData->data);
         if (logSystem) {
           logSystem->communicateLog(&para, "[STRING]%s", data);
+          if (logSystem->historyLog(para, *chipData)) {
+            historyCount_++;
+          }
         }
         break;
       case MESSAGE_CONTENT_TYPE_PICTURE:
-        InsertHeaderToBuffer(buffer, &para, me, now);
-        InsertPixbufToBuffer(buffer, data);
+        InsertHeaderToBuffer(buffer, &iter, &para, me, now);
+        InsertPixbufToBuffer(buffer, &iter, data);
         last_message_ = _("[IMG]");
         if (logSystem) {
           logSystem->communicateLog(&para, "[PICTURE]%s", data);
+          if (logSystem->historyLog(para, *chipData)) {
+            historyCount_++;
+          }
         }
         break;
       default:
@@ -814,6 +834,46 @@ void GroupInfo::_addMsgPara(const MsgPara& para, time_t now) {
   }
 }
 
+/**
+ * 把聊天记录库中本次运行之前的最近记录插入到历史消息缓冲区的开头.
+ * 只对常规模式的群组有效, 且只加载一次. 记录库仍在后台打开时不等待,
+ * 打开后再加载.
+ */
+void GroupInfo::loadHistory() {
+  if (historyLoaded_ || historySource_ || type != GROUP_BELONG_TYPE_REGULAR ||
+      !logSystem || !logSystem->getChatHistory()) {
+    return;
+  }
+  if (!logSystem->getChatHistory()->IsOpen()) {
+    historySource_ = g_timeout_add(
+        kHistoryRetryInterval, GSourceFunc(GroupInfo::OnHistoryOpenTimeout),
+        this);
+    return;
+  }
+  historyLoaded_ = true;
+
+  auto pal = members[0];
+  /* 跳过已在缓冲区中的本次记录; 群聊中的记录也写在该好友名下, 按时间排除 */
+  auto records = logSystem->getChatHistory()->Page(
+      pal->GetKey().ToString(), historyCount_, kHistoryPageSize);
+  GtkTextIter iter;
+  gtk_text_buffer_get_start_iter(buffer, &iter);
+  for (const ChatRecord& record : records) {
+    if (record.timestamp >= created_) {
+      break;
+    }
+    MsgPara para(pal);
+    para.stype =
+        record.outgoing ? MessageSourceType::SELF : MessageSourceType::PAL;
+    InsertHeaderToBuffer(buffer, &iter, &para, me, record.timestamp);
+    if (record.type == MESSAGE_CONTENT_TYPE_PICTURE) {
+      InsertPixbufToBuffer(buffer, &iter, record.text.c_str());
+    } else {
+      InsertStringToBuffer(buffer, &iter, record.text.c_str());
+    }
+  }
+}
+
 bool transModelIsFinished(TransModel* model) {
   GtkTreeIter iter;
   if (gtk_tree_model_get_iter_first(model, &iter)) {
@@ -105,12 +105,14 @@ class GroupInfo {
   const std::string& last_message() const { return last_message_; }
 
   void initBuffer(GtkTextTagTable* tag_table);
+  void loadHistory();
 
  public:
   sigc::signal<void(GroupInfo*, int, int)> signalUnreadMsgCountUpdated;
   sigc::signal<void(GroupInfo*)> signalNewFileReceived;
 
  private:
+  static gboolean OnHistoryOpenTimeout(GroupInfo* self);
   static void OnBufferInsertChildAnchor(GroupInfo* self,
                                         const GtkTextIter* location,
                                         GtkTextChildAnchor* anchor,
@@ -127,6 +129,10 @@ class GroupInfo {
   GtkTextBuffer* inputBuffer;  /// 输入缓冲
   time_t last_activity_ = 0;
   std::string last_message_;
+  time_t created_ = 0;
+  size_t historyCount_ = 0;  ///< 本次写入聊天记录库的条数
+  bool historyLoaded_ = false;
+  guint historySource_ = 0;  ///< 等待聊天记录库打开的定时器
 
  private:
   CPPalInfo me;
@@ -33,10 +33,8 @@ Application4::Application4(shared_ptr<IptuxConfig> config)
 }
 
 Application4::~Application4() {
-  if (process_events_source_id_) {
-    g_source_remove(process_events_source_id_);
-  }
   if (cthrd_) {
+    cthrd_->disconnectEventDispatcher();
     cthrd_->stop();
   }
 }
@@ -115,8 +113,8 @@ void Application4::onActivate(Application4& self) {
   }
 
   signal(SIGPIPE, SIG_IGN);
-  self.process_events_source_id_ =
-      g_timeout_add(100, Application4::ProcessEvents, &self);
+  self.cthrd_->connectEventDispatcher(
+      nullptr, [&self](shared_ptr<const Event> e) { self.onEvent(e); });
   self.activated_ = true;
 
   gtk_window_present(GTK_WINDOW(self.window_->getWindow()));
@@ -138,21 +136,4 @@ void Application4::onEvent(shared_ptr<const Event> event) {
   }
 }
 
-gboolean Application4::ProcessEvents(gpointer data) {
-  auto self = static_cast<Application4*>(data);
-  bool had_event = false;
-
-  // Process up to 10 events per tick to avoid blocking UI
-  for (int i = 0; i < 10 && self->cthrd_ && self->cthrd_->HasEvent(); ++i) {
-    auto e = self->cthrd_->PopEvent();
-    self->onEvent(e);
-    had_event = true;
-  }
-
-  (void)had_event;
-  self->process_events_source_id_ =
-      g_timeout_add(100, Application4::ProcessEvents, data);
-  return G_SOURCE_REMOVE;
-}
-
 }  // namespace iptux
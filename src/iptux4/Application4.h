@@ -40,7 +40,6 @@ class Application4 {
   bool started_{false};
   bool test_mode_{false};
   bool activated_{false};
-  guint process_events_source_id_{0};
 
  public:
   void startup();
@@ -52,7 +51,6 @@ class Application4 {
   static void onActivate(Application4& self);
   static void onQuit(void*, void*, Application4& self);
   static void onPreferences(void*, void*, Application4& self);
-  static gboolean ProcessEvents(gpointer data);
 };
 
 }  // namespace iptux
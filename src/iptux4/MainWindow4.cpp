@@ -566,6 +566,13 @@ void MainWindow4::ClearPeers() {
   RefreshOnlineCount();
 }
 
+void MainWindow4::ShowDiscoveryProgress(uint64_t done, uint64_t total) {
+  int percent = total ? int(done * 100 / total) : 100;
+  char buf[64];
+  snprintf(buf, sizeof(buf), _("Scanning network… %d%%"), percent);
+  gtk_label_set_text(GTK_LABEL(online_label_), buf);
+}
+
 void MainWindow4::RefreshOnlineCount() {
   int n = (int)peers_.size();
   if (n == 0) {
@@ -731,6 +738,35 @@ void MainWindow4::ProcessEvent(shared_ptr<const Event> event) {
           return G_SOURCE_REMOVE;
         },
         md, nullptr);
+
+  } else if (type == EventType::DISCOVERY_PROGRESS ||
+             type == EventType::DISCOVERY_FINISHED) {
+    struct ProgressData {
+      MainWindow4* win;
+      bool finished;
+      uint64_t done, total;
+    };
+    auto* d = new ProgressData{this, type == EventType::DISCOVERY_FINISHED, 0,
+                               0};
+    auto progress = dynamic_cast<const DiscoveryProgressEvent*>(event.get());
+    if (progress) {
+      d->done = progress->GetDone();
+      d->total = progress->GetTotal();
+    }
+
+    g_idle_add_full(
+        G_PRIORITY_DEFAULT_IDLE,
+        [](gpointer p) -> gboolean {
+          auto* d = static_cast<ProgressData*>(p);
+          if (d->finished) {
+            d->win->RefreshOnlineCount();
+          } else {
+            d->win->ShowDiscoveryProgress(d->done, d->total);
+          }
+          delete d;
+          return G_SOURCE_REMOVE;
+        },
+        d, nullptr);
   }
 }
 
@@ -740,13 +776,7 @@ void MainWindow4::onRefresh(GtkButton* /*button*/, MainWindow4* self) {
   auto cthrd = self->app_->getCoreThread();
   if (cthrd) {
     cthrd->SendDetectPacket("255.255.255.255");
-    auto data = cthrd->getProgramData();
-    if (data) {
-      for (const auto& seg : data->getNetSegments()) {
-        for (uint64_t i = 0; i < seg.Count() && i < 256; ++i)
-          cthrd->SendDetectPacket(seg.NthIp(i));
-      }
-    }
+    cthrd->StartDiscoveryScan();
   }
 }
 
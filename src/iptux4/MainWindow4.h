@@ -106,6 +106,7 @@ class MainWindow4 {
   void SendChatFile(ChatPane* pane);
   void SwitchToPane(const std::string& id);
   void RefreshOnlineCount();
+  void ShowDiscoveryProgress(uint64_t done, uint64_t total);
 
   static void onDetect(GtkButton* button, MainWindow4* self);
   static void onNewGroupChat(GtkButton* button, MainWindow4* self);
@@ -18,6 +18,8 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 #include "config.h"
+#include <cerrno>
+#include <cstring>
 #include <string>
 
 #include <glib.h>
@@ -36,6 +38,7 @@ using namespace iptux;
 static gboolean version = FALSE;
 static gchar* configFilename = nullptr;
 static gchar* logger = nullptr;
+static gchar* logFile = nullptr;
 static gchar* bindIp = nullptr;
 static GLogLevelFlags logLevel = G_LOG_LEVEL_WARNING;
 
@@ -59,6 +62,8 @@ static GOptionEntry entries[] = {
      "Specify config path", "CONFIG_PATH"},
     {"log", 'l', 0, G_OPTION_ARG_STRING, &logger,
      "Specify log level: DEBUG, INFO, WARN, default is WARN", "LEVEL"},
+    {"log-file", 0, 0, G_OPTION_ARG_FILENAME, &logFile,
+     "Also write the log to FILE, rotated at 10MB", "FILE"},
     {"bind", 'b', 0, G_OPTION_ARG_STRING, &bindIp,
      "Specify bind IP, like 127.0.0.2", "IP"},
     {nullptr, 0, 0, G_OPTION_ARG_NONE, nullptr, nullptr, nullptr}};
@@ -134,6 +139,15 @@ static void dealLog(const IptuxConfig& config) {
   } else {
     LOG_ERROR("unknown log level: %s", logger);
   }
+
+  string logFileStr = config.GetString("log_file");
+  if (logFile != nullptr) {
+    logFileStr = logFile;
+  }
+  if (!logFileStr.empty() && !Log::setLogFile(logFileStr)) {
+    LOG_WARN("open log file %s failed: %s", logFileStr.c_str(),
+             strerror(errno));
+  }
 }
 
 int main(int argc, char** argv) {
@@ -1,7 +1,12 @@
 #include "config.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include <string>
 
 #include <glib.h>
+#include <glib-unix.h>
 #include <glib/gi18n.h>
 #include <libintl.h>
 
@@ -17,6 +22,8 @@ using namespace iptux;
 static gboolean version = FALSE;
 static gchar* configFilename = nullptr;
 static gchar* logger = nullptr;
+static gchar* logFile = nullptr;
+static gchar* metricsFile = nullptr;
 static gchar* bindIp = nullptr;
 static gint bindPort = 0;
 static GLogLevelFlags logLevel = G_LOG_LEVEL_WARNING;
@@ -41,6 +48,12 @@ static GOptionEntry entries[] = {
      "Specify config path", "CONFIG_PATH"},
     {"log", 'l', 0, G_OPTION_ARG_STRING, &logger,
      "Specify log level: DEBUG, INFO, WARN, default is WARN", "LEVEL"},
+    {"log-file", 0, 0, G_OPTION_ARG_FILENAME, &logFile,
+     "Also write the log to FILE, rotated at 10MB", "FILE"},
+    {"metrics-file", 0, 0, G_OPTION_ARG_FILENAME, &metricsFile,
+     "Write runtime metrics as JSON to FILE on SIGUSR1 and at exit "
+     "(default: stdout on SIGUSR1)",
+     "FILE"},
     {"bind", 'b', 0, G_OPTION_ARG_STRING, &bindIp,
      "Specify bind IP, like 127.0.0.2", "IP"},
     {"port", 'p', 0, G_OPTION_ARG_INT, &bindPort,
@@ -116,6 +129,38 @@ static void dealLog(const IptuxConfig& config) {
   } else {
     LOG_ERROR("unknown log level: %s", logger);
   }
+
+  string logFileStr = config.GetString("log_file");
+  if (logFile != nullptr) {
+    logFileStr = logFile;
+  }
+  if (!logFileStr.empty() && !Log::setLogFile(logFileStr)) {
+    LOG_WARN("open log file %s failed: %s", logFileStr.c_str(),
+             strerror(errno));
+  }
+}
+
+static void dumpMetrics(Application4* app) {
+  auto cthrd = app->getCoreThread();
+  if (!cthrd) {
+    return;
+  }
+  string json = cthrd->DumpMetrics();
+  if (metricsFile == nullptr) {
+    printf("%s\n", json.c_str());
+    fflush(stdout);
+    return;
+  }
+  ofstream ofs(metricsFile, ios::trunc);
+  ofs << json << endl;
+  if (!ofs) {
+    LOG_WARN("write metrics to %s failed: %s", metricsFile, strerror(errno));
+  }
+}
+
+static gboolean onDumpMetricsSignal(gpointer data) {
+  dumpMetrics(static_cast<Application4*>(data));
+  return G_SOURCE_CONTINUE;
 }
 
 int main(int argc, char** argv) {
@@ -151,8 +196,13 @@ int main(int argc, char** argv) {
     app->getProgramData()->set_port(static_cast<uint16_t>(bindPort));
   }
 
+  g_unix_signal_add(SIGUSR1, onDumpMetricsSignal, app);
+
   AdwApplication* adwApp = app->getApp();
   int ret = g_application_run(G_APPLICATION(adwApp), argc, argv);
+  if (metricsFile != nullptr) {
+    dumpMetrics(app);
+  }
   g_object_unref(adwApp);
   return ret;
 }